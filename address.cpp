@@ -0,0 +1,433 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <cctype>
+#include <algorithm>
+#include <cerrno>
+
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include "address.hpp"
+
+namespace proxy_ns {
+    namespace {
+        std::string const unix_prefix = "unix:";
+    }
+
+    ///
+    /// \brief address_parse
+    /// \param host
+    /// \param port
+    /// \param addr
+    /// \return
+    ///
+    address_kind_t address_parse(std::string const& host,
+                                 boost::uint16_t port,
+                                 struct sockaddr_storage& addr) noexcept {
+        std::memset(&addr, 0, sizeof(addr));
+
+        if(host.empty()) {
+            return ADDRESS_INVALID;
+        }
+
+        if(host[0] == '/' || !host.compare(0, unix_prefix.size(),
+                                           unix_prefix)) {
+            std::string const path = (host[0] == '/') ?
+                        host : host.substr(unix_prefix.size());
+            struct sockaddr_un* un =
+                    reinterpret_cast<struct sockaddr_un*>(&addr);
+
+            // RU: Нужен завершающий ноль; абстрактные имена не
+            //     поддерживаются
+            if(path.empty() || path[0] != '/' ||
+               path.size() >= sizeof(un->sun_path)) {
+                return ADDRESS_INVALID;
+            }
+
+            un->sun_family = AF_UNIX;
+            std::memcpy(un->sun_path, path.c_str(), path.size() + 1);
+
+            return ADDRESS_UNIX;
+        }
+
+        struct sockaddr_in* in4 = reinterpret_cast<struct sockaddr_in*>(&addr);
+
+        if(::inet_pton(AF_INET, host.c_str(), &in4->sin_addr) == 1) {
+            in4->sin_family = AF_INET;
+            in4->sin_port = htons(port);
+
+            return ADDRESS_NUMERIC;
+        }
+
+        struct sockaddr_in6* in6 =
+                reinterpret_cast<struct sockaddr_in6*>(&addr);
+        std::string const ip6 = (host.size() > 2 && host.front() == '[' &&
+                                 host.back() == ']') ?
+                    host.substr(1, host.size() - 2) : host;
+
+        if(::inet_pton(AF_INET6, ip6.c_str(), &in6->sin6_addr) == 1) {
+            in6->sin6_family = AF_INET6;
+            in6->sin6_port = htons(port);
+
+            return ADDRESS_NUMERIC;
+        }
+
+        std::memset(&addr, 0, sizeof(addr));
+
+        for(char const ch : host) {
+            if(!std::isalnum(static_cast<unsigned char>(ch)) &&
+               ch != '-' && ch != '.' && ch != '_') {
+                return ADDRESS_INVALID;
+            }
+        }
+
+        return ADDRESS_NAME;
+    }
+
+    ///
+    /// \brief address_resolve
+    /// \param host
+    /// \param port
+    /// \param addr
+    /// \param err
+    /// \return
+    ///
+    bool address_resolve(std::string const& host, boost::uint16_t port,
+                         struct sockaddr_storage& addr, std::string& err) {
+        struct addrinfo hints;
+        struct addrinfo* res = nullptr;
+
+        std::memset(&hints, 0, sizeof(hints));
+        std::memset(&addr, 0, sizeof(addr));
+
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV;
+
+        int const rc = ::getaddrinfo(host.c_str(),
+                                     std::to_string(port).c_str(),
+                                     &hints, &res);
+        if(rc) {
+            err = ::gai_strerror(rc);
+            return false;
+        }
+
+        bool found = false;
+
+        for(struct addrinfo* p = res; p && !found; p = p->ai_next) {
+            if((AF_INET == p->ai_family || AF_INET6 == p->ai_family) &&
+               p->ai_addrlen <= sizeof(addr)) {
+                std::memcpy(&addr, p->ai_addr, p->ai_addrlen);
+                found = true;
+            }
+        }
+
+        ::freeaddrinfo(res);
+
+        if(!found) {
+            err = "no TCP address";
+        }
+
+        return found;
+    }
+
+    ///
+    /// \brief address_length
+    /// \param addr
+    /// \return
+    ///
+    socklen_t address_length(struct sockaddr_storage const& addr) noexcept {
+        switch(addr.ss_family) {
+        case AF_INET:
+            return sizeof(struct sockaddr_in);
+        case AF_INET6:
+            return sizeof(struct sockaddr_in6);
+        case AF_UNIX:
+            return static_cast<socklen_t>(
+                        offsetof(struct sockaddr_un, sun_path) +
+                        std::strlen(reinterpret_cast<struct sockaddr_un const*>(
+                                        &addr)->sun_path) + 1);
+        default:
+            return 0;
+        }
+    }
+
+    ///
+    /// \brief address_port
+    /// \param addr
+    /// \return
+    ///
+    boost::uint16_t address_port(struct sockaddr_storage const& addr) noexcept {
+        switch(addr.ss_family) {
+        case AF_INET:
+            return ntohs(reinterpret_cast<struct sockaddr_in const&>(
+                             addr).sin_port);
+        case AF_INET6:
+            return ntohs(reinterpret_cast<struct sockaddr_in6 const&>(
+                             addr).sin6_port);
+        default:
+            return 0;
+        }
+    }
+
+    ///
+    /// \brief address_equal
+    /// \param a
+    /// \param b
+    /// \return
+    ///
+    bool address_equal(struct sockaddr_storage const& a,
+                       struct sockaddr_storage const& b) noexcept {
+        if(a.ss_family != b.ss_family) {
+            return false;
+        }
+
+        switch(a.ss_family) {
+        case AF_INET: {
+            auto const& x = reinterpret_cast<struct sockaddr_in const&>(a);
+            auto const& y = reinterpret_cast<struct sockaddr_in const&>(b);
+
+            return x.sin_port == y.sin_port &&
+                    x.sin_addr.s_addr == y.sin_addr.s_addr;
+        }
+        case AF_INET6: {
+            auto const& x = reinterpret_cast<struct sockaddr_in6 const&>(a);
+            auto const& y = reinterpret_cast<struct sockaddr_in6 const&>(b);
+
+            return x.sin6_port == y.sin6_port &&
+                    !std::memcmp(&x.sin6_addr, &y.sin6_addr,
+                                 sizeof(x.sin6_addr));
+        }
+        case AF_UNIX:
+            return !std::strcmp(
+                        reinterpret_cast<struct sockaddr_un const&>(a).sun_path,
+                        reinterpret_cast<struct sockaddr_un const&>(b).sun_path);
+        default:
+            return true;
+        }
+    }
+
+    ///
+    /// \brief address_overlap
+    /// \param a
+    /// \param b
+    /// \return
+    ///
+    bool address_overlap(struct sockaddr_storage const& a,
+                         struct sockaddr_storage const& b) noexcept {
+        auto any = [](struct sockaddr_storage const& x) -> bool {
+            if(AF_INET == x.ss_family) {
+                return reinterpret_cast<struct sockaddr_in const&>(
+                            x).sin_addr.s_addr == htonl(INADDR_ANY);
+            }
+
+            return IN6_IS_ADDR_UNSPECIFIED(
+                        &reinterpret_cast<struct sockaddr_in6 const&>(
+                            x).sin6_addr);
+        };
+
+        if(AF_UNIX == a.ss_family || AF_UNIX == b.ss_family) {
+            return address_equal(a, b);
+        }
+
+        if(address_port(a) != address_port(b)) {
+            return false;
+        }
+
+        if(a.ss_family == b.ss_family) {
+            return address_equal(a, b) || any(a) || any(b);
+        }
+
+        // RU: Сокет "::" без IPV6_V6ONLY занимает и порт IPv4
+        return (AF_INET6 == a.ss_family && any(a)) ||
+               (AF_INET6 == b.ss_family && any(b));
+    }
+
+    ///
+    /// \brief address_unlink_stale
+    /// \param addr
+    /// \return
+    ///
+    bool address_unlink_stale(struct sockaddr_storage const& addr) noexcept {
+        if(AF_UNIX != addr.ss_family) {
+            return false;
+        }
+
+        char const* const path =
+                reinterpret_cast<struct sockaddr_un const&>(addr).sun_path;
+        struct stat st;
+
+        if(::lstat(path, &st) < 0 || !S_ISSOCK(st.st_mode)) {
+            return false;
+        }
+
+        int const sd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if(sd < 0) {
+            return false;
+        }
+
+        bool const dead =
+                ::connect(sd, reinterpret_cast<struct sockaddr const*>(&addr),
+                          address_length(addr)) < 0 && ECONNREFUSED == errno;
+
+        (void) ::close(sd);
+
+        return dead && !::unlink(path);
+    }
+
+    ///
+    /// \brief address_store
+    /// \param to
+    /// \param from
+    ///
+    void address_store(sock_addr& to,
+                       struct sockaddr_storage const* from) noexcept {
+        std::memset(&to, 0, sizeof(to));
+
+        if(nullptr == from) {
+            return;
+        }
+
+        switch(from->ss_family) {
+        case AF_INET:
+            std::memcpy(&to.in4, from, sizeof(to.in4));
+            break;
+        case AF_INET6:
+            std::memcpy(&to.in6, from, sizeof(to.in6));
+            break;
+        default:
+            to.sa.sa_family = from->ss_family;
+            break;
+        }
+    }
+
+    ///
+    /// \brief address_to_string
+    /// \param addr
+    /// \param len
+    /// \return
+    ///
+    std::string address_to_string(struct sockaddr const* addr,
+                                   socklen_t len) {
+        char buf[INET6_ADDRSTRLEN];
+
+        switch(addr->sa_family) {
+        case AF_INET: {
+            auto const* x = reinterpret_cast<struct sockaddr_in const*>(addr);
+
+            (void) ::inet_ntop(AF_INET, &x->sin_addr, buf, sizeof(buf));
+
+            return std::string(buf) + ":" + std::to_string(ntohs(x->sin_port));
+        }
+        case AF_INET6: {
+            auto const* x = reinterpret_cast<struct sockaddr_in6 const*>(addr);
+
+            (void) ::inet_ntop(AF_INET6, &x->sin6_addr, buf, sizeof(buf));
+
+            return "[" + std::string(buf) + "]:" +
+                    std::to_string(ntohs(x->sin6_port));
+        }
+        case AF_UNIX: {
+            size_t const off = offsetof(struct sockaddr_un, sun_path);
+            char const* path =
+                    reinterpret_cast<struct sockaddr_un const*>(addr)->sun_path;
+            size_t const max = (len > off) ?
+                        std::min(static_cast<size_t>(len) - off,
+                                 sizeof(sockaddr_un::sun_path)) : 0;
+
+            return unix_prefix + std::string(path, ::strnlen(path, max));
+        }
+        default:
+            return "-";
+        }
+    }
+
+    ///
+    /// \brief address_cache::lookup
+    /// \param host
+    /// \param port
+    /// \param ttl
+    /// \param now_ms
+    /// \param force
+    /// \param addr
+    /// \param expires_ms
+    /// \param err
+    /// \return
+    ///
+    address_cache::lookup_t address_cache::lookup(
+            std::string const& host, boost::uint16_t port,
+            boost::int32_t ttl, boost::uint64_t now_ms, bool force,
+            struct sockaddr_storage& addr, boost::uint64_t& expires_ms,
+            std::string& err) {
+        auto const key = std::make_pair(host, port);
+        auto search = this->entries.find(key);
+
+        if(search != this->entries.end() && !force &&
+           (!search->second.expires_ms ||
+            now_ms < search->second.expires_ms)) {
+            addr = search->second.addr;
+            expires_ms = search->second.expires_ms;
+
+            if(!search->second.ok) {
+                err = "not resolved yet";
+                return LOOKUP_FAILED;
+            }
+
+            return LOOKUP_CACHED;
+        }
+
+        // RU: Значение инициализируется нулями: ok = false
+        entry& e = this->entries[key];
+        struct sockaddr_storage resolved;
+        bool const ok = address_resolve(host, port, resolved, err);
+
+        if(ok) {
+            e.addr = resolved;
+            e.ok = true;
+            e.expires_ms = (ttl > 0) ? now_ms + ttl : 0;
+        }
+        else {
+            e.expires_ms = now_ms + ADDRESS_RETRY_INTERVAL;
+        }
+
+        addr = e.addr;
+        expires_ms = e.expires_ms;
+
+        if(ok) {
+            return LOOKUP_RESOLVED;
+        }
+
+        return e.ok ? LOOKUP_STALE : LOOKUP_FAILED;
+    }
+
+} // namespace proxy_ns
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
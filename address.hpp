@@ -0,0 +1,225 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#pragma once
+
+#ifndef __ADDRESS_HPP__
+#define __ADDRESS_HPP__
+
+#include <string>
+#include <map>
+#include <utility>
+
+#include <boost/cstdint.hpp>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#ifndef ADDRESS_RETRY_INTERVAL
+    #define ADDRESS_RETRY_INTERVAL 1000 // ms
+#endif // ADDRESS_RETRY_INTERVAL
+
+namespace proxy_ns {
+    ///
+    /// \brief The sock_addr union - an address inside a message (data)
+    ///
+    /// RU: sockaddr_storage (128 байт) в каждом сообщении между потоками
+    ///     обходится дорого, а путь unix-сокета там не нужен. Для AF_UNIX
+    ///     сохраняется только семейство.
+    ///
+    union sock_addr {
+        struct sockaddr sa;
+        struct sockaddr_in in4;
+        struct sockaddr_in6 in6;
+    };
+
+    ///
+    /// \brief The address_kind_t enum - what a host string is
+    ///
+    typedef enum {
+        ADDRESS_INVALID = 0,
+        ADDRESS_NUMERIC,    // IPv4 or IPv6 literal ("::1" or "[::1]")
+        ADDRESS_UNIX,       // "unix:/path" or "/path"
+        ADDRESS_NAME        // host name (see address_resolve)
+    } address_kind_t;
+
+    ///
+    /// \brief address_parse - build an address without name resolution
+    /// \param host
+    /// \param port - ignored for ADDRESS_UNIX
+    /// \param addr - zeroed (AF_UNSPEC) unless numeric or unix
+    /// \return
+    ///
+    address_kind_t address_parse(std::string const& host,
+                                 boost::uint16_t port,
+                                 struct sockaddr_storage& addr) noexcept;
+
+    ///
+    /// \brief address_resolve - getaddrinfo, blocks (main thread only)
+    /// \param host
+    /// \param port
+    /// \param addr - the first TCP address returned
+    /// \param err - the reason if false is returned
+    /// \return
+    ///
+    bool address_resolve(std::string const& host, boost::uint16_t port,
+                         struct sockaddr_storage& addr, std::string& err);
+
+    ///
+    /// \brief address_length - socklen_t for bind/connect
+    /// \param addr
+    /// \return 0 for AF_UNSPEC
+    ///
+    socklen_t address_length(struct sockaddr_storage const& addr) noexcept;
+
+    ///
+    /// \brief address_port - host byte order
+    /// \param addr
+    /// \return 0 if the family has no port
+    ///
+    boost::uint16_t address_port(struct sockaddr_storage const& addr) noexcept;
+
+    ///
+    /// \brief address_is_tcp - TCP socket options apply
+    /// \param addr
+    /// \return
+    ///
+    inline bool address_is_tcp(struct sockaddr_storage const& addr) noexcept {
+        return AF_INET == addr.ss_family || AF_INET6 == addr.ss_family;
+    }
+
+    ///
+    /// \brief address_equal - same family, address and port (or path)
+    /// \param a
+    /// \param b
+    /// \return
+    ///
+    bool address_equal(struct sockaddr_storage const& a,
+                       struct sockaddr_storage const& b) noexcept;
+
+    ///
+    /// \brief address_overlap - both can not be bound at once
+    /// \param a
+    /// \param b
+    /// \return
+    ///
+    /// RU: Один порт и одинаковый адрес или хотя бы один из них - "любой"
+    ///     (0.0.0.0 или ::). IPv4 и IPv6 считаются пересекающимися, только
+    ///     если один из них "любой" адрес IPv6.
+    ///
+    bool address_overlap(struct sockaddr_storage const& a,
+                         struct sockaddr_storage const& b) noexcept;
+
+    ///
+    /// \brief address_unlink_stale - remove a dead unix socket file
+    /// \param addr
+    /// \return true if the file was removed
+    ///
+    /// RU: Файл остаётся после аварийного завершения и мешает bind.
+    ///     Удаляется, только если это сокет и к нему нельзя подключиться
+    ///     (ECONNREFUSED): файл живой копии (--takeover) не трогаем.
+    ///
+    bool address_unlink_stale(struct sockaddr_storage const& addr) noexcept;
+
+    ///
+    /// \brief address_store - copy into a message
+    /// \param to
+    /// \param from - nullptr: AF_UNSPEC
+    ///
+    void address_store(sock_addr& to,
+                       struct sockaddr_storage const* from) noexcept;
+
+    ///
+    /// \brief address_to_string - "1.2.3.4:5", "[::1]:5", "unix:/path"
+    /// \param addr
+    /// \param len - bytes readable at addr
+    /// \return
+    ///
+    std::string address_to_string(struct sockaddr const* addr,
+                                   socklen_t len);
+
+    inline std::string address_to_string(struct sockaddr_storage const& a) {
+        return address_to_string(reinterpret_cast<struct sockaddr const*>(&a),
+                                 sizeof(a));
+    }
+
+    inline std::string address_to_string(sock_addr const& a) {
+        return address_to_string(&a.sa, sizeof(a));
+    }
+
+    ///
+    /// \brief The address_cache class - resolved host names
+    ///
+    /// RU: Имена серверов разрешаются главным потоком (getaddrinfo
+    ///     блокирует), результат живёт ttl мс. Потоки сервера получают
+    ///     готовый адрес в снимке конфигурации и DNS не ждут никогда.
+    ///     Если имя перестало разрешаться, используется последний
+    ///     известный адрес, а попытки повторяются каждые
+    ///     ADDRESS_RETRY_INTERVAL мс. Не потокобезопасно.
+    ///
+    class address_cache {
+        typedef address_cache self;
+    public:
+        typedef enum {
+            LOOKUP_CACHED = 0,  // the entry has not expired
+            LOOKUP_RESOLVED,    // resolved now
+            LOOKUP_STALE,       // resolution failed, the last address is used
+            LOOKUP_FAILED       // resolution failed, no address
+        } lookup_t;
+
+        address_cache(void) = default;
+
+        address_cache(address_cache const&) = delete;
+        address_cache& operator=(address_cache const&) = delete;
+
+        ///
+        /// \brief lookup
+        /// \param host
+        /// \param port
+        /// \param ttl - ms; 0: resolve only with force
+        /// \param now_ms - timer_wheel::now()
+        /// \param force - ignore the cached entry (start, SIGHUP)
+        /// \param addr - AF_UNSPEC for LOOKUP_FAILED
+        /// \param expires_ms - when the entry is resolved again (0 - never)
+        /// \param err - the reason for LOOKUP_STALE and LOOKUP_FAILED
+        /// \return
+        ///
+        lookup_t lookup(std::string const& host, boost::uint16_t port,
+                        boost::int32_t ttl, boost::uint64_t now_ms,
+                        bool force, struct sockaddr_storage& addr,
+                        boost::uint64_t& expires_ms, std::string& err);
+    private:
+        struct entry {
+            struct sockaddr_storage addr;
+            bool ok;                    // addr was resolved at least once
+            boost::uint64_t expires_ms; // 0 - never (ttl 0)
+        };
+
+        std::map<std::pair<std::string, boost::uint16_t>, entry> entries;
+    };
+} // namespace proxy_ns
+
+#endif // __ADDRESS_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
@@ -0,0 +1,499 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#include <map>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <charconv>
+#include <cstring>
+#include <cerrno>
+
+#include <boost/cstdint.hpp>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "log.hpp"
+#include "proxy.hpp"
+//#include "proxy_impl.hpp" // Instead of "proxy_impl.hpp" we use "proxy.hpp".
+#include "metrics.hpp"
+#include "admin.hpp"
+#include "control.hpp"
+
+namespace proxy_ns {
+    using namespace log_ns;
+
+    namespace {
+        boost::uint64_t now_ms(void) noexcept {
+            return static_cast<boost::uint64_t>(
+                        std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now().
+                                time_since_epoch()).count());
+        }
+
+        template<class T>
+        inline void append_num(std::string& out, T v) {
+            char buf[32];
+            auto r = std::to_chars(buf, buf + sizeof(buf), v);
+            out.append(buf, r.ptr);
+        }
+
+        void append_header(std::string& out, char const* name,
+                           char const* help, char const* type) {
+            out += "# HELP ";
+            out += name;
+            out += ' ';
+            out += help;
+            out += "\n# TYPE ";
+            out += name;
+            out += ' ';
+            out += type;
+            out += '\n';
+        }
+
+        std::string response(char const* status, char const* type,
+                             std::string const& body) {
+            std::string r;
+
+            r.reserve(body.size() + 128);
+            r += "HTTP/1.0 ";
+            r += status;
+            r += "\r\nContent-Type: ";
+            r += type;
+            r += "\r\nContent-Length: ";
+            append_num(r, body.size());
+            r += "\r\nConnection: close\r\n\r\n";
+            r += body;
+
+            return r;
+        }
+    }
+
+    ///
+    /// \brief admin::admin
+    /// \param pi
+    /// \param ip
+    /// \param port
+    ///
+    admin::admin(proxy_impl* pi, std::string const& ip,
+                 boost::uint16_t port) :
+        pi(pi),
+        listen_sd(-1),
+        connections(),
+        stop(false),
+        thread() {
+
+        struct sockaddr_in addr;
+        int const on = 1;
+
+        std::memset(&addr, 0, sizeof(addr));
+
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+
+        if(::inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1) {
+            throw Eproxy_invalid_value(ip);
+        }
+
+        this->listen_sd = ::socket(AF_INET,
+                                   SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                   0);
+        if(this->listen_sd < 0) {
+            throw Eproxy_syscall_failed("'socket'");
+        }
+
+        (void) ::setsockopt(this->listen_sd, SOL_SOCKET, SO_REUSEADDR,
+                            &on, sizeof(on));
+
+        if(::bind(this->listen_sd,
+                  reinterpret_cast<struct sockaddr*>(&addr),
+                  sizeof(addr)) < 0 ||
+           ::listen(this->listen_sd, SOMAXCONN) < 0) {
+            std::string const what = "'bind/listen' (" + ip + ":" +
+                                     std::to_string(port) + ": " +
+                                     ::strerror(errno) + ")";
+            (void) ::close(this->listen_sd);
+            this->listen_sd = -1;
+            throw Eproxy_syscall_failed(what);
+        }
+
+        this->thread = std::thread(&self::run, this);
+    }
+
+    ///
+    /// \brief admin::render_metrics
+    /// \param out
+    ///
+    void admin::render_metrics(std::string& out) const {
+        metrics_ns::snapshot const s = metrics_ns::metrics::inst().collect();
+
+        for(size_t i = 0; i < metrics_ns::COUNTER_END; i++) {
+            auto const c = static_cast<metrics_ns::counter_t>(i);
+            char const* name = metrics_ns::metrics::name(c);
+
+            append_header(out, name, metrics_ns::metrics::help(c), "counter");
+            out += name;
+            out += ' ';
+            append_num(out, s.counters[i]);
+            out += '\n';
+        }
+
+        append_header(out, "sqlproxy_tap_dropped_total",
+                      "Tap records dropped because the worker was too slow",
+                      "counter");
+        out += "sqlproxy_tap_dropped_total{queue=\"client\"} ";
+        append_num(out, this->pi->cw_tap.get_dropped());
+        out += "\nsqlproxy_tap_dropped_total{queue=\"server\"} ";
+        append_num(out, this->pi->sw_tap.get_dropped());
+        out += '\n';
+
+        for(size_t i = 0; i < metrics_ns::GAUGE_END; i++) {
+            auto const g = static_cast<metrics_ns::gauge_t>(i);
+            char const* name = metrics_ns::metrics::name(g);
+
+            append_header(out, name, metrics_ns::metrics::help(g), "gauge");
+            out += name;
+            out += ' ';
+            append_num(out, s.gauges[i]);
+            out += '\n';
+        }
+
+        for(size_t i = 0; i < metrics_ns::HISTOGRAM_END; i++) {
+            auto const h = static_cast<metrics_ns::histogram_t>(i);
+            char const* name = metrics_ns::metrics::name(h);
+            metrics_ns::histogram_snapshot const& x = s.histograms[i];
+            boost::uint64_t cumulative = 0;
+
+            append_header(out, name, metrics_ns::metrics::help(h),
+                          "histogram");
+
+            // RU: Корзина b содержит целые значения до 2^b - 1 включительно.
+            //     Набор границ всегда полный: пропущенные пустые корзины
+            //     ломают rate() и histogram_quantile() между опросами.
+            //     Последняя корзина открыта сверху и входит только в +Inf.
+            for(size_t b = 0; b + 1 < METRICS_HISTOGRAM_BUCKETS; b++) {
+                cumulative += x.buckets[b];
+
+                out += name;
+                out += "_bucket{le=\"";
+                append_num(out, (1ULL << b) - 1);
+                out += "\"} ";
+                append_num(out, cumulative);
+                out += '\n';
+            }
+
+            out += name;
+            out += "_bucket{le=\"+Inf\"} ";
+            append_num(out, x.count);
+            out += '\n';
+            out += name;
+            out += "_sum ";
+            append_num(out, x.sum);
+            out += '\n';
+            out += name;
+            out += "_count ";
+            append_num(out, x.count);
+            out += '\n';
+        }
+    }
+
+    ///
+    /// \brief admin::render_sessions
+    /// \param out
+    ///
+    void admin::render_sessions(std::string& out) const {
+        size_t count = 0;
+
+        out += "{\"sessions\":[";
+
+        this->pi->sessions.for_each([&out, &count](session_info const& s) {
+            char addr[INET6_ADDRSTRLEN] = "";
+
+            if(AF_INET == s.client_family || AF_INET6 == s.client_family) {
+                (void) ::inet_ntop(s.client_family, s.client_addr,
+                                   addr, sizeof(addr));
+            }
+
+            if(count++) {
+                out += ',';
+            }
+
+            out += "{\"client_sd\":";
+            append_num(out, s.c_sd);
+            out += ",\"server_sd\":";
+            append_num(out, s.s_sd);
+            out += ",\"client\":\"";
+            if(AF_INET6 == s.client_family) {
+                out += '[';
+                out += addr;
+                out += "]:";
+                append_num(out, s.client_port);
+            }
+            else if(AF_INET == s.client_family) {
+                out += addr;
+                out += ':';
+                append_num(out, s.client_port);
+            }
+            else {
+                out += "unix";
+            }
+            out += '"';
+            if(AF_UNIX == s.client_family) {
+                out += ",\"peer_pid\":";
+                append_num(out, s.client_addr[0]);
+                out += ",\"peer_uid\":";
+                append_num(out, s.client_addr[1]);
+                out += ",\"peer_gid\":";
+                append_num(out, s.client_addr[2]);
+            }
+            out += ",\"tap\":";
+            out += s.tap ? "true" : "false";
+            out += ",\"start_ms\":";
+            append_num(out, s.start_ns / 1000000);
+            out += ",\"bytes_in\":";
+            append_num(out, s.bytes_in);
+            out += ",\"bytes_out\":";
+            append_num(out, s.bytes_out);
+            out += '}';
+        });
+
+        out += "],\"count\":";
+        append_num(out, count);
+        out += "}\n";
+    }
+
+    ///
+    /// \brief admin::~admin
+    ///
+    admin::~admin(void) noexcept {
+        this->stop = true;
+
+        if(this->thread.joinable()) {
+            this->thread.join();
+        }
+
+        for(auto const& c : this->connections) {
+            (void) ::close(c.first);
+        }
+
+        if(this->listen_sd >= 0) {
+            (void) ::close(this->listen_sd);
+        }
+    }
+
+    ///
+    /// \brief admin::run
+    ///
+    void admin::run(void) {
+        std::vector<struct pollfd> fds;
+
+        while(!this->stop) {
+            fds.clear();
+            fds.push_back({this->listen_sd, POLLIN, 0});
+
+            for(auto const& c : this->connections) {
+                fds.push_back({c.first,
+                               static_cast<short>(
+                                   c.second.out.empty() ? POLLIN : POLLOUT),
+                               0});
+            }
+
+            // RU: Короткий таймаут - для проверки флага остановки.
+            int const rc = ::poll(fds.data(), fds.size(), 100);
+
+            if(rc < 0) {
+                if(EINTR == errno) {
+                    continue;
+                }
+
+                log::inst()(Ilog::LEVEL_ERROR, "A: 'poll' failed");
+                break;
+            }
+
+            boost::uint64_t const now = now_ms();
+
+            for(size_t i = 1; i < fds.size(); i++) {
+                auto it = this->connections.find(fds[i].fd);
+                bool keep = true;
+
+                if(it == this->connections.end()) {
+                    continue;
+                }
+
+                if(fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                    keep = false;
+                }
+                else if(fds[i].revents & POLLIN) {
+                    keep = this->on_readable(fds[i].fd, it->second);
+                }
+                else if(fds[i].revents & POLLOUT) {
+                    keep = this->on_writable(fds[i].fd, it->second);
+                }
+                else if(now >= it->second.deadline_ms) {
+                    keep = false;
+                }
+
+                if(!keep) {
+                    (void) ::close(fds[i].fd);
+                    this->connections.erase(it);
+                }
+            }
+
+            if(fds[0].revents & POLLIN) {
+                this->accept_all();
+            }
+        }
+    }
+
+    ///
+    /// \brief admin::accept_all
+    ///
+    void admin::accept_all(void) {
+        for(;;) {
+            int const sd = ::accept4(this->listen_sd, nullptr, nullptr,
+                                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(sd < 0) {
+                break;
+            }
+
+            connection& c = this->connections[sd];
+
+            c.in.clear();
+            c.out.clear();
+            c.sent = 0;
+            c.deadline_ms = now_ms() + ADMIN_CONNECTION_TIMEOUT;
+        }
+    }
+
+    ///
+    /// \brief admin::on_readable
+    /// \param sd
+    /// \param c
+    /// \return false if the connection must be closed
+    ///
+    bool admin::on_readable(int sd, connection& c) {
+        char buf[1024];
+        ssize_t rc = 0;
+
+        while((rc = ::recv(sd, buf, sizeof(buf), 0)) > 0) {
+            c.in.append(buf, rc);
+
+            if(c.in.size() > ADMIN_REQUEST_MAX_SIZE) {
+                return false;
+            }
+        }
+
+        if(0 == rc) {
+            return false;
+        }
+
+        if(rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+           errno != EINTR) {
+            return false;
+        }
+
+        if(c.in.find("\r\n\r\n") != std::string::npos ||
+           c.in.find("\n\n") != std::string::npos) {
+            this->handle(c);
+            return this->on_writable(sd, c);
+        }
+
+        return true;
+    }
+
+    ///
+    /// \brief admin::on_writable
+    /// \param sd
+    /// \param c
+    /// \return false if the connection must be closed
+    ///
+    bool admin::on_writable(int sd, connection& c) {
+        while(c.sent < c.out.size()) {
+            ssize_t const rc = ::send(sd, c.out.data() + c.sent,
+                                      c.out.size() - c.sent, MSG_NOSIGNAL);
+            if(rc < 0) {
+                return (EAGAIN == errno || EWOULDBLOCK == errno ||
+                        EINTR == errno);
+            }
+
+            c.sent += rc;
+        }
+
+        // RU: Ответ отправлен целиком - соединение закрывается.
+        return false;
+    }
+
+    ///
+    /// \brief admin::handle
+    /// \param c
+    ///
+    void admin::handle(connection& c) {
+        std::string::size_type const sp1 = c.in.find(' ');
+        std::string::size_type const sp2 =
+                (sp1 == std::string::npos) ?
+                    std::string::npos : c.in.find(' ', sp1 + 1);
+
+        if(sp2 == std::string::npos) {
+            c.out = response("400 Bad Request", "text/plain", "Bad request\n");
+            return;
+        }
+
+        std::string const method = c.in.substr(0, sp1);
+        std::string path = c.in.substr(sp1 + 1, sp2 - sp1 - 1);
+        std::string body;
+
+        path = path.substr(0, path.find('?'));
+
+        if(method == "POST" && path == "/drain") {
+            // RU: Сам переход выполняет главный поток (см. control_t)
+            (void) control_request(CONTROL_DRAIN);
+            c.out = response("202 Accepted", "text/plain", "Draining\n");
+        }
+        else if(method != "GET") {
+            c.out = response("405 Method Not Allowed", "text/plain",
+                             "Method not allowed\n");
+        }
+        else if(path == "/metrics") {
+            body.reserve(16384);
+            this->render_metrics(body);
+            c.out = response("200 OK", "text/plain; version=0.0.4", body);
+        }
+        else if(path == "/sessions") {
+            this->render_sessions(body);
+            c.out = response("200 OK", "application/json", body);
+        }
+        else {
+            c.out = response("404 Not Found", "text/plain",
+                             "Try /metrics or /sessions\n");
+        }
+    }
+} // namespace proxy_ns
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
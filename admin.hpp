@@ -0,0 +1,105 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#pragma once
+
+#ifndef __ADMIN_HPP__
+#define __ADMIN_HPP__
+
+#include <map>
+#include <string>
+#include <atomic>
+#include <thread>
+
+#include <boost/cstdint.hpp>
+
+#include "proxy.hpp"
+
+#ifndef ADMIN_REQUEST_MAX_SIZE
+    #define ADMIN_REQUEST_MAX_SIZE 8192
+#endif // ADMIN_REQUEST_MAX_SIZE
+
+#ifndef ADMIN_CONNECTION_TIMEOUT
+    #define ADMIN_CONNECTION_TIMEOUT 5000 // ms
+#endif // ADMIN_CONNECTION_TIMEOUT
+
+namespace proxy_ns {
+    ///
+    /// \brief The admin class
+    ///
+    /// RU: Встроенный HTTP-сервер администратора (отдельный поток,
+    ///     неблокирующие сокеты). Отдаёт:
+    ///     * /metrics  - метрики в текстовом формате Prometheus;
+    ///     * /sessions - живые сессии в JSON;
+    ///     * POST /drain - плавное завершение (см. --drain-timeout).
+    ///     Данные читаются без блокировок, которые держат потоки клиента,
+    ///     сервера и воркера (см. metrics_ns::metrics и session_table).
+    ///
+    class admin {
+        typedef admin self;
+    public:
+        admin(proxy_impl* pi, std::string const& ip, boost::uint16_t port);
+
+        admin(admin const&) = delete;
+        admin& operator=(admin const&) = delete;
+
+        ///
+        /// \brief render_metrics
+        /// \param out
+        ///
+        void render_metrics(std::string& out) const;
+
+        ///
+        /// \brief render_sessions
+        /// \param out
+        ///
+        void render_sessions(std::string& out) const;
+
+        virtual ~admin(void) noexcept;
+    private:
+        struct connection {
+            std::string in;
+            std::string out;
+            size_t sent;
+            boost::uint64_t deadline_ms;
+        };
+
+        void run(void);
+        void accept_all(void);
+        bool on_readable(int sd, connection& c);
+        bool on_writable(int sd, connection& c);
+        void handle(connection& c);
+
+        proxy_impl* const pi;
+
+        int listen_sd;
+        std::map<int, connection> connections;
+
+        std::atomic<bool> stop;
+        std::thread thread;
+    };
+} // namespace proxy_ns
+
+#endif // __ADMIN_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
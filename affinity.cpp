@@ -0,0 +1,141 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#include <string>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+
+#include "affinity.hpp"
+
+namespace proxy_ns {
+    namespace {
+        // RU: Номер CPU с позиции pos; pos сдвигается за число
+        bool cpu_number(std::string const& s, size_t& pos, long& cpu) {
+            size_t const start = pos;
+
+            cpu = 0;
+
+            while(pos < s.size() &&
+                  std::isdigit(static_cast<unsigned char>(s[pos]))) {
+                cpu = cpu * 10 + (s[pos] - '0');
+
+                if(cpu >= CPU_SETSIZE) {
+                    return false;
+                }
+
+                pos++;
+            }
+
+            return pos > start;
+        }
+    }
+
+    ///
+    /// \brief cpu_list_parse
+    /// \param list
+    /// \param set
+    /// \return
+    ///
+    bool cpu_list_parse(std::string const& list, cpu_set_t& set) noexcept {
+        size_t pos = 0;
+
+        CPU_ZERO(&set);
+
+        if(list.empty()) {
+            return false;
+        }
+
+        for(;;) {
+            long first = 0;
+            long last = 0;
+
+            if(!cpu_number(list, pos, first)) {
+                return false;
+            }
+
+            last = first;
+
+            if(pos < list.size() && list[pos] == '-') {
+                pos++;
+
+                if(!cpu_number(list, pos, last) || last < first) {
+                    return false;
+                }
+            }
+
+            for(long cpu = first; cpu <= last; cpu++) {
+                CPU_SET(cpu, &set);
+            }
+
+            if(pos == list.size()) {
+                return true;
+            }
+
+            if(list[pos] != ',') {
+                return false;
+            }
+
+            pos++;
+        }
+    }
+
+    ///
+    /// \brief thread_start
+    /// \param th
+    /// \param cpus
+    /// \param routine
+    /// \param arg
+    /// \return
+    ///
+    int thread_start(pthread_t& th, std::string const& cpus,
+                     void* (*routine)(void*), void* arg) noexcept {
+        pthread_attr_t attr;
+        cpu_set_t set;
+        int rc = 0;
+
+        if(cpus.empty()) {
+            return ::pthread_create(&th, nullptr, routine, arg);
+        }
+
+        if(!cpu_list_parse(cpus, set)) {
+            return EINVAL;
+        }
+
+        rc = ::pthread_attr_init(&attr);
+        if(rc) {
+            return rc;
+        }
+
+        rc = ::pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        if(!rc) {
+            rc = ::pthread_create(&th, &attr, routine, arg);
+        }
+
+        (void) ::pthread_attr_destroy(&attr);
+
+        return rc;
+    }
+} // namespace proxy_ns
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
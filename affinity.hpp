@@ -0,0 +1,61 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#pragma once
+
+#ifndef __AFFINITY_HPP__
+#define __AFFINITY_HPP__
+
+#include <string>
+
+#include <sched.h>
+#include <pthread.h>
+
+namespace proxy_ns {
+    ///
+    /// \brief cpu_list_parse - "0-3,8" -> CPU set
+    /// \param list - comma separated CPUs and ranges (as in taskset -c)
+    /// \param set - result
+    /// \return false if the list is empty or invalid
+    ///
+    bool cpu_list_parse(std::string const& list, cpu_set_t& set) noexcept;
+
+    ///
+    /// \brief thread_start - pthread_create pinned to a CPU list
+    /// \param th - thread
+    /// \param cpus - CPU list, "" - no pinning
+    /// \param routine
+    /// \param arg
+    /// \return pthread_create result (0 - ok)
+    ///
+    /// RU: Поток закрепляется атрибутом ещё до старта, поэтому всё, что
+    ///     он выделяет и трогает первым (логика, таблицы, буферы), по
+    ///     политике first-touch ложится в память узла NUMA его CPU.
+    ///
+    int thread_start(pthread_t& th, std::string const& cpus,
+                     void* (*routine)(void*), void* arg) noexcept;
+} // namespace proxy_ns
+
+#endif // __AFFINITY_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
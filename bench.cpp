@@ -0,0 +1,712 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+
+///
+/// Benchmarks.
+///
+/// RU: Микротесты внутренних частей (построение пакета data, очередь
+///     неотправленных данных storage, find_pollfd, форматирование лога,
+///     передача пакета data между потоками) и макротест: прокси
+///     запускается в этом же процессе между генератором нагрузки и
+///     эхо-сервером. Макротест выводит соединения/с, запросы/с, МБ/с и
+///     задержку, добавленную прокси (p50/p99/p999 относительно прямого
+///     обращения к эхо-серверу).
+///
+///     bench [-m | -M] [-d SECONDS] [-c CONNECTIONS] [-s SIZE]
+///           [-p PROXY_PORT] [-b BACKEND_PORT]
+///         -m - только микротесты; -M - только макротест.
+///
+
+#include <map>
+#include <vector>
+#include <deque>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "log.hpp"
+#include "proxy.hpp"
+//#include "proxy_impl.hpp" // Instead of "proxy_impl.hpp" we use "proxy.hpp".
+#include "client_logic.hpp"
+#include "timer_wheel.hpp"
+
+// RU: Есть только в сборке с -fprofile-generate (см. build_pgo.sh).
+//     Профиль обычно записывается в exit(), а бенчмарк завершается _exit.
+extern "C" void __gcov_dump(void) __attribute__((weak));
+
+namespace proxy_ns {
+    ///
+    /// \brief The bench_access class - access to the internals of
+    ///        client_logic for the microbenchmarks
+    ///
+    class bench_access {
+    public:
+        static void new_connect(client_logic& c, int d) {
+            c.new_connect(d);
+        }
+
+        static bool save(client_logic& c, int d,
+                         unsigned char const* buf, unsigned int size) {
+            return c.save_new_data_storage(d, buf, size);
+        }
+
+        static unsigned char const* get(client_logic& c, int d,
+                                        unsigned int& size) {
+            return c.get_data_storage(d, size);
+        }
+
+        static bool del(client_logic& c, int d) {
+            return c.delete_data_storage(d);
+        }
+
+        static int find_pollfd(client_logic const& c, int d) {
+            return c.find_pollfd(d);
+        }
+
+        static void forget_fds(client_logic& c) {
+            // RU: Дескрипторы фиктивные - деструктор не должен их закрывать
+            c.nfds = 0;
+        }
+    };
+} // namespace proxy_ns
+
+namespace {
+    using namespace proxy_ns;
+    using namespace log_ns;
+
+    typedef std::chrono::steady_clock clock_type;
+
+    ///
+    /// \brief The nulllog class - log backend which drops everything
+    ///
+    class nulllog : public baselog {
+    public:
+        virtual void write(Ilog::level_t, std::string const&) {}
+        virtual void write(Ilog::level_t, char const*) {}
+        virtual ~nulllog(void) {}
+    };
+
+    template<class T>
+    inline void do_not_optimize(T const& v) {
+        asm volatile("" : : "r,m"(v) : "memory");
+    }
+
+    double seconds_since(clock_type::time_point t0) {
+        return std::chrono::duration<double>(clock_type::now() - t0).count();
+    }
+
+    ///
+    /// \brief micro - run f(i) iters times and print ns/op
+    ///
+    template<class F>
+    void micro(char const* name, size_t iters, F f) {
+        for(size_t i = 0; i < iters / 10; i++) {
+            f(i);
+        }
+
+        auto const t0 = clock_type::now();
+
+        for(size_t i = 0; i < iters; i++) {
+            f(i);
+        }
+
+        double const s = seconds_since(t0);
+
+        std::cout << std::left << std::setw(36) << name << std::right
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(12) << (s * 1e9 / iters) << " ns/op"
+                  << std::setw(14) << std::setprecision(0) << (iters / s)
+                  << " op/s" << std::endl;
+    }
+
+    void run_micro(void) {
+        unsigned char payload[DATA_BUFFER_SIZE];
+        struct sockaddr_storage addr;
+
+        std::memset(payload, 'x', sizeof(payload));
+        (void) address_parse("127.0.0.1", 4880, addr);
+
+        std::cout << "--- micro ---" << std::endl;
+
+        micro("data (64 bytes)", 2000000, [&](size_t i) {
+            data d(DIRECTION_CLIENT_TO_SERVER, TOD_DATA,
+                   static_cast<int>(i), 1, 64, payload,
+                   &addr, &addr, &addr);
+            do_not_optimize(d);
+        });
+
+        micro("data (DATA_BUFFER_SIZE)", 200000, [&](size_t i) {
+            data d(DIRECTION_CLIENT_TO_SERVER, TOD_DATA,
+                   static_cast<int>(i), 1, DATA_BUFFER_SIZE, payload,
+                   &addr, &addr, &addr);
+            do_not_optimize(d);
+        });
+
+        {
+            proxy_impl pi;
+            client_routine_arg arg = {&pi, -1, -1, -1, -1};
+            client_logic c(&arg, &pi);
+            int const n = POLLING_REQUESTS_SIZE - 1;
+
+            for(int d = 0; d < n; d++) {
+                bench_access::new_connect(c, 100000 + d);
+            }
+
+            micro("storage save+get+delete (512)", 1000000, [&](size_t) {
+                unsigned int size = 0;
+                bench_access::save(c, 100000, payload, 512);
+                do_not_optimize(bench_access::get(c, 100000, size));
+                bench_access::del(c, 100000);
+            });
+
+            micro("storage depth 64 (512)", 20000, [&](size_t) {
+                unsigned int size = 0;
+                for(int k = 0; k < 64; k++) {
+                    bench_access::save(c, 100001, payload, 512);
+                }
+                for(int k = 0; k < 64; k++) {
+                    do_not_optimize(bench_access::get(c, 100001, size));
+                    bench_access::del(c, 100001);
+                }
+            });
+
+            micro("find_pollfd (first)", 10000000, [&](size_t) {
+                do_not_optimize(bench_access::find_pollfd(c, 100000));
+            });
+
+            std::string const name =
+                    "find_pollfd (last of " + std::to_string(n) + ")";
+            micro(name.c_str(), 200000, [&](size_t) {
+                do_not_optimize(bench_access::find_pollfd(c, 100000 + n - 1));
+            });
+
+            bench_access::forget_fds(c);
+        }
+
+        {
+            // RU: Колесо с 200k взведённых таймеров (сессии с таймаутом
+            //     простоя): взвод/отмена и срабатывание
+            boost::uint64_t now = 1000000;
+            timer_wheel w(now);
+            std::vector<timer_wheel::timer_id> ids(200000);
+
+            for(size_t k = 0; k < ids.size(); k++) {
+                ids[k] = w.arm(now + 1 + (k * 7919) % 600000, 0,
+                               static_cast<int>(k));
+            }
+
+            micro("timer_wheel arm+cancel (200k armed)", 5000000,
+                  [&](size_t i) {
+                size_t const k = i % ids.size();
+                w.cancel(ids[k]);
+                ids[k] = w.arm(now + 1 + (i * 7919) % 600000, 0,
+                               static_cast<int>(k));
+            });
+
+            timer_wheel::expired e;
+            size_t fired = 0;
+            auto const t0 = clock_type::now();
+
+            while(w.size()) {
+                now += 1000;
+                while(w.expire(now, e)) {
+                    fired++;
+                }
+            }
+
+            double const sec = seconds_since(t0);
+
+            std::cout << std::left << std::setw(36)
+                      << "timer_wheel expire (1s steps)" << std::right
+                      << std::fixed << std::setprecision(1)
+                      << std::setw(12) << (sec * 1e9 / fired) << " ns/op"
+                      << std::setw(14) << std::setprecision(0)
+                      << (fired / sec) << " op/s" << std::endl;
+        }
+
+        {
+            common_logic_log l("C");
+
+            log::inst().set_level(Ilog::LEVEL_ERROR);
+            micro("log info (disabled)", 10000000, [&](size_t i) {
+                l.info_new_incoming_connection(__FILE__, __LINE__,
+                                               static_cast<int>(i), addr);
+            });
+
+            log::inst().set_level(Ilog::LEVEL_INFO);
+            micro("log info (formatted)", 500000, [&](size_t i) {
+                l.info_new_incoming_connection(__FILE__, __LINE__,
+                                               static_cast<int>(i), addr);
+            });
+
+            log::inst().set_level(Ilog::LEVEL_ERROR);
+        }
+
+        {
+            int sv[2] = {-1, -1};
+
+            if(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0) {
+                data d(DIRECTION_CLIENT_TO_SERVER, TOD_DATA, 1, 1, 64,
+                       payload, &addr, &addr, &addr);
+                data r;
+
+                micro("data framing (socketpair)", 200000, [&](size_t) {
+                    (void) ::write(sv[0], &d, sizeof(d));
+                    size_t got = 0;
+                    while(got < sizeof(r)) {
+                        ssize_t const rc =
+                                ::read(sv[1],
+                                       reinterpret_cast<char*>(&r) + got,
+                                       sizeof(r) - got);
+                        if(rc <= 0) {
+                            break;
+                        }
+                        got += rc;
+                    }
+                    do_not_optimize(r);
+                });
+
+                (void) ::close(sv[0]);
+                (void) ::close(sv[1]);
+            }
+        }
+    }
+
+    /* ***** macro ***** */
+
+    struct macro_config {
+        double duration;
+        int connections;
+        size_t size;
+        boost::uint16_t proxy_port;
+        boost::uint16_t backend_port;
+    };
+
+    int listen_on(boost::uint16_t port) {
+        struct sockaddr_in a;
+        int const on = 1;
+        int sd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+        std::memset(&a, 0, sizeof(a));
+        a.sin_family = AF_INET;
+        a.sin_port = htons(port);
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        (void) ::setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        if(::bind(sd, reinterpret_cast<struct sockaddr*>(&a),
+                  sizeof(a)) < 0 ||
+           ::listen(sd, SOMAXCONN) < 0) {
+            (void) ::close(sd);
+            return -1;
+        }
+
+        return sd;
+    }
+
+    int connect_to(boost::uint16_t port) {
+        struct sockaddr_in a;
+        int const on = 1;
+        int sd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+        std::memset(&a, 0, sizeof(a));
+        a.sin_family = AF_INET;
+        a.sin_port = htons(port);
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if(::connect(sd, reinterpret_cast<struct sockaddr*>(&a),
+                     sizeof(a)) < 0) {
+            (void) ::close(sd);
+            return -1;
+        }
+
+        (void) ::setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        // RU: Прокси может потерять данные - генератор не должен зависнуть
+        struct timeval tv = {5, 0};
+        (void) ::setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        return sd;
+    }
+
+    bool send_all(int sd, unsigned char const* buf, size_t size) {
+        while(size) {
+            ssize_t const rc = ::send(sd, buf, size, MSG_NOSIGNAL);
+            if(rc <= 0) {
+                return false;
+            }
+            buf += rc;
+            size -= rc;
+        }
+        return true;
+    }
+
+    bool recv_all(int sd, unsigned char* buf, size_t size) {
+        while(size) {
+            ssize_t const rc = ::recv(sd, buf, size, 0);
+            if(rc <= 0) {
+                return false;
+            }
+            buf += rc;
+            size -= rc;
+        }
+        return true;
+    }
+
+    ///
+    /// \brief echo_server - single-threaded poll() echo backend
+    ///
+    void echo_server(int listen_sd) {
+        std::vector<struct pollfd> fds;
+        unsigned char buf[65536];
+
+        fds.push_back({listen_sd, POLLIN, 0});
+
+        for(;;) {
+            if(::poll(fds.data(), fds.size(), -1) < 0) {
+                continue;
+            }
+
+            for(size_t i = fds.size() - 1; i > 0; i--) {
+                if(!fds[i].revents) {
+                    continue;
+                }
+
+                ssize_t const rc = ::recv(fds[i].fd, buf, sizeof(buf), 0);
+                if(rc <= 0 || !send_all(fds[i].fd, buf, rc)) {
+                    (void) ::close(fds[i].fd);
+                    fds.erase(fds.begin() + i);
+                }
+            }
+
+            if(fds[0].revents & POLLIN) {
+                int const sd = ::accept(listen_sd, nullptr, nullptr);
+                if(sd >= 0) {
+                    int const on = 1;
+                    (void) ::setsockopt(sd, IPPROTO_TCP, TCP_NODELAY,
+                                        &on, sizeof(on));
+                    fds.push_back({sd, POLLIN, 0});
+                }
+            }
+        }
+    }
+
+    ///
+    /// \brief parallel - run f(thread index) on n threads
+    ///
+    void parallel(int n, std::function<void(int)> const& f) {
+        std::vector<std::thread> threads;
+
+        for(int i = 0; i < n; i++) {
+            threads.emplace_back(f, i);
+        }
+
+        for(auto& t : threads) {
+            t.join();
+        }
+    }
+
+    ///
+    /// \brief ping_pong - request/response latencies (ns)
+    ///
+    std::vector<boost::uint64_t> ping_pong(macro_config const& cfg,
+                                           boost::uint16_t port,
+                                           size_t& failed) {
+        std::vector<std::vector<boost::uint64_t>> lat(cfg.connections);
+        std::atomic<size_t> errors(0);
+        auto const deadline = clock_type::now() +
+                std::chrono::duration_cast<clock_type::duration>(
+                    std::chrono::duration<double>(cfg.duration));
+
+        parallel(cfg.connections, [&](int t) {
+            std::vector<unsigned char> out(cfg.size, 'q');
+            std::vector<unsigned char> in(cfg.size);
+            int const sd = connect_to(port);
+
+            if(sd < 0) {
+                errors++;
+                return;
+            }
+
+            while(clock_type::now() < deadline) {
+                auto const t0 = clock_type::now();
+
+                if(!send_all(sd, out.data(), out.size()) ||
+                   !recv_all(sd, in.data(), in.size())) {
+                    errors++;
+                    break;
+                }
+
+                lat[t].push_back(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        clock_type::now() - t0).count());
+            }
+
+            (void) ::close(sd);
+        });
+
+        std::vector<boost::uint64_t> all;
+
+        for(auto const& v : lat) {
+            all.insert(all.end(), v.begin(), v.end());
+        }
+
+        std::sort(all.begin(), all.end());
+        failed = errors;
+
+        return all;
+    }
+
+    boost::uint64_t percentile(std::vector<boost::uint64_t> const& v,
+                               double p) {
+        if(v.empty()) {
+            return 0;
+        }
+
+        size_t i = static_cast<size_t>(p * (v.size() - 1));
+        return v[std::min(i, v.size() - 1)];
+    }
+
+    void run_macro(macro_config const& cfg) {
+        int const lsd = listen_on(cfg.backend_port);
+
+        if(lsd < 0) {
+            std::cerr << "bench: can't listen on port "
+                      << cfg.backend_port << std::endl;
+            return;
+        }
+
+        std::thread(echo_server, lsd).detach();
+
+        // RU: Прокси работает до завершения процесса
+        std::thread([&cfg]() {
+            proxy p;
+            p.set_proxy_port(cfg.proxy_port);
+            p.set_server_port(cfg.backend_port);
+            p.set_server_ip("127.0.0.1");
+            p.set_tap_sample_rate(0);
+            (void) p.run();
+        }).detach();
+
+        for(int i = 0; i < 100; i++) {
+            int const sd = connect_to(cfg.proxy_port);
+            if(sd >= 0) {
+                (void) ::close(sd);
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+
+        std::cout << "--- macro (" << cfg.connections << " connections, "
+                  << cfg.size << " bytes, " << cfg.duration << " s) ---"
+                  << std::endl;
+
+        // 1. Connection rate
+        {
+            std::atomic<size_t> done(0);
+            std::atomic<size_t> errors(0);
+            auto const t0 = clock_type::now();
+
+            parallel(cfg.connections, [&](int) {
+                unsigned char b = 'c';
+
+                while(seconds_since(t0) < cfg.duration) {
+                    int const sd = connect_to(cfg.proxy_port);
+                    if(sd < 0 || !send_all(sd, &b, 1) || !recv_all(sd, &b, 1)) {
+                        errors++;
+                    }
+                    else {
+                        done++;
+                    }
+                    if(sd >= 0) {
+                        (void) ::close(sd);
+                    }
+                }
+            });
+
+            std::cout << "connections/sec: " << std::fixed
+                      << std::setprecision(0)
+                      << (done / seconds_since(t0))
+                      << " (errors: " << errors << ")" << std::endl;
+        }
+
+        // 2. Request rate and added latency
+        {
+            size_t failed_direct = 0;
+            size_t failed_proxy = 0;
+
+            auto const direct = ping_pong(cfg, cfg.backend_port,
+                                          failed_direct);
+            auto const proxied = ping_pong(cfg, cfg.proxy_port,
+                                           failed_proxy);
+
+            std::cout << "requests/sec:    " << std::fixed
+                      << std::setprecision(0)
+                      << (proxied.size() / cfg.duration)
+                      << " (direct: " << (direct.size() / cfg.duration)
+                      << "; errors: " << failed_proxy << ")" << std::endl;
+
+            for(double p : {0.5, 0.99, 0.999}) {
+                boost::int64_t const a = percentile(proxied, p);
+                boost::int64_t const b = percentile(direct, p);
+
+                std::cout << "p" << std::setw(5) << std::left
+                          << std::setprecision(1) << (p * 100)
+                          << std::setprecision(0) << std::right
+                          << " latency: " << std::setw(8) << (a / 1000)
+                          << " us (direct " << std::setw(8) << (b / 1000)
+                          << " us, added " << std::setw(8)
+                          << ((a - b) / 1000) << " us)" << std::endl;
+            }
+        }
+
+        // 3. Throughput
+        {
+            size_t const block = 65536;
+            std::atomic<boost::uint64_t> bytes(0);
+            std::atomic<size_t> errors(0);
+            auto const t0 = clock_type::now();
+
+            parallel(cfg.connections, [&](int) {
+                std::vector<unsigned char> out(block, 'b');
+                std::vector<unsigned char> in(block);
+                int const sd = connect_to(cfg.proxy_port);
+
+                if(sd < 0) {
+                    errors++;
+                    return;
+                }
+
+                while(seconds_since(t0) < cfg.duration) {
+                    if(!send_all(sd, out.data(), out.size()) ||
+                       !recv_all(sd, in.data(), in.size())) {
+                        errors++;
+                        break;
+                    }
+                    bytes += block;
+                }
+
+                (void) ::close(sd);
+            });
+
+            std::cout << "MB/s (echoed):   " << std::fixed
+                      << std::setprecision(1)
+                      << (bytes / seconds_since(t0) / (1024.0 * 1024.0))
+                      << " (errors: " << errors << ")" << std::endl;
+        }
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    macro_config cfg = {3.0, 16, 64, 14880, 15555};
+    bool micro_only = false;
+    bool macro_only = false;
+    int c = 0;
+
+    while((c = ::getopt(argc, argv, "mMd:c:s:p:b:h")) != -1) {
+        try {
+            switch(c) {
+            case 'm':
+                micro_only = true;
+                break;
+            case 'M':
+                macro_only = true;
+                break;
+            case 'd':
+                cfg.duration = boost::lexical_cast<double>(optarg);
+                break;
+            case 'c':
+                cfg.connections = boost::lexical_cast<int>(optarg);
+                break;
+            case 's':
+                cfg.size = boost::lexical_cast<size_t>(optarg);
+                break;
+            case 'p':
+                cfg.proxy_port = boost::lexical_cast<boost::uint16_t>(optarg);
+                break;
+            case 'b':
+                cfg.backend_port =
+                        boost::lexical_cast<boost::uint16_t>(optarg);
+                break;
+            default:
+                std::cerr << "Usage: " << argv[0]
+                          << " [-m | -M] [-d SECONDS] [-c CONNECTIONS]"
+                          << " [-s SIZE] [-p PROXY_PORT] [-b BACKEND_PORT]"
+                          << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        catch(boost::bad_lexical_cast const&) {
+            std::cerr << argv[0] << ": invalid value '" << optarg << "'"
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    log_ns::log::inst(boost::make_shared<nulllog>());
+    log_ns::log::inst().set_level(log_ns::Ilog::LEVEL_ERROR);
+
+    if(!macro_only) {
+        run_micro();
+    }
+
+    if(!micro_only) {
+        run_macro(cfg);
+    }
+
+    // RU: Потоки прокси и эхо-сервера не останавливаются
+    std::cout.flush();
+
+    if(__gcov_dump) {
+        __gcov_dump();
+    }
+
+    ::_exit(EXIT_SUCCESS);
+}
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
@@ -19,6 +19,9 @@ echo "Compiling..."
 
 # -DUSE_FULL_DEBUG
 # -DUSE_FULL_DEBUG_POLL_INTERVAL
+# -DUSE_USDT
+# -DUSE_CPU_DISPATCH
+# -DFIND_POLLFD_BLOCK
 # -DPOLLING_REQUESTS_SIZE
 # -DDATA_BUFFER_SIZE
 # -D__USER_DEFAULT_PROXY_PORT
@@ -31,6 +34,7 @@ echo "Compiling..."
 # -D__USER_DEFAULT_SERVER_KEEP_ALIVE
 # -D__USER_DEFAULT_CLIENT_TCP_NO_DELAY
 # -D__USER_DEFAULT_SERVER_TCP_NO_DELAY
+# -DLOG_COMPILE_LEVEL
 
 g++ -Wall \
     -Wextra \
@@ -55,6 +59,19 @@ g++ -Wall \
     client_logic.cpp \
     server_logic.cpp \
     worker_logic.cpp \
+    capture.cpp \
+    shadow.cpp \
+    metrics.cpp \
+    trace.cpp \
+    admin.cpp \
+    dispatch.cpp \
+    timer_wheel.cpp \
+    takeover.cpp \
+    config.cpp \
+    control.cpp \
+    address.cpp \
+    sockopt.cpp \
+    affinity.cpp \
     -o "${BINARY_NAME}"
 
 if [ -f "${BINARY_NAME}" ]; then
@@ -0,0 +1,100 @@
+#! /bin/bash
+
+# ##############################################################################
+# Two-stage PGO build:
+#   1. instrumented build (-DPGO=GENERATE);
+#   2. training: bench (micro and macro) and proxy_loadgen through the proxy
+#      to fake_sqld (mysql and pgsql, closed and open loop, with reconnects);
+#   3. optimized build with the collected profiles (-DPGO=USE).
+#
+# Usage: ./build_pgo.sh [BUILD_DIR] [extra cmake options, e.g. -DPORTABLE=ON]
+# ##############################################################################
+
+set -e
+
+export BUILD_DIR="${1:-./build_pgo}"
+shift || true
+
+export PGO_DIR="$(realpath -m "${BUILD_DIR}/pgo")"
+
+export TRAIN_PROXY_PORT=14880
+export TRAIN_MYSQL_PORT=13306
+export TRAIN_PGSQL_PORT=15432
+export TRAIN_SECONDS=5
+
+echo "Instrumented build..."
+
+rm -rf "${PGO_DIR}"
+
+cmake -S . -B "${BUILD_DIR}" \
+    -DCMAKE_BUILD_TYPE=Release \
+    -DLTO=ON \
+    -DPGO=GENERATE \
+    -DPGO_DIR="${PGO_DIR}" \
+    "$@"
+
+cmake --build "${BUILD_DIR}" -j"$(nproc)"
+
+echo "Training..."
+
+"${BUILD_DIR}/bench" -d 2 > /dev/null
+
+for PROTOCOL in mysql pgsql; do
+    if [ "${PROTOCOL}" = "mysql" ]; then
+        BACKEND_PORT=${TRAIN_MYSQL_PORT}
+    else
+        BACKEND_PORT=${TRAIN_PGSQL_PORT}
+    fi
+
+    "${BUILD_DIR}/fake_sqld" -P ${PROTOCOL} -d ${BACKEND_PORT} -t 2 \
+        --rows=10 --width=64 > /dev/null &
+    FAKE_PID=$!
+
+    # RU: Прокси запускается не демоном, чтобы его PID был известен
+    #     точно. Профиль записывается только при штатном завершении (по
+    #     SIGTERM).
+    "${BUILD_DIR}/proxy" --no-daemon -p ${TRAIN_PROXY_PORT} \
+        -d ${BACKEND_PORT} -i 127.0.0.1 -o ERROR < /dev/null > /dev/null &
+    PROXY_PID=$!
+
+    sleep 1
+
+    "${BUILD_DIR}/proxy_loadgen" -P ${PROTOCOL} -d ${TRAIN_PROXY_PORT} \
+        -c 32 -t 2 -D ${TRAIN_SECONDS} > /dev/null || true
+    "${BUILD_DIR}/proxy_loadgen" -P ${PROTOCOL} -d ${TRAIN_PROXY_PORT} \
+        -c 32 -t 2 -D ${TRAIN_SECONDS} --mode=open --rate=5000 \
+        > /dev/null || true
+    "${BUILD_DIR}/proxy_loadgen" -P ${PROTOCOL} -d ${TRAIN_PROXY_PORT} \
+        -c 8 -D ${TRAIN_SECONDS} --reconnect=10 > /dev/null || true
+
+    kill -TERM ${PROXY_PID}
+    wait ${PROXY_PID} || true
+    kill -TERM ${FAKE_PID} || true
+    wait ${FAKE_PID} || true
+
+    sleep 1
+done
+
+# RU: Без профилей второй этап молча соберёт обычный Release. Профиль
+#     main.cpp пишет только прокси (bench его не содержит).
+if [ -z "$(find "${PGO_DIR}" -name '*.gcda' -print -quit 2> /dev/null)" ]; then
+    echo "Training wrote no profiles (*.gcda) to ${PGO_DIR}" >&2
+    exit 1
+fi
+
+if [ -z "$(find "${PGO_DIR}" -name '*main.cpp.gcda' -print -quit)" ]; then
+    echo "Training wrote no profile for the proxy itself" >&2
+    exit 1
+fi
+
+echo "Optimized build..."
+
+cmake -S . -B "${BUILD_DIR}" -DPGO=USE
+
+cmake --build "${BUILD_DIR}" -j"$(nproc)" --clean-first
+
+echo "OK!"
+
+# ##############################################################################
+# End of file
+# ##############################################################################
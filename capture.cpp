@@ -0,0 +1,265 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#include <string>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "capture.hpp"
+
+namespace capture_ns {
+    namespace {
+        boost::uint64_t clock_ns(clockid_t id) noexcept {
+            struct timespec ts;
+            (void) ::clock_gettime(id, &ts);
+            return static_cast<boost::uint64_t>(ts.tv_sec) * 1000000000ULL +
+                    static_cast<boost::uint64_t>(ts.tv_nsec);
+        }
+    }
+
+    boost::uint64_t monotonic_ns(void) noexcept {
+        return clock_ns(CLOCK_MONOTONIC);
+    }
+
+    boost::uint64_t realtime_ns(void) noexcept {
+        return clock_ns(CLOCK_REALTIME);
+    }
+
+    ///
+    /// \brief capture::capture
+    /// \param _path
+    /// \param _segment_size
+    /// \param _segment_count
+    ///
+    capture::capture(std::string const& _path,
+                     size_t _segment_size,
+                     size_t _segment_count) :
+        path(_path),
+        segment_size(std::max(_segment_size,
+                              sizeof(capture_file_header) +
+                              capture_record_size(0))),
+        segment_count(std::max(_segment_count, size_t(1))),
+        segment(0),
+        fd(-1),
+        base(nullptr),
+        offset(0),
+        records(0),
+        bytes(0) {
+
+        // RU: Продолжаем нумерацию сегментов, оставшихся от прошлых
+        //     запусков, чтобы не затереть их.
+        std::string::size_type const slash = this->path.rfind('/');
+        std::string const dir = (slash == std::string::npos) ?
+                    std::string(".") : this->path.substr(0, slash + 1);
+        std::string const prefix = ((slash == std::string::npos) ?
+                    this->path : this->path.substr(slash + 1)) + ".";
+
+        DIR* d = ::opendir(dir.c_str());
+        if(d) {
+            struct dirent* e = nullptr;
+            while((e = ::readdir(d)) != nullptr) {
+                std::string const name(e->d_name);
+                if(name.compare(0, prefix.size(), prefix) == 0) {
+                    try {
+                        boost::uint64_t const n =
+                            boost::lexical_cast<boost::uint64_t>(
+                                name.substr(prefix.size()));
+                        this->segment = std::max(this->segment, n + 1);
+                    }
+                    catch(boost::bad_lexical_cast const&) {
+                    }
+                }
+            }
+            (void) ::closedir(d);
+        }
+
+        this->open_segment();
+    }
+
+    ///
+    /// \brief capture::write
+    /// \param timestamp
+    /// \param session
+    /// \param direction
+    /// \param tod
+    /// \param buf
+    /// \param length
+    /// \return
+    ///
+    bool capture::write(boost::uint64_t timestamp,
+                        boost::uint32_t session,
+                        capture_direction_t direction,
+                        boost::uint8_t tod,
+                        unsigned char const* buf,
+                        boost::uint32_t length) {
+        size_t const need = capture_record_size(length);
+
+        if(sizeof(capture_file_header) + need > this->segment_size) {
+            return false;
+        }
+
+        if(this->offset + need > this->segment_size) {
+            this->close_segment();
+            this->segment++;
+            this->open_segment();
+        }
+
+        capture_record_header h;
+
+        std::fill_n(reinterpret_cast<char*>(&h), sizeof(h), '\0');
+
+        h.timestamp = timestamp;
+        h.session = session;
+        h.direction = static_cast<boost::uint8_t>(direction);
+        h.tod = tod;
+        h.length = length;
+
+        std::memcpy(this->base + this->offset, &h, sizeof(h));
+        if(length) {
+            std::memcpy(this->base + this->offset + sizeof(h), buf, length);
+        }
+
+        this->offset += need;
+        this->records++;
+        this->bytes += length;
+
+        return true;
+    }
+
+    ///
+    /// \brief capture::close
+    ///
+    void capture::close(void) noexcept {
+        this->close_segment();
+    }
+
+    boost::uint64_t capture::get_records(void) const noexcept {
+        return this->records;
+    }
+
+    boost::uint64_t capture::get_bytes(void) const noexcept {
+        return this->bytes;
+    }
+
+    ///
+    /// \brief capture::~capture
+    ///
+    capture::~capture(void) noexcept {
+        this->close_segment();
+    }
+
+    ///
+    /// \brief capture::open_segment
+    ///
+    void capture::open_segment(void) {
+        std::string const name = this->segment_name(this->segment);
+        int rc = 0;
+
+        this->fd = ::open(name.c_str(),
+                          O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(this->fd < 0) {
+            throw Ecapture_failed(name + ": " + ::strerror(errno));
+        }
+
+        // RU: Место резервируется заранее: запись в mmap на переполненном
+        //     диске привела бы к SIGBUS.
+        rc = ::posix_fallocate(this->fd, 0, this->segment_size);
+        if(rc) {
+            (void) ::close(this->fd);
+            this->fd = -1;
+            throw Ecapture_failed(name + ": " + ::strerror(rc));
+        }
+
+        void* p = ::mmap(nullptr, this->segment_size,
+                         PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+        if(MAP_FAILED == p) {
+            int const err = errno;
+            (void) ::close(this->fd);
+            this->fd = -1;
+            throw Ecapture_failed(name + ": " + ::strerror(err));
+        }
+
+        (void) ::madvise(p, this->segment_size, MADV_SEQUENTIAL);
+
+        this->base = reinterpret_cast<unsigned char*>(p);
+
+        capture_file_header h;
+
+        std::fill_n(reinterpret_cast<char*>(&h), sizeof(h), '\0');
+        std::memcpy(h.magic, CAPTURE_MAGIC, sizeof(h.magic));
+
+        h.version = CAPTURE_VERSION;
+        h.header_size = sizeof(h);
+        h.realtime_ns = realtime_ns();
+        h.monotonic_ns = monotonic_ns();
+        h.segment = this->segment;
+
+        std::memcpy(this->base, &h, sizeof(h));
+        this->offset = sizeof(h);
+
+        // RU: Удаляем самый старый сегмент.
+        if(this->segment >= this->segment_count) {
+            (void) ::unlink(this->segment_name(
+                                this->segment - this->segment_count).c_str());
+        }
+    }
+
+    ///
+    /// \brief capture::close_segment
+    ///
+    void capture::close_segment(void) noexcept {
+        if(this->base) {
+            (void) ::munmap(this->base, this->segment_size);
+            this->base = nullptr;
+        }
+
+        if(this->fd >= 0) {
+            (void) ::ftruncate(this->fd, this->offset);
+            (void) ::close(this->fd);
+            this->fd = -1;
+        }
+    }
+
+    ///
+    /// \brief capture::segment_name
+    /// \param n
+    /// \return
+    ///
+    std::string capture::segment_name(boost::uint64_t n) const {
+        return this->path + "." + std::to_string(n);
+    }
+} // namespace capture_ns
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
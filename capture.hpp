@@ -0,0 +1,205 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#pragma once
+
+#ifndef __CAPTURE_HPP__
+#define __CAPTURE_HPP__
+
+#include <string>
+#include <exception>
+#include <stdexcept>
+
+#include <boost/cstdint.hpp>
+
+#include <sys/types.h>
+
+/*
+ * NOTE (RU): Формат файла захвата трафика.
+ * -----------------------------------------------------------------------------
+ * Каждый сегмент - отдельный файл "<path>.<N>", где N возрастает. Сегмент
+ * начинается с заголовка capture_file_header, за которым следуют записи:
+ * capture_record_header + данные (выровнены на CAPTURE_RECORD_ALIGN).
+ * Запись с нулевым заголовком (или конец файла) - конец сегмента.
+ * Все числа - в порядке байт машины, записавшей файл.
+ * -----------------------------------------------------------------------------
+ */
+
+#define CAPTURE_MAGIC "SQLPCAP1"
+#define CAPTURE_VERSION 1
+#define CAPTURE_RECORD_ALIGN 8
+
+#ifndef CAPTURE_DEFAULT_SEGMENT_SIZE
+    #define CAPTURE_DEFAULT_SEGMENT_SIZE (64 * 1024 * 1024)
+#endif // CAPTURE_DEFAULT_SEGMENT_SIZE
+
+#ifndef CAPTURE_DEFAULT_SEGMENT_COUNT
+    #define CAPTURE_DEFAULT_SEGMENT_COUNT 8
+#endif // CAPTURE_DEFAULT_SEGMENT_COUNT
+
+namespace capture_ns {
+    ///
+    /// \brief The capture_file_header struct
+    ///
+    struct capture_file_header {
+        char magic[8];                  // CAPTURE_MAGIC
+        boost::uint32_t version;        // CAPTURE_VERSION
+        boost::uint32_t header_size;    // sizeof(capture_file_header)
+        boost::uint64_t realtime_ns;    // CLOCK_REALTIME at segment start
+        boost::uint64_t monotonic_ns;   // CLOCK_MONOTONIC at segment start
+        boost::uint64_t segment;        // segment sequence number
+        boost::uint64_t reserved[3];
+    };
+
+    ///
+    /// \brief The capture_record_header struct
+    ///
+    struct capture_record_header {
+        boost::uint64_t timestamp;      // CLOCK_MONOTONIC, ns
+        boost::uint32_t session;        // client socket descriptor
+        boost::uint8_t direction;       // capture_direction_t
+        boost::uint8_t tod;             // proxy_ns::type_of_data_t
+        boost::uint16_t reserved;
+        boost::uint32_t length;         // payload length
+        boost::uint32_t reserved2;
+    };
+
+    typedef enum {
+        CAPTURE_DIRECTION_UNKNOWN = 0,
+        CAPTURE_DIRECTION_CLIENT_TO_SERVER,
+        CAPTURE_DIRECTION_SERVER_TO_CLIENT,
+        CAPTURE_DIRECTION_END
+    } capture_direction_t;
+
+    static_assert(sizeof(capture_file_header) == 64,
+                  "capture_file_header: unexpected size");
+    static_assert(sizeof(capture_record_header) % CAPTURE_RECORD_ALIGN == 0,
+                  "capture_record_header: unexpected size");
+
+    ///
+    /// \brief capture_record_size
+    /// \param length - payload length
+    /// \return full (aligned) record size
+    ///
+    inline size_t capture_record_size(size_t length) noexcept {
+        return (sizeof(capture_record_header) + length +
+                CAPTURE_RECORD_ALIGN - 1) & ~size_t(CAPTURE_RECORD_ALIGN - 1);
+    }
+
+    ///
+    /// \brief monotonic_ns
+    /// \return
+    ///
+    boost::uint64_t monotonic_ns(void) noexcept;
+
+    ///
+    /// \brief realtime_ns
+    /// \return
+    ///
+    boost::uint64_t realtime_ns(void) noexcept;
+
+    ///
+    /// \brief The capture class
+    ///
+    /// RU: Запись трафика в кольцо сегментов, отображённых в память (mmap).
+    ///     Запись только добавлением, без системных вызовов на каждую
+    ///     запись: сброс на диск выполняет ядро большими блоками.
+    ///     Объект не потокобезопасен - используется только воркером.
+    ///
+    class capture {
+        typedef capture self;
+    public:
+        capture(std::string const& path,
+                size_t segment_size = CAPTURE_DEFAULT_SEGMENT_SIZE,
+                size_t segment_count = CAPTURE_DEFAULT_SEGMENT_COUNT);
+
+        capture(capture const&) = delete;
+        capture& operator=(capture const&) = delete;
+
+        ///
+        /// \brief write
+        /// \return false if the record is too large for a segment
+        ///
+        bool write(boost::uint64_t timestamp,
+                   boost::uint32_t session,
+                   capture_direction_t direction,
+                   boost::uint8_t tod,
+                   unsigned char const* buf,
+                   boost::uint32_t length);
+
+        ///
+        /// \brief close - finish the current segment (truncate to used size)
+        ///
+        void close(void) noexcept;
+
+        boost::uint64_t get_records(void) const noexcept;
+        boost::uint64_t get_bytes(void) const noexcept;
+
+        virtual ~capture(void) noexcept;
+    private:
+        void open_segment(void);
+        void close_segment(void) noexcept;
+        std::string segment_name(boost::uint64_t n) const;
+
+        std::string const path;
+        size_t const segment_size;
+        size_t const segment_count;
+
+        boost::uint64_t segment;
+        int fd;
+        unsigned char* base;
+        size_t offset;
+
+        boost::uint64_t records;
+        boost::uint64_t bytes;
+    };
+
+    class IEcapture : public std::exception {
+    protected:
+        IEcapture(void) noexcept {}
+    public:
+        virtual ~IEcapture() noexcept {}
+        virtual char const* what(void) const noexcept {
+            static std::string const msg("IEcapture");
+            return msg.c_str();
+        }
+    };
+
+    class Ecapture_failed : public IEcapture {
+    public:
+        Ecapture_failed(void) noexcept :
+            msg("Capture failed") {}
+        explicit Ecapture_failed(std::string const& reason) noexcept :
+            msg("Capture failed: " + reason) {}
+        virtual ~Ecapture_failed() noexcept {}
+        virtual char const* what(void) const noexcept {
+            return msg.c_str();
+        }
+    private:
+        std::string const msg;
+    };
+} // namespace capture_ns
+
+#endif // __CAPTURE_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
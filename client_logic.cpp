@@ -52,6 +52,8 @@
 #include <sys/time.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <pthread.h>
@@ -60,6 +62,10 @@
 #include "proxy_result.hpp"
 #include "proxy.hpp"
 //#include "proxy_impl.hpp" // Instead of "proxy_impl.hpp" we use "proxy.hpp".
+#include "metrics.hpp"
+#include "capture.hpp"
+#include "trace.hpp"
+#include "dispatch.hpp"
 
 #include "client_logic.hpp"
 
@@ -80,19 +86,21 @@ namespace proxy_ns {
         s_out_fd(_c_arg->_cs_out_pd),
         w_in_fd(_c_arg->_wc_in_pd),
         w_out_fd(_c_arg->_cw_out_pd),
+        listen_sds(),
+        listen_addrs(),
+        listen_sessions(),
         nfds(0),
         timeout(0),
         flag_compress_array(false),
-        listen_sd(-1),
         cur_fd(-1),
         cur_events(0),
         s_read_enable(false),
         w_read_enable(false),
         s_write_enable(false),
-        w_write_enable(false){
-
-        std::fill_n(reinterpret_cast<char*>(&this->proxy_addr),
-                    sizeof(this->proxy_addr), '\0');
+        timers(),
+        now_ms(timer_wheel::now()),
+        cfg(_pi->runtime_cfg),
+        drain_started(false) {
 
         std::fill_n(reinterpret_cast<char*>(this->fds),
                     sizeof(this->fds), '\0');
@@ -111,73 +119,30 @@ namespace proxy_ns {
     /// \brief client_logic::prepare
     ///
     void client_logic::prepare(void) {
-        int rc_ = RES_CODE_OK;
-        int rc = 0;
-
-        this->listen_sd = ::socket(AF_INET, SOCK_STREAM, 0);
-        if(this->listen_sd < 0) {
-            this->l.get()->error_socket_failed(
-                        __FILE__, __LINE__, errno, this->listen_sd);
-            this->pi->c_last_err = RES_CODE_ERROR;
-            throw Eclient_logic_fatal();
-        }
-
-        // Re-use addr
-        rc_ = this->pi->set_reuseaddr(this->listen_sd, true,
-            this->pi->fok_placeholder,
-            [this](int rc, int err) {
-                boost::ignore_unused(rc);
-                this->l.get()->error_setsockopt_failed(
-                        __FILE__, __LINE__, err, this->listen_sd);
-            });
-
-        if(RES_CODE_OK != rc_) {
-            (void) ::close(this->listen_sd);
-            this->pi->c_last_err = RES_CODE_ERROR;
-            throw Eclient_logic_fatal();
-        }
-
-        // Nonblock
-        rc_ = this->pi->set_nonblock(this->listen_sd,
-            this->pi->fok_placeholder,
-            [this](int rc, int err) {
-                boost::ignore_unused(rc);
-                this->l.get()->error_ioctl_or_fcntl_failed(
-                        __FILE__, __LINE__, err, this->listen_sd);
-            });
+        this->pi->c_last_err = RES_CODE_OK;
 
-        if(RES_CODE_OK != rc_) {
-            (void) ::close(this->listen_sd);
-            this->pi->c_last_err = RES_CODE_ERROR;
-            throw Eclient_logic_fatal();
-        }
+        size_t const n = this->cfg->listeners.size();
 
-        std::fill_n(reinterpret_cast<char*>(&this->proxy_addr),
-                    sizeof(this->proxy_addr), '\0');
+        this->listen_sds.assign(n, -1);
+        this->listen_addrs.resize(n);
+        this->listen_sessions.assign(n, 0);
 
-        this->proxy_addr.sin_family = AF_INET;
-        this->proxy_addr.sin_port = htons(this->pi->proxy_port);
-        this->proxy_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        for(size_t i = 0; i < n; i++) {
+            this->listen_addrs[i] = this->cfg->listeners[i].listen_addr;
 
-        rc = ::bind(this->listen_sd,
-                    reinterpret_cast<struct sockaddr*>(&this->proxy_addr),
-                    sizeof(this->proxy_addr));
-        if(rc < 0) {
-            this->l.get()->error_bind_failed(
-                        __FILE__, __LINE__, errno, this->listen_sd);
-            (void) ::close(this->listen_sd);
-            this->pi->c_last_err = RES_CODE_ERROR;
-            throw Eclient_logic_fatal();
+            if(this->pi->listen_fd[i] >= 0) {
+                // RU: Сокет получен от работающей копии (--takeover): он уже
+                //     привязан к порту, слушает и неблокирующий
+                this->listen_sds[i] = this->pi->listen_fd[i];
+            }
+            else {
+                this->listen_sds[i] = this->open_listen(
+                            this->cfg->listeners[i]);
+                this->pi->listen_fd[i] = this->listen_sds[i];
+            }
         }
 
-        rc = ::listen(listen_sd, 1);
-        if(rc < 0) {
-            this->l.get()->error_listen_failed(
-                        __FILE__, __LINE__, errno, this->listen_sd);
-            (void) ::close(this->listen_sd);
-            this->pi->c_last_err = RES_CODE_ERROR;
-            throw Eclient_logic_fatal();
-        }
+        this->pi->listen_count = n;
 
         std::fill_n(reinterpret_cast<char*>(&this->fds[0]),
                     sizeof(this->fds), '\0');
@@ -192,9 +157,11 @@ namespace proxy_ns {
         this->fds[nfds].events = POLLIN;
         this->nfds++;
 
-        this->fds[nfds].fd = this->listen_sd;
-        this->fds[nfds].events = POLLIN;
-        this->nfds++;
+        for(int const sd : this->listen_sds) {
+            this->fds[nfds].fd = sd;
+            this->fds[nfds].events = POLLIN;
+            this->nfds++;
+        }
 
         this->timeout = this->pi->client_poll_timeout;
 
@@ -209,33 +176,67 @@ namespace proxy_ns {
             this->fds[nfds].fd = this->s_out_fd;
             this->fds[nfds].events = POLLOUT;
             this->nfds++;
-
-            this->fds[nfds].fd = this->w_out_fd;
-            this->fds[nfds].events = POLLOUT;
-            this->nfds++;
         };
 
         auto connects_absence = [&]() {
-            nfds -= 2;
+            nfds -= 1;
         };
 
         while(!this->pi->end_proxy) {
             this->s_read_enable = false;
             this->w_read_enable = false;
             this->s_write_enable = false;
-            this->w_write_enable = false;
 
             constexpr static size_t const data_size = sizeof(data);
 
-            static int const min_descriptors_count_ro = 3;
-            static int const min_descriptors_count_rw = 5;
+            int const min_descriptors_count_ro =
+                    LISTEN_INDEX + static_cast<int>(this->listen_sds.size());
+            int const min_descriptors_count_rw = min_descriptors_count_ro + 1;
 #ifdef USE_FULL_DEBUG
     #ifdef USE_FULL_DEBUG_POLL_INTERVAL
             l(Ilog::LEVEL_DEBUG, "C: Waiting on poll (client)...");
     #endif // USE_FULL_DEBUG_POLL_INTERVAL
 #endif // USE_FULL_DEBUG
 
+            if(this->pi->draining && !this->drain_started) {
+                this->drain_start();
+            }
+
+            // RU: Ждём не дольше, чем до ближайшего таймера
+            this->timeout = this->timers.size() ?
+                    this->timers.next_timeout(timer_wheel::now(),
+                                              this->pi->client_poll_timeout) :
+                    this->pi->client_poll_timeout;
+
+            // RU: Таблица pollfd заполнена или у слушателя max-sessions
+            //     сессий - новые соединения ждут в очереди listen, пока не
+            //     освободится место. После передачи слушающих сокетов новому
+            //     процессу (см. takeover) соединения принимает только он.
+            for(size_t k = 0; k < this->listen_sds.size(); k++) {
+                boost::uint32_t const max_sessions =
+                        this->cfg->route(k).max_sessions;
+
+                this->fds[LISTEN_INDEX + k].events =
+                        (!this->pi->draining &&
+                         this->nfds < POLLING_REQUESTS_SIZE - 1 &&
+                         (!max_sessions ||
+                          this->listen_sessions[k] < max_sessions)) ?
+                            POLLIN : 0;
+            }
+
+            if(this->drain_started &&
+               this->db.empty() && this->db_for_close.empty()) {
+                // RU: Последняя сессия закрыта
+                this->l.get()->info_drained(__FILE__, __LINE__);
+                this->pi->end_proxy = true;
+                break;
+            }
+
             int rc = ::poll(this->fds, this->nfds, this->timeout);
+
+            this->now_ms = timer_wheel::now();
+            (void) this->cfg.refresh();
+
             if(rc < 0) {
                 this->l.get()->error_poll_failed(__FILE__, __LINE__, errno);
                 this->pi->c_last_err = RES_CODE_ERROR;
@@ -245,7 +246,9 @@ namespace proxy_ns {
                 if(min_descriptors_count_ro == this->nfds) {
                     connects_present();
                 }
-                else if(min_descriptors_count_rw == this->nfds) {
+                else if(min_descriptors_count_rw == this->nfds &&
+                        this->s_out_queue.empty()) {
+                    // RU: Пока очередь не пуста, канал остаётся в опросе
                     connects_absence();
                 }
 
@@ -259,9 +262,23 @@ namespace proxy_ns {
                         this->l.get()->debug_revent_includes_pollhup(
                                     __FILE__, __LINE__, this->fds[i].fd);
 
-                        if(this->fds[i].fd != this->listen_sd &&
+                        if(!this->is_listen_slot(i) &&
                            this->fds[i].fd != this->s_in_fd &&
-                           this->fds[i].fd != this->w_in_fd) {
+                           this->fds[i].fd != this->w_in_fd &&
+                           (this->fds[i].revents & POLLIN)) {
+                            // RU: Клиент (через unix-сокет) мог отправить
+                            //     последний запрос и сразу закрыть
+                            //     соединение. Данные дочитываются ниже, а
+                            //     конец данных закроет сессию обычным путём
+                            //     (recv вернёт 0).
+                        }
+                        else if(!this->is_listen_slot(i) &&
+                                this->fds[i].fd != this->s_in_fd &&
+                                this->fds[i].fd != this->w_in_fd) {
+                            if(proxy_impl::peer_reset(this->fds[i].fd)) {
+                                metrics_ns::counter_add(
+                                    metrics_ns::COUNTER_CLIENT_RESETS);
+                            }
                             this->send_disconnect(this->fds[i].fd,
                                                   this->db[this->fds[i].fd]);
                             this->calculate_count_lost(this->fds[i].fd);
@@ -281,9 +298,13 @@ namespace proxy_ns {
                     else if(this->fds[i].revents & POLLERR) {
                         this->l.get()->debug_revent_includes_pollerr(
                                     __FILE__, __LINE__, this->fds[i].fd);
-                        if(this->fds[i].fd != this->listen_sd &&
+                        if(!this->is_listen_slot(i) &&
                            this->fds[i].fd != this->s_in_fd &&
                            this->fds[i].fd != this->w_in_fd) {
+                            if(proxy_impl::peer_reset(this->fds[i].fd)) {
+                                metrics_ns::counter_add(
+                                    metrics_ns::COUNTER_CLIENT_RESETS);
+                            }
                             this->send_disconnect(this->fds[i].fd,
                                                   this->db[this->fds[i].fd]);
                             this->calculate_count_lost(this->fds[i].fd);
@@ -317,8 +338,8 @@ namespace proxy_ns {
                         continue;
                     }
 
-                    if(this->cur_fd == this->listen_sd) {
-                        this->new_connect();
+                    if(this->is_listen_slot(i)) {
+                        this->accept_connects(i - LISTEN_INDEX);
                     }
                     else if(this->cur_fd == this->s_in_fd) {
                         this->from_server();
@@ -327,17 +348,20 @@ namespace proxy_ns {
                         this->from_worker();
                     }
                     else if(this->cur_fd == this->s_out_fd) {
-                        this->s_write_enable =
-                                this->pi->can_write_to_pipe_data(
-                                    this->cur_fd, data_size);
-                    }
-                    else if(this->cur_fd == this->w_out_fd) {
-                        this->w_write_enable =
+                        this->flush_s_out_queue();
+
+                        // RU: Чтение новых данных приостанавливается до
+                        //     разбора очереди. Решение принимается один раз
+                        //     за проход: иначе первые в таблице сессии
+                        //     занимали бы канал, а остальные не читались.
+                        this->s_write_enable = this->s_out_queue.empty() &&
                                 this->pi->can_write_to_pipe_data(
                                     this->cur_fd, data_size);
                     }
                     else {
-                        if(this->s_write_enable && this->w_write_enable) {
+                        // RU: Воркер не влияет на пересылку данных: копия
+                        //     трафика для него никогда не блокирует.
+                        if(this->s_write_enable) {
                             this->from_clients();
                         }
                     }
@@ -348,6 +372,15 @@ namespace proxy_ns {
                     this->compress_array();
                 }
             }
+
+            if(this->timers.size()) {
+                this->expire_timers();
+
+                if(this->flag_compress_array) {
+                    this->flag_compress_array = false;
+                    this->compress_array();
+                }
+            }
         }
     }
 
@@ -375,25 +408,130 @@ namespace proxy_ns {
     /* ***************************************************************** */
 
     ///
-    /// \brief client_logic::new_connect
+    /// \brief client_logic::open_listen
+    /// \param c
+    /// \return
     ///
-    void client_logic::new_connect(void) {
+    int client_logic::open_listen(listener_config const& c) {
+        int rc_ = RES_CODE_OK;
+        int rc = 0;
+        int listen_sd = -1;
+
+        struct sockaddr_storage const& addr = c.listen_addr;
+
+        listen_sd = ::socket(addr.ss_family, SOCK_STREAM, 0);
+        if(listen_sd < 0) {
+            this->l.get()->error_socket_failed(
+                        __FILE__, __LINE__, errno, listen_sd);
+            this->pi->c_last_err = RES_CODE_ERROR;
+            throw Eclient_logic_fatal();
+        }
+
+        // Re-use addr
+        rc_ = this->pi->set_reuseaddr(listen_sd, true,
+            this->pi->fok_placeholder,
+            [this, &listen_sd](int rc, int err) {
+                boost::ignore_unused(rc);
+                this->l.get()->error_setsockopt_failed(
+                        __FILE__, __LINE__, err, listen_sd);
+            });
+
+        if(RES_CODE_OK != rc_) {
+            (void) ::close(listen_sd);
+            this->pi->c_last_err = RES_CODE_ERROR;
+            throw Eclient_logic_fatal();
+        }
+
+        // Nonblock
+        rc_ = this->pi->set_nonblock(listen_sd,
+            this->pi->fok_placeholder,
+            [this, &listen_sd](int rc, int err) {
+                boost::ignore_unused(rc);
+                this->l.get()->error_ioctl_or_fcntl_failed(
+                        __FILE__, __LINE__, err, listen_sd);
+            });
+
+        if(RES_CODE_OK != rc_) {
+            (void) ::close(listen_sd);
+            this->pi->c_last_err = RES_CODE_ERROR;
+            throw Eclient_logic_fatal();
+        }
+
+        // RU: Параметры слушателя (TCP_DEFER_ACCEPT, TCP_FASTOPEN, буферы)
+        //     наследуются принятыми сокетами
+        (void) sockopt_apply(listen_sd, c.client_opts, SOCKOPT_LISTEN,
+            address_is_tcp(addr),
+            [this, &listen_sd](char const* name, int err) {
+                this->l.get()->error_sockopt_failed(
+                        __FILE__, __LINE__, err, listen_sd, name);
+            });
+
+        if(address_unlink_stale(addr)) {
+            this->l.get()->info_stale_socket_removed(__FILE__, __LINE__, addr);
+        }
+
+        rc = ::bind(listen_sd,
+                    reinterpret_cast<struct sockaddr const*>(&addr),
+                    address_length(addr));
+        if(rc < 0) {
+            this->l.get()->error_bind_failed(
+                        __FILE__, __LINE__, errno, listen_sd);
+            (void) ::close(listen_sd);
+            this->pi->c_last_err = RES_CODE_ERROR;
+            throw Eclient_logic_fatal();
+        }
+
+        // RU: Права на файл unix-сокета (connect требует права на запись)
+        if(AF_UNIX == addr.ss_family && c.listen_mode) {
+            rc = ::chmod(reinterpret_cast<struct sockaddr_un const&>(
+                             addr).sun_path, c.listen_mode);
+            if(rc < 0) {
+                this->l.get()->error_chmod_failed(
+                            __FILE__, __LINE__, errno, listen_sd);
+                (void) ::close(listen_sd);
+                this->pi->c_last_err = RES_CODE_ERROR;
+                throw Eclient_logic_fatal();
+            }
+        }
+
+        rc = ::listen(listen_sd, SOMAXCONN);
+        if(rc < 0) {
+            this->l.get()->error_listen_failed(
+                        __FILE__, __LINE__, errno, listen_sd);
+            (void) ::close(listen_sd);
+            this->pi->c_last_err = RES_CODE_ERROR;
+            throw Eclient_logic_fatal();
+        }
+
+        return listen_sd;
+    }
+
+    ///
+    /// \brief client_logic::accept_connects
+    /// \param index
+    ///
+    void client_logic::accept_connects(size_t index) {
         int new_sd = -1;
-        struct sockaddr_in client_addr;
+        struct sockaddr_storage client_addr;
         socklen_t client_addr_len = 0;
         int val = 0;
         int rc_ = RES_CODE_OK;
+        struct ucred peer;
+
+        int const listen_sd = this->listen_sds[index];
+        boost::uint32_t const max_sessions =
+                this->cfg->route(index).max_sessions;
 
         this->l.get()->debug_listen_socket_readable(
-                    __FILE__, __LINE__, this->listen_sd);
+                    __FILE__, __LINE__, listen_sd);
 
         do {
             std::fill_n(reinterpret_cast<char*>(&client_addr),
                         sizeof(client_addr), '\0');
 
-            client_addr_len = 0;
+            client_addr_len = sizeof(client_addr);
 
-            new_sd = ::accept(this->listen_sd,
+            new_sd = ::accept(listen_sd,
                               reinterpret_cast<struct sockaddr*>(
                                   &client_addr),
                               &client_addr_len);
@@ -421,89 +559,140 @@ namespace proxy_ns {
                     throw Eclient_logic_fatal();
                 }
 
-                // Keep alive
-                rc_ = this->pi->set_keep_alive(new_sd,
-                    this->pi->client_keep_alive,
-                    this->pi->fok_placeholder,
-                    [this, &new_sd](int rc, int err) {
-                        boost::ignore_unused(rc);
-                        this->l.get()->error_setsockopt_failed(
-                                __FILE__, __LINE__, err, new_sd);
-                    });
-
-                if(RES_CODE_OK != rc_) {
-                    (void) ::close(new_sd);
-                    this->pi->c_last_err = RES_CODE_ERROR;
-                    throw Eclient_logic_fatal();
-                }
+                // RU: Клиент unix-сокета: проверить его uid/gid
+                if(AF_UNIX == client_addr.ss_family) {
+                    socklen_t peer_len = sizeof(peer);
 
-                rc_ = this->pi->get_keep_alive(new_sd, val,
-                    this->pi->fok_placeholder,
-                    [this, &new_sd](int rc, int err) {
-                        boost::ignore_unused(rc);
+                    if(::getsockopt(new_sd, SOL_SOCKET, SO_PEERCRED,
+                                    &peer, &peer_len) < 0) {
                         this->l.get()->error_getsockopt_failed(
-                                __FILE__, __LINE__, err, new_sd);
-                    });
+                                    __FILE__, __LINE__, errno, new_sd);
+                        (void) ::close(new_sd);
+                        continue;
+                    }
 
-                if(RES_CODE_OK != rc_) {
-                    (void) ::close(new_sd);
-                    this->pi->c_last_err = RES_CODE_ERROR;
-                    throw Eclient_logic_fatal();
-                }
-                else {
-                    this->l.get()->debug_keep_alive_onoff(
-                                __FILE__, __LINE__, val, new_sd);
-                }
+                    bool const allowed = this->cfg->route(index).peer_allowed(
+                                peer.uid, peer.gid);
 
-                // TCP no delay (Nagle's algorithm)
-                rc_ = this->pi->set_tcp_no_delay(new_sd,
-                    this->pi->client_tcp_no_delay,
-                    this->pi->fok_placeholder,
-                    [this, &new_sd](int rc, int err) {
-                        boost::ignore_unused(rc);
-                        this->l.get()->error_setsockopt_failed(
-                                __FILE__, __LINE__, err, new_sd);
-                    });
+                    this->l.get()->info_peer_credentials(
+                                __FILE__, __LINE__, new_sd, peer, allowed);
 
-                if(RES_CODE_OK != rc_) {
-                    (void) ::close(new_sd);
-                    this->pi->c_last_err = RES_CODE_ERROR;
-                    throw Eclient_logic_fatal();
+                    if(!allowed) {
+                        metrics_ns::counter_add(
+                            metrics_ns::COUNTER_PEER_REJECTED, 1);
+                        (void) ::close(new_sd);
+                        continue;
+                    }
                 }
 
-                rc_ = this->pi->get_tcp_no_delay(new_sd, val,
-                    this->pi->fok_placeholder,
-                    [this, &new_sd](int rc, int err) {
-                        boost::ignore_unused(rc);
-                        this->l.get()->error_getsockopt_failed(
-                                __FILE__, __LINE__, err, new_sd);
-                    });
+                if(address_is_tcp(client_addr)) {
+                    // Keep alive
+                    rc_ = this->pi->set_keep_alive(new_sd,
+                        this->pi->client_keep_alive,
+                        this->pi->fok_placeholder,
+                        [this, &new_sd](int rc, int err) {
+                            boost::ignore_unused(rc);
+                            this->l.get()->error_setsockopt_failed(
+                                    __FILE__, __LINE__, err, new_sd);
+                        });
+
+                    if(RES_CODE_OK != rc_) {
+                        (void) ::close(new_sd);
+                        this->pi->c_last_err = RES_CODE_ERROR;
+                        throw Eclient_logic_fatal();
+                    }
 
-                if(RES_CODE_OK != rc_) {
-                    (void) ::close(new_sd);
-                    this->pi->c_last_err = RES_CODE_ERROR;
-                    throw Eclient_logic_fatal();
-                }
-                else {
-                    this->l.get()->debug_tcp_no_delay_onoff(
-                                __FILE__, __LINE__, val, new_sd);
+                    rc_ = this->pi->get_keep_alive(new_sd, val,
+                        this->pi->fok_placeholder,
+                        [this, &new_sd](int rc, int err) {
+                            boost::ignore_unused(rc);
+                            this->l.get()->error_getsockopt_failed(
+                                    __FILE__, __LINE__, err, new_sd);
+                        });
+
+                    if(RES_CODE_OK != rc_) {
+                        (void) ::close(new_sd);
+                        this->pi->c_last_err = RES_CODE_ERROR;
+                        throw Eclient_logic_fatal();
+                    }
+                    else {
+                        this->l.get()->debug_keep_alive_onoff(
+                                    __FILE__, __LINE__, val, new_sd);
+                    }
+
+                    // TCP no delay (Nagle's algorithm)
+                    rc_ = this->pi->set_tcp_no_delay(new_sd,
+                        this->pi->client_tcp_no_delay,
+                        this->pi->fok_placeholder,
+                        [this, &new_sd](int rc, int err) {
+                            boost::ignore_unused(rc);
+                            this->l.get()->error_setsockopt_failed(
+                                    __FILE__, __LINE__, err, new_sd);
+                        });
+
+                    if(RES_CODE_OK != rc_) {
+                        (void) ::close(new_sd);
+                        this->pi->c_last_err = RES_CODE_ERROR;
+                        throw Eclient_logic_fatal();
+                    }
+
+                    rc_ = this->pi->get_tcp_no_delay(new_sd, val,
+                        this->pi->fok_placeholder,
+                        [this, &new_sd](int rc, int err) {
+                            boost::ignore_unused(rc);
+                            this->l.get()->error_getsockopt_failed(
+                                    __FILE__, __LINE__, err, new_sd);
+                        });
+
+                    if(RES_CODE_OK != rc_) {
+                        (void) ::close(new_sd);
+                        this->pi->c_last_err = RES_CODE_ERROR;
+                        throw Eclient_logic_fatal();
+                    }
+                    else {
+                        this->l.get()->debug_tcp_no_delay_onoff(
+                                    __FILE__, __LINE__, val, new_sd);
+                    }
+
+                    (void) sockopt_apply(new_sd,
+                        this->cfg->route(index).client_opts, SOCKOPT_ACCEPT,
+                        true,
+                        [this, &new_sd](char const* name, int err) {
+                            this->l.get()->error_sockopt_failed(
+                                    __FILE__, __LINE__, err, new_sd, name);
+                        });
                 }
 
+                this->tap[new_sd] = this->pi->tap_sampled(&client_addr);
+                this->route[new_sd] = index;
+
+                this->pi->sessions.open(
+                    new_sd, &client_addr, this->tap[new_sd],
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::system_clock::now().
+                            time_since_epoch()).count(),
+                    &peer);
+
+                TRACE_PROBE3(accept, new_sd,
+                             AF_INET == client_addr.ss_family ?
+                                 reinterpret_cast<struct sockaddr_in&>(
+                                     client_addr).sin_addr.s_addr : 0,
+                             address_port(client_addr));
+
                 this->send_new_connect(new_sd, -1,
                                        0, nullptr,
                                        &client_addr,
-                                       &this->proxy_addr,
+                                       &this->listen_addrs[index],
                                        nullptr);
 
                 this->l.get()->info_new_incoming_connection(
-                            __FILE__, __LINE__, new_sd,
-                            inet_ntoa(client_addr.sin_addr),
-                            ntohs(client_addr.sin_port));
+                            __FILE__, __LINE__, new_sd, client_addr);
 
                 this->new_connect(new_sd);
             }
         }
-        while(new_sd != -1);
+        while(new_sd != -1 && this->nfds < POLLING_REQUESTS_SIZE - 1 &&
+              (!max_sessions || this->listen_sessions[index] < max_sessions));
     }
 
     ///
@@ -563,7 +752,7 @@ namespace proxy_ns {
     /// \brief client_logic::from_clients
     ///
     void client_logic::from_clients(void) {
-        struct sockaddr_in client_addr;
+        struct sockaddr_storage client_addr;
         socklen_t client_addr_len = sizeof(client_addr);
         bool close_conn = false;
         bool cont = true;
@@ -604,18 +793,23 @@ namespace proxy_ns {
                 buf = const_cast<unsigned char*>(this->get_data_storage(
                                                  this->cur_fd, buf_size));
 
-                rc = ::send(this->cur_fd, buf + index, buf_size, 0);
+                rc = ::send(this->cur_fd, buf + index, buf_size,
+                            MSG_NOSIGNAL);
                 if(rc < 0) {
-                    if(errno != EWOULDBLOCK) {
-                        this->l.get()->error_send_failed(
-                                    __FILE__, __LINE__,
-                                    errno,
-                                    this->cur_fd);
+                    if(errno != EWOULDBLOCK && errno != EINTR) {
+                        // RU: Клиент пропал - закрывается только его сессия
+                        this->close_broken(this->cur_fd, errno);
+                        return;
                     }
                 }
                 else {
                     // Отправка данных удалась
                     this->counter_sent[this->cur_fd] += rc;
+                    this->touch(this->cur_fd);
+                    TRACE_PROBE2(client_send, this->cur_fd, rc);
+                    this->pi->sessions.add_out(this->cur_fd, rc);
+                    metrics_ns::counter_add(
+                        metrics_ns::COUNTER_CLIENT_BYTES_SENT, rc);
                     if(static_cast<unsigned int>(rc) != buf_size) {
                         // RU: не все данные отправлены
                         buf_size = buf_size - rc;
@@ -638,6 +832,8 @@ namespace proxy_ns {
                         this->delete_data_storage(this->cur_fd);
                     }
                 }
+
+                this->response_flushed(this->cur_fd);
             }
 
             if(for_close && this->empty_data_storage(this->cur_fd)) {
@@ -731,7 +927,15 @@ namespace proxy_ns {
                                                    buf_size,
                                 [this, &close_conn, &cont](int err) -> void {
                                     // rc < 0
-                                    if(err != EWOULDBLOCK) {
+                                    if(err == ECONNRESET) {
+                                        this->l.get()->info_peer_reset(
+                                            __FILE__, __LINE__, err,
+                                            this->cur_fd);
+                                        metrics_ns::counter_add(
+                                            metrics_ns::COUNTER_CLIENT_RESETS);
+                                        close_conn = true;
+                                    }
+                                    else if(err != EWOULDBLOCK) {
                                         this->l.get()->error_recv_failed(
                                             __FILE__, __LINE__, err,
                                             this->cur_fd);
@@ -751,7 +955,8 @@ namespace proxy_ns {
                                     this->send_data(this->cur_fd, srv_cur_fd,
                                                     len, buf,
                                                     &client_addr,
-                                                    &this->proxy_addr,
+                                                    this->proxy_addr_of(
+                                                        this->cur_fd),
                                                     nullptr);
                             });
                         }
@@ -763,7 +968,7 @@ namespace proxy_ns {
         if(close_conn) {
             this->send_disconnect(this->cur_fd, this->db[this->cur_fd],
                     0, nullptr,
-                    &client_addr, &this->proxy_addr, nullptr);
+                    &client_addr, this->proxy_addr_of(this->cur_fd), nullptr);
 
             this->calculate_count_lost(this->cur_fd);
 
@@ -788,6 +993,7 @@ namespace proxy_ns {
         if(search != this->db.end()) {
             // RU: Соединение найдено
             this->db[d.c_sd] = d.s_sd;
+            this->pi->sessions.set_server(d.c_sd, d.s_sd);
         }
         else {
             // RU: Найти подобное соединение не удалось
@@ -797,7 +1003,7 @@ namespace proxy_ns {
             this->send_connect_not_found(d.c_sd, d.s_sd,
                                          0, nullptr,
                                          nullptr,
-                                         &this->proxy_addr,
+                                         this->proxy_addr_of(d.c_sd),
                                          nullptr);
         }
     }
@@ -817,12 +1023,17 @@ namespace proxy_ns {
             bool direct = true;
             int client_index = this->find_pollfd(d.c_sd);
 
+            // RU: Сервер отвечает на запрос
+            this->request_since.erase(d.c_sd);
+
             if(client_index >= 0) {
                 if(this->fds[client_index].revents & POLLOUT) {
                     auto search = db.find(d.c_sd);
                     if(search != db.end()) {
                         // RU: Соединение найдено.
                         //     Отправить данные клиенту
+                        this->response_since.emplace(d.c_sd, d.timestamp);
+
                         if(this->empty_data_storage(d.c_sd)) {
                             // No unsent data are present
                             buf = const_cast<unsigned char*>(&d.buffer[index]);
@@ -838,13 +1049,15 @@ namespace proxy_ns {
                                             d.c_sd, buf_size));
 
                             direct = false;
-                        //}
+                        }
 
-                        int rc = ::send(d.c_sd, buf, buf_size, 0);
+                        int rc = ::send(d.c_sd, buf, buf_size, MSG_NOSIGNAL);
                         if(rc < 0) {
-                            if(errno != EWOULDBLOCK) {
-                                this->l.get()->error_send_failed(
-                                            __FILE__, __LINE__, errno, d.c_sd);
+                            if(errno != EWOULDBLOCK && errno != EINTR) {
+                                // RU: Клиент пропал - закрывается только
+                                //     его сессия
+                                this->close_broken(d.c_sd, errno);
+                                return;
                             }
                             else {
                                 if(direct) {
@@ -864,6 +1077,11 @@ namespace proxy_ns {
                         else {
                             // Отправка данных удалась
                             this->counter_sent[d.c_sd] += rc;
+                            this->touch(d.c_sd);
+                            TRACE_PROBE2(client_send, d.c_sd, rc);
+                            this->pi->sessions.add_out(d.c_sd, rc);
+                            metrics_ns::counter_add(
+                                metrics_ns::COUNTER_CLIENT_BYTES_SENT, rc);
                             if(static_cast<unsigned int>(rc) != buf_size) {
                                 // RU: не все данные отправлены
                                 buf_size = buf_size - rc;
@@ -894,6 +1112,8 @@ namespace proxy_ns {
 
                             direct = false;
                         }
+
+                        this->response_flushed(d.c_sd);
                     }
                     else {
                         this->l.get()->error_unknown_socket_descriptor(
@@ -902,7 +1122,8 @@ namespace proxy_ns {
                         this->send_connect_not_found(d.c_sd, d.s_sd,
                                                      0, nullptr,
                                                      nullptr,
-                                                     &this->proxy_addr,
+                                                     this->proxy_addr_of(
+                                                         d.c_sd),
                                                      nullptr);
                     }
                 }
@@ -934,6 +1155,14 @@ namespace proxy_ns {
         this->l.get()->debug_signal_server_disconnect(
                     __FILE__, __LINE__, d.c_sd, d.s_sd);
 
+        // RU: Клиент мог закрыть сессию одновременно с сервером - тогда
+        //     дескриптор уже закрыт (или занят новой сессией)
+        auto search = this->db.find(d.c_sd);
+        if(search == this->db.end() ||
+           (search->second >= 0 && search->second != d.s_sd)) {
+            return;
+        }
+
         this->close_connect(d.c_sd);
     }
 
@@ -955,8 +1184,9 @@ namespace proxy_ns {
     void client_logic::compress_array(void) {
         for(int i = 0; i < this->nfds;) {
             if(this->fds[i].fd == -1) {
-                for(int j = i; j < this->nfds; j++) {
-                    this->fds[j].fd = this->fds[j + 1].fd;
+                // RU: Сдвигается весь pollfd - events у слотов разные
+                for(int j = i; j < this->nfds - 1; j++) {
+                    this->fds[j] = this->fds[j + 1];
                 }
                 this->nfds--;
             }
@@ -966,6 +1196,183 @@ namespace proxy_ns {
         }
     }
 
+    ///
+    /// \brief client_logic::close_broken - send to the client failed
+    /// \param d - client socket descriptor
+    /// \param err - errno of the failed send
+    ///
+    /// RU: Клиент сбросил соединение (EPIPE/ECONNRESET) или сокет сломан
+    ///     иначе - закрывается только эта сессия, процесс продолжает работу.
+    ///
+    void client_logic::close_broken(int d, int err) {
+        if(err == EPIPE || err == ECONNRESET) {
+            this->l.get()->info_peer_reset(__FILE__, __LINE__, err, d);
+            metrics_ns::counter_add(metrics_ns::COUNTER_CLIENT_RESETS);
+        }
+        else {
+            this->l.get()->error_send_failed(__FILE__, __LINE__, err, d);
+        }
+
+        auto search_srv = this->db.find(d);
+        if(search_srv != this->db.end()) {
+            this->send_disconnect(d, search_srv->second);
+        }
+
+        this->calculate_count_lost(d);
+        this->l.get()->info_connect_close(
+            __FILE__, __LINE__, d,
+            this->counter_sent[d],
+            this->counter_recv[d],
+            this->counter_buffered[d],
+            this->counter_lost[d]);
+        this->close_connect_force(d);
+    }
+
+    ///
+    /// \brief client_logic::expire_timers
+    ///
+    void client_logic::expire_timers(void) {
+        timer_wheel::expired e;
+
+        while(this->timers.expire(this->now_ms, e)) {
+            if(e.kind == TIMER_DRAIN) {
+                this->drain_sessions();
+                continue;
+            }
+
+            auto search = this->idle.find(e.key);
+            if(e.kind != TIMER_IDLE || search == this->idle.end() ||
+               search->second.timer != e.id) {
+                this->l.get()->error_inernal_error(__FILE__, __LINE__);
+                continue;
+            }
+
+            boost::int32_t const idle_timeout =
+                    this->cfg->route(this->route_of(e.key)).client_idle_timeout;
+
+            if(idle_timeout <= 0) {
+                // RU: Таймаут выключен при перечитывании конфигурации
+                this->idle.erase(search);
+                continue;
+            }
+
+            boost::uint64_t const deadline =
+                    search->second.last_ms + idle_timeout;
+
+            if(deadline > this->now_ms) {
+                // RU: Сессия была активна - ждём оставшийся срок
+                search->second.timer = this->timers.arm(
+                            deadline, TIMER_IDLE, e.key);
+                continue;
+            }
+
+            if(this->request_since.count(e.key)) {
+                // RU: Запрос ждёт ответа сервера - сессия не простаивает,
+                //     долгий запрос ограничивает только query_timeout
+                search->second.timer = this->timers.arm(
+                            this->now_ms + idle_timeout,
+                            TIMER_IDLE, e.key);
+                continue;
+            }
+
+            this->l.get()->info_idle_timeout(__FILE__, __LINE__, e.key,
+                                             idle_timeout);
+
+            metrics_ns::counter_add(metrics_ns::COUNTER_SESSIONS_IDLE_CLOSED);
+
+            // RU: Если сервер уже закрыл свою сторону (сессия ждёт
+            //     отправки остатка данных), сообщать ему не о чем
+            auto search_srv = this->db.find(e.key);
+            if(search_srv != this->db.end()) {
+                this->send_disconnect(e.key, search_srv->second);
+            }
+
+            this->calculate_count_lost(e.key);
+            this->l.get()->info_connect_close(
+                __FILE__, __LINE__, e.key,
+                this->counter_sent[e.key],
+                this->counter_recv[e.key],
+                this->counter_buffered[e.key],
+                this->counter_lost[e.key]);
+            this->close_connect_force(e.key);
+        }
+    }
+
+    ///
+    /// \brief client_logic::drain_start
+    ///
+    /// RU: Слушающий сокет закрывается: балансировщик сразу получает отказ
+    ///     и переводит нагрузку. После takeover сокет остаётся открытым в
+    ///     новом процессе - закрывается только наш дескриптор.
+    ///
+    void client_logic::drain_start(void) {
+        // RU: poll пропускает отрицательные дескрипторы, а -1 означает
+        //     удалённый слот (compress_array). Слоты слушающих сокетов
+        //     остаются на месте - первые слоты таблицы фиксированы.
+        static int const closed_sd = -2;
+
+        this->drain_started = true;
+
+        for(size_t i = 0; i < this->listen_sds.size(); i++) {
+            if(this->listen_sds[i] >= 0) {
+                this->pi->listen_fd[i] = -1;
+                (void) ::close(this->listen_sds[i]);
+                this->listen_sds[i] = -1;
+            }
+
+            this->fds[LISTEN_INDEX + i].fd = closed_sd;
+            this->fds[LISTEN_INDEX + i].events = 0;
+        }
+
+        // RU: Даже тихая сессия получает DRAIN_QUIET_TIME на ответ, который
+        //     мог быть ещё в пути
+        for(auto const& x : this->db) {
+            this->drain[x.first] = this->now_ms;
+        }
+
+        this->l.get()->info_drain_start(__FILE__, __LINE__,
+                                        this->db.size() +
+                                        this->db_for_close.size());
+
+        (void) this->timers.arm(this->now_ms + DRAIN_CHECK_INTERVAL,
+                                TIMER_DRAIN, 0);
+    }
+
+    ///
+    /// \brief client_logic::drain_sessions
+    ///
+    void client_logic::drain_sessions(void) {
+        std::vector<int> quiet;
+
+        for(auto const& x : this->drain) {
+            auto search = this->db.find(x.first);
+
+            if(search == this->db.end() ||
+               search->second < 0 ||
+               this->request_since.count(x.first) ||
+               !this->empty_data_storage(x.first) ||
+               this->now_ms < x.second + DRAIN_QUIET_TIME) {
+                // RU: Сервер ещё не подключён, запрос ждёт ответа, ответ
+                //     не отправлен клиенту или обмен идёт прямо сейчас
+                continue;
+            }
+
+            quiet.push_back(x.first);
+        }
+
+        for(int d : quiet) {
+            this->l.get()->info_drain_close(__FILE__, __LINE__, d);
+
+            metrics_ns::counter_add(metrics_ns::COUNTER_SESSIONS_DRAINED);
+
+            this->send_disconnect(d, this->db[d]);
+            this->close_connect(d);
+        }
+
+        (void) this->timers.arm(this->now_ms + DRAIN_CHECK_INTERVAL,
+                                TIMER_DRAIN, 0);
+    }
+
     /* ***************************************************************** */
     /* ********************** CLASS: client_logic ********************** */
     /* **************************** PRIVATE **************************** */
@@ -977,13 +1384,46 @@ namespace proxy_ns {
         this->counter_buffered[d] = 0;
         this->counter_lost[d] = 0;
 
+        metrics_ns::counter_add(metrics_ns::COUNTER_SESSIONS_ACCEPTED);
+        metrics_ns::gauge_add(metrics_ns::GAUGE_SESSIONS_ACTIVE, 1);
+
         std::deque<boost::shared_ptr<std::vector<unsigned char>>> q;
         this->storage[d] = q;
 
         this->db[d] = -1;
+
+        size_t const index = this->route_of(d);
+        boost::int32_t const idle_timeout =
+                this->cfg->route(index).client_idle_timeout;
+
+        if(index < this->listen_sessions.size()) {
+            this->listen_sessions[index]++;
+        }
+
+        if(LISTEN_INDEX + static_cast<int>(this->listen_sds.size()) ==
+           this->nfds) {
+            // RU: Клиентские сокеты идут после s_out (см. run). Последняя
+            //     сессия могла закрыться в этом же проходе, и s_out уже
+            //     убран из массива.
+            this->fds[this->nfds].fd = this->s_out_fd;
+            this->fds[this->nfds].events = POLLOUT;
+            this->fds[this->nfds].revents = 0;
+            this->nfds++;
+        }
+
         this->fds[this->nfds].fd = d;
         this->fds[this->nfds].events = POLLIN | POLLOUT;
+        this->fds[this->nfds].revents = 0;
         this->nfds++;
+
+        if(idle_timeout > 0) {
+            idle_state x;
+            x.timer = this->timers.arm(
+                        this->now_ms + idle_timeout,
+                        TIMER_IDLE, d);
+            x.last_ms = this->now_ms;
+            this->idle[d] = x;
+        }
     }
 
     void client_logic::close_connect(int d) {
@@ -1005,27 +1445,98 @@ namespace proxy_ns {
         }
     }
 
+    ///
+    /// \brief client_logic::is_listen_slot
+    /// \param i - index in fds
+    /// \return
+    ///
+    bool client_logic::is_listen_slot(int i) const {
+        return i >= LISTEN_INDEX &&
+               i < LISTEN_INDEX + static_cast<int>(this->listen_sds.size());
+    }
+
+    ///
+    /// \brief client_logic::route_of - listener of a session
+    /// \param d - client socket descriptor
+    /// \return listener index ([0] if the session is unknown)
+    ///
+    size_t client_logic::route_of(int d) const {
+        auto search = this->route.find(d);
+
+        return search != this->route.end() ? search->second : 0;
+    }
+
+    ///
+    /// \brief client_logic::proxy_addr_of - local address of a session
+    /// \param d - client socket descriptor
+    /// \return
+    ///
+    struct sockaddr_storage const* client_logic::proxy_addr_of(int d) const {
+        size_t const index = this->route_of(d);
+
+        return index < this->listen_addrs.size() ?
+                    &this->listen_addrs[index] : nullptr;
+    }
+
     void client_logic::close_connect_force(int d) {
         int count = this->nfds;
         for(int i = 0; i < count; i++) {
             if(this->fds[i].fd == d) {
+               // RU: Сессия может закрываться при обработке другого
+               //     дескриптора - события этого poll ей уже не нужны
                this->fds[i].fd = -1;
+               this->fds[i].revents = 0;
                this->flag_compress_array = true;
                break;
             }
         }
 
+        this->pi->sessions.close(d);
+
+        // RU: Счётчики нельзя трогать через [] - это добавит запись
+        //     для уже закрытой сессии
+        if(TRACE_ENABLED(session_close)) {
+            TRACE_PROBE3(session_close, d,
+                         this->counter_sent.count(d) ?
+                            this->counter_sent.at(d) : 0,
+                         this->counter_recv.count(d) ?
+                            this->counter_recv.at(d) : 0);
+        }
+
         (void) ::close(d);
 
         this->db.erase(d);
+        this->tap.erase(d);
         this->db_for_close.remove(d);
+
+        auto search_route = this->route.find(d);
+        if(search_route != this->route.end()) {
+            if(search_route->second < this->listen_sessions.size()) {
+                this->listen_sessions[search_route->second]--;
+            }
+
+            this->route.erase(search_route);
+        }
         this->clear_data_storage(d);
         this->storage.erase(d);
 
-        this->counter_sent.erase(d);
+        if(this->counter_sent.erase(d)) {
+            metrics_ns::counter_add(metrics_ns::COUNTER_SESSIONS_CLOSED);
+            metrics_ns::gauge_add(metrics_ns::GAUGE_SESSIONS_ACTIVE, -1);
+        }
+
         this->counter_recv.erase(d);
         this->counter_buffered.erase(d);
         this->counter_lost.erase(d);
+        this->response_since.erase(d);
+        this->request_since.erase(d);
+        this->drain.erase(d);
+
+        auto search = this->idle.find(d);
+        if(search != this->idle.end()) {
+            this->timers.cancel(search->second.timer);
+            this->idle.erase(search);
+        }
     }
 
     bool client_logic::save_new_data_storage(int d, unsigned char const* buf,
@@ -1041,6 +1552,9 @@ namespace proxy_ns {
             search->second.push_back(v);
 
             this->counter_buffered[d] += size;
+            TRACE_PROBE2(client_enqueue, d, size);
+
+            metrics_ns::counter_add(metrics_ns::COUNTER_BYTES_BUFFERED, size);
 
             return true;
         }
@@ -1061,6 +1575,9 @@ namespace proxy_ns {
             search->second.push_front(v);
 
             this->counter_buffered[d] += size;
+            TRACE_PROBE2(client_enqueue, d, size);
+
+            metrics_ns::counter_add(metrics_ns::COUNTER_BYTES_BUFFERED, size);
 
             return true;
         }
@@ -1085,6 +1602,11 @@ namespace proxy_ns {
     bool client_logic::delete_data_storage(int d) {
         auto search = storage.find(d);
         if(search != storage.end()) {
+            if(TRACE_ENABLED(client_dequeue)) {
+                TRACE_PROBE2(client_dequeue, d,
+                             search->second.empty() ?
+                                0 : search->second.front().get()->size());
+            }
             search->second.pop_front();
             return true;
         }
@@ -1121,17 +1643,7 @@ namespace proxy_ns {
     }
 
     int client_logic::find_pollfd(int d) const {
-        int res_index = -1;
-
-        int count = this->nfds;
-        for(int i = 0; i < count; i++) {
-            if(this->fds[i].fd == d) {
-               res_index = i;
-               break;
-            }
-        }
-
-        return res_index;
+        return proxy_ns::find_pollfd_index(this->fds, this->nfds, d);
     }
 
     void client_logic::calculate_count_lost(int d) {
@@ -1140,16 +1652,55 @@ namespace proxy_ns {
             this->counter_lost[d] = 0;
         }
         else {
-            boost::uint32_t count = 0;
+            boost::uint64_t count = 0;
             std::for_each(search->second.begin(), search->second.end(),
                           [&count](auto const v) {
                 count += v.get()->size();
             });
             this->counter_lost[d] = count;
+
+            metrics_ns::counter_add(metrics_ns::COUNTER_BYTES_LOST, count);
         }
     }
 
     ///
+    /// \brief client_logic::response_flushed - after a send to the client
+    /// \param d - client socket descriptor
+    ///
+    void client_logic::response_flushed(int d) {
+        auto search = this->response_since.find(d);
+
+        if(search != this->response_since.end() &&
+           this->empty_data_storage(d)) {
+            // RU: Все данные сервера переданы клиенту
+            metrics_ns::histogram_observe(
+                metrics_ns::HISTOGRAM_PROXY_RESPONSE_US,
+                (capture_ns::monotonic_ns() - search->second) / 1000);
+
+            this->response_since.erase(search);
+        }
+    }
+
+    ///
+    /// \brief client_logic::touch - client I/O, the session is not idle
+    /// \param d - client socket descriptor
+    ///
+    void client_logic::touch(int d) {
+        auto search = this->idle.find(d);
+
+        if(search != this->idle.end()) {
+            search->second.last_ms = this->now_ms;
+        }
+
+        if(this->drain_started) {
+            auto search_drain = this->drain.find(d);
+
+            if(search_drain != this->drain.end()) {
+                search_drain->second = this->now_ms;
+            }
+        }
+    }
+
     ///
     ///
     template<class TF_NEG, class TF_ZERO, class TF_POS>
@@ -1169,6 +1720,11 @@ namespace proxy_ns {
         }
         else {
             this->counter_recv[sd] += rc;
+            this->request_since.emplace(sd, this->now_ms);
+            this->touch(sd);
+            TRACE_PROBE2(client_read, sd, rc);
+            this->pi->sessions.add_in(sd, rc);
+            metrics_ns::counter_add(metrics_ns::COUNTER_CLIENT_BYTES_RECV, rc);
             p_f(rc, buf, size);
         }
 
@@ -1199,6 +1755,7 @@ namespace proxy_ns {
     bool client_logic::read_data(int fd, data& d) {
         return this->read_data(fd, d,
             [this, &d](int rc) -> bool {
+                boost::ignore_unused(rc);
                 assert(rc == sizeof(d));
                 return true;
             },
@@ -1238,6 +1795,7 @@ namespace proxy_ns {
                DIRECTION_CLIENT_TO_WORKER == direction);
         return this->send_data(fd, direction, d,
             [this, &d](int rc) -> bool {
+                boost::ignore_unused(rc);
                 assert(rc == sizeof(d));
                 return true;
             },
@@ -1248,6 +1806,41 @@ namespace proxy_ns {
             });
     }
 
+    ///
+    /// \brief client_logic::send_to_server
+    /// \param d
+    /// \return
+    ///
+    /// RU: Поток сервера в это время может сам писать нам и ждать, пока
+    ///     мы прочитаем. Поэтому блокирующая запись допустима только при
+    ///     свободном месте в канале, иначе сообщение ставится в очередь
+    ///     (и управляющее, и с данными - порядок сохраняется).
+    ///
+    bool client_logic::send_to_server(data& d) {
+        if(this->s_out_queue.empty() &&
+           this->pi->can_write_to_pipe(this->s_out_fd, sizeof(d))) {
+            return this->send_data(this->s_out_fd,
+                                   DIRECTION_CLIENT_TO_SERVER, d);
+        }
+
+        d.direction = DIRECTION_CLIENT_TO_SERVER;
+        this->s_out_queue.push_back(d);
+
+        return true;
+    }
+
+    ///
+    /// \brief client_logic::flush_s_out_queue
+    ///
+    void client_logic::flush_s_out_queue(void) {
+        while(!this->s_out_queue.empty() &&
+              this->pi->can_write_to_pipe(this->s_out_fd, sizeof(data))) {
+            (void) this->send_data(this->s_out_fd, DIRECTION_CLIENT_TO_SERVER,
+                                   this->s_out_queue.front());
+            this->s_out_queue.pop_front();
+        }
+    }
+
     ///
     /// \brief client_logic::send_data
     /// \param tod
@@ -1263,18 +1856,29 @@ namespace proxy_ns {
     bool client_logic::send_data(type_of_data_t tod, int c, int s,
                                  unsigned int len,
                                  unsigned char const* buf,
-                                 struct sockaddr_in const* ca,
-                                 struct sockaddr_in const* pa,
-                                 struct sockaddr_in const* sa) {
+                                 struct sockaddr_storage const* ca,
+                                 struct sockaddr_storage const* pa,
+                                 struct sockaddr_storage const* sa) {
         bool retc = true;
-        bool retw = true;
 
         data d(DIRECTION_UNKNOWN, tod, c, s, len, buf, ca, pa, sa);
 
-        retc = this->send_data(this->s_out_fd, DIRECTION_CLIENT_TO_SERVER, d);
-        retw = this->send_data(this->w_out_fd, DIRECTION_CLIENT_TO_WORKER, d);
+        auto search_tap = this->tap.find(c);
+        d.tap = (search_tap != this->tap.end() && search_tap->second);
+        d.route = static_cast<boost::uint32_t>(this->route_of(c));
+
+        retc = this->send_to_server(d);
+
+        if(d.tap) {
+            d.direction = DIRECTION_CLIENT_TO_WORKER;
+            this->pi->tap_push(this->pi->cw_tap, this->w_out_fd, d);
+        }
+
+        if(TOD_DISCONNECT == tod || TOD_NOT_CONNECT == tod) {
+            this->tap.erase(c);
+        }
 
-        return (retc && retw);
+        return retc;
     }
 
     ///
@@ -1291,9 +1895,9 @@ namespace proxy_ns {
     bool client_logic::send_new_connect(int c, int s,
                                         unsigned int len,
                                         unsigned char const* buf,
-                                        struct sockaddr_in const* ca,
-                                        struct sockaddr_in const* pa,
-                                        struct sockaddr_in const* sa) {
+                                        struct sockaddr_storage const* ca,
+                                        struct sockaddr_storage const* pa,
+                                        struct sockaddr_storage const* sa) {
         return this->send_data(TOD_NEW_CONNECT, c, s, len, buf, ca, pa, sa);
     }
 
@@ -1311,9 +1915,9 @@ namespace proxy_ns {
     bool client_logic::send_disconnect(int c, int s,
                                        unsigned int len,
                                        unsigned char const* buf,
-                                       struct sockaddr_in const* ca,
-                                       struct sockaddr_in const* pa,
-                                       struct sockaddr_in const* sa) {
+                                       struct sockaddr_storage const* ca,
+                                       struct sockaddr_storage const* pa,
+                                       struct sockaddr_storage const* sa) {
         return this->send_data(TOD_DISCONNECT, c, s, len, buf, ca, pa, sa);
     }
 
@@ -1331,9 +1935,9 @@ namespace proxy_ns {
     bool client_logic::send_data(int c, int s,
                                  unsigned int len,
                                  unsigned char const* buf,
-                                 struct sockaddr_in const* ca,
-                                 struct sockaddr_in const* pa,
-                                 struct sockaddr_in const* sa) {
+                                 struct sockaddr_storage const* ca,
+                                 struct sockaddr_storage const* pa,
+                                 struct sockaddr_storage const* sa) {
         return this->send_data(TOD_DATA, c, s, len, buf, ca, pa, sa);
     }
 
@@ -1351,9 +1955,9 @@ namespace proxy_ns {
     bool client_logic::send_not_connect(int c, int s,
                                         unsigned int len,
                                         unsigned char const* buf,
-                                        struct sockaddr_in const* ca,
-                                        struct sockaddr_in const* pa,
-                                        struct sockaddr_in const* sa) {
+                                        struct sockaddr_storage const* ca,
+                                        struct sockaddr_storage const* pa,
+                                        struct sockaddr_storage const* sa) {
         return this->send_data(TOD_NOT_CONNECT, c, s, len, buf, ca, pa, sa);
     }
 
@@ -1371,9 +1975,9 @@ namespace proxy_ns {
     bool client_logic::send_connect_not_found(int c, int s,
                                               unsigned int len,
                                               unsigned char const* buf,
-                                              struct sockaddr_in const* ca,
-                                              struct sockaddr_in const* pa,
-                                              struct sockaddr_in const* sa) {
+                                              struct sockaddr_storage const* ca,
+                                              struct sockaddr_storage const* pa,
+                                              struct sockaddr_storage const* sa) {
         return this->send_data(TOD_CONNECT_NOT_FOUND,
                                c, s, len, buf, ca, pa, sa);
     }
@@ -1392,9 +1996,9 @@ namespace proxy_ns {
     bool client_logic::send_other(int c, int s,
                                   unsigned int len,
                                   unsigned char const* buf,
-                                  struct sockaddr_in const* ca,
-                                  struct sockaddr_in const* pa,
-                                  struct sockaddr_in const* sa) {
+                                  struct sockaddr_storage const* ca,
+                                  struct sockaddr_storage const* pa,
+                                  struct sockaddr_storage const* sa) {
         return this->send_data(TOD_OTHER, c, s, len, buf, ca, pa, sa);
     }
 } // namespace proxy_ns
@@ -42,11 +42,23 @@
 #include "proxy_result.hpp"
 #include "proxy.hpp"
 //#include "proxy_impl.hpp" // Instead of "proxy_impl.hpp" we use "proxy.hpp".
+#include "timer_wheel.hpp"
+
+#ifndef DRAIN_CHECK_INTERVAL
+    #define DRAIN_CHECK_INTERVAL 100 // ms
+#endif // DRAIN_CHECK_INTERVAL
+
+#ifndef DRAIN_QUIET_TIME
+    #define DRAIN_QUIET_TIME 250 // ms
+#endif // DRAIN_QUIET_TIME
 
 namespace proxy_ns {
     using namespace log_ns;
 
+    class bench_access;
+
     class client_logic {
+        friend class bench_access; // see bench.cpp
     public:
         ///
         /// \brief client_logic
@@ -76,9 +88,17 @@ namespace proxy_ns {
         void done(void) noexcept;
     protected:
         ///
-        /// \brief new_connect
+        /// \brief open_listen - create a listening socket
+        /// \param c - listener (address, file mode, socket options)
+        /// \return socket descriptor
+        ///
+        int open_listen(listener_config const& c);
+
+        ///
+        /// \brief accept_connects - accept clients of a listener
+        /// \param index - listener index (see listener_config)
         ///
-        void new_connect(void);
+        void accept_connects(size_t index);
 
         ///
         /// \brief from_worker
@@ -129,7 +149,44 @@ namespace proxy_ns {
         /// \brief compress_array
         ///
         void compress_array(void);
+
+        ///
+        /// \brief expire_timers - close sessions idle for too long
+        ///
+        void expire_timers(void);
+
+        ///
+        /// \brief drain_start - stop accepting, watch the sessions left
+        ///
+        void drain_start(void);
+
+        ///
+        /// \brief drain_sessions - close sessions at a quiet point
+        ///
+        void drain_sessions(void);
     private:
+        // RU: Виды таймеров потока клиента
+        enum {
+            TIMER_IDLE = 1,
+            TIMER_DRAIN
+        };
+
+        // RU: Слоты таблицы pollfd: s_in, w_in, слушатели, s_out (пока есть
+        //     клиенты), клиенты
+        static int const LISTEN_INDEX = 2;
+
+        ///
+        /// \brief The idle_state struct
+        ///
+        /// RU: Таймер не перевзводится на каждый пакет: при срабатывании
+        ///     проверяется время последнего обмена, и если сессия была
+        ///     активна, таймер взводится на оставшийся срок.
+        ///
+        struct idle_state {
+            timer_wheel::timer_id timer;
+            boost::uint64_t last_ms;     // last client I/O (CLOCK_MONOTONIC)
+        };
+
         client_routine_arg* c_arg;
         proxy_impl* pi;
         boost::scoped_ptr<proxy_ns::common_logic_log> l;
@@ -139,14 +196,17 @@ namespace proxy_ns {
         int w_in_fd;
         int w_out_fd;
 
-        struct sockaddr_in proxy_addr;
+        // RU: Слушатели по индексу (см. listener_config): сокет, адрес и
+        //     число открытых сессий (для max-sessions)
+        std::vector<int> listen_sds;
+        std::vector<struct sockaddr_storage> listen_addrs;
+        std::vector<size_t> listen_sessions;
 
         struct pollfd fds[POLLING_REQUESTS_SIZE];
         int nfds;
         int timeout;
         bool flag_compress_array;
 
-        int listen_sd;
         int cur_fd;
         short int cur_events;
         short int cur_revents;
@@ -154,7 +214,10 @@ namespace proxy_ns {
         bool s_read_enable;
         bool w_read_enable;
         bool s_write_enable;
-        bool w_write_enable;
+
+        // RU: Сообщения для потока сервера, которые не поместились в канал.
+        //     Пока очередь не пуста, новые сообщения встают за ней.
+        std::deque<data> s_out_queue;
 
         // key: client socket descriptor
         // value: server socket descriptor
@@ -168,14 +231,54 @@ namespace proxy_ns {
         // Value: client socket descriptor
         std::list<int> db_for_close;
 
-        std::map<int, boost::uint32_t> counter_sent;
-        std::map<int, boost::uint32_t> counter_recv;
-        std::map<int, boost::uint32_t> counter_buffered;
-        std::map<int, boost::uint32_t> counter_lost;
+        // key: client socket descriptor
+        // value: session is copied to the worker
+        std::map<int, bool> tap;
+
+        // key: client socket descriptor
+        // value: listener index
+        std::map<int, size_t> route;
+
+        std::map<int, boost::uint64_t> counter_sent;
+        std::map<int, boost::uint64_t> counter_recv;
+        std::map<int, boost::uint64_t> counter_buffered;
+        std::map<int, boost::uint64_t> counter_lost;
+
+        // key: client socket descriptor
+        // value: CLOCK_MONOTONIC (ns) of the oldest unsent server data
+        std::map<int, boost::uint64_t> response_since;
+
+        // RU: Таймеры потока и время (мс) последнего выхода из poll
+        timer_wheel timers;
+        boost::uint64_t now_ms;
+
+        // RU: Снимок перечитываемых параметров (обновляется после poll)
+        runtime_config_view cfg;
+
+        // key: client socket descriptor
+        // value: idle timer (only if client_idle_timeout is set)
+        std::map<int, idle_state> idle;
+
+        // key: client socket descriptor
+        // value: now_ms of the first client data not answered by the server
+        std::map<int, boost::uint64_t> request_since;
+
+        // RU: "Доживание" (pi->draining): сессия закрывается, когда на её
+        //     запрос нет ожидаемого ответа, буфер клиента пуст и обмена не
+        //     было DRAIN_QUIET_TIME мс. Протокол прокси не разбирает, поэтому
+        //     граница запроса определяется по тишине, а не по пакетам.
+        // key: client socket descriptor
+        // value: now_ms of the last I/O (only while draining)
+        std::map<int, boost::uint64_t> drain;
+        bool drain_started;
 
         void new_connect(int d);
+        bool is_listen_slot(int i) const;
+        size_t route_of(int d) const;
+        struct sockaddr_storage const* proxy_addr_of(int d) const;
         void close_connect(int d);
         void close_connect_force(int d);
+        void close_broken(int d, int err);
         bool save_new_data_storage(int d, unsigned char const* buf,
                                    unsigned int size);
         bool save_unset_data_storage(int d, unsigned char const* buf,
@@ -187,6 +290,8 @@ namespace proxy_ns {
         bool empty_data_storage(int d);
         int find_pollfd(int d) const;
         void calculate_count_lost(int d);
+        void response_flushed(int d);
+        void touch(int d);
 
         template<class TF_NEG, class TF_ZERO, class TF_POS>
         int read_data_socket(int sd, unsigned char* buf, size_t size,
@@ -224,6 +329,18 @@ namespace proxy_ns {
         ///
         bool send_data(int fd, direction_t direction, data& d);
 
+        ///
+        /// \brief send_to_server - message to the server thread (never blocks)
+        /// \param d
+        /// \return
+        ///
+        bool send_to_server(data& d);
+
+        ///
+        /// \brief flush_s_out_queue - write queued messages while there is room
+        ///
+        void flush_s_out_queue(void);
+
         ///
         /// \brief send_data
         /// \param tod
@@ -239,9 +356,9 @@ namespace proxy_ns {
         bool send_data(type_of_data_t tod, int c, int s = -1,
                        unsigned int len = 0,
                        unsigned char const* buf = nullptr,
-                       struct sockaddr_in const* ca = nullptr,
-                       struct sockaddr_in const* pa = nullptr,
-                       struct sockaddr_in const* sa = nullptr);
+                       struct sockaddr_storage const* ca = nullptr,
+                       struct sockaddr_storage const* pa = nullptr,
+                       struct sockaddr_storage const* sa = nullptr);
 
         ///
         /// \brief send_new_connect
@@ -257,9 +374,9 @@ namespace proxy_ns {
         bool send_new_connect(int c, int s,
                               unsigned int len = 0,
                               unsigned char const* buf = nullptr,
-                              struct sockaddr_in const* ca = nullptr,
-                              struct sockaddr_in const* pa = nullptr,
-                              struct sockaddr_in const* sa = nullptr);
+                              struct sockaddr_storage const* ca = nullptr,
+                              struct sockaddr_storage const* pa = nullptr,
+                              struct sockaddr_storage const* sa = nullptr);
 
         ///
         /// \brief send_disconnect
@@ -275,9 +392,9 @@ namespace proxy_ns {
         bool send_disconnect(int c, int s,
                              unsigned int len = 0,
                              unsigned char const* buf = nullptr,
-                             struct sockaddr_in const* ca = nullptr,
-                             struct sockaddr_in const* pa = nullptr,
-                             struct sockaddr_in const* sa = nullptr);
+                             struct sockaddr_storage const* ca = nullptr,
+                             struct sockaddr_storage const* pa = nullptr,
+                             struct sockaddr_storage const* sa = nullptr);
 
         ///
         /// \brief send_data
@@ -293,9 +410,9 @@ namespace proxy_ns {
         bool send_data(int c, int s,
                        unsigned int len,
                        unsigned char const* buf,
-                       struct sockaddr_in const* ca = nullptr,
-                       struct sockaddr_in const* pa = nullptr,
-                       struct sockaddr_in const* sa = nullptr);
+                       struct sockaddr_storage const* ca = nullptr,
+                       struct sockaddr_storage const* pa = nullptr,
+                       struct sockaddr_storage const* sa = nullptr);
 
         ///
         /// \brief send_not_connect
@@ -311,9 +428,9 @@ namespace proxy_ns {
         bool send_not_connect(int c, int s = -1,
                               unsigned int len = 0,
                               unsigned char const* buf = nullptr,
-                              struct sockaddr_in const* ca = nullptr,
-                              struct sockaddr_in const* pa = nullptr,
-                              struct sockaddr_in const* sa = nullptr);
+                              struct sockaddr_storage const* ca = nullptr,
+                              struct sockaddr_storage const* pa = nullptr,
+                              struct sockaddr_storage const* sa = nullptr);
 
         ///
         /// \brief send_connect_not_found
@@ -329,9 +446,9 @@ namespace proxy_ns {
         bool send_connect_not_found(int c, int s,
                                     unsigned int len = 0,
                                     unsigned char const* buf = nullptr,
-                                    struct sockaddr_in const* ca = nullptr,
-                                    struct sockaddr_in const* pa = nullptr,
-                                    struct sockaddr_in const* sa = nullptr);
+                                    struct sockaddr_storage const* ca = nullptr,
+                                    struct sockaddr_storage const* pa = nullptr,
+                                    struct sockaddr_storage const* sa = nullptr);
 
         ///
         /// \brief send_other
@@ -347,9 +464,9 @@ namespace proxy_ns {
         bool send_other(int c, int s,
                         unsigned int len,
                         unsigned char const* buf,
-                        struct sockaddr_in const* ca = nullptr,
-                        struct sockaddr_in const* pa = nullptr,
-                        struct sockaddr_in const* sa = nullptr);
+                        struct sockaddr_storage const* ca = nullptr,
+                        struct sockaddr_storage const* pa = nullptr,
+                        struct sockaddr_storage const* sa = nullptr);
     };
 
     ///
@@ -0,0 +1,452 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <map>
+#include <vector>
+#include <tuple>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include "proxy.hpp"
+//#include "proxy_impl.hpp" // Instead of "proxy_impl.hpp" we use "proxy.hpp".
+#include "config.hpp"
+
+namespace proxy_ns {
+    namespace {
+        typedef std::function<void (listener_config&,
+                                    std::string const&)> setter_t;
+
+        template<typename T>
+        setter_t field(T listener_config::* member, T min_value) {
+            return [member, min_value](listener_config& c,
+                                       std::string const& value) {
+                // RU: lexical_cast для uint16_t молча принимает "-1"
+                long long const v = boost::lexical_cast<long long>(value);
+
+                if(v < static_cast<long long>(min_value) ||
+                   v > static_cast<long long>(
+                       std::numeric_limits<T>::max())) {
+                    throw boost::bad_lexical_cast();
+                }
+
+                c.*member = static_cast<T>(v);
+            };
+        }
+
+        // RU: client-rcvbuf -> client_opts.rcvbuf
+        setter_t sockopt(sockopt_profile listener_config::* side,
+                         boost::int32_t sockopt_profile::* member) {
+            return [side, member](listener_config& c,
+                                  std::string const& value) {
+                long long const v = boost::lexical_cast<long long>(value);
+
+                if(v < 0 || v > std::numeric_limits<boost::int32_t>::max()) {
+                    throw boost::bad_lexical_cast();
+                }
+
+                (c.*side).*member = static_cast<boost::int32_t>(v);
+            };
+        }
+
+        // RU: "1000, 1001" -> {1000, 1001}
+        void id_list(std::vector<boost::uint32_t>& ids,
+                     std::string const& value) {
+            std::stringstream in(value);
+            std::string item;
+
+            ids.clear();
+
+            while(std::getline(in, item, ',')) {
+                boost::algorithm::trim(item);
+
+                if(item.empty() || item[0] == '-') {
+                    throw boost::bad_lexical_cast();
+                }
+
+                ids.push_back(boost::lexical_cast<boost::uint32_t>(item));
+            }
+        }
+
+        bool valid_name(std::string const& name) {
+            if(name.empty()) {
+                return false;
+            }
+
+            for(char const ch : name) {
+                if(!std::isalnum(static_cast<unsigned char>(ch)) &&
+                   ch != '_' && ch != '-' && ch != '.') {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        ///
+        /// \brief The section struct - "[listener NAME]" before it is applied
+        ///
+        struct section {
+            std::string where;
+            std::string name;
+            // RU: (место, ключ, значение)
+            std::vector<std::tuple<std::string,
+                                   std::string, std::string>> keys;
+        };
+    }
+
+    ///
+    /// \brief runtime_config::load
+    /// \param path
+    ///
+    void runtime_config::load(std::string const& path) {
+        static std::map<std::string, setter_t> const setters = {
+            {"server-addr",
+             [](listener_config& c, std::string const& value) {
+                 c.server_ip = value;
+             }},
+            {"server-port",
+             field(&listener_config::server_port,
+                   static_cast<boost::uint16_t>(1))},
+            {"connect-timeout",
+             field(&listener_config::connect_timeout, 0)},
+            {"connect-retries",
+             field(&listener_config::connect_retries, 0)},
+            {"connect-backoff",
+             field(&listener_config::connect_backoff, 0)},
+            {"client-idle-timeout",
+             field(&listener_config::client_idle_timeout, 0)},
+            {"query-timeout",
+             field(&listener_config::query_timeout, 0)},
+            {"resolve-ttl",
+             field(&listener_config::resolve_ttl, 0)},
+            {"max-sessions",
+             field(&listener_config::max_sessions, 0u)},
+            {"listen-addr",
+             [](listener_config& c, std::string const& value) {
+                 c.listen_ip = value;
+             }},
+            {"listen-mode",
+             [](listener_config& c, std::string const& value) {
+                 std::size_t pos = 0;
+                 unsigned long const v = std::stoul(value, &pos, 8);
+
+                 if(pos != value.size() || v > 07777) {
+                     throw boost::bad_lexical_cast();
+                 }
+
+                 c.listen_mode = static_cast<boost::uint32_t>(v);
+             }},
+            {"peer-uid",
+             [](listener_config& c, std::string const& value) {
+                 id_list(c.peer_uids, value);
+             }},
+            {"peer-gid",
+             [](listener_config& c, std::string const& value) {
+                 id_list(c.peer_gids, value);
+             }},
+            {"listen-port",
+             field(&listener_config::listen_port,
+                   static_cast<boost::uint16_t>(1))},
+            {"client-defer-accept",
+             sockopt(&listener_config::client_opts,
+                     &sockopt_profile::defer_accept)},
+            {"client-fastopen",
+             sockopt(&listener_config::client_opts,
+                     &sockopt_profile::fastopen)},
+            {"client-rcvbuf",
+             sockopt(&listener_config::client_opts,
+                     &sockopt_profile::rcvbuf)},
+            {"client-sndbuf",
+             sockopt(&listener_config::client_opts,
+                     &sockopt_profile::sndbuf)},
+            {"client-notsent-lowat",
+             sockopt(&listener_config::client_opts,
+                     &sockopt_profile::notsent_lowat)},
+            {"client-busy-poll",
+             sockopt(&listener_config::client_opts,
+                     &sockopt_profile::busy_poll)},
+            {"server-fastopen",
+             sockopt(&listener_config::server_opts,
+                     &sockopt_profile::fastopen)},
+            {"server-rcvbuf",
+             sockopt(&listener_config::server_opts,
+                     &sockopt_profile::rcvbuf)},
+            {"server-sndbuf",
+             sockopt(&listener_config::server_opts,
+                     &sockopt_profile::sndbuf)},
+            {"server-notsent-lowat",
+             sockopt(&listener_config::server_opts,
+                     &sockopt_profile::notsent_lowat)},
+            {"server-busy-poll",
+             sockopt(&listener_config::server_opts,
+                     &sockopt_profile::busy_poll)}
+        };
+
+        auto apply = [](listener_config& c, std::string const& where,
+                        std::string const& key, std::string const& value) {
+            auto const search = setters.find(key);
+
+            if(search == setters.end()) {
+                throw Eproxy_invalid_value(where + ": unknown key " + key);
+            }
+
+            try {
+                search->second(c, value);
+            }
+            catch(boost::bad_lexical_cast const&) {
+                throw Eproxy_invalid_value(where + ": " + key + " = " + value);
+            }
+            catch(std::logic_error const&) {
+                // RU: std::stoul - invalid_argument, out_of_range
+                throw Eproxy_invalid_value(where + ": " + key + " = " + value);
+            }
+        };
+
+        std::ifstream in(path.c_str());
+
+        if(!in) {
+            throw Eproxy_invalid_value(path + ": " + ::strerror(errno));
+        }
+
+        runtime_config tmp(*this);
+        std::vector<section> sections;
+        std::string line;
+        size_t line_no = 0;
+
+        // RU: Слушатели из файла строятся заново при каждом чтении
+        tmp.listeners.resize(1);
+
+        while(std::getline(in, line)) {
+            line_no++;
+
+            boost::algorithm::trim(line);
+
+            if(line.empty() || line[0] == '#' || line[0] == ';') {
+                continue;
+            }
+
+            std::string const where = path + ":" + std::to_string(line_no);
+
+            if(line[0] == '[') {
+                static std::string const kind = "listener";
+
+                std::string const head = boost::algorithm::trim_copy(
+                            line.substr(1, line.size() - 1 -
+                                        (line.back() == ']' ? 1 : 0)));
+
+                if(line.back() != ']' || head.compare(0, kind.size(), kind) ||
+                   head.size() == kind.size() ||
+                   !std::isspace(static_cast<unsigned char>(
+                                     head[kind.size()]))) {
+                    throw Eproxy_invalid_value(where +
+                                               ": [listener NAME] expected");
+                }
+
+                section x;
+                x.where = where;
+                x.name = boost::algorithm::trim_copy(
+                            head.substr(kind.size()));
+
+                if(!valid_name(x.name)) {
+                    throw Eproxy_invalid_value(where + ": bad listener name " +
+                                               x.name);
+                }
+
+                for(auto const& y : sections) {
+                    if(y.name == x.name) {
+                        throw Eproxy_invalid_value(where +
+                                                   ": duplicate listener " +
+                                                   x.name);
+                    }
+                }
+
+                if(sections.size() + 1 >= LISTENERS_MAX) {
+                    throw Eproxy_invalid_value(where + ": more than " +
+                                               std::to_string(LISTENERS_MAX) +
+                                               " listeners");
+                }
+
+                sections.push_back(x);
+                continue;
+            }
+
+            std::string::size_type const eq = line.find('=');
+
+            if(eq == std::string::npos) {
+                throw Eproxy_invalid_value(where + ": '=' expected");
+            }
+
+            std::string const key =
+                    boost::algorithm::trim_copy(line.substr(0, eq));
+            std::string const value =
+                    boost::algorithm::trim_copy(line.substr(eq + 1));
+
+            if(!sections.empty()) {
+                sections.back().keys.emplace_back(where, key, value);
+                continue;
+            }
+
+            if(key == "listen-port") {
+                // RU: Порт слушателя [0] - это --port
+                throw Eproxy_invalid_value(where + ": " + key +
+                                           " is allowed in a [listener] only");
+            }
+
+            apply(tmp.listeners[0], where, key, value);
+        }
+
+        if(in.bad()) {
+            throw Eproxy_invalid_value(path + ": read error");
+        }
+
+        // RU: Секции наследуют итоговые значения слушателя [0], поэтому
+        //     порядок строк в файле не важен
+        for(auto const& x : sections) {
+            listener_config c = tmp.listeners[0];
+
+            // RU: Адрес слушателя и правила доступа не наследуются
+            c.name = x.name;
+            c.listen_ip = "0.0.0.0";
+            c.listen_port = 0;
+            c.listen_mode = 0;
+            c.peer_uids.clear();
+            c.peer_gids.clear();
+            c.max_sessions = 0;
+
+            for(auto const& k : x.keys) {
+                apply(c, std::get<0>(k), std::get<1>(k), std::get<2>(k));
+            }
+
+            struct sockaddr_storage addr;
+
+            if(!c.listen_port &&
+               ADDRESS_UNIX != address_parse(c.listen_ip, 0, addr)) {
+                throw Eproxy_invalid_value(x.where + ": listen-port expected");
+            }
+
+            tmp.listeners.push_back(c);
+        }
+
+        *this = tmp;
+    }
+
+    ///
+    /// \brief runtime_config::validate
+    ///
+    void runtime_config::validate(void) {
+        for(auto& c : this->listeners) {
+            std::string const who = c.name.empty() ?
+                        std::string() : "listener " + c.name + ": ";
+
+            c.server_kind = address_parse(c.server_ip, c.server_port,
+                                          c.server_addr);
+
+            if(ADDRESS_INVALID == c.server_kind) {
+                throw Eproxy_invalid_value(who + c.server_ip);
+            }
+
+            address_kind_t const kind = address_parse(c.listen_ip,
+                                                      c.listen_port,
+                                                      c.listen_addr);
+
+            if(ADDRESS_NUMERIC != kind && ADDRESS_UNIX != kind) {
+                throw Eproxy_invalid_value(who + c.listen_ip);
+            }
+
+            if(ADDRESS_UNIX != kind && (c.listen_mode ||
+               !c.peer_uids.empty() || !c.peer_gids.empty())) {
+                throw Eproxy_invalid_value(
+                            who + "listen-mode, peer-uid and peer-gid need "
+                            "a unix:/path listen-addr");
+            }
+        }
+
+        for(size_t i = 0; i < this->listeners.size(); i++) {
+            for(size_t j = 0; j < i; j++) {
+                if(address_overlap(this->listeners[i].listen_addr,
+                                   this->listeners[j].listen_addr)) {
+                    throw Eproxy_invalid_value(
+                                "listener " + this->listeners[i].name +
+                                ": port " +
+                                std::to_string(this->listeners[i].listen_port) +
+                                " is already in use");
+                }
+            }
+        }
+    }
+
+    ///
+    /// \brief listener_config::peer_allowed
+    /// \param uid
+    /// \param gid
+    /// \return
+    ///
+    bool listener_config::peer_allowed(boost::uint32_t uid,
+                                       boost::uint32_t gid) const noexcept {
+        if(this->peer_uids.empty() && this->peer_gids.empty()) {
+            return true;
+        }
+
+        return std::find(this->peer_uids.begin(), this->peer_uids.end(),
+                         uid) != this->peer_uids.end() ||
+               std::find(this->peer_gids.begin(), this->peer_gids.end(),
+                         gid) != this->peer_gids.end();
+    }
+
+    ///
+    /// \brief runtime_config::same_listeners
+    /// \param other
+    /// \return
+    ///
+    bool runtime_config::same_listeners(
+            runtime_config const& other) const noexcept {
+        if(this->listeners.size() != other.listeners.size()) {
+            return false;
+        }
+
+        for(size_t i = 0; i < this->listeners.size(); i++) {
+            listener_config const& a = this->listeners[i];
+            listener_config const& b = other.listeners[i];
+
+            if(a.name != b.name || a.listen_ip != b.listen_ip ||
+               a.listen_port != b.listen_port) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+} // namespace proxy_ns
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
@@ -0,0 +1,245 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#pragma once
+
+#ifndef __CONFIG_HPP__
+#define __CONFIG_HPP__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include <boost/cstdint.hpp>
+
+#include <sys/socket.h>
+
+#include "address.hpp"
+#include "sockopt.hpp"
+
+#ifndef LISTENERS_MAX
+    #define LISTENERS_MAX 16
+#endif // LISTENERS_MAX
+
+namespace proxy_ns {
+    ///
+    /// \brief The listener_config struct - one listener and its backend
+    ///
+    /// RU: Слушатель [0] задаётся командной строкой (--port, --server-addr,
+    ///     ...) и ключами в начале файла; остальные - секциями
+    ///     "[listener NAME]". Ключи, не заданные в секции, берутся у
+    ///     слушателя [0].
+    ///
+    struct listener_config {
+        std::string name;               // "" - the command line listener
+        std::string listen_ip;          // IPv4, IPv6 or unix:/path
+        boost::uint16_t listen_port;    // ignored for a unix socket
+        struct sockaddr_storage listen_addr; // listen_ip:listen_port
+        boost::uint32_t listen_mode;    // unix socket file mode, 0 - umask
+
+        // RU: Правила для клиентов unix-сокета (SO_PEERCRED): клиент
+        //     допускается, если его uid или gid есть в списке. Пустые
+        //     списки - допускаются все.
+        std::vector<boost::uint32_t> peer_uids;
+        std::vector<boost::uint32_t> peer_gids;
+
+        std::string server_ip;          // IPv4, IPv6, unix:/path or a name
+        boost::uint16_t server_port;
+        address_kind_t server_kind;
+        struct sockaddr_storage server_addr; // server_ip:server_port; a name
+                                             // - see proxy_impl::resolve
+        boost::int32_t resolve_ttl;     // ms, 0 - on start and SIGHUP only
+
+        boost::int32_t connect_timeout;
+        boost::int32_t connect_retries;
+        boost::int32_t connect_backoff;
+        boost::int32_t client_idle_timeout;
+        boost::int32_t query_timeout;
+        boost::uint32_t max_sessions;   // 0 - unlimited
+
+        sockopt_profile client_opts;    // listener and accepted clients
+        sockopt_profile server_opts;    // backend connections
+
+        ///
+        /// \brief peer_allowed - the peer-uid and peer-gid rules
+        /// \param uid
+        /// \param gid
+        /// \return
+        ///
+        bool peer_allowed(boost::uint32_t uid,
+                          boost::uint32_t gid) const noexcept;
+    };
+
+    ///
+    /// \brief The runtime_config struct - parameters reloadable on SIGHUP
+    ///
+    /// RU: Неизменяемый снимок параметров, которые можно менять без
+    ///     перезапуска и без разрыва сессий. Новые значения действуют на
+    ///     новые подключения к серверу и на вновь взводимые таймеры.
+    ///     Набор слушателей (имена и адреса) задаётся при запуске:
+    ///     сокеты открыты, поэтому при перечитывании он меняться не может.
+    ///
+    struct runtime_config {
+        std::vector<listener_config> listeners; // [0] - always present
+
+        boost::uint64_t generation;
+
+        ///
+        /// \brief load - override values with "key = value" lines of a file
+        /// \param path
+        ///
+        /// Keys are the long option names (server-addr, connect-timeout, ...).
+        /// A "[listener NAME]" line starts a new listener; it needs
+        /// listen-port (or a unix:/path listen-addr) and may set
+        /// listen-addr, listen-mode, peer-uid, peer-gid and max-sessions.
+        /// client-* and server-* socket options (defer-accept, fastopen,
+        /// rcvbuf, sndbuf, notsent-lowat, busy-poll) tune both sides of a
+        /// listener, see sockopt_profile.
+        /// listen-addr before the first section moves the --port listener.
+        /// Empty lines and lines starting with '#' or ';' are skipped.
+        /// Throws Eproxy_invalid_value; the object is left unchanged then.
+        ///
+        void load(std::string const& path);
+
+        ///
+        /// \brief validate - check values and build the addresses
+        ///
+        /// Server host names are not resolved here: server_addr stays
+        /// AF_UNSPEC until proxy_impl resolves them.
+        ///
+        void validate(void);
+
+        ///
+        /// \brief same_listeners - names and listen addresses are equal
+        /// \param other
+        /// \return
+        ///
+        bool same_listeners(runtime_config const& other) const noexcept;
+
+        ///
+        /// \brief route - listener of a session (unknown index - [0])
+        /// \param index
+        /// \return
+        ///
+        listener_config const& route(size_t index) const noexcept {
+            return this->listeners[index < this->listeners.size() ?
+                                   index : 0];
+        }
+    };
+
+    ///
+    /// \brief The runtime_config_holder class
+    ///
+    /// RU: Публикация снимков в стиле RCU. Писатель (главный поток) подменяет
+    ///     указатель под мьютексом и увеличивает номер поколения. Читатели
+    ///     (потоки клиента и сервера) на каждой итерации цикла сравнивают
+    ///     только номер поколения и берут мьютекс лишь при его изменении.
+    ///     Старый снимок освобождается, когда его отпустит последний читатель.
+    ///
+    class runtime_config_holder {
+        typedef runtime_config_holder self;
+    public:
+        typedef std::shared_ptr<runtime_config const> pointer;
+
+        runtime_config_holder(void) :
+            m(), cfg(self::initial()), gen(0) {
+        }
+
+        runtime_config_holder(runtime_config_holder const&) = delete;
+        runtime_config_holder& operator=(runtime_config_holder const&) = delete;
+
+        void publish(pointer c) {
+            std::lock_guard<std::mutex> lock(this->m);
+
+            this->cfg = c;
+            this->gen.store(c->generation, std::memory_order_release);
+        }
+
+        pointer current(void) const {
+            std::lock_guard<std::mutex> lock(this->m);
+
+            return this->cfg;
+        }
+
+        boost::uint64_t generation(void) const noexcept {
+            return this->gen.load(std::memory_order_acquire);
+        }
+    private:
+        // RU: До первой загрузки (поколение 0) читатели видят один
+        //     слушатель с нулевыми параметрами
+        static pointer initial(void) {
+            std::shared_ptr<runtime_config> c =
+                    std::make_shared<runtime_config>();
+
+            c->listeners.resize(1);
+            c->generation = 0;
+
+            return c;
+        }
+
+        mutable std::mutex m;
+        pointer cfg;
+        std::atomic<boost::uint64_t> gen;
+    };
+
+    ///
+    /// \brief The runtime_config_view class - snapshot held by one thread
+    ///
+    class runtime_config_view {
+        typedef runtime_config_view self;
+    public:
+        explicit runtime_config_view(runtime_config_holder const& h) :
+            h(h), cfg(h.current()) {
+        }
+
+        runtime_config_view(runtime_config_view const&) = delete;
+        runtime_config_view& operator=(runtime_config_view const&) = delete;
+
+        ///
+        /// \brief refresh - take a new snapshot if one was published
+        /// \return true if the snapshot was replaced
+        ///
+        bool refresh(void) {
+            if(this->cfg && this->h.generation() == this->cfg->generation) {
+                return false;
+            }
+
+            this->cfg = this->h.current();
+
+            return true;
+        }
+
+        runtime_config const* operator->(void) const noexcept {
+            return this->cfg.get();
+        }
+    private:
+        runtime_config_holder const& h;
+        runtime_config_holder::pointer cfg;
+    };
+} // namespace proxy_ns
+
+#endif // __CONFIG_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
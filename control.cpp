@@ -0,0 +1,61 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#include <atomic>
+
+#include "control.hpp"
+
+namespace proxy_ns {
+    namespace {
+        // RU: std::atomic<bool> всегда lock-free, поэтому годится для
+        //     обработчиков сигналов
+        std::atomic<bool> requests[CONTROL_END];
+        std::atomic<bool> attached(false);
+    }
+
+    bool control_request(control_t c) noexcept {
+        if(!attached.load()) {
+            return false;
+        }
+
+        requests[c].store(true);
+
+        return true;
+    }
+
+    bool control_take(control_t c) noexcept {
+        return requests[c].exchange(false);
+    }
+
+    void control_attach(bool on) noexcept {
+        if(on) {
+            for(auto& r : requests) {
+                r.store(false);
+            }
+        }
+
+        attached.store(on);
+    }
+} // namespace proxy_ns
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
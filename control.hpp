@@ -0,0 +1,71 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#pragma once
+
+#ifndef __CONTROL_HPP__
+#define __CONTROL_HPP__
+
+#ifndef CONTROL_CHECK_INTERVAL
+    #define CONTROL_CHECK_INTERVAL 100 // ms
+#endif // CONTROL_CHECK_INTERVAL
+
+namespace proxy_ns {
+    ///
+    /// \brief The control_t enum - requests to the main thread
+    ///
+    /// RU: Обработчики сигналов и администраторский интерфейс ничего не
+    ///     делают сами: они только ставят флаг, а главный поток (см.
+    ///     proxy_impl::run) проверяет флаги каждые CONTROL_CHECK_INTERVAL мс.
+    ///
+    typedef enum {
+        CONTROL_RELOAD = 0, // re-read the config file (SIGHUP)
+        CONTROL_DRAIN,      // graceful shutdown (SIGTERM, SIGINT, /drain)
+        CONTROL_STOP,       // immediate shutdown (second SIGTERM/SIGINT)
+        CONTROL_END
+    } control_t;
+
+    ///
+    /// \brief control_request - async-signal-safe, any thread
+    /// \param c
+    /// \return false if no running proxy would take the request
+    ///
+    bool control_request(control_t c) noexcept;
+
+    ///
+    /// \brief control_take - main thread only
+    /// \param c
+    /// \return true once per control_request(c) call (or series of calls)
+    ///
+    bool control_take(control_t c) noexcept;
+
+    ///
+    /// \brief control_attach - the main thread starts/stops taking requests
+    /// \param on
+    ///
+    void control_attach(bool on) noexcept;
+} // namespace proxy_ns
+
+#endif // __CONTROL_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
@@ -52,13 +52,14 @@
 
 extern void program_exit(int retcode) noexcept;
 extern void _program_exit(int retcode) noexcept;
+extern void program_reload(void) noexcept;
+extern bool program_stop(void) noexcept;
 
 namespace daemon_ns {
 	using namespace log_ns;
 
 	void sig_handler_SIGUSR1(int sig, siginfo_t* sinfo, void* buf);
 	void sig_handler_SIGUSR2(int sig, siginfo_t* sinfo, void* buf);
-    void sig_handler_SIGPIPE(int sig, siginfo_t* sinfo, void* buf);
     void sig_handler_SIGINT(int sig, siginfo_t* sinfo, void* buf);
     void sig_handler_SIGABRT(int sig, siginfo_t* sinfo, void* buf);
     void sig_handler_SIGTERM(int sig, siginfo_t* sinfo, void* buf);
@@ -93,7 +94,7 @@ namespace daemon_ns {
 		self::used = true;
 	}
 	
-    daemon::result_t daemon::go(bool demonization, bool force) {
+    daemon::result_t daemon::go(bool demonization, bool force, bool takeover) {
 		daemon::result_t result = self::RES_NO_ERROR;
 		
 		int stdio_fd = 0;
@@ -202,7 +203,23 @@ namespace daemon_ns {
                                     }
                                 }
                                 else {
-                                    if(force) {
+                                    if(takeover) {
+                                        // RU: Работающая копия передаст
+                                        //     слушающий сокет и завершится
+                                        //     сама (см. proxy_ns::takeover).
+                                        //     Файл блокировки теперь наш.
+                                        l(Ilog::LEVEL_INFO,
+                  "A copy of the program is already running. Taking over...");
+                                        if(::unlink(
+                                            self::DEFAULT_LOCK_PID_PATH) < 0) {
+                                            l(Ilog::LEVEL_ERROR,
+                                              "Can't delete the lock file");
+                                            result = self::RES_UNLINK_ERROR;
+                                            ::free(buf);
+                                            break;
+                                        }
+                                    }
+                                    else if(force) {
                                         l(Ilog::LEVEL_INFO,
                      "A copy of the program is already running. Restarting...");
                                         (void) ::kill(pid_from_file, SIGUSR1);
@@ -323,7 +340,9 @@ namespace daemon_ns {
 
 				this->setsignal(SIGUSR1, sig_handler_SIGUSR1);
 				this->setsignal(SIGUSR2, sig_handler_SIGUSR2);
-                this->setsignal(SIGPIPE, sig_handler_SIGPIPE);
+                // RU: Обрыв соединения - ошибка одной сессии (EPIPE), а не
+                //     повод завершать весь процесс
+                this->ignoresignal(SIGPIPE);
                 this->setsignal(SIGINT, sig_handler_SIGINT);
                 this->setsignal(SIGABRT, sig_handler_SIGABRT);
                 this->setsignal(SIGTERM, sig_handler_SIGTERM);
@@ -347,7 +366,7 @@ namespace daemon_ns {
 		
 		(void) ::close(this->lock_fd);
 
-        if(this->owner) {
+        if(this->owner && this->lock_owner()) {
             (void) ::unlink(self::DEFAULT_LOCK_PID_PATH);
         }
 		
@@ -363,6 +382,35 @@ namespace daemon_ns {
 		self::used = false;
 	}
 
+    ///
+    /// \brief daemon::lock_owner - does the lock file hold our pid?
+    ///
+    /// RU: После передачи сокета (--takeover) файл блокировки принадлежит
+    ///     новому процессу - старый не должен его удалять.
+    ///
+    bool daemon::lock_owner(void) const {
+        char buf[16] = {0};
+        bool ret = false;
+
+        int fd = ::open(self::DEFAULT_LOCK_PID_PATH, O_RDONLY);
+        if(fd >= 0) {
+            ssize_t const rc = ::read(fd, buf, sizeof(buf) - 1);
+            if(rc > 0) {
+                try {
+                    ret = (boost::lexical_cast<pid_t>(buf) ==
+                           this->current_pid);
+                }
+                catch(boost::bad_lexical_cast const&) {
+                    ret = false;
+                }
+            }
+
+            (void) ::close(fd);
+        }
+
+        return ret;
+    }
+
 	void daemon::setsignal(int sig, sighandler hndlr) {
 		struct sigaction sa_new;
 		struct sigaction sa_old;
@@ -395,6 +443,31 @@ namespace daemon_ns {
 		}
 	}
 	
+    void daemon::ignoresignal(int sig) {
+        struct sigaction sa;
+
+        (void) ::memset(&sa, 0, sizeof(sa));
+
+        (void) ::sigemptyset(&sa.sa_mask);
+
+        sa.sa_handler = SIG_IGN;
+
+        if(::sigaction(sig, &sa, nullptr) < 0) {
+            std::stringstream ss;
+
+            ss << "sigaction error (signal number " << sig << ")";
+
+            log::inst()(Ilog::LEVEL_ERROR, ss.str());
+        }
+        else {
+            std::stringstream ss;
+
+            ss << "sigaction ok (signal number " << sig << ", ignored)";
+
+            log::inst()(Ilog::LEVEL_DEBUG, ss.str());
+        }
+    }
+
 	void sig_handler_SIGUSR1(int sig, siginfo_t* sinfo, void* buf) {
         boost::ignore_unused(sig, sinfo, buf);
 
@@ -409,20 +482,15 @@ namespace daemon_ns {
 		log::inst()(Ilog::LEVEL_DEBUG, "Signal received: SIGUSR2");
 	}
 
-    void sig_handler_SIGPIPE(int sig, siginfo_t* sinfo, void* buf) {
-        boost::ignore_unused(sig, sinfo, buf);
-
-        log::inst()(Ilog::LEVEL_DEBUG, "Signal received: SIGPIPE");
-
-        ::program_exit(EXIT_FAILURE);
-    }
-
     void sig_handler_SIGINT(int sig, siginfo_t* sinfo, void* buf) {
         boost::ignore_unused(sig, sinfo, buf);
 
-        log::inst()(Ilog::LEVEL_DEBUG, "Signal received: SIGINT");
-
-        ::program_exit(EXIT_SUCCESS);
+        // RU: Пока прокси работает, он завершается сам (см. control_t).
+        //     Журнал в обработчике не пишем: asynclog не async-signal-safe,
+        //     "Stop requested" пишет главный цикл.
+        if(!::program_stop()) {
+            ::program_exit(EXIT_SUCCESS);
+        }
     }
 
     void sig_handler_SIGABRT(int sig, siginfo_t* sinfo, void* buf) {
@@ -437,9 +505,12 @@ namespace daemon_ns {
     void sig_handler_SIGTERM(int sig, siginfo_t* sinfo, void* buf) {
         boost::ignore_unused(sig, sinfo, buf);
 
-        log::inst()(Ilog::LEVEL_DEBUG, "Signal received: SIGTERM");
-
-        ::program_exit(EXIT_SUCCESS);
+        // RU: Пока прокси работает, он завершается сам (см. control_t).
+        //     Журнал в обработчике не пишем: asynclog не async-signal-safe,
+        //     "Stop requested" пишет главный цикл.
+        if(!::program_stop()) {
+            ::program_exit(EXIT_SUCCESS);
+        }
     }
 
     void sig_handler_SIGQUIT(int sig, siginfo_t* sinfo, void* buf) {
@@ -453,7 +524,9 @@ namespace daemon_ns {
     void sig_handler_SIGHUP(int sig, siginfo_t* sinfo, void* buf) {
         boost::ignore_unused(sig, sinfo, buf);
 
-        log::inst()(Ilog::LEVEL_DEBUG, "Signal received: SIGHUP");
+        // RU: Журнал в обработчике не пишем (см. SIGINT): "Config:
+        //     reloading" пишет главный цикл
+        ::program_reload();
     }
 
 } // namespace daemon
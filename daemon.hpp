@@ -59,12 +59,15 @@ namespace daemon_ns {
 		daemon(void);
 
         virtual daemon::result_t go(bool demonization = true,
-                                    bool force = false);
+                                    bool force = false,
+                                    bool takeover = false);
 		virtual void finish(void);
 		
 		virtual ~daemon(void);
 	protected:
 		void setsignal(int sig, sighandler hndlr);
+        void ignoresignal(int sig);
+        bool lock_owner(void) const;
 	private:
 		static bool used;
 		
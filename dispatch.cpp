@@ -0,0 +1,138 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+
+#include <cstddef>
+
+#include <immintrin.h>
+
+#include "dispatch.hpp"
+
+namespace {
+    // RU: struct pollfd - это {int fd; short events; short revents;}, т.е.
+    //     8 байт, дескриптор - в младших 4 байтах. Сравниваются все 32-битные
+    //     слова, а в маске результата остаются только слова с fd (чётные).
+    static_assert(sizeof(struct pollfd) == 8 &&
+                  offsetof(struct pollfd, fd) == 0,
+                  "unexpected layout of struct pollfd");
+
+    inline int find_pollfd_tail(struct pollfd const* fds, int i, int count,
+                                int d) noexcept {
+        for(; i < count; i++) {
+            if(fds[i].fd == d) {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+#if defined(USE_CPU_DISPATCH) || !defined(__AVX2__)
+    ///
+    /// \brief find_pollfd_sse2 - 4 descriptors per iteration (x86-64 base)
+    ///
+    int find_pollfd_sse2(struct pollfd const* fds, int count, int d) noexcept {
+        __m128i const key = _mm_set1_epi32(d);
+        int i = 0;
+
+        for(; i + 4 <= count; i += 4) {
+            __m128i const a = _mm_loadu_si128(
+                        reinterpret_cast<__m128i const*>(fds + i));
+            __m128i const b = _mm_loadu_si128(
+                        reinterpret_cast<__m128i const*>(fds + i + 2));
+            int const m =
+                    (_mm_movemask_ps(_mm_castsi128_ps(
+                                         _mm_cmpeq_epi32(a, key))) & 0x5) |
+                    ((_mm_movemask_ps(_mm_castsi128_ps(
+                                          _mm_cmpeq_epi32(b, key))) & 0x5) << 4);
+            if(m) {
+                return i + (__builtin_ctz(m) >> 1);
+            }
+        }
+
+        return find_pollfd_tail(fds, i, count, d);
+    }
+#endif // USE_CPU_DISPATCH || !__AVX2__
+
+#if defined(USE_CPU_DISPATCH) || defined(__AVX2__)
+    ///
+    /// \brief find_pollfd_avx2 - 8 descriptors per iteration
+    ///
+    __attribute__((target("avx2")))
+    int find_pollfd_avx2(struct pollfd const* fds, int count, int d) noexcept {
+        __m256i const key = _mm256_set1_epi32(d);
+        int i = 0;
+
+        for(; i + 8 <= count; i += 8) {
+            __m256i const a = _mm256_loadu_si256(
+                        reinterpret_cast<__m256i const*>(fds + i));
+            __m256i const b = _mm256_loadu_si256(
+                        reinterpret_cast<__m256i const*>(fds + i + 4));
+            int const m =
+                    (_mm256_movemask_ps(_mm256_castsi256_ps(
+                                            _mm256_cmpeq_epi32(a, key))) &
+                     0x55) |
+                    ((_mm256_movemask_ps(_mm256_castsi256_ps(
+                                             _mm256_cmpeq_epi32(b, key))) &
+                      0x55) << 8);
+            if(m) {
+                return i + (__builtin_ctz(m) >> 1);
+            }
+        }
+
+        return find_pollfd_tail(fds, i, count, d);
+    }
+#endif // USE_CPU_DISPATCH || __AVX2__
+
+#if defined(USE_CPU_DISPATCH)
+    typedef int (*find_pollfd_t)(struct pollfd const*, int, int);
+
+    find_pollfd_t select_find_pollfd(void) noexcept {
+        __builtin_cpu_init();
+
+        return __builtin_cpu_supports("avx2") ?
+                    find_pollfd_avx2 : find_pollfd_sse2;
+    }
+
+    find_pollfd_t const find_pollfd_impl = select_find_pollfd();
+#elif defined(__AVX2__)
+    inline int find_pollfd_impl(struct pollfd const* fds, int count,
+                                int d) noexcept {
+        return find_pollfd_avx2(fds, count, d);
+    }
+#else
+    inline int find_pollfd_impl(struct pollfd const* fds, int count,
+                                int d) noexcept {
+        return find_pollfd_sse2(fds, count, d);
+    }
+#endif // USE_CPU_DISPATCH
+} // namespace
+
+namespace proxy_ns {
+    int find_pollfd_index(struct pollfd const* fds, int count,
+                          int d) noexcept {
+        return find_pollfd_impl(fds, count, d);
+    }
+} // namespace proxy_ns
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
@@ -0,0 +1,60 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+
+#pragma once
+
+#ifndef __DISPATCH_HPP__
+#define __DISPATCH_HPP__
+
+#include <poll.h>
+
+///
+/// Runtime CPU dispatch for hot loops.
+///
+/// RU: Переносимая сборка (cmake -DPORTABLE=ON) компилируется без
+///     -march=native и определяет USE_CPU_DISPATCH. Тогда функции из
+///     dispatch.cpp собираются в двух вариантах (AVX2 и базовый x86-64),
+///     а нужный выбирается один раз при запуске программы по
+///     __builtin_cpu_supports. Без USE_CPU_DISPATCH собирается один
+///     вариант: сборка с -march=native и так использует все возможности
+///     процессора.
+///
+///     target_clones (ifunc) не используется: GCC не может собрать такие
+///     функции с LTO, если они вызываются из другой единицы трансляции.
+///
+
+namespace proxy_ns {
+    ///
+    /// \brief find_pollfd_index - index of the descriptor d in fds
+    /// \param fds
+    /// \param count
+    /// \param d
+    /// \return index or -1
+    ///
+    int find_pollfd_index(struct pollfd const* fds, int count, int d) noexcept;
+} // namespace proxy_ns
+
+#endif // __DISPATCH_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
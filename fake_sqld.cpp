@@ -0,0 +1,954 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+/* *****************************************************************************
+ * RU: Имитация сервера СУБД для нагрузочного тестирования прокси без
+ *     настоящей базы данных. Поддерживается минимум протоколов MySQL
+ *     (handshake v10, COM_QUERY/COM_PING/COM_QUIT, текстовый result set)
+ *     и PostgreSQL v3 (startup без пароля, простой и расширенный протокол
+ *     запросов). На любой запрос возвращается результат из ROWS строк по
+ *     одной колонке шириной WIDTH байт с задержкой LATENCY микросекунд.
+ *
+ *     Каждый поток имеет свой epoll и свой слушающий сокет (SO_REUSEPORT),
+ *     соединения между потоками распределяет ядро.
+ *
+ *     Пример:
+ *
+ *     fake_sqld --protocol=pgsql -d 5432 -t 4 --rows=10 --latency=500
+ * ************************************************************************** */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <deque>
+#include <queue>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef FAKE_SQLD_EVENTS
+    #define FAKE_SQLD_EVENTS 256
+#endif // FAKE_SQLD_EVENTS
+
+#ifndef FAKE_SQLD_READ_SIZE
+    #define FAKE_SQLD_READ_SIZE 65536
+#endif // FAKE_SQLD_READ_SIZE
+
+namespace {
+    typedef enum {
+        PROTOCOL_MYSQL = 0,
+        PROTOCOL_PGSQL
+    } protocol_t;
+
+    struct configuration {
+        protocol_t protocol;
+        std::string addr;
+        boost::uint16_t port;
+        unsigned int threads;
+        boost::uint32_t rows;
+        boost::uint32_t width;
+        boost::uint32_t latency;    // us
+
+        configuration(void) :
+            protocol(PROTOCOL_MYSQL),
+            addr("127.0.0.1"),
+            port(0),
+            threads(std::max(1U, std::thread::hardware_concurrency())),
+            rows(1),
+            width(16),
+            latency(0) {
+        }
+    };
+
+    ///
+    /// \brief The responses struct - prebuilt protocol messages
+    ///
+    /// RU: Все ответы не зависят от запроса, поэтому собираются один раз.
+    ///
+    struct responses {
+        // MySQL
+        std::string my_handshake;
+        std::string my_auth_ok;         // seq 2
+        std::string my_ok;              // seq 1
+        std::string my_result;          // seq 1..N
+
+        // PostgreSQL
+        std::string pg_no_ssl;
+        std::string pg_startup;         // AuthenticationOk .. ReadyForQuery
+        std::string pg_query;           // T, D.., C, Z
+        std::string pg_parse;
+        std::string pg_bind;
+        std::string pg_close;
+        std::string pg_describe_portal;
+        std::string pg_describe_statement;
+        std::string pg_execute;         // D.., C
+        std::string pg_sync;
+    };
+
+    struct statistic {
+        std::atomic<boost::uint64_t> connections;
+        std::atomic<boost::uint64_t> queries;
+        std::atomic<boost::uint64_t> bytes_sent;
+    };
+
+    configuration config;
+    responses resp;
+    statistic stats;
+    std::atomic<bool> stop(false);
+
+    option longopts[] = {
+        {"help",        no_argument,       0, 'h'},
+        {"protocol",    required_argument, 0, 'P'},
+        {"addr",        required_argument, 0, 'i'},
+        {"port",        required_argument, 0, 'd'},
+        {"threads",     required_argument, 0, 't'},
+        {"rows",        required_argument, 0, 'r'},
+        {"width",       required_argument, 0, 'w'},
+        {"latency",     required_argument, 0, 'l'},
+        {0,             0,                 0, 0x00}
+    };
+
+    void help(char const* name) noexcept {
+        std::cout << "Use " << name << " [OPTIONS]" << std::endl;
+        std::cout << std::endl << "Options:" << std::endl;
+        std::cout << "-h\t--help\t\t\t\t"
+                  << "- show this help and exit" << std::endl;
+        std::cout << "-P\t--protocol=[mysql|pgsql]\t"
+                  << "- wire protocol (mysql)" << std::endl;
+        std::cout << "-i\t--addr=[IPADDRESS]\t\t"
+                  << "- listen address (127.0.0.1)" << std::endl;
+        std::cout << "-d\t--port=[PORT]\t\t\t"
+                  << "- listen port (3306 or 5432)" << std::endl;
+        std::cout << "-t\t--threads=[N]\t\t\t"
+                  << "- worker threads (number of CPUs)" << std::endl;
+        std::cout << "-r\t--rows=[N]\t\t\t"
+                  << "- rows in every result (1)" << std::endl;
+        std::cout << "-w\t--width=[BYTES]\t\t\t"
+                  << "- size of the value in every row (16)" << std::endl;
+        std::cout << "-l\t--latency=[USEC]\t\t"
+                  << "- delay before every result (0)" << std::endl;
+    }
+
+    boost::uint64_t now_us(void) noexcept {
+        return static_cast<boost::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now().
+                            time_since_epoch()).count());
+    }
+
+    /* ***** MySQL ***** */
+
+    void put_le(std::string& s, boost::uint64_t v, size_t n) {
+        for(size_t i = 0; i < n; i++) {
+            s += static_cast<char>((v >> (8 * i)) & 0xff);
+        }
+    }
+
+    void put_lenenc_int(std::string& s, boost::uint64_t v) {
+        if(v < 251) {
+            put_le(s, v, 1);
+        }
+        else if(v < (1ULL << 16)) {
+            s += '\xfc';
+            put_le(s, v, 2);
+        }
+        else if(v < (1ULL << 24)) {
+            s += '\xfd';
+            put_le(s, v, 3);
+        }
+        else {
+            s += '\xfe';
+            put_le(s, v, 8);
+        }
+    }
+
+    void put_lenenc_str(std::string& s, std::string const& v) {
+        put_lenenc_int(s, v.size());
+        s += v;
+    }
+
+    void my_packet(std::string& out, boost::uint8_t seq,
+                   std::string const& payload) {
+        put_le(out, payload.size(), 3);
+        out += static_cast<char>(seq);
+        out += payload;
+    }
+
+    void build_mysql(void) {
+        // RU: CLIENT_LONG_PASSWORD | CLIENT_FOUND_ROWS | CLIENT_LONG_FLAG |
+        //     CLIENT_CONNECT_WITH_DB | CLIENT_PROTOCOL_41 |
+        //     CLIENT_TRANSACTIONS | CLIENT_SECURE_CONNECTION |
+        //     CLIENT_MULTI_RESULTS | CLIENT_PLUGIN_AUTH
+        boost::uint32_t const caps = 0x1 | 0x2 | 0x4 | 0x8 | 0x200 |
+                                     0x2000 | 0x8000 | 0x20000 | 0x80000;
+        std::string p;
+
+        p += '\x0a';
+        p += std::string("5.7.99-fake_sqld", 17);      // with '\0'
+        put_le(p, 1, 4);                                // connection id
+        p += "abcdefgh";                                // auth data 1
+        p += '\0';
+        put_le(p, caps & 0xffff, 2);
+        p += '\x21';                                    // utf8_general_ci
+        put_le(p, 0x0002, 2);                           // autocommit
+        put_le(p, caps >> 16, 2);
+        p += static_cast<char>(21);
+        p += std::string(10, '\0');
+        p += std::string("ijklmnopqrst", 13);           // auth data 2
+        p += std::string("mysql_native_password", 22);
+        my_packet(resp.my_handshake, 0, p);
+
+        std::string const ok("\x00\x00\x00\x02\x00\x00\x00", 7);
+        my_packet(resp.my_auth_ok, 2, ok);
+        my_packet(resp.my_ok, 1, ok);
+
+        std::string const eof("\xfe\x00\x00\x02\x00", 5);
+        boost::uint8_t seq = 1;
+
+        p.clear();
+        put_lenenc_int(p, 1);
+        my_packet(resp.my_result, seq++, p);
+
+        p.clear();
+        put_lenenc_str(p, "def");
+        put_lenenc_str(p, "");
+        put_lenenc_str(p, "");
+        put_lenenc_str(p, "");
+        put_lenenc_str(p, "c");
+        put_lenenc_str(p, "");
+        p += '\x0c';
+        put_le(p, 0x21, 2);
+        put_le(p, config.width, 4);
+        p += '\xfd';                                    // VAR_STRING
+        put_le(p, 0, 2);
+        p += '\0';
+        put_le(p, 0, 2);
+        my_packet(resp.my_result, seq++, p);
+        my_packet(resp.my_result, seq++, eof);
+
+        p.clear();
+        put_lenenc_str(p, std::string(config.width, 'x'));
+        for(boost::uint32_t i = 0; i < config.rows; i++) {
+            my_packet(resp.my_result, seq++, p);
+        }
+
+        my_packet(resp.my_result, seq++, eof);
+    }
+
+    /* ***** PostgreSQL ***** */
+
+    void put_be(std::string& s, boost::uint64_t v, size_t n) {
+        for(size_t i = n; i > 0; i--) {
+            s += static_cast<char>((v >> (8 * (i - 1))) & 0xff);
+        }
+    }
+
+    boost::uint32_t get_be32(char const* p) {
+        unsigned char const* u = reinterpret_cast<unsigned char const*>(p);
+        return (static_cast<boost::uint32_t>(u[0]) << 24) |
+               (static_cast<boost::uint32_t>(u[1]) << 16) |
+               (static_cast<boost::uint32_t>(u[2]) << 8) |
+                static_cast<boost::uint32_t>(u[3]);
+    }
+
+    void pg_message(std::string& out, char type, std::string const& body) {
+        out += type;
+        put_be(out, body.size() + 4, 4);
+        out += body;
+    }
+
+    void build_pgsql(void) {
+        std::string b;
+
+        resp.pg_no_ssl = "N";
+
+        put_be(b, 0, 4);
+        pg_message(resp.pg_startup, 'R', b);            // AuthenticationOk
+
+        for(auto const& kv : std::map<std::string, std::string> {
+                {"server_version", "13.0 (fake_sqld)"},
+                {"server_encoding", "UTF8"},
+                {"client_encoding", "UTF8"},
+                {"DateStyle", "ISO, MDY"},
+                {"integer_datetimes", "on"},
+                {"standard_conforming_strings", "on"}}) {
+            b = kv.first;
+            b += '\0';
+            b += kv.second;
+            b += '\0';
+            pg_message(resp.pg_startup, 'S', b);
+        }
+
+        b.clear();
+        put_be(b, 1, 4);                                // process id
+        put_be(b, 2, 4);                                // secret key
+        pg_message(resp.pg_startup, 'K', b);
+
+        std::string ready;
+        pg_message(ready, 'Z', "I");
+        resp.pg_startup += ready;
+
+        std::string row_description;
+        b.clear();
+        put_be(b, 1, 2);
+        b += std::string("c", 2);
+        put_be(b, 0, 4);                                // table oid
+        put_be(b, 0, 2);                                // column number
+        put_be(b, 25, 4);                               // text
+        put_be(b, 0xffff, 2);                           // typlen -1
+        put_be(b, 0xffffffff, 4);                       // typmod -1
+        put_be(b, 0, 2);                                // text format
+        pg_message(row_description, 'T', b);
+
+        std::string rows;
+        b.clear();
+        put_be(b, 1, 2);
+        put_be(b, config.width, 4);
+        b += std::string(config.width, 'x');
+        for(boost::uint32_t i = 0; i < config.rows; i++) {
+            pg_message(rows, 'D', b);
+        }
+
+        pg_message(rows, 'C', "SELECT " + std::to_string(config.rows) +
+                                  std::string(1, '\0'));
+
+        resp.pg_query = row_description + rows + ready;
+        resp.pg_execute = rows;
+        resp.pg_describe_portal = row_description;
+
+        b.clear();
+        put_be(b, 0, 2);
+        pg_message(resp.pg_describe_statement, 't', b);
+        resp.pg_describe_statement += row_description;
+
+        pg_message(resp.pg_parse, '1', "");
+        pg_message(resp.pg_bind, '2', "");
+        pg_message(resp.pg_close, '3', "");
+        resp.pg_sync = ready;
+    }
+
+    /* ***** server ***** */
+
+    typedef enum {
+        STATE_MY_AUTH = 0,
+        STATE_MY_COMMAND,
+        STATE_PG_STARTUP,
+        STATE_PG_READY
+    } state_t;
+
+    struct pending {
+        boost::uint64_t due;        // us, steady clock
+        std::string const* msg;
+    };
+
+    struct connection {
+        state_t state;
+        std::string in;
+        std::string out;
+        size_t sent;
+        std::deque<pending> queue;  // RU: ответы в порядке запросов
+        bool want_out;              // RU: EPOLLOUT зарегистрирован
+        bool closing;
+    };
+
+    class worker {
+        typedef worker self;
+    public:
+        worker(void) : ep(-1), listen_sd(-1) {}
+
+        bool start(void);
+        void run(void);
+
+        ~worker(void) noexcept;
+    private:
+        void accept_all(void);
+        void on_event(int sd, boost::uint32_t ev);
+        bool parse(connection& c, boost::uint64_t now);
+        bool parse_mysql(connection& c, boost::uint64_t now);
+        bool parse_pgsql(connection& c, boost::uint64_t now);
+        void reply(connection& c, std::string const* msg,
+                   boost::uint64_t due);
+        bool release(int sd, connection& c, boost::uint64_t now);
+        bool flush(int sd, connection& c);
+        void close_connection(int sd);
+        void run_timers(boost::uint64_t now);
+
+        int ep;
+        int listen_sd;
+        std::map<int, connection> connections;
+
+        // RU: (время, сокет) - ближайший срок отправки отложенного ответа
+        std::priority_queue<std::pair<boost::uint64_t, int>,
+                            std::vector<std::pair<boost::uint64_t, int>>,
+                            std::greater<std::pair<boost::uint64_t, int>>>
+            timers;
+    };
+
+    bool worker::start(void) {
+        struct sockaddr_in a;
+        int const on = 1;
+
+        std::memset(&a, 0, sizeof(a));
+        a.sin_family = AF_INET;
+        a.sin_port = htons(config.port);
+
+        if(::inet_pton(AF_INET, config.addr.c_str(), &a.sin_addr) != 1) {
+            std::cerr << "fake_sqld: invalid address '" << config.addr
+                      << "'" << std::endl;
+            return false;
+        }
+
+        this->listen_sd = ::socket(AF_INET,
+                                   SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                   0);
+        if(this->listen_sd < 0) {
+            std::cerr << "fake_sqld: socket: " << ::strerror(errno)
+                      << std::endl;
+            return false;
+        }
+
+        (void) ::setsockopt(this->listen_sd, SOL_SOCKET, SO_REUSEADDR,
+                            &on, sizeof(on));
+        (void) ::setsockopt(this->listen_sd, SOL_SOCKET, SO_REUSEPORT,
+                            &on, sizeof(on));
+
+        if(::bind(this->listen_sd, reinterpret_cast<struct sockaddr*>(&a),
+                  sizeof(a)) < 0 ||
+           ::listen(this->listen_sd, SOMAXCONN) < 0) {
+            std::cerr << "fake_sqld: bind/listen " << config.addr << ":"
+                      << config.port << ": " << ::strerror(errno)
+                      << std::endl;
+            return false;
+        }
+
+        this->ep = ::epoll_create1(EPOLL_CLOEXEC);
+        if(this->ep < 0) {
+            std::cerr << "fake_sqld: epoll_create1: " << ::strerror(errno)
+                      << std::endl;
+            return false;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = this->listen_sd;
+
+        return ::epoll_ctl(this->ep, EPOLL_CTL_ADD, this->listen_sd, &ev) == 0;
+    }
+
+    void worker::run(void) {
+        struct epoll_event events[FAKE_SQLD_EVENTS];
+
+        while(!stop) {
+            int timeout = 100;
+
+            if(!this->timers.empty()) {
+                boost::uint64_t const now = now_us();
+                boost::uint64_t const due = this->timers.top().first;
+
+                timeout = (due <= now) ?
+                            0 : static_cast<int>(std::min<boost::uint64_t>(
+                                                     (due - now + 999) / 1000,
+                                                     100));
+            }
+
+            int const n = ::epoll_wait(this->ep, events, FAKE_SQLD_EVENTS,
+                                       timeout);
+
+            for(int i = 0; i < n; i++) {
+                if(events[i].data.fd == this->listen_sd) {
+                    this->accept_all();
+                }
+                else {
+                    this->on_event(events[i].data.fd, events[i].events);
+                }
+            }
+
+            this->run_timers(now_us());
+        }
+    }
+
+    worker::~worker(void) noexcept {
+        for(auto const& c : this->connections) {
+            (void) ::close(c.first);
+        }
+
+        if(this->listen_sd >= 0) {
+            (void) ::close(this->listen_sd);
+        }
+
+        if(this->ep >= 0) {
+            (void) ::close(this->ep);
+        }
+    }
+
+    void worker::accept_all(void) {
+        for(;;) {
+            int const sd = ::accept4(this->listen_sd, nullptr, nullptr,
+                                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(sd < 0) {
+                return;
+            }
+
+            int const on = 1;
+            (void) ::setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = sd;
+
+            if(::epoll_ctl(this->ep, EPOLL_CTL_ADD, sd, &ev) < 0) {
+                (void) ::close(sd);
+                continue;
+            }
+
+            stats.connections++;
+
+            connection& c = this->connections[sd];
+            c = connection();
+
+            if(PROTOCOL_MYSQL == config.protocol) {
+                // RU: В MySQL первым говорит сервер
+                c.state = STATE_MY_AUTH;
+                this->reply(c, &resp.my_handshake, 0);
+                if(!this->release(sd, c, now_us())) {
+                    this->close_connection(sd);
+                }
+            }
+            else {
+                c.state = STATE_PG_STARTUP;
+            }
+        }
+    }
+
+    void worker::on_event(int sd, boost::uint32_t ev) {
+        auto search = this->connections.find(sd);
+
+        if(search == this->connections.end()) {
+            return;
+        }
+
+        connection& c = search->second;
+        bool ok = true;
+
+        if(ev & EPOLLIN) {
+            char buf[FAKE_SQLD_READ_SIZE];
+
+            for(;;) {
+                ssize_t const rc = ::recv(sd, buf, sizeof(buf), 0);
+
+                if(rc > 0) {
+                    c.in.append(buf, rc);
+                    continue;
+                }
+
+                if(0 == rc || (errno != EAGAIN && errno != EWOULDBLOCK &&
+                               errno != EINTR)) {
+                    ok = false;
+                }
+
+                break;
+            }
+
+            boost::uint64_t const now = now_us();
+
+            ok = this->parse(c, now) && ok;
+            ok = ok && this->release(sd, c, now);
+        }
+        else if(ev & (EPOLLERR | EPOLLHUP)) {
+            ok = false;
+        }
+
+        if(ok && (ev & EPOLLOUT)) {
+            ok = this->flush(sd, c);
+        }
+
+        if(!ok) {
+            this->close_connection(sd);
+        }
+    }
+
+    bool worker::parse(connection& c, boost::uint64_t now) {
+        return (PROTOCOL_MYSQL == config.protocol) ?
+                    this->parse_mysql(c, now) : this->parse_pgsql(c, now);
+    }
+
+    ///
+    /// \brief worker::parse_mysql
+    /// \return false if the connection must be closed
+    ///
+    bool worker::parse_mysql(connection& c, boost::uint64_t now) {
+        size_t pos = 0;
+
+        while(!c.closing && c.in.size() - pos >= 4) {
+            unsigned char const* h =
+                    reinterpret_cast<unsigned char const*>(c.in.data() + pos);
+            size_t const len = h[0] | (h[1] << 8) | (h[2] << 16);
+
+            if(c.in.size() - pos < 4 + len) {
+                break;
+            }
+
+            unsigned char const cmd = len ? h[4] : 0;
+            pos += 4 + len;
+
+            if(STATE_MY_AUTH == c.state) {
+                // RU: Любые учётные данные принимаются
+                c.state = STATE_MY_COMMAND;
+                this->reply(c, &resp.my_auth_ok, 0);
+                continue;
+            }
+
+            switch(cmd) {
+            case 0x01:  // COM_QUIT
+                c.closing = true;
+                break;
+            case 0x03:  // COM_QUERY
+                stats.queries++;
+                this->reply(c, &resp.my_result, now + config.latency);
+                break;
+            default:    // COM_PING, COM_INIT_DB, ...
+                this->reply(c, &resp.my_ok, 0);
+                break;
+            }
+        }
+
+        c.in.erase(0, pos);
+
+        return true;
+    }
+
+    ///
+    /// \brief worker::parse_pgsql
+    /// \return false if the connection must be closed
+    ///
+    bool worker::parse_pgsql(connection& c, boost::uint64_t now) {
+        size_t pos = 0;
+
+        while(!c.closing) {
+            size_t const avail = c.in.size() - pos;
+            char const* p = c.in.data() + pos;
+
+            if(STATE_PG_STARTUP == c.state) {
+                if(avail < 8) {
+                    break;
+                }
+
+                size_t const len = get_be32(p);
+                if(len < 8 || len > 10000) {
+                    return false;
+                }
+
+                if(avail < len) {
+                    break;
+                }
+
+                boost::uint32_t const code = get_be32(p + 4);
+                pos += len;
+
+                if(80877103 == code || 80877104 == code) {
+                    // RU: SSLRequest/GSSENCRequest - отказ, клиент
+                    //     продолжит без шифрования
+                    this->reply(c, &resp.pg_no_ssl, 0);
+                }
+                else if(80877102 == code) {
+                    // RU: CancelRequest
+                    return false;
+                }
+                else {
+                    c.state = STATE_PG_READY;
+                    this->reply(c, &resp.pg_startup, 0);
+                }
+
+                continue;
+            }
+
+            if(avail < 5) {
+                break;
+            }
+
+            size_t const len = get_be32(p + 1);
+            if(len < 4) {
+                return false;
+            }
+
+            if(avail < 1 + len) {
+                break;
+            }
+
+            pos += 1 + len;
+
+            switch(p[0]) {
+            case 'Q':
+                stats.queries++;
+                this->reply(c, &resp.pg_query, now + config.latency);
+                break;
+            case 'P':
+                this->reply(c, &resp.pg_parse, 0);
+                break;
+            case 'B':
+                this->reply(c, &resp.pg_bind, 0);
+                break;
+            case 'D':
+                this->reply(c, (len > 4 && 'S' == p[5]) ?
+                                &resp.pg_describe_statement :
+                                &resp.pg_describe_portal, 0);
+                break;
+            case 'E':
+                stats.queries++;
+                this->reply(c, &resp.pg_execute, now + config.latency);
+                break;
+            case 'C':
+                this->reply(c, &resp.pg_close, 0);
+                break;
+            case 'S':
+                this->reply(c, &resp.pg_sync, 0);
+                break;
+            case 'X':
+                c.closing = true;
+                break;
+            default:    // 'H' (Flush) and others
+                break;
+            }
+        }
+
+        c.in.erase(0, pos);
+
+        return true;
+    }
+
+    void worker::reply(connection& c, std::string const* msg,
+                       boost::uint64_t due) {
+        c.queue.push_back(pending{due, msg});
+    }
+
+    ///
+    /// \brief worker::release - move due responses to the output buffer
+    /// \return false if the connection must be closed
+    ///
+    bool worker::release(int sd, connection& c, boost::uint64_t now) {
+        while(!c.queue.empty() && c.queue.front().due <= now) {
+            c.out += *c.queue.front().msg;
+            c.queue.pop_front();
+        }
+
+        if(!c.queue.empty()) {
+            this->timers.emplace(c.queue.front().due, sd);
+        }
+
+        return this->flush(sd, c);
+    }
+
+    ///
+    /// \brief worker::flush
+    /// \return false if the connection must be closed
+    ///
+    bool worker::flush(int sd, connection& c) {
+        while(c.sent < c.out.size()) {
+            ssize_t const rc = ::send(sd, c.out.data() + c.sent,
+                                      c.out.size() - c.sent, MSG_NOSIGNAL);
+            if(rc < 0) {
+                if(EAGAIN == errno || EWOULDBLOCK == errno) {
+                    break;
+                }
+                if(EINTR == errno) {
+                    continue;
+                }
+                return false;
+            }
+
+            c.sent += rc;
+            stats.bytes_sent += rc;
+        }
+
+        if(c.sent == c.out.size()) {
+            c.out.clear();
+            c.sent = 0;
+
+            if(c.closing && c.queue.empty()) {
+                return false;
+            }
+        }
+
+        bool const want_out = !c.out.empty();
+
+        if(want_out != c.want_out) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN | (want_out ? static_cast<boost::uint32_t>(EPOLLOUT) : 0U);
+            ev.data.fd = sd;
+
+            (void) ::epoll_ctl(this->ep, EPOLL_CTL_MOD, sd, &ev);
+            c.want_out = want_out;
+        }
+
+        return true;
+    }
+
+    void worker::close_connection(int sd) {
+        (void) ::epoll_ctl(this->ep, EPOLL_CTL_DEL, sd, nullptr);
+        (void) ::close(sd);
+        this->connections.erase(sd);
+    }
+
+    void worker::run_timers(boost::uint64_t now) {
+        while(!this->timers.empty() && this->timers.top().first <= now) {
+            int const sd = this->timers.top().second;
+            this->timers.pop();
+
+            // RU: Сокет мог быть закрыт (и даже открыт заново) - лишняя
+            //     проверка безвредна
+            auto search = this->connections.find(sd);
+            if(search != this->connections.end() &&
+               !this->release(sd, search->second, now)) {
+                this->close_connection(sd);
+            }
+        }
+    }
+
+    void on_signal(int) {
+        stop = true;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    int optc = 0;
+
+    while((optc = getopt_long(argc, argv, ":hP:i:d:t:r:w:l:",
+                              longopts, 0)) != -1) {
+        try {
+            switch(optc) {
+            case 'h':
+                help(argv[0]);
+                return EXIT_SUCCESS;
+            case 'P':
+                if(std::string("mysql") == optarg) {
+                    config.protocol = PROTOCOL_MYSQL;
+                }
+                else if(std::string("pgsql") == optarg) {
+                    config.protocol = PROTOCOL_PGSQL;
+                }
+                else {
+                    throw boost::bad_lexical_cast();
+                }
+                break;
+            case 'i':
+                config.addr = optarg;
+                break;
+            case 'd':
+                config.port = boost::lexical_cast<boost::uint16_t>(optarg);
+                break;
+            case 't':
+                config.threads = boost::lexical_cast<unsigned int>(optarg);
+                break;
+            case 'r':
+                config.rows = boost::lexical_cast<boost::uint32_t>(optarg);
+                break;
+            case 'w':
+                config.width = boost::lexical_cast<boost::uint32_t>(optarg);
+                break;
+            case 'l':
+                config.latency = boost::lexical_cast<boost::uint32_t>(optarg);
+                break;
+            default:
+                help(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        catch(boost::bad_lexical_cast const&) {
+            std::cerr << argv[0] << ": invalid value '" << optarg << "'"
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(!config.port) {
+        config.port = (PROTOCOL_MYSQL == config.protocol) ? 3306 : 5432;
+    }
+
+    if(!config.threads) {
+        config.threads = 1;
+    }
+
+    if(PROTOCOL_MYSQL == config.protocol) {
+        build_mysql();
+    }
+    else {
+        build_pgsql();
+    }
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::vector<worker> workers(config.threads);
+
+    for(auto& w : workers) {
+        if(!w.start()) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "fake_sqld: "
+              << ((PROTOCOL_MYSQL == config.protocol) ? "mysql" : "pgsql")
+              << " on " << config.addr << ":" << config.port << ", "
+              << config.threads << " thread(s), " << config.rows
+              << " row(s) x " << config.width << " bytes, latency "
+              << config.latency << " us" << std::endl;
+
+    std::vector<std::thread> threads;
+
+    for(auto& w : workers) {
+        threads.emplace_back(&worker::run, &w);
+    }
+
+    for(auto& t : threads) {
+        t.join();
+    }
+
+    std::cout << "Connections: " << stats.connections << std::endl;
+    std::cout << "Queries:     " << stats.queries << std::endl;
+    std::cout << "Bytes sent:  " << stats.bytes_sent << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
@@ -26,6 +26,9 @@
 #include <iostream>
 #include <ios>
 #include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -51,6 +54,12 @@ namespace log_ns {
     baselog::~baselog(void) {
     }
 
+    // RU: Определено раньше log::instance: при завершении программы
+    //     строки должны пережить лог (asynclog пишет остаток очереди в
+    //     деструкторе).
+    std::array<std::string, Ilog::LEVEL_END> const
+        loghelper::lvlstr{"DEFAULT", "DEBUG", "INFO", "ERROR"};
+
     /* ***** CLASS: log ***** */
 	log log::instance;
 	
@@ -147,6 +156,165 @@ namespace log_ns {
 		}
 	}
 
+    /* ***** CLASS: asynclog ***** */
+    std::atomic<boost::uint64_t> asynclog::generation(0);
+
+    asynclog::asynclog(boost::shared_ptr<Ilog> backend) :
+        baselog(),
+        backend(backend),
+        id(++self::generation),
+        rings_mutex(),
+        rings(),
+        wake_mutex(),
+        wake(),
+        stop(false),
+        reported_dropped(0),
+        thread() {
+
+        this->thread = std::thread(&self::writer, this);
+    }
+
+    void asynclog::write(Ilog::level_t l, std::string const& msg) {
+        if(this->get_level() <= l) {
+            this->push(l, msg.data(), msg.size());
+        }
+    }
+
+    void asynclog::write(Ilog::level_t l, char const* msg) {
+        if(this->get_level() <= l) {
+            this->push(l, msg, std::strlen(msg));
+        }
+    }
+
+    boost::shared_ptr<Ilog> asynclog::get_backend(void) {
+        return this->backend;
+    }
+
+    boost::uint64_t asynclog::get_dropped(void) const {
+        boost::uint64_t dropped = 0;
+
+        std::lock_guard<std::mutex> lock(this->rings_mutex);
+
+        for(auto const& r : this->rings) {
+            dropped += r.get()->get_dropped();
+        }
+
+        return dropped;
+    }
+
+    asynclog::~asynclog(void) {
+        {
+            std::lock_guard<std::mutex> lock(this->wake_mutex);
+            this->stop = true;
+        }
+
+        this->wake.notify_one();
+
+        if(this->thread.joinable()) {
+            this->thread.join();
+        }
+    }
+
+    void asynclog::push(Ilog::level_t l, char const* msg, size_t len) {
+        ring_t* r = this->thread_ring();
+        record rec;
+        bool first = false;
+
+        rec.level = l;
+        rec.len = static_cast<boost::uint32_t>(
+                    std::min(len, sizeof(rec.msg) - 1));
+
+        std::memcpy(rec.msg, msg, rec.len);
+        rec.msg[rec.len] = '\0';
+
+        if(rec.len < len && rec.len >= 3) {
+            std::memcpy(rec.msg + rec.len - 3, "...", 3);
+        }
+
+        // RU: Писатель будится только при переходе кольца из пустого
+        //     состояния; в остальных случаях он проснётся по таймеру.
+        if(r->try_push(rec, first) && first) {
+            this->wake.notify_one();
+        }
+    }
+
+    asynclog::ring_t* asynclog::thread_ring(void) {
+        struct slot {
+            boost::uint64_t id;
+            ring_t* ring;
+        };
+
+        static thread_local slot tls{0, nullptr};
+
+        if(tls.id != this->id) {
+            std::unique_ptr<ring_t> r(new ring_t());
+            std::lock_guard<std::mutex> lock(this->rings_mutex);
+
+            tls.ring = r.get();
+            tls.id = this->id;
+
+            this->rings.push_back(std::move(r));
+        }
+
+        return tls.ring;
+    }
+
+    void asynclog::writer(void) {
+        for(;;) {
+            bool const last = this->stop;
+
+            if(0 == this->drain() && !last) {
+                std::unique_lock<std::mutex> lock(this->wake_mutex);
+                this->wake.wait_for(
+                            lock,
+                            std::chrono::milliseconds(ASYNCLOG_FLUSH_INTERVAL));
+            }
+
+            boost::uint64_t const dropped = this->get_dropped();
+
+            if(dropped != this->reported_dropped) {
+                std::stringstream ss;
+
+                ss << "Log records dropped: "
+                   << (dropped - this->reported_dropped)
+                   << " (total=" << dropped << ")";
+
+                this->backend.get()->write(Ilog::LEVEL_ERROR, ss.str());
+                this->reported_dropped = dropped;
+            }
+
+            if(last) {
+                break;
+            }
+        }
+    }
+
+    size_t asynclog::drain(void) {
+        std::vector<ring_t*> snapshot;
+        size_t count = 0;
+        record rec;
+
+        {
+            std::lock_guard<std::mutex> lock(this->rings_mutex);
+
+            snapshot.reserve(this->rings.size());
+            for(auto const& r : this->rings) {
+                snapshot.push_back(r.get());
+            }
+        }
+
+        // RU: Кольца не удаляются до уничтожения объекта, поэтому
+        //     указатели остаются действительными без блокировки.
+        for(ring_t* r : snapshot) {
+            while(r->try_pop(rec)) {
+                this->backend.get()->write(rec.level, rec.msg);
+                count++;
+            }
+        }
+
+        return count;
+    }
+
 	/* ***** CLASS: stdoutlog ***** */
     stdoutlog::stdoutlog(void) : baselog() {
 	}
@@ -168,9 +336,6 @@ namespace log_ns {
 	}
 
     /* ***** CLASS: loghelper ***** */
-    std::array<std::string, Ilog::LEVEL_END> const
-        loghelper::lvlstr{"DEFAULT", "DEBUG", "INFO", "ERROR"};
-
     loghelper::loghelper(void) {
     }
 
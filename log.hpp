@@ -25,6 +25,12 @@
 #define __LOG_HPP__
 
 #include <array>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 #include <exception>
 #include <stdexcept>
 
@@ -32,6 +38,31 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/core/ignore_unused.hpp>
+#include <boost/cstdint.hpp>
+
+#include "tap_ring.hpp"
+
+///
+/// RU: Минимальный уровень сообщений, который попадает в программу.
+///     Вызовы write_lazy с меньшим уровнем удаляются компилятором.
+///     Например, -DLOG_COMPILE_LEVEL=2 (LEVEL_INFO) убирает отладочные
+///     сообщения из релизной сборки.
+///
+#ifndef LOG_COMPILE_LEVEL
+    #define LOG_COMPILE_LEVEL 0 // Ilog::LEVEL_DEFAULT
+#endif // LOG_COMPILE_LEVEL
+
+#ifndef ASYNCLOG_RING_SIZE
+    #define ASYNCLOG_RING_SIZE 1024
+#endif // ASYNCLOG_RING_SIZE
+
+#ifndef ASYNCLOG_RECORD_SIZE
+    #define ASYNCLOG_RECORD_SIZE 256
+#endif // ASYNCLOG_RECORD_SIZE
+
+#ifndef ASYNCLOG_FLUSH_INTERVAL
+    #define ASYNCLOG_FLUSH_INTERVAL 100 // ms
+#endif // ASYNCLOG_FLUSH_INTERVAL
 
 namespace log_ns {
 	class Ilog {
@@ -79,6 +110,28 @@ namespace log_ns {
 		void operator()(Ilog::level_t l, std::string const& msg);
 		void operator()(Ilog::level_t l, char const* msg);
 
+        ///
+        /// \brief is_enabled
+        /// \param l
+        /// \return true if a message of level l will be written
+        ///
+        inline bool is_enabled(Ilog::level_t l) const {
+            return (l >= LOG_COMPILE_LEVEL) && (this->get_level() <= l);
+        }
+
+        ///
+        /// \brief write_lazy - call the formatter only if level L is enabled
+        /// \param f - functor returning the message (std::string)
+        ///
+        template<Ilog::level_t L, class F>
+        inline void write_lazy(F const& f) {
+            if constexpr(L >= LOG_COMPILE_LEVEL) {
+                if(this->is_enabled(L)) {
+                    this->write(L, f());
+                }
+            }
+        }
+
 		virtual ~log(void);
 	private:
 		log(void);
@@ -123,6 +176,65 @@ namespace log_ns {
 		virtual ~stdoutlog(void);
 	};
 
+    ///
+    /// \brief The asynclog class
+    ///
+    /// RU: Асинхронный лог. Сообщение копируется в кольцо вызывающего
+    ///     потока (у каждого потока своё кольцо, без блокировок) и
+    ///     записывается во внутренний лог (syslog/stdoutlog) отдельным
+    ///     потоком-писателем пачками. Вызывающий поток никогда не ждёт:
+    ///     при переполнении кольца сообщение теряется и учитывается в
+    ///     счётчике потерь. Длинные сообщения обрезаются.
+    ///     Поток-писатель создаётся в конструкторе, поэтому объект нужно
+    ///     создавать после перехода в режим демона (после fork).
+    ///
+    class asynclog : public baselog {
+        typedef asynclog self;
+    public:
+        struct record {
+            Ilog::level_t level;
+            boost::uint32_t len;
+            char msg[ASYNCLOG_RECORD_SIZE - sizeof(Ilog::level_t) -
+                     sizeof(boost::uint32_t)];
+        };
+
+        typedef proxy_ns::tap_ring<record, ASYNCLOG_RING_SIZE> ring_t;
+
+        explicit asynclog(boost::shared_ptr<Ilog> backend);
+
+        virtual void write(Ilog::level_t l, std::string const& msg);
+        virtual void write(Ilog::level_t l, char const* msg);
+
+        boost::shared_ptr<Ilog> get_backend(void);
+        boost::uint64_t get_dropped(void) const;
+
+        virtual ~asynclog(void);
+    private:
+        asynclog(asynclog const&) = delete;
+        asynclog& operator=(asynclog const&) = delete;
+
+        void push(Ilog::level_t l, char const* msg, size_t len);
+        ring_t* thread_ring(void);
+        void writer(void);
+        size_t drain(void);
+
+        static std::atomic<boost::uint64_t> generation;
+
+        boost::shared_ptr<Ilog> backend;
+        boost::uint64_t const id;
+
+        mutable std::mutex rings_mutex;
+        std::vector<std::unique_ptr<ring_t>> rings;
+
+        std::mutex wake_mutex;
+        std::condition_variable wake;
+        std::atomic<bool> stop;
+
+        boost::uint64_t reported_dropped;
+
+        std::thread thread;
+    };
+
     class mocklog : public baselog {
 	public:
         mocklog() : level(Ilog::LEVEL_DEFAULT) {}
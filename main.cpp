@@ -73,6 +73,7 @@
 #include "daemon.hpp"
 #include "log.hpp"
 #include "proxy.hpp"
+#include "control.hpp"
 
 #ifndef USER_CONFIG_DEFAULT_PROXY_PORT
     #define USER_CONFIG_DEFAULT_PROXY_PORT 4880
@@ -94,6 +95,94 @@
     #define USER_CONFIG_DEFAULT_CONNECT_TIMEOUT 3000
 #endif // USER_CONFIG_DEFAULT_CONNECT_TIMEOUT
 
+#ifndef USER_CONFIG_DEFAULT_TAP_SAMPLE_RATE
+    #define USER_CONFIG_DEFAULT_TAP_SAMPLE_RATE 1
+#endif // USER_CONFIG_DEFAULT_TAP_SAMPLE_RATE
+
+#ifndef USER_CONFIG_DEFAULT_TAP_FILTER
+    #define USER_CONFIG_DEFAULT_TAP_FILTER ""
+#endif // USER_CONFIG_DEFAULT_TAP_FILTER
+
+#ifndef USER_CONFIG_DEFAULT_CAPTURE_FILE
+    #define USER_CONFIG_DEFAULT_CAPTURE_FILE ""
+#endif // USER_CONFIG_DEFAULT_CAPTURE_FILE
+
+#ifndef USER_CONFIG_DEFAULT_CAPTURE_SEGMENT_SIZE
+    #define USER_CONFIG_DEFAULT_CAPTURE_SEGMENT_SIZE 64
+#endif // USER_CONFIG_DEFAULT_CAPTURE_SEGMENT_SIZE
+
+#ifndef USER_CONFIG_DEFAULT_CAPTURE_SEGMENT_COUNT
+    #define USER_CONFIG_DEFAULT_CAPTURE_SEGMENT_COUNT 8
+#endif // USER_CONFIG_DEFAULT_CAPTURE_SEGMENT_COUNT
+
+#ifndef USER_CONFIG_DEFAULT_SHADOW_ADDR
+    #define USER_CONFIG_DEFAULT_SHADOW_ADDR ""
+#endif // USER_CONFIG_DEFAULT_SHADOW_ADDR
+
+#ifndef USER_CONFIG_DEFAULT_SHADOW_PORT
+    #define USER_CONFIG_DEFAULT_SHADOW_PORT 0
+#endif // USER_CONFIG_DEFAULT_SHADOW_PORT
+
+#ifndef USER_CONFIG_DEFAULT_SHADOW_SAMPLE_RATE
+    #define USER_CONFIG_DEFAULT_SHADOW_SAMPLE_RATE 1
+#endif // USER_CONFIG_DEFAULT_SHADOW_SAMPLE_RATE
+
+#ifndef USER_CONFIG_DEFAULT_SHADOW_BUFFER_SIZE
+    #define USER_CONFIG_DEFAULT_SHADOW_BUFFER_SIZE 1024
+#endif // USER_CONFIG_DEFAULT_SHADOW_BUFFER_SIZE
+
+#ifndef USER_CONFIG_DEFAULT_ADMIN_ADDR
+    #define USER_CONFIG_DEFAULT_ADMIN_ADDR "127.0.0.1"
+#endif // USER_CONFIG_DEFAULT_ADMIN_ADDR
+
+#ifndef USER_CONFIG_DEFAULT_ADMIN_PORT
+    #define USER_CONFIG_DEFAULT_ADMIN_PORT 0
+#endif // USER_CONFIG_DEFAULT_ADMIN_PORT
+
+#ifndef USER_CONFIG_DEFAULT_CLIENT_IDLE_TIMEOUT
+    #define USER_CONFIG_DEFAULT_CLIENT_IDLE_TIMEOUT 0
+#endif // USER_CONFIG_DEFAULT_CLIENT_IDLE_TIMEOUT
+
+#ifndef USER_CONFIG_DEFAULT_QUERY_TIMEOUT
+    #define USER_CONFIG_DEFAULT_QUERY_TIMEOUT 0
+#endif // USER_CONFIG_DEFAULT_QUERY_TIMEOUT
+
+#ifndef USER_CONFIG_DEFAULT_CONNECT_RETRIES
+    #define USER_CONFIG_DEFAULT_CONNECT_RETRIES 0
+#endif // USER_CONFIG_DEFAULT_CONNECT_RETRIES
+
+#ifndef USER_CONFIG_DEFAULT_CONNECT_BACKOFF
+    #define USER_CONFIG_DEFAULT_CONNECT_BACKOFF 100
+#endif // USER_CONFIG_DEFAULT_CONNECT_BACKOFF
+
+#ifndef USER_CONFIG_DEFAULT_TAKEOVER_PATH
+    #define USER_CONFIG_DEFAULT_TAKEOVER_PATH "/var/run/sqlproxy.takeover"
+#endif // USER_CONFIG_DEFAULT_TAKEOVER_PATH
+
+#ifndef USER_CONFIG_DEFAULT_CONFIG_FILE
+    #define USER_CONFIG_DEFAULT_CONFIG_FILE ""
+#endif // USER_CONFIG_DEFAULT_CONFIG_FILE
+
+#ifndef USER_CONFIG_DEFAULT_DRAIN_TIMEOUT
+    #define USER_CONFIG_DEFAULT_DRAIN_TIMEOUT 30000
+#endif // USER_CONFIG_DEFAULT_DRAIN_TIMEOUT
+
+#ifndef USER_CONFIG_DEFAULT_RESOLVE_TTL
+    #define USER_CONFIG_DEFAULT_RESOLVE_TTL 30000
+#endif // USER_CONFIG_DEFAULT_RESOLVE_TTL
+
+#ifndef USER_CONFIG_DEFAULT_SERVER_CPUS
+    #define USER_CONFIG_DEFAULT_SERVER_CPUS ""
+#endif // USER_CONFIG_DEFAULT_SERVER_CPUS
+
+#ifndef USER_CONFIG_DEFAULT_CLIENT_CPUS
+    #define USER_CONFIG_DEFAULT_CLIENT_CPUS ""
+#endif // USER_CONFIG_DEFAULT_CLIENT_CPUS
+
+#ifndef USER_CONFIG_DEFAULT_WORKER_CPUS
+    #define USER_CONFIG_DEFAULT_WORKER_CPUS ""
+#endif // USER_CONFIG_DEFAULT_WORKER_CPUS
+
 #ifndef USER_CONFIG_DEFAULT_LOG_LEVEL
     #define USER_CONFIG_DEFAULT_LOG_LEVEL "INFO"
 #endif // USER_CONFIG_DEFAULT_LOG_LEVEL
@@ -109,9 +198,14 @@ int get_retcode_from_jump_value_hard(int jump_value) noexcept;
 
 void program_exit(int retcode) noexcept;
 void _program_exit(int retcode) noexcept;
+void program_reload(void) noexcept;
+bool program_stop(void) noexcept;
 
 extern char** environ;
 
+// RU: Есть только в сборке с -fprofile-generate (см. build_pgo.sh)
+extern "C" void __gcov_dump(void) __attribute__((weak));
+
 std::jmp_buf jump_exit_buf;
 int const jump_val_offset = 1000;
 int const jump_val_offset_hard = 2000;
@@ -177,6 +271,30 @@ namespace {
         std::string log_level;
         boost::int32_t timeout;
         boost::int32_t connect_timeout;
+        boost::uint32_t tap_sample_rate;
+        std::string tap_filter;
+        std::string capture_file;
+        size_t capture_segment_size;
+        size_t capture_segment_count;
+        std::string shadow_addr;
+        boost::uint16_t shadow_port;
+        boost::uint32_t shadow_sample_rate;
+        size_t shadow_buffer_size;
+        int flag_sync_log;
+        std::string admin_addr;
+        boost::uint16_t admin_port;
+        boost::int32_t client_idle_timeout;
+        boost::int32_t query_timeout;
+        boost::int32_t connect_retries;
+        boost::int32_t connect_backoff;
+        int flag_takeover;
+        std::string takeover_path;
+        std::string config_file;
+        boost::int32_t drain_timeout;
+        boost::int32_t resolve_ttl;
+        std::string server_cpus;
+        std::string client_cpus;
+        std::string worker_cpus;
         std::list<std::string> operands;
 
         /* Methods */
@@ -234,6 +352,80 @@ namespace {
         inline void set_connect_timeout(char const* value) {
             this->connect_timeout = boost::lexical_cast<boost::int32_t>(value);
         }
+        inline void set_tap_sample_rate(char const* value) {
+            this->tap_sample_rate = boost::lexical_cast<boost::uint32_t>(value);
+        }
+        inline void set_tap_filter(char const* value) {
+            this->tap_filter = boost::lexical_cast<std::string>(value);
+        }
+        inline void set_capture_file(char const* value) {
+            this->capture_file = boost::lexical_cast<std::string>(value);
+        }
+        inline void set_capture_segment_size(char const* value) {
+            this->capture_segment_size = boost::lexical_cast<size_t>(value);
+        }
+        inline void set_capture_segment_count(char const* value) {
+            this->capture_segment_count = boost::lexical_cast<size_t>(value);
+        }
+        inline void set_shadow_addr(char const* value) {
+            this->shadow_addr = boost::lexical_cast<std::string>(value);
+        }
+        inline void set_shadow_port(char const* value) {
+            this->shadow_port = boost::lexical_cast<boost::uint16_t>(value);
+        }
+        inline void set_shadow_sample_rate(char const* value) {
+            this->shadow_sample_rate =
+                    boost::lexical_cast<boost::uint32_t>(value);
+        }
+        inline void set_shadow_buffer_size(char const* value) {
+            this->shadow_buffer_size = boost::lexical_cast<size_t>(value);
+        }
+        inline void set_flag_sync_log(char const* value) {
+            this->flag_sync_log = boost::lexical_cast<int>(value);
+        }
+        inline void set_admin_addr(char const* value) {
+            this->admin_addr = boost::lexical_cast<std::string>(value);
+        }
+        inline void set_admin_port(char const* value) {
+            this->admin_port = boost::lexical_cast<boost::uint16_t>(value);
+        }
+        inline void set_client_idle_timeout(char const* value) {
+            this->client_idle_timeout =
+                    boost::lexical_cast<boost::int32_t>(value);
+        }
+        inline void set_query_timeout(char const* value) {
+            this->query_timeout = boost::lexical_cast<boost::int32_t>(value);
+        }
+        inline void set_connect_retries(char const* value) {
+            this->connect_retries = boost::lexical_cast<boost::int32_t>(value);
+        }
+        inline void set_connect_backoff(char const* value) {
+            this->connect_backoff = boost::lexical_cast<boost::int32_t>(value);
+        }
+        inline void set_flag_takeover(char const* value) {
+            this->flag_takeover = boost::lexical_cast<int>(value);
+        }
+        inline void set_takeover_path(char const* value) {
+            this->takeover_path = boost::lexical_cast<std::string>(value);
+        }
+        inline void set_config_file(char const* value) {
+            this->config_file = boost::lexical_cast<std::string>(value);
+        }
+        inline void set_drain_timeout(char const* value) {
+            this->drain_timeout = boost::lexical_cast<boost::int32_t>(value);
+        }
+        inline void set_resolve_ttl(char const* value) {
+            this->resolve_ttl = boost::lexical_cast<boost::int32_t>(value);
+        }
+        inline void set_server_cpus(char const* value) {
+            this->server_cpus = boost::lexical_cast<std::string>(value);
+        }
+        inline void set_client_cpus(char const* value) {
+            this->client_cpus = boost::lexical_cast<std::string>(value);
+        }
+        inline void set_worker_cpus(char const* value) {
+            this->worker_cpus = boost::lexical_cast<std::string>(value);
+        }
 
         inline void set_operands(char const* value) {
             std::istringstream iss(value);
@@ -263,6 +455,30 @@ namespace {
             log_level(USER_CONFIG_DEFAULT_LOG_LEVEL),
             timeout(USER_CONFIG_DEFAULT_TIMEOUT),
             connect_timeout(USER_CONFIG_DEFAULT_CONNECT_TIMEOUT),
+            tap_sample_rate(USER_CONFIG_DEFAULT_TAP_SAMPLE_RATE),
+            tap_filter(USER_CONFIG_DEFAULT_TAP_FILTER),
+            capture_file(USER_CONFIG_DEFAULT_CAPTURE_FILE),
+            capture_segment_size(USER_CONFIG_DEFAULT_CAPTURE_SEGMENT_SIZE),
+            capture_segment_count(USER_CONFIG_DEFAULT_CAPTURE_SEGMENT_COUNT),
+            shadow_addr(USER_CONFIG_DEFAULT_SHADOW_ADDR),
+            shadow_port(USER_CONFIG_DEFAULT_SHADOW_PORT),
+            shadow_sample_rate(USER_CONFIG_DEFAULT_SHADOW_SAMPLE_RATE),
+            shadow_buffer_size(USER_CONFIG_DEFAULT_SHADOW_BUFFER_SIZE),
+            flag_sync_log(0),
+            admin_addr(USER_CONFIG_DEFAULT_ADMIN_ADDR),
+            admin_port(USER_CONFIG_DEFAULT_ADMIN_PORT),
+            client_idle_timeout(USER_CONFIG_DEFAULT_CLIENT_IDLE_TIMEOUT),
+            query_timeout(USER_CONFIG_DEFAULT_QUERY_TIMEOUT),
+            connect_retries(USER_CONFIG_DEFAULT_CONNECT_RETRIES),
+            connect_backoff(USER_CONFIG_DEFAULT_CONNECT_BACKOFF),
+            flag_takeover(0),
+            takeover_path(USER_CONFIG_DEFAULT_TAKEOVER_PATH),
+            config_file(USER_CONFIG_DEFAULT_CONFIG_FILE),
+            drain_timeout(USER_CONFIG_DEFAULT_DRAIN_TIMEOUT),
+            resolve_ttl(USER_CONFIG_DEFAULT_RESOLVE_TTL),
+            server_cpus(USER_CONFIG_DEFAULT_SERVER_CPUS),
+            client_cpus(USER_CONFIG_DEFAULT_CLIENT_CPUS),
+            worker_cpus(USER_CONFIG_DEFAULT_WORKER_CPUS),
             operands() {
         }
 
@@ -287,6 +503,30 @@ namespace {
             this->log_level.clear();
             this->timeout = 0;
             this->connect_timeout = 0;
+            this->tap_sample_rate = 0;
+            this->tap_filter.clear();
+            this->capture_file.clear();
+            this->capture_segment_size = 0;
+            this->capture_segment_count = 0;
+            this->shadow_addr.clear();
+            this->shadow_port = 0;
+            this->shadow_sample_rate = 0;
+            this->shadow_buffer_size = 0;
+            this->flag_sync_log = 0;
+            this->admin_addr.clear();
+            this->admin_port = 0;
+            this->client_idle_timeout = 0;
+            this->query_timeout = 0;
+            this->connect_retries = 0;
+            this->connect_backoff = 0;
+            this->flag_takeover = 0;
+            this->takeover_path.clear();
+            this->config_file.clear();
+            this->drain_timeout = 0;
+            this->resolve_ttl = 0;
+            this->server_cpus.clear();
+            this->client_cpus.clear();
+            this->worker_cpus.clear();
             this->operands.clear();
         }
     };
@@ -300,6 +540,33 @@ namespace {
 
     configuration config;
 
+    // RU: Коды длинных опций, не имеющих короткого аналога.
+    enum {
+        OPT_TAP_SAMPLE_RATE = 0x100,
+        OPT_TAP_FILTER,
+        OPT_CAPTURE_FILE,
+        OPT_CAPTURE_SEGMENT_SIZE,
+        OPT_CAPTURE_SEGMENT_COUNT,
+        OPT_SHADOW_ADDR,
+        OPT_SHADOW_PORT,
+        OPT_SHADOW_SAMPLE_RATE,
+        OPT_SHADOW_BUFFER_SIZE,
+        OPT_ADMIN_ADDR,
+        OPT_ADMIN_PORT,
+        OPT_CLIENT_IDLE_TIMEOUT,
+        OPT_QUERY_TIMEOUT,
+        OPT_CONNECT_RETRIES,
+        OPT_CONNECT_BACKOFF,
+        OPT_TAKEOVER_PATH,
+        OPT_CONFIG_FILE,
+        OPT_DRAIN_TIMEOUT,
+        OPT_RESOLVE_TTL,
+        OPT_SERVER_CPUS,
+        OPT_CLIENT_CPUS,
+        OPT_WORKER_CPUS,
+        OPT_END_OF_LONG_ONLY
+    };
+
     option longopts[] = {
         {"help",                no_argument,
             &config.flag_show_help,          0x01}, // 'h'
@@ -337,6 +604,54 @@ namespace {
             0,                               't' }, // 't'
         {"connect-timeout",     required_argument,
             0,                               'c' }, // 'c'
+        {"tap-sample-rate",     required_argument,
+            0,               OPT_TAP_SAMPLE_RATE }, // none
+        {"tap-filter",          required_argument,
+            0,                    OPT_TAP_FILTER }, // none
+        {"capture-file",        required_argument,
+            0,                  OPT_CAPTURE_FILE }, // none
+        {"capture-segment-size", required_argument,
+            0,          OPT_CAPTURE_SEGMENT_SIZE }, // none
+        {"capture-segment-count", required_argument,
+            0,         OPT_CAPTURE_SEGMENT_COUNT }, // none
+        {"shadow-addr",         required_argument,
+            0,                   OPT_SHADOW_ADDR }, // none
+        {"shadow-port",         required_argument,
+            0,                   OPT_SHADOW_PORT }, // none
+        {"shadow-sample-rate",  required_argument,
+            0,            OPT_SHADOW_SAMPLE_RATE }, // none
+        {"shadow-buffer-size",  required_argument,
+            0,            OPT_SHADOW_BUFFER_SIZE }, // none
+        {"sync-log",            no_argument,
+            &config.flag_sync_log,           0x01}, // none
+        {"admin-addr",          required_argument,
+            0,                    OPT_ADMIN_ADDR }, // none
+        {"admin-port",          required_argument,
+            0,                    OPT_ADMIN_PORT }, // none
+        {"client-idle-timeout", required_argument,
+            0,           OPT_CLIENT_IDLE_TIMEOUT }, // none
+        {"query-timeout",       required_argument,
+            0,                 OPT_QUERY_TIMEOUT }, // none
+        {"connect-retries",     required_argument,
+            0,               OPT_CONNECT_RETRIES }, // none
+        {"connect-backoff",     required_argument,
+            0,               OPT_CONNECT_BACKOFF }, // none
+        {"takeover",            no_argument,
+            &config.flag_takeover,           0x01}, // none
+        {"takeover-path",       required_argument,
+            0,                 OPT_TAKEOVER_PATH }, // none
+        {"config",              required_argument,
+            0,                   OPT_CONFIG_FILE }, // none
+        {"drain-timeout",       required_argument,
+            0,                 OPT_DRAIN_TIMEOUT }, // none
+        {"resolve-ttl",         required_argument,
+            0,                   OPT_RESOLVE_TTL }, // none
+        {"server-cpus",         required_argument,
+            0,                   OPT_SERVER_CPUS }, // none
+        {"client-cpus",         required_argument,
+            0,                   OPT_CLIENT_CPUS }, // none
+        {"worker-cpus",         required_argument,
+            0,                   OPT_WORKER_CPUS }, // none
         {0,                     0,
             0,                               0x00}  // end
     };
@@ -396,6 +711,78 @@ namespace {
         {"SQLPROXY_CONNECT_TIMEOUT",
             boost::bind(&configuration::set_connect_timeout,
                 &config, _1)},
+        {"SQLPROXY_TAP_SAMPLE_RATE",
+            boost::bind(&configuration::set_tap_sample_rate,
+                &config, _1)},
+        {"SQLPROXY_TAP_FILTER",
+            boost::bind(&configuration::set_tap_filter,
+                &config, _1)},
+        {"SQLPROXY_CAPTURE_FILE",
+            boost::bind(&configuration::set_capture_file,
+                &config, _1)},
+        {"SQLPROXY_CAPTURE_SEGMENT_SIZE",
+            boost::bind(&configuration::set_capture_segment_size,
+                &config, _1)},
+        {"SQLPROXY_CAPTURE_SEGMENT_COUNT",
+            boost::bind(&configuration::set_capture_segment_count,
+                &config, _1)},
+        {"SQLPROXY_SHADOW_ADDR",
+            boost::bind(&configuration::set_shadow_addr,
+                &config, _1)},
+        {"SQLPROXY_SHADOW_PORT",
+            boost::bind(&configuration::set_shadow_port,
+                &config, _1)},
+        {"SQLPROXY_SHADOW_SAMPLE_RATE",
+            boost::bind(&configuration::set_shadow_sample_rate,
+                &config, _1)},
+        {"SQLPROXY_SHADOW_BUFFER_SIZE",
+            boost::bind(&configuration::set_shadow_buffer_size,
+                &config, _1)},
+        {"SQLPROXY_FLAG_SYNC_LOG",
+            boost::bind(&configuration::set_flag_sync_log,
+                &config, _1)},
+        {"SQLPROXY_ADMIN_ADDR",
+            boost::bind(&configuration::set_admin_addr,
+                &config, _1)},
+        {"SQLPROXY_ADMIN_PORT",
+            boost::bind(&configuration::set_admin_port,
+                &config, _1)},
+        {"SQLPROXY_CLIENT_IDLE_TIMEOUT",
+            boost::bind(&configuration::set_client_idle_timeout,
+                &config, _1)},
+        {"SQLPROXY_QUERY_TIMEOUT",
+            boost::bind(&configuration::set_query_timeout,
+                &config, _1)},
+        {"SQLPROXY_CONNECT_RETRIES",
+            boost::bind(&configuration::set_connect_retries,
+                &config, _1)},
+        {"SQLPROXY_CONNECT_BACKOFF",
+            boost::bind(&configuration::set_connect_backoff,
+                &config, _1)},
+        {"SQLPROXY_TAKEOVER",
+            boost::bind(&configuration::set_flag_takeover,
+                &config, _1)},
+        {"SQLPROXY_TAKEOVER_PATH",
+            boost::bind(&configuration::set_takeover_path,
+                &config, _1)},
+        {"SQLPROXY_CONFIG",
+            boost::bind(&configuration::set_config_file,
+                &config, _1)},
+        {"SQLPROXY_DRAIN_TIMEOUT",
+            boost::bind(&configuration::set_drain_timeout,
+                &config, _1)},
+        {"SQLPROXY_RESOLVE_TTL",
+            boost::bind(&configuration::set_resolve_ttl,
+                &config, _1)},
+        {"SQLPROXY_SERVER_CPUS",
+            boost::bind(&configuration::set_server_cpus,
+                &config, _1)},
+        {"SQLPROXY_CLIENT_CPUS",
+            boost::bind(&configuration::set_client_cpus,
+                &config, _1)},
+        {"SQLPROXY_WORKER_CPUS",
+            boost::bind(&configuration::set_worker_cpus,
+                &config, _1)},
         {"BRAINLOLLER_OPERANDS",
             boost::bind(&configuration::set_operands,
                 &config, _1)},
@@ -454,14 +841,73 @@ namespace {
                   << "- set proxy port" << std::endl;
         std::cout <<"-d\t--server-port=[PORT]\t\t"
                   << "- set sql server port" << std::endl;
-        std::cout <<"-i\t--server-addr=[IPADDRESS]\t"
-                  << "- set sql server ip-address" << std::endl;
+        std::cout <<"-i\t--server-addr=[ADDRESS]\t\t"
+                  << "- set sql server address: IPv4, IPv6, host name"
+                  << std::endl
+                  << "\t\t\t\t\t  or unix:/path (the port is ignored)"
+                  << std::endl;
         std::cout <<"-o\t--log-level=[LOGLEVEL]\t\t"
                   << "- set log level" << std::endl;
         std::cout <<"-t\t--timeout=[NUMBER]\t\t"
                   << "- set timeout (for poll)" << std::endl;
         std::cout <<"-с\t--connect-timeout=[NUMBER]\t"
                   << "- set timeout for connect to sql-server" << std::endl;
+        std::cout <<"\t--tap-sample-rate=[NUMBER]\t"
+                  << "- sessions copied to the worker: 0 - none, 1 - all, "
+                  << "N - one of N" << std::endl;
+        std::cout <<"\t--tap-filter=[ADDR/BITS]\t"
+                  << "- copy to the worker only clients from this network"
+                  << std::endl;
+        std::cout <<"\t--capture-file=[PATH]\t\t"
+                  << "- write traffic of sampled sessions to PATH.<N>"
+                  << std::endl;
+        std::cout <<"\t--capture-segment-size=[MB]\t"
+                  << "- size of one capture segment (MiB)" << std::endl;
+        std::cout <<"\t--capture-segment-count=[NUMBER]\t"
+                  << "- number of capture segments to keep" << std::endl;
+        std::cout <<"\t--shadow-addr=[IP]\t\t"
+                  << "- shadow server address (empty: off)" << std::endl;
+        std::cout <<"\t--shadow-port=[PORT]\t\t"
+                  << "- shadow server port (0: off)" << std::endl;
+        std::cout <<"\t--shadow-sample-rate=[N]\t"
+                  << "- mirror every N-th tapped session (0: none)"
+                  << std::endl;
+        std::cout <<"\t--shadow-buffer-size=[KiB]\t"
+                  << "- pending data limit per shadow session" << std::endl;
+        std::cout <<"\t--sync-log\t\t\t"
+                  << "- write log on the calling thread" << std::endl;
+        std::cout <<"\t--admin-addr=[IP]\t\t"
+                  << "- admin HTTP endpoint address" << std::endl;
+        std::cout <<"\t--admin-port=[PORT]\t\t"
+                  << "- admin HTTP endpoint port (0: off)" << std::endl;
+        std::cout <<"\t--client-idle-timeout=[MS]\t"
+                  << "- close idle client sessions (0: off)" << std::endl;
+        std::cout <<"\t--query-timeout=[MS]\t\t"
+                  << "- max wait for a response (0: off)" << std::endl;
+        std::cout <<"\t--connect-retries=[N]\t\t"
+                  << "- backend connect retries" << std::endl;
+        std::cout <<"\t--connect-backoff=[MS]\t\t"
+                  << "- first retry delay, doubled each retry" << std::endl;
+        std::cout <<"\t--takeover\t\t\t"
+                  << "- take over the listening socket of a running copy"
+                  << std::endl;
+        std::cout <<"\t--takeover-path=[PATH]\t\t"
+                  << "- takeover unix socket ('' - off)" << std::endl;
+        std::cout <<"\t--config=[FILE]\t\t\t"
+                  << "- runtime config with [listener] sections,"
+                  << " re-read on SIGHUP" << std::endl;
+        std::cout <<"\t--drain-timeout=[MS]\t\t"
+                  << "- graceful shutdown deadline (0: stop at once)"
+                  << std::endl;
+        std::cout <<"\t--resolve-ttl=[MS]\t\t"
+                  << "- re-resolve server host names (0: on SIGHUP)"
+                  << std::endl;
+        std::cout <<"\t--server-cpus=[LIST]\t\t"
+                  << "- pin the server thread to CPUs (0-3,8)" << std::endl;
+        std::cout <<"\t--client-cpus=[LIST]\t\t"
+                  << "- pin the client thread to CPUs" << std::endl;
+        std::cout <<"\t--worker-cpus=[LIST]\t\t"
+                  << "- pin the worker thread to CPUs" << std::endl;
 
         std::cout << std::endl << "Environment:" << std::endl;
         std::cout << "\tSQLPROXY_FLAG_SHOW_HELP\t\t\t"
@@ -500,6 +946,54 @@ namespace {
                   << "- same as '-t|--timeout'" << std::endl;
         std::cout << "\tSQLPROXY_CONNECT_TIMEOUT\t\t"
                   << "- same as '-c|--connect-timeout'" << std::endl;
+        std::cout << "\tSQLPROXY_TAP_SAMPLE_RATE\t\t"
+                  << "- same as '--tap-sample-rate'" << std::endl;
+        std::cout << "\tSQLPROXY_TAP_FILTER\t\t\t"
+                  << "- same as '--tap-filter'" << std::endl;
+        std::cout << "\tSQLPROXY_CAPTURE_FILE\t\t\t"
+                  << "- same as '--capture-file'" << std::endl;
+        std::cout << "\tSQLPROXY_CAPTURE_SEGMENT_SIZE\t\t"
+                  << "- same as '--capture-segment-size'" << std::endl;
+        std::cout << "\tSQLPROXY_CAPTURE_SEGMENT_COUNT\t\t"
+                  << "- same as '--capture-segment-count'" << std::endl;
+        std::cout << "\tSQLPROXY_SHADOW_ADDR\t\t\t"
+                  << "- same as '--shadow-addr'" << std::endl;
+        std::cout << "\tSQLPROXY_SHADOW_PORT\t\t\t"
+                  << "- same as '--shadow-port'" << std::endl;
+        std::cout << "\tSQLPROXY_SHADOW_SAMPLE_RATE\t\t"
+                  << "- same as '--shadow-sample-rate'" << std::endl;
+        std::cout << "\tSQLPROXY_SHADOW_BUFFER_SIZE\t\t"
+                  << "- same as '--shadow-buffer-size'" << std::endl;
+        std::cout << "\tSQLPROXY_FLAG_SYNC_LOG\t\t\t"
+                  << "- same as '--sync-log': {0,1}" << std::endl;
+        std::cout << "\tSQLPROXY_ADMIN_ADDR\t\t\t"
+                  << "- same as '--admin-addr'" << std::endl;
+        std::cout << "\tSQLPROXY_ADMIN_PORT\t\t\t"
+                  << "- same as '--admin-port'" << std::endl;
+        std::cout << "\tSQLPROXY_CLIENT_IDLE_TIMEOUT\t\t"
+                  << "- same as '--client-idle-timeout'" << std::endl;
+        std::cout << "\tSQLPROXY_QUERY_TIMEOUT\t\t\t"
+                  << "- same as '--query-timeout'" << std::endl;
+        std::cout << "\tSQLPROXY_CONNECT_RETRIES\t\t"
+                  << "- same as '--connect-retries'" << std::endl;
+        std::cout << "\tSQLPROXY_CONNECT_BACKOFF\t\t"
+                  << "- same as '--connect-backoff'" << std::endl;
+        std::cout << "\tSQLPROXY_TAKEOVER\t\t\t"
+                  << "- same as '--takeover': {0,1}" << std::endl;
+        std::cout << "\tSQLPROXY_TAKEOVER_PATH\t\t\t"
+                  << "- same as '--takeover-path'" << std::endl;
+        std::cout << "\tSQLPROXY_CONFIG\t\t\t\t"
+                  << "- same as '--config'" << std::endl;
+        std::cout << "\tSQLPROXY_DRAIN_TIMEOUT\t\t\t"
+                  << "- same as '--drain-timeout'" << std::endl;
+        std::cout << "\tSQLPROXY_RESOLVE_TTL\t\t\t"
+                  << "- same as '--resolve-ttl'" << std::endl;
+        std::cout << "\tSQLPROXY_SERVER_CPUS\t\t\t"
+                  << "- same as '--server-cpus'" << std::endl;
+        std::cout << "\tSQLPROXY_CLIENT_CPUS\t\t\t"
+                  << "- same as '--client-cpus'" << std::endl;
+        std::cout << "\tSQLPROXY_WORKER_CPUS\t\t\t"
+                  << "- same as '--worker-cpus'" << std::endl;
 
         std::cout << std::endl << "Log levels:" << std::endl;
         std::cout << "\t" << LOG_LEVEL_DEBUG << "\t"
@@ -639,6 +1133,116 @@ int main(int argc, char** argv) {
                         config.set_connect_timeout(optarg);
                     }
                     break;
+                case OPT_TAP_SAMPLE_RATE:
+                    if(optarg != nullptr) {
+                        config.set_tap_sample_rate(optarg);
+                    }
+                    break;
+                case OPT_TAP_FILTER:
+                    if(optarg != nullptr) {
+                        config.set_tap_filter(optarg);
+                    }
+                    break;
+                case OPT_CAPTURE_FILE:
+                    if(optarg != nullptr) {
+                        config.set_capture_file(optarg);
+                    }
+                    break;
+                case OPT_CAPTURE_SEGMENT_SIZE:
+                    if(optarg != nullptr) {
+                        config.set_capture_segment_size(optarg);
+                    }
+                    break;
+                case OPT_CAPTURE_SEGMENT_COUNT:
+                    if(optarg != nullptr) {
+                        config.set_capture_segment_count(optarg);
+                    }
+                    break;
+                case OPT_SHADOW_ADDR:
+                    if(optarg != nullptr) {
+                        config.set_shadow_addr(optarg);
+                    }
+                    break;
+                case OPT_SHADOW_PORT:
+                    if(optarg != nullptr) {
+                        config.set_shadow_port(optarg);
+                    }
+                    break;
+                case OPT_SHADOW_SAMPLE_RATE:
+                    if(optarg != nullptr) {
+                        config.set_shadow_sample_rate(optarg);
+                    }
+                    break;
+                case OPT_SHADOW_BUFFER_SIZE:
+                    if(optarg != nullptr) {
+                        config.set_shadow_buffer_size(optarg);
+                    }
+                    break;
+                case OPT_ADMIN_ADDR:
+                    if(optarg != nullptr) {
+                        config.set_admin_addr(optarg);
+                    }
+                    break;
+                case OPT_ADMIN_PORT:
+                    if(optarg != nullptr) {
+                        config.set_admin_port(optarg);
+                    }
+                    break;
+                case OPT_CLIENT_IDLE_TIMEOUT:
+                    if(optarg != nullptr) {
+                        config.set_client_idle_timeout(optarg);
+                    }
+                    break;
+                case OPT_QUERY_TIMEOUT:
+                    if(optarg != nullptr) {
+                        config.set_query_timeout(optarg);
+                    }
+                    break;
+                case OPT_CONNECT_RETRIES:
+                    if(optarg != nullptr) {
+                        config.set_connect_retries(optarg);
+                    }
+                    break;
+                case OPT_CONNECT_BACKOFF:
+                    if(optarg != nullptr) {
+                        config.set_connect_backoff(optarg);
+                    }
+                    break;
+                case OPT_TAKEOVER_PATH:
+                    if(optarg != nullptr) {
+                        config.set_takeover_path(optarg);
+                    }
+                    break;
+                case OPT_CONFIG_FILE:
+                    if(optarg != nullptr) {
+                        config.set_config_file(optarg);
+                    }
+                    break;
+                case OPT_DRAIN_TIMEOUT:
+                    if(optarg != nullptr) {
+                        config.set_drain_timeout(optarg);
+                    }
+                    break;
+                case OPT_RESOLVE_TTL:
+                    if(optarg != nullptr) {
+                        config.set_resolve_ttl(optarg);
+                    }
+                    break;
+                case OPT_SERVER_CPUS:
+                    if(optarg != nullptr) {
+                        config.set_server_cpus(optarg);
+                    }
+                    break;
+                case OPT_CLIENT_CPUS:
+                    if(optarg != nullptr) {
+                        config.set_client_cpus(optarg);
+                    }
+                    break;
+                case OPT_WORKER_CPUS:
+                    if(optarg != nullptr) {
+                        config.set_worker_cpus(optarg);
+                    }
+                    break;
                 case 0:
                     break;
                 case ':':
@@ -707,6 +1311,54 @@ int main(int argc, char** argv) {
                       << config.timeout << std::endl;
             std::cout << "\tconnect_timeout = "
                       << config.connect_timeout << std::endl;
+            std::cout << "\ttap_sample_rate = "
+                      << config.tap_sample_rate << std::endl;
+            std::cout << "\ttap_filter = "
+                      << config.tap_filter << std::endl;
+            std::cout << "\tcapture_file = "
+                      << config.capture_file << std::endl;
+            std::cout << "\tcapture_segment_size = "
+                      << config.capture_segment_size << std::endl;
+            std::cout << "\tcapture_segment_count = "
+                      << config.capture_segment_count << std::endl;
+            std::cout << "\tshadow_addr = "
+                      << config.shadow_addr << std::endl;
+            std::cout << "\tshadow_port = "
+                      << config.shadow_port << std::endl;
+            std::cout << "\tshadow_sample_rate = "
+                      << config.shadow_sample_rate << std::endl;
+            std::cout << "\tshadow_buffer_size = "
+                      << config.shadow_buffer_size << std::endl;
+            std::cout << "\tflag_sync_log = "
+                      << config.flag_sync_log << std::endl;
+            std::cout << "\tadmin_addr = "
+                      << config.admin_addr << std::endl;
+            std::cout << "\tadmin_port = "
+                      << config.admin_port << std::endl;
+            std::cout << "\tclient_idle_timeout = "
+                      << config.client_idle_timeout << std::endl;
+            std::cout << "\tquery_timeout = "
+                      << config.query_timeout << std::endl;
+            std::cout << "\tconnect_retries = "
+                      << config.connect_retries << std::endl;
+            std::cout << "\tconnect_backoff = "
+                      << config.connect_backoff << std::endl;
+            std::cout << "\tflag_takeover = "
+                      << config.flag_takeover << std::endl;
+            std::cout << "\ttakeover_path = "
+                      << config.takeover_path << std::endl;
+            std::cout << "\tconfig_file = "
+                      << config.config_file << std::endl;
+            std::cout << "\tdrain_timeout = "
+                      << config.drain_timeout << std::endl;
+            std::cout << "\tresolve_ttl = "
+                      << config.resolve_ttl << std::endl;
+            std::cout << "\tserver_cpus = "
+                      << config.server_cpus << std::endl;
+            std::cout << "\tclient_cpus = "
+                      << config.client_cpus << std::endl;
+            std::cout << "\tworker_cpus = "
+                      << config.worker_cpus << std::endl;
             std::cout << "\toperands = "
                       << ((config.operands.empty()) ? "(absense)" : "")
                       << std::endl;
@@ -778,6 +1430,101 @@ int main(int argc, char** argv) {
     p.get()->set_server_keep_alive(config.flag_server_keep_alive);
     p.get()->set_client_tcp_no_delay(config.flag_client_tcp_no_delay);
     p.get()->set_server_tcp_no_delay(config.flag_server_tcp_no_delay);
+    p.get()->set_tap_sample_rate(config.tap_sample_rate);
+    p.get()->set_capture_file(config.capture_file);
+    p.get()->set_capture_segment_size(
+                config.capture_segment_size * 1024 * 1024);
+    p.get()->set_capture_segment_count(config.capture_segment_count);
+    p.get()->set_shadow_port(config.shadow_port);
+    p.get()->set_shadow_sample_rate(config.shadow_sample_rate);
+    p.get()->set_shadow_buffer_size(config.shadow_buffer_size * 1024);
+    p.get()->set_admin_port(config.admin_port);
+    p.get()->set_client_idle_timeout(config.client_idle_timeout);
+    p.get()->set_query_timeout(config.query_timeout);
+    p.get()->set_connect_retries(config.connect_retries);
+    p.get()->set_connect_backoff(config.connect_backoff);
+    p.get()->set_takeover(config.flag_takeover);
+    p.get()->set_takeover_path(config.takeover_path);
+
+    // RU: Демон меняет рабочий каталог на "/", а файл перечитывается позже
+    if(!config.config_file.empty() && config.config_file[0] != '/') {
+        char* const cwd = ::getcwd(nullptr, 0);
+        if(cwd) {
+            config.config_file = std::string(cwd) + "/" + config.config_file;
+            ::free(cwd);
+        }
+    }
+
+    p.get()->set_config_file(config.config_file);
+    p.get()->set_drain_timeout(config.drain_timeout);
+    p.get()->set_resolve_ttl(config.resolve_ttl);
+
+    try {
+        p.get()->set_tap_filter(config.tap_filter);
+    }
+    catch(proxy_ns::Eproxy_invalid_value const& e) {
+        std::cerr << argv[0] << ": option '--tap-filter': "
+                  << e.what() << std::endl;
+        ::exit(EXIT_FAILURE);
+    }
+
+    try {
+        p.get()->set_shadow_addr(config.shadow_addr);
+    }
+    catch(proxy_ns::Eproxy_invalid_value const& e) {
+        std::cerr << argv[0] << ": option '--shadow-addr': "
+                  << e.what() << std::endl;
+        ::exit(EXIT_FAILURE);
+    }
+
+    try {
+        p.get()->set_admin_addr(config.admin_addr);
+    }
+    catch(proxy_ns::Eproxy_invalid_value const& e) {
+        std::cerr << argv[0] << ": option '--admin-addr': "
+                  << e.what() << std::endl;
+        ::exit(EXIT_FAILURE);
+    }
+
+    try {
+        p.get()->set_server_cpus(config.server_cpus);
+    }
+    catch(proxy_ns::Eproxy_invalid_value const& e) {
+        std::cerr << argv[0] << ": option '--server-cpus': "
+                  << e.what() << std::endl;
+        ::exit(EXIT_FAILURE);
+    }
+
+    try {
+        p.get()->set_client_cpus(config.client_cpus);
+    }
+    catch(proxy_ns::Eproxy_invalid_value const& e) {
+        std::cerr << argv[0] << ": option '--client-cpus': "
+                  << e.what() << std::endl;
+        ::exit(EXIT_FAILURE);
+    }
+
+    try {
+        p.get()->set_worker_cpus(config.worker_cpus);
+    }
+    catch(proxy_ns::Eproxy_invalid_value const& e) {
+        std::cerr << argv[0] << ": option '--worker-cpus': "
+                  << e.what() << std::endl;
+        ::exit(EXIT_FAILURE);
+    }
+
+    // RU: Ошибки файла при запуске видны сразу, а не только в журнале
+    if(!config.config_file.empty()) {
+        try {
+            proxy_ns::runtime_config c = proxy_ns::runtime_config();
+            c.load(config.config_file);
+        }
+        catch(proxy_ns::Eproxy_invalid_value const& e) {
+            std::cerr << argv[0] << ": option '--config': "
+                      << e.what() << std::endl;
+            ::exit(EXIT_FAILURE);
+        }
+    }
 
     []()->void {
         std::map<std::string, log_ns::Ilog::level_t> lvl {
@@ -814,7 +1561,8 @@ int main(int argc, char** argv) {
         }
     }
 
-    daemon_result = d.get()->go(!config.flag_no_daemon, config.flag_force);
+    daemon_result = d.get()->go(!config.flag_no_daemon, config.flag_force,
+                                config.flag_takeover);
 
     if(daemon_ns::daemon::RES_NO_ERROR != daemon_result) {
         std::cout << "Startup failed!" << std::endl;
@@ -825,6 +1573,15 @@ int main(int argc, char** argv) {
         ::exit(EXIT_SUCCESS);
     }
 
+    // RU: Асинхронный лог создаётся только здесь: его поток-писатель не
+    //     пережил бы fork при переходе в режим демона.
+    if(!config.flag_sync_log) {
+        boost::ignore_unused(
+                    log_ns::log::inst(
+                        boost::make_shared<log_ns::asynclog>(
+                            log_ns::log::inst().get_internal_log())));
+    }
+
     proxy_result = p.get()->run();
 
     if(proxy_ns::RES_CODE_OK != proxy_result) {
@@ -836,6 +1593,14 @@ int main(int argc, char** argv) {
 end_program:
     log_ns::log::inst().write(log_ns::Ilog::LEVEL_DEBUG,
                               "Label: end_program");
+
+    // RU: Профиль записывается до разрушения объектов: потоки прокси
+    //     при выходе по сигналу ещё работают и могут упасть раньше, чем
+    //     профиль будет записан в exit().
+    if(::__gcov_dump) {
+        ::__gcov_dump();
+    }
+
     return retcode;
 
 end_program_hard:
@@ -880,6 +1645,21 @@ void _program_exit(int retcode) noexcept {
     std::longjmp(::jump_exit_buf, ::get_jump_value_from_retcode_hard(retcode));
 }
 
+void program_reload(void) noexcept {
+    (void) proxy_ns::control_request(proxy_ns::CONTROL_RELOAD);
+}
+
+bool program_stop(void) noexcept {
+    // RU: Первый сигнал - плавное завершение, повторный - немедленное
+    static std::atomic<int> count(0);
+
+    if(0 == count.fetch_add(1) && ::config.drain_timeout > 0) {
+        return proxy_ns::control_request(proxy_ns::CONTROL_DRAIN);
+    }
+
+    return proxy_ns::control_request(proxy_ns::CONTROL_STOP);
+}
+
 /* ****************************************************************************
  * End of file
  * ************************************************************************** */
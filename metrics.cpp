@@ -0,0 +1,250 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#include <array>
+#include <atomic>
+
+#include <boost/cstdint.hpp>
+
+#include "metrics.hpp"
+
+namespace metrics_ns {
+    namespace {
+        struct description {
+            char const* name;
+            char const* help;
+        };
+
+        std::array<description, COUNTER_END> const counters_desc {{
+            {"sqlproxy_sessions_accepted_total",
+             "Client sessions accepted"},
+            {"sqlproxy_sessions_closed_total",
+             "Client sessions closed"},
+            {"sqlproxy_backend_connects_total",
+             "Successful connections to the backend"},
+            {"sqlproxy_backend_connect_failures_total",
+             "Failed or timed out connections to the backend"},
+            {"sqlproxy_client_received_bytes_total",
+             "Bytes received from clients"},
+            {"sqlproxy_client_sent_bytes_total",
+             "Bytes sent to clients"},
+            {"sqlproxy_backend_received_bytes_total",
+             "Bytes received from the backend"},
+            {"sqlproxy_backend_sent_bytes_total",
+             "Bytes sent to the backend"},
+            {"sqlproxy_buffered_bytes_total",
+             "Bytes queued because the peer socket was not writable"},
+            {"sqlproxy_lost_bytes_total",
+             "Queued bytes dropped when a session was closed"},
+            {"sqlproxy_sessions_idle_closed_total",
+             "Client sessions closed by the idle timeout"},
+            {"sqlproxy_query_timeouts_total",
+             "Sessions closed because the backend did not respond in time"},
+            {"sqlproxy_backend_connect_retries_total",
+             "Backend connect attempts scheduled after a failure"},
+            {"sqlproxy_config_reloads_total",
+             "Configuration snapshots published on SIGHUP"},
+            {"sqlproxy_config_reload_failures_total",
+             "SIGHUP reloads rejected because of an invalid file"},
+            {"sqlproxy_sessions_drained_total",
+             "Sessions closed at a quiet point while draining"},
+            {"sqlproxy_client_resets_total",
+             "Sessions closed because the client reset the connection"},
+            {"sqlproxy_backend_resets_total",
+             "Sessions closed because the backend reset the connection"},
+            {"sqlproxy_resolve_failures_total",
+             "Failed resolutions of a backend host name"},
+            {"sqlproxy_peer_rejected_total",
+             "Unix socket clients rejected by peer-uid/peer-gid"}
+        }};
+
+        std::array<description, GAUGE_END> const gauges_desc {{
+            {"sqlproxy_sessions_active",
+             "Client sessions currently open"},
+            {"sqlproxy_backend_sessions_active",
+             "Backend connections currently open"},
+            {"sqlproxy_backend_connects_pending",
+             "Backend connections in progress"},
+            {"sqlproxy_tap_queue_client",
+             "Records in the client->worker tap queue"},
+            {"sqlproxy_tap_queue_server",
+             "Records in the server->worker tap queue"},
+            {"sqlproxy_draining",
+             "1 while the proxy drains sessions before exiting"}
+        }};
+
+        std::array<description, HISTOGRAM_END> const histograms_desc {{
+            {"sqlproxy_backend_connect_microseconds",
+             "Backend connect latency"},
+            {"sqlproxy_proxy_request_microseconds",
+             "Proxy-added latency: client read to backend write completion"},
+            {"sqlproxy_backend_first_byte_microseconds",
+             "Backend latency: request written to first response byte"},
+            {"sqlproxy_backend_response_microseconds",
+             "Backend latency: request written to last response byte"},
+            {"sqlproxy_proxy_response_microseconds",
+             "Proxy-added latency: backend read to client write completion"}
+        }};
+    }
+
+    metrics metrics::instance;
+
+    ///
+    /// \brief shard::shard
+    ///
+    shard::shard(void) noexcept {
+        for(auto& c : this->counters) {
+            c.store(0, std::memory_order_relaxed);
+        }
+
+        for(auto& g : this->gauges) {
+            g.store(0, std::memory_order_relaxed);
+        }
+
+        for(auto& h : this->histograms) {
+            for(auto& b : h.buckets) {
+                b.store(0, std::memory_order_relaxed);
+            }
+
+            h.count.store(0, std::memory_order_relaxed);
+            h.sum.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    metrics::metrics(void) : shards_count(0), overflow() {
+        for(auto& s : this->shards) {
+            s.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    metrics::~metrics(void) {
+        // RU: Шарды намеренно не освобождаются: потоки могут писать в них
+        //     до самого завершения процесса.
+    }
+
+    metrics& metrics::inst(void) {
+        return self::instance;
+    }
+
+    ///
+    /// \brief metrics::local
+    /// \return
+    ///
+    shard& metrics::local(void) {
+        static thread_local shard* s = nullptr;
+
+        if(nullptr == s) {
+            size_t const i = this->shards_count.fetch_add(
+                        1, std::memory_order_relaxed);
+
+            if(i < METRICS_MAX_SHARDS) {
+                s = new shard();
+                this->shards[i].store(s, std::memory_order_release);
+            }
+            else {
+                s = &this->overflow;
+            }
+        }
+
+        return *s;
+    }
+
+    ///
+    /// \brief metrics::collect
+    /// \return
+    ///
+    snapshot metrics::collect(void) const {
+        snapshot r;
+
+        r.counters.fill(0);
+        r.gauges.fill(0);
+
+        for(auto& h : r.histograms) {
+            h.buckets.fill(0);
+            h.count = 0;
+            h.sum = 0;
+        }
+
+        auto add = [&r](shard const& s) -> void {
+            for(size_t i = 0; i < COUNTER_END; i++) {
+                r.counters[i] +=
+                        s.counters[i].load(std::memory_order_relaxed);
+            }
+
+            for(size_t i = 0; i < GAUGE_END; i++) {
+                r.gauges[i] += s.gauges[i].load(std::memory_order_relaxed);
+            }
+
+            for(size_t i = 0; i < HISTOGRAM_END; i++) {
+                for(size_t b = 0; b < METRICS_HISTOGRAM_BUCKETS; b++) {
+                    r.histograms[i].buckets[b] +=
+                            s.histograms[i].buckets[b].load(
+                                std::memory_order_relaxed);
+                }
+
+                r.histograms[i].count +=
+                        s.histograms[i].count.load(std::memory_order_relaxed);
+                r.histograms[i].sum +=
+                        s.histograms[i].sum.load(std::memory_order_relaxed);
+            }
+        };
+
+        for(size_t i = 0; i < METRICS_MAX_SHARDS; i++) {
+            shard const* s = this->shards[i].load(std::memory_order_acquire);
+
+            if(s) {
+                add(*s);
+            }
+        }
+
+        add(this->overflow);
+
+        return r;
+    }
+
+    char const* metrics::name(counter_t c) noexcept {
+        return counters_desc[c].name;
+    }
+
+    char const* metrics::name(gauge_t g) noexcept {
+        return gauges_desc[g].name;
+    }
+
+    char const* metrics::name(histogram_t h) noexcept {
+        return histograms_desc[h].name;
+    }
+
+    char const* metrics::help(counter_t c) noexcept {
+        return counters_desc[c].help;
+    }
+
+    char const* metrics::help(gauge_t g) noexcept {
+        return gauges_desc[g].help;
+    }
+
+    char const* metrics::help(histogram_t h) noexcept {
+        return histograms_desc[h].help;
+    }
+} // namespace metrics_ns
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
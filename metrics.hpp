@@ -0,0 +1,225 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#pragma once
+
+#ifndef __METRICS_HPP__
+#define __METRICS_HPP__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+#include <boost/cstdint.hpp>
+
+#ifndef METRICS_MAX_SHARDS
+    #define METRICS_MAX_SHARDS 64
+#endif // METRICS_MAX_SHARDS
+
+#define METRICS_HISTOGRAM_BUCKETS 64
+
+namespace metrics_ns {
+    ///
+    /// \brief The counter_t enum - monotonic counters
+    ///
+    typedef enum {
+        COUNTER_SESSIONS_ACCEPTED = 0,
+        COUNTER_SESSIONS_CLOSED,
+        COUNTER_BACKEND_CONNECTS,
+        COUNTER_BACKEND_CONNECT_FAILURES,
+        COUNTER_CLIENT_BYTES_RECV,
+        COUNTER_CLIENT_BYTES_SENT,
+        COUNTER_SERVER_BYTES_RECV,
+        COUNTER_SERVER_BYTES_SENT,
+        COUNTER_BYTES_BUFFERED,
+        COUNTER_BYTES_LOST,
+        COUNTER_SESSIONS_IDLE_CLOSED,
+        COUNTER_QUERY_TIMEOUTS,
+        COUNTER_BACKEND_CONNECT_RETRIES,
+        COUNTER_CONFIG_RELOADS,
+        COUNTER_CONFIG_RELOAD_FAILURES,
+        COUNTER_SESSIONS_DRAINED,
+        COUNTER_CLIENT_RESETS,
+        COUNTER_BACKEND_RESETS,
+        COUNTER_RESOLVE_FAILURES,
+        COUNTER_PEER_REJECTED,
+        COUNTER_END
+    } counter_t;
+
+    ///
+    /// \brief The gauge_t enum
+    ///
+    typedef enum {
+        GAUGE_SESSIONS_ACTIVE = 0,
+        GAUGE_BACKEND_SESSIONS_ACTIVE,
+        GAUGE_BACKEND_CONNECTS_PENDING,
+        GAUGE_TAP_QUEUE_CW,
+        GAUGE_TAP_QUEUE_SW,
+        GAUGE_DRAINING,
+        GAUGE_END
+    } gauge_t;
+
+    ///
+    /// \brief The histogram_t enum - log2 histograms
+    ///
+    typedef enum {
+        HISTOGRAM_BACKEND_CONNECT_US = 0,
+        HISTOGRAM_PROXY_REQUEST_US,      // client read -> backend write
+        HISTOGRAM_BACKEND_FIRST_BYTE_US, // backend write -> first byte
+        HISTOGRAM_BACKEND_RESPONSE_US,   // backend write -> last byte
+        HISTOGRAM_PROXY_RESPONSE_US,     // backend read -> client write
+        HISTOGRAM_END
+    } histogram_t;
+
+    ///
+    /// \brief The histogram_snapshot struct
+    ///
+    /// RU: Корзина i содержит значения из [2^(i-1), 2^i), корзина 0 -
+    ///     только ноль.
+    ///
+    struct histogram_snapshot {
+        std::array<boost::uint64_t, METRICS_HISTOGRAM_BUCKETS> buckets;
+        boost::uint64_t count;
+        boost::uint64_t sum;
+    };
+
+    ///
+    /// \brief The snapshot struct - aggregated values of all shards
+    ///
+    struct snapshot {
+        std::array<boost::uint64_t, COUNTER_END> counters;
+        std::array<boost::int64_t, GAUGE_END> gauges;
+        std::array<histogram_snapshot, HISTOGRAM_END> histograms;
+    };
+
+    ///
+    /// \brief The shard struct
+    ///
+    /// RU: Набор значений одного потока. Выровнен на строку кэша, чтобы
+    ///     потоки не делили строки между собой.
+    ///
+    struct alignas(64) shard {
+        struct histogram {
+            std::atomic<boost::uint64_t> buckets[METRICS_HISTOGRAM_BUCKETS];
+            std::atomic<boost::uint64_t> count;
+            std::atomic<boost::uint64_t> sum;
+        };
+
+        shard(void) noexcept;
+
+        std::atomic<boost::uint64_t> counters[COUNTER_END];
+        std::atomic<boost::int64_t> gauges[GAUGE_END];
+        histogram histograms[HISTOGRAM_END];
+    };
+
+    ///
+    /// \brief The metrics class
+    ///
+    /// RU: Реестр метрик. Каждый поток пишет только в свой шард (без
+    ///     блокировок и без разделяемых строк кэша). Читатель суммирует
+    ///     шарды, также без блокировок. Шарды не освобождаются до конца
+    ///     работы программы.
+    ///
+    class metrics {
+        typedef metrics self;
+    public:
+        static metrics& inst(void);
+
+        ///
+        /// \brief local - shard of the calling thread
+        /// \return
+        ///
+        shard& local(void);
+
+        ///
+        /// \brief collect - aggregate all shards
+        /// \return
+        ///
+        snapshot collect(void) const;
+
+        static char const* name(counter_t c) noexcept;
+        static char const* name(gauge_t g) noexcept;
+        static char const* name(histogram_t h) noexcept;
+
+        static char const* help(counter_t c) noexcept;
+        static char const* help(gauge_t g) noexcept;
+        static char const* help(histogram_t h) noexcept;
+
+        ///
+        /// \brief bucket - log2 bucket index of a value
+        /// \param v
+        /// \return
+        ///
+        static inline size_t bucket(boost::uint64_t v) noexcept {
+            size_t const b =
+                    v ? static_cast<size_t>(64 - __builtin_clzll(v)) : 0;
+
+            return (b < METRICS_HISTOGRAM_BUCKETS) ?
+                        b : (METRICS_HISTOGRAM_BUCKETS - 1);
+        }
+
+        ~metrics(void);
+    private:
+        metrics(void);
+        metrics(metrics const&) = delete;
+        metrics& operator=(metrics const&) = delete;
+
+        static metrics instance;
+
+        std::atomic<shard*> shards[METRICS_MAX_SHARDS];
+        std::atomic<size_t> shards_count;
+
+        // RU: Общий шард для потоков, которым не хватило своего.
+        shard overflow;
+    };
+
+    inline void counter_add(counter_t c, boost::uint64_t v = 1) noexcept {
+        metrics::inst().local().counters[c].fetch_add(
+                    v, std::memory_order_relaxed);
+    }
+
+    inline void gauge_add(gauge_t g, boost::int64_t v) noexcept {
+        metrics::inst().local().gauges[g].fetch_add(
+                    v, std::memory_order_relaxed);
+    }
+
+    ///
+    /// \brief gauge_set - only for gauges with a single writer thread
+    ///
+    inline void gauge_set(gauge_t g, boost::int64_t v) noexcept {
+        metrics::inst().local().gauges[g].store(
+                    v, std::memory_order_relaxed);
+    }
+
+    inline void histogram_observe(histogram_t h, boost::uint64_t v) noexcept {
+        shard::histogram& x = metrics::inst().local().histograms[h];
+
+        x.buckets[metrics::bucket(v)].fetch_add(1, std::memory_order_relaxed);
+        x.count.fetch_add(1, std::memory_order_relaxed);
+        x.sum.fetch_add(v, std::memory_order_relaxed);
+    }
+} // namespace metrics_ns
+
+#endif // __METRICS_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
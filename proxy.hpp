@@ -46,6 +46,29 @@ namespace proxy_ns {
         virtual void set_server_keep_alive(bool value) = 0;
         virtual void set_client_tcp_no_delay(bool value) = 0;
         virtual void set_server_tcp_no_delay(bool value) = 0;
+        virtual void set_tap_sample_rate(boost::uint32_t value) = 0;
+        virtual void set_tap_filter(std::string const& value) = 0;
+        virtual void set_capture_file(std::string const& value) = 0;
+        virtual void set_capture_segment_size(size_t value) = 0;
+        virtual void set_capture_segment_count(size_t value) = 0;
+        virtual void set_shadow_addr(std::string const& value) = 0;
+        virtual void set_shadow_port(boost::uint16_t value) = 0;
+        virtual void set_shadow_sample_rate(boost::uint32_t value) = 0;
+        virtual void set_shadow_buffer_size(size_t value) = 0;
+        virtual void set_admin_addr(std::string const& value) = 0;
+        virtual void set_admin_port(boost::uint16_t value) = 0;
+        virtual void set_client_idle_timeout(boost::int32_t value) = 0;
+        virtual void set_query_timeout(boost::int32_t value) = 0;
+        virtual void set_connect_retries(boost::int32_t value) = 0;
+        virtual void set_connect_backoff(boost::int32_t value) = 0;
+        virtual void set_takeover(bool value) = 0;
+        virtual void set_takeover_path(std::string const& value) = 0;
+        virtual void set_config_file(std::string const& value) = 0;
+        virtual void set_drain_timeout(boost::int32_t value) = 0;
+        virtual void set_resolve_ttl(boost::int32_t value) = 0;
+        virtual void set_server_cpus(std::string const& value) = 0;
+        virtual void set_client_cpus(std::string const& value) = 0;
+        virtual void set_worker_cpus(std::string const& value) = 0;
 
         virtual boost::uint16_t get_proxy_port(void) const = 0;
         virtual boost::uint16_t get_server_port(void) const = 0;
@@ -56,6 +79,29 @@ namespace proxy_ns {
         virtual bool get_server_keep_alive(void) const = 0;
         virtual bool get_client_tcp_no_delay(void) const = 0;
         virtual bool get_server_tcp_no_delay(void) const = 0;
+        virtual boost::uint32_t get_tap_sample_rate(void) const = 0;
+        virtual std::string const& get_tap_filter(void) const = 0;
+        virtual std::string const& get_capture_file(void) const = 0;
+        virtual size_t get_capture_segment_size(void) const = 0;
+        virtual size_t get_capture_segment_count(void) const = 0;
+        virtual std::string const& get_shadow_addr(void) const = 0;
+        virtual boost::uint16_t get_shadow_port(void) const = 0;
+        virtual boost::uint32_t get_shadow_sample_rate(void) const = 0;
+        virtual size_t get_shadow_buffer_size(void) const = 0;
+        virtual std::string const& get_admin_addr(void) const = 0;
+        virtual boost::uint16_t get_admin_port(void) const = 0;
+        virtual boost::int32_t get_client_idle_timeout(void) const = 0;
+        virtual boost::int32_t get_query_timeout(void) const = 0;
+        virtual boost::int32_t get_connect_retries(void) const = 0;
+        virtual boost::int32_t get_connect_backoff(void) const = 0;
+        virtual bool get_takeover(void) const = 0;
+        virtual std::string const& get_takeover_path(void) const = 0;
+        virtual std::string const& get_config_file(void) const = 0;
+        virtual boost::int32_t get_drain_timeout(void) const = 0;
+        virtual boost::int32_t get_resolve_ttl(void) const = 0;
+        virtual std::string const& get_server_cpus(void) const = 0;
+        virtual std::string const& get_client_cpus(void) const = 0;
+        virtual std::string const& get_worker_cpus(void) const = 0;
 			
 		virtual ~Iproxy(void) {}
 	};
@@ -109,6 +155,98 @@ namespace proxy_ns {
             p.get()->set_server_tcp_no_delay(value);
         }
 
+        virtual void set_tap_sample_rate(boost::uint32_t value) {
+            p.get()->set_tap_sample_rate(value);
+        }
+
+        virtual void set_tap_filter(std::string const& value) {
+            p.get()->set_tap_filter(value);
+        }
+
+        virtual void set_capture_file(std::string const& value) {
+            p.get()->set_capture_file(value);
+        }
+
+        virtual void set_capture_segment_size(size_t value) {
+            p.get()->set_capture_segment_size(value);
+        }
+
+        virtual void set_capture_segment_count(size_t value) {
+            p.get()->set_capture_segment_count(value);
+        }
+
+        virtual void set_shadow_addr(std::string const& value) {
+            p.get()->set_shadow_addr(value);
+        }
+
+        virtual void set_shadow_port(boost::uint16_t value) {
+            p.get()->set_shadow_port(value);
+        }
+
+        virtual void set_shadow_sample_rate(boost::uint32_t value) {
+            p.get()->set_shadow_sample_rate(value);
+        }
+
+        virtual void set_shadow_buffer_size(size_t value) {
+            p.get()->set_shadow_buffer_size(value);
+        }
+
+        virtual void set_admin_addr(std::string const& value) {
+            p.get()->set_admin_addr(value);
+        }
+
+        virtual void set_admin_port(boost::uint16_t value) {
+            p.get()->set_admin_port(value);
+        }
+
+        virtual void set_client_idle_timeout(boost::int32_t value) {
+            p.get()->set_client_idle_timeout(value);
+        }
+
+        virtual void set_query_timeout(boost::int32_t value) {
+            p.get()->set_query_timeout(value);
+        }
+
+        virtual void set_connect_retries(boost::int32_t value) {
+            p.get()->set_connect_retries(value);
+        }
+
+        virtual void set_connect_backoff(boost::int32_t value) {
+            p.get()->set_connect_backoff(value);
+        }
+
+        virtual void set_takeover(bool value) {
+            p.get()->set_takeover(value);
+        }
+
+        virtual void set_takeover_path(std::string const& value) {
+            p.get()->set_takeover_path(value);
+        }
+
+        virtual void set_config_file(std::string const& value) {
+            p.get()->set_config_file(value);
+        }
+
+        virtual void set_drain_timeout(boost::int32_t value) {
+            p.get()->set_drain_timeout(value);
+        }
+
+        virtual void set_resolve_ttl(boost::int32_t value) {
+            p.get()->set_resolve_ttl(value);
+        }
+
+        virtual void set_server_cpus(std::string const& value) {
+            p.get()->set_server_cpus(value);
+        }
+
+        virtual void set_client_cpus(std::string const& value) {
+            p.get()->set_client_cpus(value);
+        }
+
+        virtual void set_worker_cpus(std::string const& value) {
+            p.get()->set_worker_cpus(value);
+        }
+
         virtual boost::uint16_t get_proxy_port(void) const {
             return p.get()->get_proxy_port();
         }
@@ -145,6 +283,98 @@ namespace proxy_ns {
             return p.get()->get_server_tcp_no_delay();
         }
 
+        virtual boost::uint32_t get_tap_sample_rate(void) const {
+            return p.get()->get_tap_sample_rate();
+        }
+
+        virtual std::string const& get_tap_filter(void) const {
+            return p.get()->get_tap_filter();
+        }
+
+        virtual std::string const& get_capture_file(void) const {
+            return p.get()->get_capture_file();
+        }
+
+        virtual size_t get_capture_segment_size(void) const {
+            return p.get()->get_capture_segment_size();
+        }
+
+        virtual size_t get_capture_segment_count(void) const {
+            return p.get()->get_capture_segment_count();
+        }
+
+        virtual std::string const& get_shadow_addr(void) const {
+            return p.get()->get_shadow_addr();
+        }
+
+        virtual boost::uint16_t get_shadow_port(void) const {
+            return p.get()->get_shadow_port();
+        }
+
+        virtual boost::uint32_t get_shadow_sample_rate(void) const {
+            return p.get()->get_shadow_sample_rate();
+        }
+
+        virtual size_t get_shadow_buffer_size(void) const {
+            return p.get()->get_shadow_buffer_size();
+        }
+
+        virtual std::string const& get_admin_addr(void) const {
+            return p.get()->get_admin_addr();
+        }
+
+        virtual boost::uint16_t get_admin_port(void) const {
+            return p.get()->get_admin_port();
+        }
+
+        virtual boost::int32_t get_client_idle_timeout(void) const {
+            return p.get()->get_client_idle_timeout();
+        }
+
+        virtual boost::int32_t get_query_timeout(void) const {
+            return p.get()->get_query_timeout();
+        }
+
+        virtual boost::int32_t get_connect_retries(void) const {
+            return p.get()->get_connect_retries();
+        }
+
+        virtual boost::int32_t get_connect_backoff(void) const {
+            return p.get()->get_connect_backoff();
+        }
+
+        virtual bool get_takeover(void) const {
+            return p.get()->get_takeover();
+        }
+
+        virtual std::string const& get_takeover_path(void) const {
+            return p.get()->get_takeover_path();
+        }
+
+        virtual std::string const& get_config_file(void) const {
+            return p.get()->get_config_file();
+        }
+
+        virtual boost::int32_t get_drain_timeout(void) const {
+            return p.get()->get_drain_timeout();
+        }
+
+        virtual boost::int32_t get_resolve_ttl(void) const {
+            return p.get()->get_resolve_ttl();
+        }
+
+        virtual std::string const& get_server_cpus(void) const {
+            return p.get()->get_server_cpus();
+        }
+
+        virtual std::string const& get_client_cpus(void) const {
+            return p.get()->get_client_cpus();
+        }
+
+        virtual std::string const& get_worker_cpus(void) const {
+            return p.get()->get_worker_cpus();
+        }
+
 		virtual ~proxy(void) {
 		}
 	private:
@@ -187,6 +417,21 @@ namespace proxy_ns {
         std::string const msg;
     };
 
+    class Eproxy_invalid_value : public IEproxy {
+    public:
+        Eproxy_invalid_value(void) noexcept :
+            msg("Invalid value") {}
+        explicit Eproxy_invalid_value(
+                std::string const& value) noexcept :
+            msg("Invalid value: '" + value + "'") {}
+        virtual ~Eproxy_invalid_value() noexcept {}
+        virtual char const* what(void) const noexcept {
+            return msg.c_str();
+        }
+    private:
+        std::string const msg;
+    };
+
     class Eproxy_not_supported : public IEproxy {
     public:
         Eproxy_not_supported(void) noexcept {}
@@ -35,6 +35,7 @@
 #include <vector>
 #include <numeric>
 #include <algorithm>
+#include <limits>
 #include <iterator>
 #include <sstream>
 #include <iostream>
@@ -48,6 +49,7 @@
 #include <functional>
 
 #include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/cstdint.hpp>
 #include <boost/core/ignore_unused.hpp>
 #include <boost/lexical_cast.hpp>
@@ -59,6 +61,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <linux/sockios.h>
 #include <sys/utsname.h>
 #include <arpa/inet.h>
 #include <poll.h>
@@ -73,6 +76,14 @@
 #include "proxy_result.hpp"
 #include "proxy.hpp"
 //#include "proxy_impl.hpp" // Instead of "proxy_impl.hpp" we use "proxy.hpp".
+#include "capture.hpp"
+#include "shadow.hpp"
+#include "admin.hpp"
+#include "takeover.hpp"
+#include "metrics.hpp"
+#include "control.hpp"
+#include "timer_wheel.hpp"
+#include "affinity.hpp"
 
 #ifndef __USER_DEFAULT_PROXY_PORT
     #define __USER_DEFAULT_PROXY_PORT 4880
@@ -119,6 +130,98 @@
 #define __USER_DEFAULT_SERVER_TCP_NO_DELAY 0
 #endif // __USER_DEFAULT_SERVER_TCP_NO_DELAY
 
+#ifndef __USER_DEFAULT_TAP_SAMPLE_RATE
+#define __USER_DEFAULT_TAP_SAMPLE_RATE 1
+#endif // __USER_DEFAULT_TAP_SAMPLE_RATE
+
+#ifndef __USER_DEFAULT_TAP_FILTER
+#define __USER_DEFAULT_TAP_FILTER ""
+#endif // __USER_DEFAULT_TAP_FILTER
+
+#ifndef __USER_DEFAULT_CAPTURE_FILE
+#define __USER_DEFAULT_CAPTURE_FILE ""
+#endif // __USER_DEFAULT_CAPTURE_FILE
+
+#ifndef __USER_DEFAULT_CAPTURE_SEGMENT_SIZE
+#define __USER_DEFAULT_CAPTURE_SEGMENT_SIZE CAPTURE_DEFAULT_SEGMENT_SIZE
+#endif // __USER_DEFAULT_CAPTURE_SEGMENT_SIZE
+
+#ifndef __USER_DEFAULT_CAPTURE_SEGMENT_COUNT
+#define __USER_DEFAULT_CAPTURE_SEGMENT_COUNT CAPTURE_DEFAULT_SEGMENT_COUNT
+#endif // __USER_DEFAULT_CAPTURE_SEGMENT_COUNT
+
+#ifndef __USER_DEFAULT_SHADOW_ADDR
+#define __USER_DEFAULT_SHADOW_ADDR ""
+#endif // __USER_DEFAULT_SHADOW_ADDR
+
+#ifndef __USER_DEFAULT_SHADOW_PORT
+#define __USER_DEFAULT_SHADOW_PORT 0
+#endif // __USER_DEFAULT_SHADOW_PORT
+
+#ifndef __USER_DEFAULT_SHADOW_SAMPLE_RATE
+#define __USER_DEFAULT_SHADOW_SAMPLE_RATE 1
+#endif // __USER_DEFAULT_SHADOW_SAMPLE_RATE
+
+#ifndef __USER_DEFAULT_SHADOW_BUFFER_SIZE
+#define __USER_DEFAULT_SHADOW_BUFFER_SIZE SHADOW_SESSION_BUFFER_SIZE
+#endif // __USER_DEFAULT_SHADOW_BUFFER_SIZE
+
+#ifndef __USER_DEFAULT_ADMIN_ADDR
+#define __USER_DEFAULT_ADMIN_ADDR "127.0.0.1"
+#endif // __USER_DEFAULT_ADMIN_ADDR
+
+#ifndef __USER_DEFAULT_ADMIN_PORT
+#define __USER_DEFAULT_ADMIN_PORT 0
+#endif // __USER_DEFAULT_ADMIN_PORT
+
+#ifndef __USER_DEFAULT_CLIENT_IDLE_TIMEOUT
+#define __USER_DEFAULT_CLIENT_IDLE_TIMEOUT 0
+#endif // __USER_DEFAULT_CLIENT_IDLE_TIMEOUT
+
+#ifndef __USER_DEFAULT_QUERY_TIMEOUT
+#define __USER_DEFAULT_QUERY_TIMEOUT 0
+#endif // __USER_DEFAULT_QUERY_TIMEOUT
+
+#ifndef __USER_DEFAULT_CONNECT_RETRIES
+#define __USER_DEFAULT_CONNECT_RETRIES 0
+#endif // __USER_DEFAULT_CONNECT_RETRIES
+
+#ifndef __USER_DEFAULT_CONNECT_BACKOFF
+#define __USER_DEFAULT_CONNECT_BACKOFF 100
+#endif // __USER_DEFAULT_CONNECT_BACKOFF
+
+#ifndef __USER_DEFAULT_TAKEOVER
+#define __USER_DEFAULT_TAKEOVER 0
+#endif // __USER_DEFAULT_TAKEOVER
+
+#ifndef __USER_DEFAULT_TAKEOVER_PATH
+#define __USER_DEFAULT_TAKEOVER_PATH "/var/run/sqlproxy.takeover"
+#endif // __USER_DEFAULT_TAKEOVER_PATH
+
+#ifndef __USER_DEFAULT_CONFIG_FILE
+#define __USER_DEFAULT_CONFIG_FILE ""
+#endif // __USER_DEFAULT_CONFIG_FILE
+
+#ifndef __USER_DEFAULT_DRAIN_TIMEOUT
+#define __USER_DEFAULT_DRAIN_TIMEOUT 30000
+#endif // __USER_DEFAULT_DRAIN_TIMEOUT
+
+#ifndef __USER_DEFAULT_RESOLVE_TTL
+#define __USER_DEFAULT_RESOLVE_TTL 30000
+#endif // __USER_DEFAULT_RESOLVE_TTL
+
+#ifndef __USER_DEFAULT_SERVER_CPUS
+#define __USER_DEFAULT_SERVER_CPUS ""
+#endif // __USER_DEFAULT_SERVER_CPUS
+
+#ifndef __USER_DEFAULT_CLIENT_CPUS
+#define __USER_DEFAULT_CLIENT_CPUS ""
+#endif // __USER_DEFAULT_CLIENT_CPUS
+
+#ifndef __USER_DEFAULT_WORKER_CPUS
+#define __USER_DEFAULT_WORKER_CPUS ""
+#endif // __USER_DEFAULT_WORKER_CPUS
+
 namespace proxy_ns {
     namespace {
         size_t __set_max_pipe_size_helper(int fd,
@@ -210,6 +313,75 @@ namespace proxy_ns {
     bool const proxy_impl::DEFAULT_SERVER_TCP_NO_DELAY =
             __USER_DEFAULT_SERVER_TCP_NO_DELAY;
 
+    boost::uint32_t const proxy_impl::DEFAULT_TAP_SAMPLE_RATE =
+            __USER_DEFAULT_TAP_SAMPLE_RATE;
+
+    std::string const proxy_impl::DEFAULT_TAP_FILTER =
+            __USER_DEFAULT_TAP_FILTER;
+
+    std::string const proxy_impl::DEFAULT_CAPTURE_FILE =
+            __USER_DEFAULT_CAPTURE_FILE;
+
+    size_t const proxy_impl::DEFAULT_CAPTURE_SEGMENT_SIZE =
+            __USER_DEFAULT_CAPTURE_SEGMENT_SIZE;
+
+    size_t const proxy_impl::DEFAULT_CAPTURE_SEGMENT_COUNT =
+            __USER_DEFAULT_CAPTURE_SEGMENT_COUNT;
+
+    std::string const proxy_impl::DEFAULT_SHADOW_ADDR =
+            __USER_DEFAULT_SHADOW_ADDR;
+
+    boost::uint16_t const proxy_impl::DEFAULT_SHADOW_PORT =
+            __USER_DEFAULT_SHADOW_PORT;
+
+    boost::uint32_t const proxy_impl::DEFAULT_SHADOW_SAMPLE_RATE =
+            __USER_DEFAULT_SHADOW_SAMPLE_RATE;
+
+    size_t const proxy_impl::DEFAULT_SHADOW_BUFFER_SIZE =
+            __USER_DEFAULT_SHADOW_BUFFER_SIZE;
+
+    std::string const proxy_impl::DEFAULT_ADMIN_ADDR =
+            __USER_DEFAULT_ADMIN_ADDR;
+
+    boost::uint16_t const proxy_impl::DEFAULT_ADMIN_PORT =
+            __USER_DEFAULT_ADMIN_PORT;
+
+    boost::int32_t const proxy_impl::DEFAULT_CLIENT_IDLE_TIMEOUT =
+            __USER_DEFAULT_CLIENT_IDLE_TIMEOUT;
+
+    boost::int32_t const proxy_impl::DEFAULT_QUERY_TIMEOUT =
+            __USER_DEFAULT_QUERY_TIMEOUT;
+
+    boost::int32_t const proxy_impl::DEFAULT_CONNECT_RETRIES =
+            __USER_DEFAULT_CONNECT_RETRIES;
+
+    boost::int32_t const proxy_impl::DEFAULT_CONNECT_BACKOFF =
+            __USER_DEFAULT_CONNECT_BACKOFF;
+
+    bool const proxy_impl::DEFAULT_TAKEOVER =
+            __USER_DEFAULT_TAKEOVER;
+
+    std::string const proxy_impl::DEFAULT_TAKEOVER_PATH =
+            __USER_DEFAULT_TAKEOVER_PATH;
+
+    std::string const proxy_impl::DEFAULT_CONFIG_FILE =
+            __USER_DEFAULT_CONFIG_FILE;
+
+    boost::int32_t const proxy_impl::DEFAULT_DRAIN_TIMEOUT =
+            __USER_DEFAULT_DRAIN_TIMEOUT;
+
+    boost::int32_t const proxy_impl::DEFAULT_RESOLVE_TTL =
+            __USER_DEFAULT_RESOLVE_TTL;
+
+    std::string const proxy_impl::DEFAULT_SERVER_CPUS =
+            __USER_DEFAULT_SERVER_CPUS;
+
+    std::string const proxy_impl::DEFAULT_CLIENT_CPUS =
+            __USER_DEFAULT_CLIENT_CPUS;
+
+    std::string const proxy_impl::DEFAULT_WORKER_CPUS =
+            __USER_DEFAULT_WORKER_CPUS;
+
     data::data(void) {
         this->direction = DIRECTION_UNKNOWN;
         this->tod = TOD_UNKNOWN;
@@ -219,6 +391,11 @@ namespace proxy_ns {
 
         this->buffer_len = 0;
 
+        this->tap = false;
+        this->route = 0;
+
+        this->timestamp = 0;
+
         std::fill_n(reinterpret_cast<char*>(this->buffer),
                     sizeof(this->buffer), '\0');
 
@@ -236,9 +413,9 @@ namespace proxy_ns {
                int const& _s_sd,
                unsigned int const& _buffer_len,
                unsigned char const* _buffer,
-               struct sockaddr_in const& _client_addr,
-               struct sockaddr_in const& _proxy_addr,
-               struct sockaddr_in const& _server_addr) :
+               struct sockaddr_storage const& _client_addr,
+               struct sockaddr_storage const& _proxy_addr,
+               struct sockaddr_storage const& _server_addr) :
         data(_direction,
              _tod,
              _c_sd,
@@ -255,14 +432,17 @@ namespace proxy_ns {
                int const& _s_sd,
                unsigned int const& _buffer_len,
                unsigned char const* _buffer,
-               struct sockaddr_in const* _client_addr,
-               struct sockaddr_in const* _proxy_addr,
-               struct sockaddr_in const* _server_addr) :
+               struct sockaddr_storage const* _client_addr,
+               struct sockaddr_storage const* _proxy_addr,
+               struct sockaddr_storage const* _server_addr) :
         direction(_direction),
         tod(_tod),
         c_sd(_c_sd),
         s_sd(_s_sd),
-        buffer_len(_buffer_len) {
+        buffer_len(_buffer_len),
+        tap(false),
+        route(0),
+        timestamp(capture_ns::monotonic_ns()) {
 
 #ifdef USE_FULL_DEBUG
         if(!((_buffer == nullptr && _buffer_len == 0) ||
@@ -296,37 +476,10 @@ namespace proxy_ns {
                       reinterpret_cast<char*>(&this->buffer));
         }
 
-        if(nullptr == _client_addr) {
-            std::fill_n(reinterpret_cast<char*>(&this->client_addr),
-                        sizeof(this->client_addr), '\0');
-        }
-        else {
-            std::copy(reinterpret_cast<char const*>(_client_addr),
-                      reinterpret_cast<char const*>(_client_addr),
-                      reinterpret_cast<char*>(&this->client_addr));
-        }
-
-        if(nullptr == _proxy_addr) {
-            std::fill_n(reinterpret_cast<char*>(&this->proxy_addr),
-                        sizeof(this->proxy_addr), '\0');
-        }
-        else {
-            std::copy(reinterpret_cast<char const*>(_proxy_addr),
-                      reinterpret_cast<char const*>(_proxy_addr) +
-                        sizeof(this->proxy_addr),
-                    reinterpret_cast<char*>(&this->proxy_addr));
-        }
-
-        if(nullptr == _server_addr) {
-            std::fill_n(reinterpret_cast<char*>(&this->server_addr),
-                        sizeof(this->server_addr), '\0');
-        }
-        else {
-            std::copy(reinterpret_cast<char const*>(_server_addr),
-                      reinterpret_cast<char const*>(_server_addr) +
-                        sizeof(this->server_addr),
-                    reinterpret_cast<char*>(&this->server_addr));
-        }
+        // RU: Из sockaddr_storage копируется только нужная семейству часть
+        address_store(this->client_addr, _client_addr);
+        address_store(this->proxy_addr, _proxy_addr);
+        address_store(this->server_addr, _server_addr);
     }
 
     ///
@@ -338,6 +491,8 @@ namespace proxy_ns {
 		c_last_err(RES_CODE_UNKNOWN),
 		w_last_err(RES_CODE_UNKNOWN),
 		end_proxy(false),
+        listen_count(0),
+        draining(false),
         proxy_port(self::DEFAULT_PROXY_PORT),
         server_port(self::DEFAULT_SERVER_PORT),
         server_ip(self::DEFAULT_SERVER_IP),
@@ -349,6 +504,36 @@ namespace proxy_ns {
         server_keep_alive(self::DEFAULT_SERVER_KEEP_ALIVE),
         client_tcp_no_delay(self::DEFAULT_CLIENT_TCP_NO_DELAY),
         server_tcp_no_delay(self::DEFAULT_SERVER_TCP_NO_DELAY),
+        tap_sample_rate(self::DEFAULT_TAP_SAMPLE_RATE),
+        tap_session_counter(0),
+        tap_filter(),
+        tap_filter_addr(0),
+        tap_filter_mask(0),
+        cw_tap(),
+        sw_tap(),
+        capture_file(self::DEFAULT_CAPTURE_FILE),
+        capture_segment_size(self::DEFAULT_CAPTURE_SEGMENT_SIZE),
+        capture_segment_count(self::DEFAULT_CAPTURE_SEGMENT_COUNT),
+        shadow_addr(self::DEFAULT_SHADOW_ADDR),
+        shadow_port(self::DEFAULT_SHADOW_PORT),
+        shadow_sample_rate(self::DEFAULT_SHADOW_SAMPLE_RATE),
+        shadow_buffer_size(self::DEFAULT_SHADOW_BUFFER_SIZE),
+        admin_addr(self::DEFAULT_ADMIN_ADDR),
+        admin_port(self::DEFAULT_ADMIN_PORT),
+        client_idle_timeout(self::DEFAULT_CLIENT_IDLE_TIMEOUT),
+        query_timeout(self::DEFAULT_QUERY_TIMEOUT),
+        connect_retries(self::DEFAULT_CONNECT_RETRIES),
+        connect_backoff(self::DEFAULT_CONNECT_BACKOFF),
+        takeover(self::DEFAULT_TAKEOVER),
+        takeover_path(self::DEFAULT_TAKEOVER_PATH),
+        config_file(self::DEFAULT_CONFIG_FILE),
+        drain_timeout(self::DEFAULT_DRAIN_TIMEOUT),
+        resolve_ttl(self::DEFAULT_RESOLVE_TTL),
+        server_cpus(self::DEFAULT_SERVER_CPUS),
+        client_cpus(self::DEFAULT_CLIENT_CPUS),
+        worker_cpus(self::DEFAULT_WORKER_CPUS),
+        resolver(),
+        resolve_deadline(std::numeric_limits<boost::uint64_t>::max()),
         s_thread(0),
         c_thread(0),
         w_thread(0),
@@ -359,6 +544,10 @@ namespace proxy_ns {
         max_pipe_size(0),
         max_pipe_size_system(0) {
 
+        for(auto& x : this->listen_fd) {
+            x = -1;
+        }
+
         std::function<size_t(std::string const&)> f_get_max_system_size =
                 [](std::string const& procfilename) -> size_t {
             size_t res = 0;
@@ -409,10 +598,8 @@ namespace proxy_ns {
             return res;
         };
 
-        // TODO: для сокетов получать максимальное значение действительно,
-        //       а затем пытаться выставить это значние.
-        //       Сейчас берётся значение по-умолчанию и оно считается
-        //       максимальным.
+        // RU: Для сокетов берётся максимальное значение, которое затем
+        //     выставляется (см. set_max_pipe_size).
         this->max_pipe_size_system = (this->use_pipe) ?
             f_get_max_system_size("/proc/sys/fs/pipe-max-size") :
                 std::min(
@@ -432,6 +619,10 @@ namespace proxy_ns {
         size_t res_pipe_size = 0;
 		int rc = 0;
 
+        if(!this->load_runtime_config()) {
+            return RES_CODE_ERROR;
+        }
+
         rc = this->pipe_create(this->pipe_sc_pd);
 		if(rc < 0) {
 			l(Ilog::LEVEL_ERROR, "'pipe' error");
@@ -590,12 +781,123 @@ namespace proxy_ns {
           std::string("Pipe buffer size (max for data [bytes]): ") +
           std::to_string(this->max_pipe_data_size));
 
+        // RU: Каналы C->W и S->W используются только как "звонок" для
+        //     воркера (сами данные передаются через tap_ring). Запись в них
+        //     не должна блокировать потоки клиента и сервера.
+        for(int sd : {this->pipe_cw_pd[self::CLIENT_WORKER_OUT],
+                      this->pipe_cw_pd[self::WORKER_CLIENT_IN],
+                      this->pipe_sw_pd[self::SERVER_WORKER_OUT],
+                      this->pipe_sw_pd[self::WORKER_SERVER_IN]}) {
+            (void) this->set_nonblock(sd, this->fok_placeholder,
+                [&l](int rc, int err) {
+                    boost::ignore_unused(rc);
+                    l(Ilog::LEVEL_ERROR,
+                      std::string("'fcntl' failed (tap doorbell): ") +
+                      ::strerror(err));
+                });
+        }
+
+        // RU: Слушающие сокеты работающей копии (если она есть) забираются
+        //     до запуска своего сервера передачи - тот удалит её путь
+        if(this->takeover && !this->takeover_path.empty()) {
+            int fds[LISTENERS_MAX];
+            size_t const n = proxy_ns::takeover::receive(this->takeover_path,
+                                                         TAKEOVER_TIMEOUT,
+                                                         fds, LISTENERS_MAX);
+            if(!n) {
+                l(Ilog::LEVEL_INFO,
+                  "Takeover: no running copy, listening on our own");
+            }
+            else {
+                this->adopt_listeners(fds, n);
+            }
+        }
+
+        boost::scoped_ptr<proxy_ns::takeover> tko;
+
+        if(!this->takeover_path.empty()) {
+            try {
+                tko.reset(new proxy_ns::takeover(this, this->takeover_path));
+            }
+            catch(IEproxy const& e) {
+                l(Ilog::LEVEL_ERROR, std::string("Takeover: ") + e.what());
+            }
+        }
+
+        boost::scoped_ptr<admin> adm;
+
+        if(this->admin_port) {
+            try {
+                adm.reset(new admin(this, this->admin_addr, this->admin_port));
+            }
+            catch(IEproxy const& e) {
+                l(Ilog::LEVEL_ERROR, std::string("Admin: ") + e.what());
+            }
+        }
+
 		this->server_run();
 		this->client_run();
 		this->worker_run();
 
+        // RU: Главный поток ждёт завершения остальных и выполняет запросы
+        //     обработчиков сигналов и администраторского интерфейса
+        boost::uint64_t drain_deadline = 0;
+
+        auto active_sessions = []() -> boost::int64_t {
+            return metrics_ns::metrics::inst().collect().gauges[
+                        metrics_ns::GAUGE_SESSIONS_ACTIVE];
+        };
+
+        control_attach(true);
+
+        while(!this->end_proxy) {
+            (void) ::poll(nullptr, 0, CONTROL_CHECK_INTERVAL);
+
+            if(control_take(CONTROL_RELOAD)) {
+                l(Ilog::LEVEL_INFO, "Config: reloading");
+                (void) this->load_runtime_config();
+            }
+
+            this->refresh_backends();
+
+            if(control_take(CONTROL_DRAIN)) {
+                this->draining = true;
+            }
+
+            if(control_take(CONTROL_STOP)) {
+                l(Ilog::LEVEL_INFO, "Stop requested");
+                this->end_proxy = true;
+            }
+
+            // RU: Переход в "доживание" - по запросу или после takeover
+            if(this->draining && !drain_deadline) {
+                drain_deadline = (this->drain_timeout > 0) ?
+                        timer_wheel::now() + this->drain_timeout :
+                        ~static_cast<boost::uint64_t>(0);
+
+                metrics_ns::gauge_set(metrics_ns::GAUGE_DRAINING, 1);
+
+                l(Ilog::LEVEL_INFO,
+                  "Drain: started, " +
+                  ((this->drain_timeout > 0) ?
+                       "deadline " + std::to_string(this->drain_timeout) +
+                       " ms" : std::string("no deadline")) + ", " +
+                  std::to_string(active_sessions()) + " sessions");
+            }
+
+            if(drain_deadline && timer_wheel::now() >= drain_deadline) {
+                l(Ilog::LEVEL_INFO,
+                  "Drain: deadline reached, " +
+                  std::to_string(active_sessions()) +
+                  " sessions are cut");
+                this->end_proxy = true;
+            }
+        }
+
+        control_attach(false);
+
 		rc = ::pthread_join(this->s_thread, nullptr);
-		if(!rc) {
+		if(rc) {
 			l(Ilog::LEVEL_ERROR, "'pthread_join' failed (server thread)");
 		}
         else {
@@ -603,7 +905,7 @@ namespace proxy_ns {
         }
 
         rc = ::pthread_join(this->c_thread, nullptr);
-        if(!rc) {
+        if(rc) {
             l(Ilog::LEVEL_ERROR, "'pthread_join' failed (client thread)");
         }
         else {
@@ -611,13 +913,16 @@ namespace proxy_ns {
         }
 
         rc = ::pthread_join(this->w_thread, nullptr);
-        if(!rc) {
+        if(rc) {
             l(Ilog::LEVEL_ERROR, "'pthread_join' failed (worker thread)");
         }
         else {
             l(Ilog::LEVEL_DEBUG, "'pthread_join' ok (worker thread)");
         }
 
+        adm.reset();
+        tko.reset();
+
         (void) ::close(this->pipe_sc_pd[0]);
         (void) ::close(this->pipe_sc_pd[1]);
         (void) ::close(this->pipe_cs_pd[0]);
@@ -741,234 +1046,779 @@ namespace proxy_ns {
         }
     }
 
-    boost::uint16_t proxy_impl::get_proxy_port(void) const {
+    void proxy_impl::set_tap_sample_rate(boost::uint32_t value) {
         if(this->run_mutex.try_lock()) {
+            this->tap_sample_rate = value;
             this->run_mutex.unlock();
-            return this->proxy_port;
         }
         else {
             throw Eproxy_running();
         }
     }
 
-    boost::uint16_t proxy_impl::get_server_port(void) const {
+    void proxy_impl::set_tap_filter(std::string const& value) {
+        in_addr_t addr = 0;
+        in_addr_t mask = 0;
+
+        if(!value.empty()) {
+            std::string::size_type const pos = value.find('/');
+            std::string const host = value.substr(0, pos);
+            unsigned long bits = 32;
+            struct in_addr ia;
+
+            if(pos != std::string::npos) {
+                try {
+                    bits = boost::lexical_cast<unsigned long>(
+                                value.substr(pos + 1));
+                }
+                catch(boost::bad_lexical_cast const&) {
+                    throw Eproxy_invalid_value(value);
+                }
+            }
+
+            if(bits > 32 || ::inet_pton(AF_INET, host.c_str(), &ia) != 1) {
+                throw Eproxy_invalid_value(value);
+            }
+
+            mask = (bits == 0) ? 0 : htonl(~0U << (32 - bits));
+            addr = ia.s_addr & mask;
+        }
+
         if(this->run_mutex.try_lock()) {
+            this->tap_filter = value;
+            this->tap_filter_addr = addr;
+            this->tap_filter_mask = mask;
             this->run_mutex.unlock();
-            return this->server_port;
         }
         else {
             throw Eproxy_running();
         }
     }
 
-    std::string const& proxy_impl::get_server_ip(void) const {
+    void proxy_impl::set_capture_file(std::string const& value) {
         if(this->run_mutex.try_lock()) {
+            this->capture_file = value;
             this->run_mutex.unlock();
-            return this->server_ip;
         }
         else {
             throw Eproxy_running();
         }
     }
 
-    boost::int32_t proxy_impl::get_timeout(void) const {
+    void proxy_impl::set_capture_segment_size(size_t value) {
         if(this->run_mutex.try_lock()) {
+            this->capture_segment_size = value;
             this->run_mutex.unlock();
-            // RU: Возвращается среднее арифметическое между 3 таймаутами.
-            return ([this]()->boost::int32_t {
-                std::array<boost::int32_t, 3> v{
-                    this->client_poll_timeout,
-                    this->server_poll_timeout,
-                    this->worker_poll_timeout
-                };
-
-                return (std::accumulate(v.begin(), v.end(), 0) / v.size());
-            }());
         }
         else {
             throw Eproxy_running();
         }
     }
 
-    boost::int32_t proxy_impl::get_connect_timeout(void) const {
+    void proxy_impl::set_capture_segment_count(size_t value) {
         if(this->run_mutex.try_lock()) {
+            this->capture_segment_count = value;
             this->run_mutex.unlock();
-            return this->connect_timeout;
         }
         else {
             throw Eproxy_running();
         }
     }
 
-    bool proxy_impl::get_client_keep_alive(void) const {
+    void proxy_impl::set_shadow_addr(std::string const& value) {
+        struct in_addr ia;
+
+        if(!value.empty() && ::inet_pton(AF_INET, value.c_str(), &ia) != 1) {
+            throw Eproxy_invalid_value(value);
+        }
+
         if(this->run_mutex.try_lock()) {
+            this->shadow_addr = value;
             this->run_mutex.unlock();
-            return this->client_keep_alive;
         }
         else {
             throw Eproxy_running();
         }
     }
 
-    bool proxy_impl::get_server_keep_alive(void) const {
+    void proxy_impl::set_shadow_port(boost::uint16_t value) {
         if(this->run_mutex.try_lock()) {
+            this->shadow_port = value;
             this->run_mutex.unlock();
-            return this->server_keep_alive;
         }
         else {
             throw Eproxy_running();
         }
     }
 
-    bool proxy_impl::get_client_tcp_no_delay(void) const {
+    void proxy_impl::set_shadow_sample_rate(boost::uint32_t value) {
         if(this->run_mutex.try_lock()) {
+            this->shadow_sample_rate = value;
             this->run_mutex.unlock();
-            return this->client_tcp_no_delay;
         }
         else {
             throw Eproxy_running();
         }
     }
 
-    bool proxy_impl::get_server_tcp_no_delay(void) const {
+    void proxy_impl::set_shadow_buffer_size(size_t value) {
         if(this->run_mutex.try_lock()) {
+            this->shadow_buffer_size = value;
             this->run_mutex.unlock();
-            return this->server_tcp_no_delay;
         }
         else {
             throw Eproxy_running();
         }
     }
 
-    ///
-    /// \brief proxy_impl::~proxy_impl
-    ///
-	proxy_impl::~proxy_impl(void) {
-	}
-
-    ///
-    /// \brief proxy_impl::server_run
-    ///
-	void proxy_impl::server_run(void) {
-		this->s_arg._proxy = this;
-        this->s_arg._sc_out_pd = this->pipe_sc_pd[self::SERVER_CLIENT_OUT];
-        this->s_arg._cs_in_pd  = this->pipe_cs_pd[self::SERVER_CLIENT_IN];
-        this->s_arg._sw_out_pd = this->pipe_sw_pd[self::SERVER_WORKER_OUT];
-        this->s_arg._ws_in_pd  = this->pipe_ws_pd[self::SERVER_WORKER_IN];
-			
-        int rc = ::pthread_create(reinterpret_cast<pthread_t*>(
-                                      &(this->s_thread)),
-								  nullptr,
-								  server_worker,
-								  reinterpret_cast<void*>(&(this->s_arg)));
-		
-		if(!rc) {
-			this->s_last_err = RES_CODE_ERROR;
-		}
-	}
-	
-    ///
-    /// \brief proxy_impl::client_run
-    ///
-	void proxy_impl::client_run(void) {
-        this->c_arg._proxy = this;
-        this->c_arg._cs_out_pd = this->pipe_cs_pd[self::CLIENT_SERVER_OUT];
-        this->c_arg._sc_in_pd  = this->pipe_sc_pd[self::CLIENT_SERVER_IN];
-        this->c_arg._cw_out_pd = this->pipe_cw_pd[self::CLIENT_WORKER_OUT];
-        this->c_arg._wc_in_pd  = this->pipe_wc_pd[self::CLIENT_WORKER_IN];
-
-        int rc = ::pthread_create(reinterpret_cast<pthread_t*>(
-                                      &(this->c_thread)),
-                                  nullptr,
-                                  client_worker,
-                                  reinterpret_cast<void*>(&(this->c_arg)));
+    void proxy_impl::set_admin_addr(std::string const& value) {
+        struct in_addr ia;
 
-        if(!rc) {
-            this->c_last_err = RES_CODE_ERROR;
+        if(::inet_pton(AF_INET, value.c_str(), &ia) != 1) {
+            throw Eproxy_invalid_value(value);
         }
-	}
-	
-    ///
-    /// \brief proxy_impl::worker_run
-    ///
-	void proxy_impl::worker_run(void) {
-        this->w_arg._proxy = this;
-        this->w_arg._ws_out_pd = this->pipe_ws_pd[self::WORKER_SERVER_OUT];
-        this->w_arg._sw_in_pd  = this->pipe_sw_pd[self::WORKER_SERVER_IN];
-        this->w_arg._wc_out_pd = this->pipe_wc_pd[self::WORKER_CLIENT_OUT];
-        this->w_arg._cw_in_pd  = this->pipe_cw_pd[self::WORKER_CLIENT_IN];
 
-        int rc = ::pthread_create(reinterpret_cast<pthread_t*>(
-                                      &(this->w_thread)),
-                                  nullptr,
-                                  worker_worker,
-                                  reinterpret_cast<void*>(&(this->w_arg)));
-
-        if(!rc) {
-            this->w_last_err = RES_CODE_ERROR;
+        if(this->run_mutex.try_lock()) {
+            this->admin_addr = value;
+            this->run_mutex.unlock();
         }
-	}
+        else {
+            throw Eproxy_running();
+        }
+    }
 
-    int proxy_impl::pipe_create(int* d) {
-        if(this->use_pipe) {
-            return ::pipe(d);
+    void proxy_impl::set_admin_port(boost::uint16_t value) {
+        if(this->run_mutex.try_lock()) {
+            this->admin_port = value;
+            this->run_mutex.unlock();
         }
         else {
-            return ::socketpair(AF_UNIX, SOCK_STREAM, 0, d);
+            throw Eproxy_running();
         }
     }
 
-    size_t proxy_impl::set_max_pipe_size(int pipe_fd) {
-        if(this->use_pipe) {
-            ssize_t default_max_pipe_size = 0;
-
-            default_max_pipe_size = ::fcntl(pipe_fd, F_GETPIPE_SZ);
-            if(default_max_pipe_size < 0) {
-                throw Eproxy_syscall_failed("'fcntl' (F_GETPIPE_SZ)");
-            }
-
-            this->max_pipe_size = default_max_pipe_size;
-            this->max_pipe_size = __set_max_pipe_size_helper(pipe_fd,
-                                             default_max_pipe_size,
-                                             this->max_pipe_size_system,
-                                             default_max_pipe_size,
-                                             1024);
+    void proxy_impl::set_client_idle_timeout(boost::int32_t value) {
+        if(this->run_mutex.try_lock()) {
+            this->client_idle_timeout = value;
+            this->run_mutex.unlock();
         }
         else {
-            // RU: В настоящее время для сокета ничего не меняем.
-            //     Оставляем значение, которое было получено как
-            //     "значение по-умолчанию".
-            //     this->max_pipe_size_system - содержит не максимальное,
-            //     а минимальное из текущих значение (для чтения и записи).
-            this->max_pipe_size = this->max_pipe_size_system;
+            throw Eproxy_running();
         }
-
-        this->pipe_reserved_size = (this->max_pipe_size / 100) *
-                this->pipe_reserved_percent;
-
-        this->max_pipe_data_size = this->max_pipe_size -
-                this->pipe_reserved_size;
-
-        return this->max_pipe_size;
     }
 
-    size_t proxy_impl::set_max_pipe_size_force(int pipe_fd, size_t new_size) {
-        if(this->use_pipe) {
-            int rc = ::fcntl(pipe_fd, F_SETPIPE_SZ, &new_size);
-            if(rc < 0) {
-                throw Eproxy_syscall_failed("'fcntl' (F_SETPIPE_SZ)");
-            }
-
-            this->max_pipe_size = new_size;
+    void proxy_impl::set_query_timeout(boost::int32_t value) {
+        if(this->run_mutex.try_lock()) {
+            this->query_timeout = value;
+            this->run_mutex.unlock();
         }
         else {
-            throw Eproxy_not_supported();
+            throw Eproxy_running();
         }
+    }
 
-        this->pipe_reserved_size = (this->max_pipe_size / 100) *
-                this->pipe_reserved_percent;
-
-        this->max_pipe_data_size = this->max_pipe_size -
+    void proxy_impl::set_connect_retries(boost::int32_t value) {
+        if(this->run_mutex.try_lock()) {
+            this->connect_retries = value;
+            this->run_mutex.unlock();
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    void proxy_impl::set_connect_backoff(boost::int32_t value) {
+        if(this->run_mutex.try_lock()) {
+            this->connect_backoff = value;
+            this->run_mutex.unlock();
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    void proxy_impl::set_takeover(bool value) {
+        if(this->run_mutex.try_lock()) {
+            this->takeover = value;
+            this->run_mutex.unlock();
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    void proxy_impl::set_takeover_path(std::string const& value) {
+        if(this->run_mutex.try_lock()) {
+            this->takeover_path = value;
+            this->run_mutex.unlock();
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    void proxy_impl::set_config_file(std::string const& value) {
+        if(this->run_mutex.try_lock()) {
+            this->config_file = value;
+            this->run_mutex.unlock();
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    void proxy_impl::set_drain_timeout(boost::int32_t value) {
+        if(this->run_mutex.try_lock()) {
+            this->drain_timeout = value;
+            this->run_mutex.unlock();
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    void proxy_impl::set_resolve_ttl(boost::int32_t value) {
+        if(this->run_mutex.try_lock()) {
+            this->resolve_ttl = value;
+            this->run_mutex.unlock();
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    void proxy_impl::set_server_cpus(std::string const& value) {
+        cpu_set_t set;
+
+        if(!value.empty() && !cpu_list_parse(value, set)) {
+            throw Eproxy_invalid_value(value);
+        }
+
+        if(this->run_mutex.try_lock()) {
+            this->server_cpus = value;
+            this->run_mutex.unlock();
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    void proxy_impl::set_client_cpus(std::string const& value) {
+        cpu_set_t set;
+
+        if(!value.empty() && !cpu_list_parse(value, set)) {
+            throw Eproxy_invalid_value(value);
+        }
+
+        if(this->run_mutex.try_lock()) {
+            this->client_cpus = value;
+            this->run_mutex.unlock();
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    void proxy_impl::set_worker_cpus(std::string const& value) {
+        cpu_set_t set;
+
+        if(!value.empty() && !cpu_list_parse(value, set)) {
+            throw Eproxy_invalid_value(value);
+        }
+
+        if(this->run_mutex.try_lock()) {
+            this->worker_cpus = value;
+            this->run_mutex.unlock();
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::uint16_t proxy_impl::get_proxy_port(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->proxy_port;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::uint16_t proxy_impl::get_server_port(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->server_port;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    std::string const& proxy_impl::get_server_ip(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->server_ip;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::int32_t proxy_impl::get_timeout(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            // RU: Возвращается среднее арифметическое между 3 таймаутами.
+            return ([this]()->boost::int32_t {
+                std::array<boost::int32_t, 3> v{
+                    this->client_poll_timeout,
+                    this->server_poll_timeout,
+                    this->worker_poll_timeout
+                };
+
+                return (std::accumulate(v.begin(), v.end(), 0) / v.size());
+            }());
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::int32_t proxy_impl::get_connect_timeout(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->connect_timeout;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    bool proxy_impl::get_client_keep_alive(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->client_keep_alive;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    bool proxy_impl::get_server_keep_alive(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->server_keep_alive;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    bool proxy_impl::get_client_tcp_no_delay(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->client_tcp_no_delay;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    bool proxy_impl::get_server_tcp_no_delay(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->server_tcp_no_delay;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::uint32_t proxy_impl::get_tap_sample_rate(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->tap_sample_rate;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    std::string const& proxy_impl::get_tap_filter(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->tap_filter;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    std::string const& proxy_impl::get_capture_file(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->capture_file;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    size_t proxy_impl::get_capture_segment_size(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->capture_segment_size;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    size_t proxy_impl::get_capture_segment_count(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->capture_segment_count;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    std::string const& proxy_impl::get_shadow_addr(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->shadow_addr;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::uint16_t proxy_impl::get_shadow_port(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->shadow_port;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::uint32_t proxy_impl::get_shadow_sample_rate(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->shadow_sample_rate;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    size_t proxy_impl::get_shadow_buffer_size(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->shadow_buffer_size;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    std::string const& proxy_impl::get_admin_addr(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->admin_addr;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::uint16_t proxy_impl::get_admin_port(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->admin_port;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::int32_t proxy_impl::get_client_idle_timeout(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->client_idle_timeout;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::int32_t proxy_impl::get_query_timeout(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->query_timeout;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::int32_t proxy_impl::get_connect_retries(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->connect_retries;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::int32_t proxy_impl::get_connect_backoff(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->connect_backoff;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    bool proxy_impl::get_takeover(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->takeover;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    std::string const& proxy_impl::get_takeover_path(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->takeover_path;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    std::string const& proxy_impl::get_config_file(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->config_file;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::int32_t proxy_impl::get_drain_timeout(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->drain_timeout;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    boost::int32_t proxy_impl::get_resolve_ttl(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->resolve_ttl;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    std::string const& proxy_impl::get_server_cpus(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->server_cpus;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    std::string const& proxy_impl::get_client_cpus(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->client_cpus;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    std::string const& proxy_impl::get_worker_cpus(void) const {
+        if(this->run_mutex.try_lock()) {
+            this->run_mutex.unlock();
+            return this->worker_cpus;
+        }
+        else {
+            throw Eproxy_running();
+        }
+    }
+
+    ///
+    /// \brief proxy_impl::~proxy_impl
+    ///
+	proxy_impl::~proxy_impl(void) {
+	}
+
+    ///
+    /// \brief proxy_impl::server_run
+    ///
+	void proxy_impl::server_run(void) {
+		this->s_arg._proxy = this;
+        this->s_arg._sc_out_pd = this->pipe_sc_pd[self::SERVER_CLIENT_OUT];
+        this->s_arg._cs_in_pd  = this->pipe_cs_pd[self::SERVER_CLIENT_IN];
+        this->s_arg._sw_out_pd = this->pipe_sw_pd[self::SERVER_WORKER_OUT];
+        this->s_arg._ws_in_pd  = this->pipe_ws_pd[self::SERVER_WORKER_IN];
+			
+        int rc = this->thread_start(this->s_thread, this->server_cpus, "server",
+                                    server_worker, &(this->s_arg));
+		
+		if(!rc) {
+			this->s_last_err = RES_CODE_ERROR;
+		}
+	}
+	
+    ///
+    /// \brief proxy_impl::client_run
+    ///
+	void proxy_impl::client_run(void) {
+        this->c_arg._proxy = this;
+        this->c_arg._cs_out_pd = this->pipe_cs_pd[self::CLIENT_SERVER_OUT];
+        this->c_arg._sc_in_pd  = this->pipe_sc_pd[self::CLIENT_SERVER_IN];
+        this->c_arg._cw_out_pd = this->pipe_cw_pd[self::CLIENT_WORKER_OUT];
+        this->c_arg._wc_in_pd  = this->pipe_wc_pd[self::CLIENT_WORKER_IN];
+
+        int rc = this->thread_start(this->c_thread, this->client_cpus, "client",
+                                    client_worker, &(this->c_arg));
+
+        if(!rc) {
+            this->c_last_err = RES_CODE_ERROR;
+        }
+	}
+	
+    ///
+    /// \brief proxy_impl::worker_run
+    ///
+	void proxy_impl::worker_run(void) {
+        this->w_arg._proxy = this;
+        this->w_arg._ws_out_pd = this->pipe_ws_pd[self::WORKER_SERVER_OUT];
+        this->w_arg._sw_in_pd  = this->pipe_sw_pd[self::WORKER_SERVER_IN];
+        this->w_arg._wc_out_pd = this->pipe_wc_pd[self::WORKER_CLIENT_OUT];
+        this->w_arg._cw_in_pd  = this->pipe_cw_pd[self::WORKER_CLIENT_IN];
+
+        int rc = this->thread_start(this->w_thread, this->worker_cpus, "worker",
+                                    worker_worker, &(this->w_arg));
+
+        if(!rc) {
+            this->w_last_err = RES_CODE_ERROR;
+        }
+	}
+
+    ///
+    /// \brief proxy_impl::thread_start - start a reactor thread
+    /// \param th
+    /// \param cpus - CPU list, "" - no pinning
+    /// \param who - thread name for the log
+    /// \param routine
+    /// \param arg
+    /// \return pthread_create result
+    ///
+    int proxy_impl::thread_start(pthread_t& th, std::string const& cpus,
+                                 char const* who,
+                                 void* (*routine)(void*), void* arg) {
+        log_ns::log& l = log_ns::log::inst();
+
+        int rc = proxy_ns::thread_start(th, cpus, routine, arg);
+
+        if(cpus.empty()) {
+            return rc;
+        }
+
+        if(!rc) {
+            l(Ilog::LEVEL_INFO, std::string("Affinity: ") + who +
+              " thread on CPUs " + cpus);
+            return rc;
+        }
+
+        // RU: CPU из списка недоступны (cpuset, offline) - поток работает
+        //     без закрепления, прокси не останавливается
+        l(Ilog::LEVEL_ERROR, std::string("Affinity: ") + who +
+          " thread can not run on CPUs " + cpus + " (" + ::strerror(rc) +
+          "), not pinned");
+
+        return proxy_ns::thread_start(th, std::string(), routine, arg);
+    }
+
+    int proxy_impl::pipe_create(int* d) {
+        if(this->use_pipe) {
+            return ::pipe(d);
+        }
+        else {
+            return ::socketpair(AF_UNIX, SOCK_STREAM, 0, d);
+        }
+    }
+
+    size_t proxy_impl::set_max_pipe_size(int pipe_fd) {
+        if(this->use_pipe) {
+            ssize_t default_max_pipe_size = 0;
+
+            default_max_pipe_size = ::fcntl(pipe_fd, F_GETPIPE_SZ);
+            if(default_max_pipe_size < 0) {
+                throw Eproxy_syscall_failed("'fcntl' (F_GETPIPE_SZ)");
+            }
+
+            this->max_pipe_size = default_max_pipe_size;
+            this->max_pipe_size = __set_max_pipe_size_helper(pipe_fd,
+                                             default_max_pipe_size,
+                                             this->max_pipe_size_system,
+                                             default_max_pipe_size,
+                                             1024);
+        }
+        else {
+            // RU: В настоящее время для сокета ничего не меняем.
+            //     Оставляем значение, которое было получено как
+            //     "значение по-умолчанию".
+            //     this->max_pipe_size_system - содержит не максимальное,
+            //     а минимальное из текущих значение (для чтения и записи).
+            this->max_pipe_size = this->max_pipe_size_system;
+        }
+
+        this->pipe_reserved_size = (this->max_pipe_size / 100) *
+                this->pipe_reserved_percent;
+
+        this->max_pipe_data_size = this->max_pipe_size -
+                this->pipe_reserved_size;
+
+        return this->max_pipe_size;
+    }
+
+    size_t proxy_impl::set_max_pipe_size_force(int pipe_fd, size_t new_size) {
+        if(this->use_pipe) {
+            int rc = ::fcntl(pipe_fd, F_SETPIPE_SZ, &new_size);
+            if(rc < 0) {
+                throw Eproxy_syscall_failed("'fcntl' (F_SETPIPE_SZ)");
+            }
+
+            this->max_pipe_size = new_size;
+        }
+        else {
+            throw Eproxy_not_supported();
+        }
+
+        this->pipe_reserved_size = (this->max_pipe_size / 100) *
+                this->pipe_reserved_percent;
+
+        this->max_pipe_data_size = this->max_pipe_size -
                 this->pipe_reserved_size;
 
         return this->max_pipe_size;
@@ -990,16 +1840,22 @@ namespace proxy_ns {
     bool proxy_impl::can_write_to_pipe_universal(int pipe_w_fd,
                                                  size_t max_size,
                                                  size_t size) const {
-        size_t count_bytes = 0;
+        int count_bytes = 0;
         bool ret = false;
         int rc = 0;
 
-        rc = ::ioctl(pipe_w_fd, FIONREAD, &count_bytes);
-        if(rc < 0) {
+        // RU: Для канала FIONREAD на пишущем конце даёт объём непрочитанных
+        //     данных. У пары сокетов так получается встречное направление,
+        //     поэтому берётся очередь отправки (SIOCOUTQ).
+        rc = ::ioctl(pipe_w_fd, (this->use_pipe) ? FIONREAD : SIOCOUTQ,
+                     &count_bytes);
+        if(rc < 0 || count_bytes < 0) {
             ret = false;
         }
         else {
-            ret = (size <= (max_size - count_bytes));
+            size_t const used = static_cast<size_t>(count_bytes);
+
+            ret = (used < max_size && size <= (max_size - used));
         }
 
         return ret;
@@ -1226,11 +2082,8 @@ namespace proxy_ns {
             std::stringstream proxy;
             std::stringstream server;
 
-            auto f = [](std::stringstream& s,
-                        struct sockaddr_in const& addr)->void {
-                s << inet_ntoa(addr.sin_addr)
-                  << ":"
-                  << ntohs(addr.sin_port);
+            auto f = [](std::stringstream& s, sock_addr const& addr)->void {
+                s << address_to_string(addr);
             };
 
             f(client, d.client_addr);
@@ -1296,6 +2149,290 @@ namespace proxy_ns {
 #endif // USE_FULL_DEBUG
     }
 
+    ///
+    /// \brief proxy_impl::tap_sampled
+    /// \param ca - client address
+    /// \return true if the new session must be copied to the worker
+    ///
+    /// RU: Вызывается только из потока клиента при приёме соединения.
+    ///
+    bool proxy_impl::tap_sampled(struct sockaddr_storage const* ca) {
+        if(0 == this->tap_sample_rate) {
+            return false;
+        }
+
+        // RU: Фильтр задаётся адресом IPv4; клиенты IPv6 и unix-сокетов
+        //     под него не попадают
+        if(this->tap_filter_mask && (nullptr == ca ||
+           AF_INET != ca->ss_family ||
+           (reinterpret_cast<struct sockaddr_in const*>(
+                ca)->sin_addr.s_addr & this->tap_filter_mask) !=
+                this->tap_filter_addr)) {
+            return false;
+        }
+
+        return (0 == (this->tap_session_counter++ % this->tap_sample_rate));
+    }
+
+    ///
+    /// \brief proxy_impl::tap_push
+    /// \param ring
+    /// \param doorbell_fd
+    /// \param d
+    ///
+    /// RU: Никогда не блокируется. Если воркер не успевает - запись
+    ///     теряется (учитывается в счётчике потерь кольца). Воркер будится
+    ///     одним байтом только при переходе кольца из пустого состояния.
+    ///
+    void proxy_impl::tap_push(tap_ring<data>& ring, int doorbell_fd,
+                              data const& d) const {
+        bool first = false;
+
+        if(ring.try_push(d, first) && first) {
+            static char const bell = 0;
+            // RU: EAGAIN допустим - значит воркер и так будет разбужен.
+            (void) ::send(doorbell_fd, &bell, sizeof(bell),
+                          MSG_DONTWAIT | MSG_NOSIGNAL);
+        }
+    }
+
+    ///
+    /// \brief proxy_impl::adopt_listeners - sockets from a running copy
+    /// \param fds
+    /// \param n
+    ///
+    /// RU: Сокет достаётся слушателю с тем же адресом. Новая версия могла
+    ///     изменить набор слушателей: лишние сокеты закрываются, а
+    ///     недостающие поток клиента откроет сам.
+    ///
+    void proxy_impl::adopt_listeners(int const* fds, size_t n) {
+        log_ns::log& l = log_ns::log::inst();
+
+        runtime_config_holder::pointer const c = this->runtime_cfg.current();
+
+        for(size_t i = 0; i < n; i++) {
+            struct sockaddr_storage addr;
+            socklen_t len = sizeof(addr);
+            size_t j = 0;
+
+            std::memset(&addr, 0, sizeof(addr));
+
+            if(::getsockname(fds[i], reinterpret_cast<struct sockaddr*>(&addr),
+                             &len) == 0) {
+                for(; j < c->listeners.size(); j++) {
+                    if(address_equal(c->listeners[j].listen_addr, addr) &&
+                       this->listen_fd[j] < 0) {
+                        break;
+                    }
+                }
+            }
+            else {
+                j = c->listeners.size();
+            }
+
+            std::string const where = address_to_string(addr);
+
+            if(j < c->listeners.size()) {
+                this->listen_fd[j] = fds[i];
+
+                l(Ilog::LEVEL_INFO,
+                  "Takeover: the listening socket " + where + " is received");
+            }
+            else {
+                (void) ::close(fds[i]);
+
+                l(Ilog::LEVEL_INFO,
+                  "Takeover: the listening socket " + where +
+                  " is not in the config, closed");
+            }
+        }
+    }
+
+    ///
+    /// \brief proxy_impl::load_runtime_config
+    /// \return false if the file is invalid (the current snapshot is kept)
+    ///
+    /// RU: Вызывается только из главного потока: при запуске и по SIGHUP.
+    ///     Снимок каждый раз строится заново от значений командной строки,
+    ///     поэтому удалённый из файла ключ возвращает исходное значение.
+    ///
+    bool proxy_impl::load_runtime_config(void) {
+        log_ns::log& l = log_ns::log::inst();
+
+        runtime_config_holder::pointer const old = this->runtime_cfg.current();
+        bool const reload = old->generation > 0;
+        std::shared_ptr<runtime_config> c = std::make_shared<runtime_config>();
+
+        listener_config x;
+
+        x.listen_ip = "0.0.0.0";
+        x.listen_port = this->proxy_port;
+        x.listen_mode = 0;
+        x.server_ip = this->server_ip;
+        x.server_port = this->server_port;
+        x.connect_timeout = this->connect_timeout;
+        x.connect_retries = this->connect_retries;
+        x.connect_backoff = this->connect_backoff;
+        x.client_idle_timeout = this->client_idle_timeout;
+        x.query_timeout = this->query_timeout;
+        x.max_sessions = 0;
+        x.client_opts = sockopt_profile();
+        x.server_opts = sockopt_profile();
+        x.resolve_ttl = this->resolve_ttl;
+
+        c->listeners.push_back(x);
+        c->generation = old->generation + 1;
+
+        try {
+            if(!this->config_file.empty()) {
+                c->load(this->config_file);
+            }
+
+            c->validate();
+
+            if(reload && !c->same_listeners(*old)) {
+                // RU: Слушающие сокеты открыты при запуске
+                throw Eproxy_invalid_value(
+                            "listeners can not be added, removed or moved "
+                            "by a reload");
+            }
+        }
+        catch(IEproxy const& e) {
+            l(Ilog::LEVEL_ERROR, std::string("Config: ") + e.what());
+
+            if(reload) {
+                metrics_ns::counter_add(
+                    metrics_ns::COUNTER_CONFIG_RELOAD_FAILURES, 1);
+                l(Ilog::LEVEL_ERROR,
+                  "Config: keeping generation " +
+                  std::to_string(old->generation));
+            }
+
+            return false;
+        }
+
+        // RU: Имена разрешаются заново при каждом чтении файла
+        (void) this->resolve_backends(*c, true);
+
+        this->runtime_cfg.publish(c);
+
+        if(reload) {
+            metrics_ns::counter_add(metrics_ns::COUNTER_CONFIG_RELOADS, 1);
+        }
+
+        for(auto const& y : c->listeners) {
+            l(Ilog::LEVEL_INFO,
+              "Config: generation " + std::to_string(c->generation) +
+              (y.name.empty() ? std::string() : ", listener " + y.name +
+               " (" + address_to_string(y.listen_addr) + ")") +
+              ", server " +
+              (ADDRESS_NAME == y.server_kind ?
+                   y.server_ip + ":" + std::to_string(y.server_port) +
+                   " (" + address_to_string(y.server_addr) + ")" :
+                   address_to_string(y.server_addr)) +
+              ", connect timeout " + std::to_string(y.connect_timeout) +
+              " ms, retries " + std::to_string(y.connect_retries) +
+              ", backoff " + std::to_string(y.connect_backoff) +
+              " ms, idle timeout " + std::to_string(y.client_idle_timeout) +
+              " ms, query timeout " + std::to_string(y.query_timeout) +
+              " ms, max sessions " + std::to_string(y.max_sessions));
+        }
+
+        return true;
+    }
+
+    ///
+    /// \brief proxy_impl::resolve_backends - addresses of server host names
+    /// \param c - snapshot to fill (not published yet)
+    /// \param force - ignore the cache (start, SIGHUP)
+    /// \return true if any server address has changed
+    ///
+    /// RU: Вызывается только из главного потока. Имя, которое не удалось
+    ///     разрешить ни разу, оставляет адрес AF_UNSPEC: подключения к
+    ///     такому серверу завершаются отказом, пока имя не разрешится.
+    ///
+    bool proxy_impl::resolve_backends(runtime_config& c, bool force) {
+        log_ns::log& l = log_ns::log::inst();
+
+        boost::uint64_t const now = timer_wheel::now();
+        bool changed = false;
+
+        this->resolve_deadline = std::numeric_limits<boost::uint64_t>::max();
+
+        for(auto& y : c.listeners) {
+            if(ADDRESS_NAME != y.server_kind) {
+                continue;
+            }
+
+            struct sockaddr_storage addr;
+            boost::uint64_t expires = 0;
+            std::string err;
+            std::string const name = y.server_ip + ":" +
+                                     std::to_string(y.server_port);
+
+            switch(this->resolver.lookup(y.server_ip, y.server_port,
+                                         y.resolve_ttl, now, force,
+                                         addr, expires, err)) {
+            case address_cache::LOOKUP_CACHED:
+                break;
+            case address_cache::LOOKUP_RESOLVED:
+                if(!address_equal(addr, y.server_addr)) {
+                    l(Ilog::LEVEL_INFO, "Resolver: " + name + " is " +
+                      address_to_string(addr));
+                }
+                break;
+            case address_cache::LOOKUP_STALE:
+                metrics_ns::counter_add(metrics_ns::COUNTER_RESOLVE_FAILURES);
+                l(Ilog::LEVEL_ERROR, "Resolver: " + name + ": " + err +
+                  ", keeping " + address_to_string(addr));
+                break;
+            case address_cache::LOOKUP_FAILED:
+                metrics_ns::counter_add(metrics_ns::COUNTER_RESOLVE_FAILURES);
+                l(Ilog::LEVEL_ERROR, "Resolver: " + name + ": " + err);
+                break;
+            }
+
+            if(!address_equal(addr, y.server_addr)) {
+                y.server_addr = addr;
+                changed = true;
+            }
+
+            if(expires) {
+                this->resolve_deadline = std::min(this->resolve_deadline,
+                                                  expires);
+            }
+        }
+
+        return changed;
+    }
+
+    ///
+    /// \brief proxy_impl::refresh_backends - re-resolve expired names
+    ///
+    /// RU: Новый снимок публикуется, только если адрес изменился; сессии
+    ///     не разрываются, новый адрес действует на новые подключения.
+    ///
+    void proxy_impl::refresh_backends(void) {
+        if(timer_wheel::now() < this->resolve_deadline) {
+            return;
+        }
+
+        runtime_config_holder::pointer const old = this->runtime_cfg.current();
+        std::shared_ptr<runtime_config> c =
+                std::make_shared<runtime_config>(*old);
+
+        if(this->resolve_backends(*c, false)) {
+            c->generation = old->generation + 1;
+
+            this->runtime_cfg.publish(c);
+
+            log_ns::log::inst()(Ilog::LEVEL_INFO,
+                                "Config: generation " +
+                                std::to_string(c->generation) +
+                                ", server addresses re-resolved");
+        }
+    }
+
 } // namespace proxy_ns
 
 /* *****************************************************************************
@@ -31,6 +31,7 @@
 #include <mutex>
 #include <atomic>
 #include <functional>
+#include <cerrno>
 
 #include <boost/cstdint.hpp>
 
@@ -42,6 +43,9 @@
 
 #include "log.hpp"
 #include "proxy_result.hpp"
+#include "tap_ring.hpp"
+#include "session_table.hpp"
+#include "config.hpp"
 
 #ifndef POLLING_REQUESTS_SIZE
     #define POLLING_REQUESTS_SIZE 1000
@@ -118,9 +122,9 @@ namespace proxy_ns {
              int const& _s_sd,
              unsigned int const& _buffer_len,
              unsigned char const* _buffer,
-             struct sockaddr_in const& _client_addr,
-             struct sockaddr_in const& _proxy_addr,
-             struct sockaddr_in const& _server_addr);
+             struct sockaddr_storage const& _client_addr,
+             struct sockaddr_storage const& _proxy_addr,
+             struct sockaddr_storage const& _server_addr);
 
         data(direction_t const& _direction,
              type_of_data_t const& _tod,
@@ -128,9 +132,9 @@ namespace proxy_ns {
              int const& _s_sd,
              unsigned int const& _buffer_len,
              unsigned char const* _buffer,
-             struct sockaddr_in const* _client_addr,
-             struct sockaddr_in const* _proxy_addr,
-             struct sockaddr_in const* _server_addr);
+             struct sockaddr_storage const* _client_addr,
+             struct sockaddr_storage const* _proxy_addr,
+             struct sockaddr_storage const* _server_addr);
 
         direction_t direction;
         type_of_data_t tod;
@@ -138,9 +142,12 @@ namespace proxy_ns {
         int s_sd;
         unsigned int buffer_len;
         unsigned char buffer[DATA_BUFFER_SIZE];
-        struct sockaddr_in client_addr;
-        struct sockaddr_in proxy_addr;
-        struct sockaddr_in server_addr;
+        sock_addr client_addr;
+        sock_addr proxy_addr;
+        sock_addr server_addr;
+        bool tap;                // RU: Сессия попала в выборку воркера
+        boost::uint32_t route;   // RU: Слушатель сессии (см. listener_config)
+        boost::uint64_t timestamp; // RU: CLOCK_MONOTONIC (нс) создания пакета
 	};
 
 	///
@@ -200,6 +207,29 @@ namespace proxy_ns {
         virtual void set_server_keep_alive(bool value) = 0;
         virtual void set_client_tcp_no_delay(bool value) = 0;
         virtual void set_server_tcp_no_delay(bool value) = 0;
+        virtual void set_tap_sample_rate(boost::uint32_t value) = 0;
+        virtual void set_tap_filter(std::string const& value) = 0;
+        virtual void set_capture_file(std::string const& value) = 0;
+        virtual void set_capture_segment_size(size_t value) = 0;
+        virtual void set_capture_segment_count(size_t value) = 0;
+        virtual void set_shadow_addr(std::string const& value) = 0;
+        virtual void set_shadow_port(boost::uint16_t value) = 0;
+        virtual void set_shadow_sample_rate(boost::uint32_t value) = 0;
+        virtual void set_shadow_buffer_size(size_t value) = 0;
+        virtual void set_admin_addr(std::string const& value) = 0;
+        virtual void set_admin_port(boost::uint16_t value) = 0;
+        virtual void set_client_idle_timeout(boost::int32_t value) = 0;
+        virtual void set_query_timeout(boost::int32_t value) = 0;
+        virtual void set_connect_retries(boost::int32_t value) = 0;
+        virtual void set_connect_backoff(boost::int32_t value) = 0;
+        virtual void set_takeover(bool value) = 0;
+        virtual void set_takeover_path(std::string const& value) = 0;
+        virtual void set_config_file(std::string const& value) = 0;
+        virtual void set_drain_timeout(boost::int32_t value) = 0;
+        virtual void set_resolve_ttl(boost::int32_t value) = 0;
+        virtual void set_server_cpus(std::string const& value) = 0;
+        virtual void set_client_cpus(std::string const& value) = 0;
+        virtual void set_worker_cpus(std::string const& value) = 0;
 
         virtual boost::uint16_t get_proxy_port(void) const = 0;
         virtual boost::uint16_t get_server_port(void) const = 0;
@@ -210,6 +240,29 @@ namespace proxy_ns {
         virtual bool get_server_keep_alive(void) const = 0;
         virtual bool get_client_tcp_no_delay(void) const = 0;
         virtual bool get_server_tcp_no_delay(void) const = 0;
+        virtual boost::uint32_t get_tap_sample_rate(void) const = 0;
+        virtual std::string const& get_tap_filter(void) const = 0;
+        virtual std::string const& get_capture_file(void) const = 0;
+        virtual size_t get_capture_segment_size(void) const = 0;
+        virtual size_t get_capture_segment_count(void) const = 0;
+        virtual std::string const& get_shadow_addr(void) const = 0;
+        virtual boost::uint16_t get_shadow_port(void) const = 0;
+        virtual boost::uint32_t get_shadow_sample_rate(void) const = 0;
+        virtual size_t get_shadow_buffer_size(void) const = 0;
+        virtual std::string const& get_admin_addr(void) const = 0;
+        virtual boost::uint16_t get_admin_port(void) const = 0;
+        virtual boost::int32_t get_client_idle_timeout(void) const = 0;
+        virtual boost::int32_t get_query_timeout(void) const = 0;
+        virtual boost::int32_t get_connect_retries(void) const = 0;
+        virtual boost::int32_t get_connect_backoff(void) const = 0;
+        virtual bool get_takeover(void) const = 0;
+        virtual std::string const& get_takeover_path(void) const = 0;
+        virtual std::string const& get_config_file(void) const = 0;
+        virtual boost::int32_t get_drain_timeout(void) const = 0;
+        virtual boost::int32_t get_resolve_ttl(void) const = 0;
+        virtual std::string const& get_server_cpus(void) const = 0;
+        virtual std::string const& get_client_cpus(void) const = 0;
+        virtual std::string const& get_worker_cpus(void) const = 0;
 
 		virtual ~Iproxy_impl(void) {}
 	};
@@ -227,6 +280,8 @@ namespace proxy_ns {
         friend class server_logic;
         friend class client_logic;
         friend class worker_logic;
+        friend class admin;
+        friend class takeover;
 	public:
 		proxy_impl(void);
 	
@@ -242,6 +297,29 @@ namespace proxy_ns {
         virtual void set_server_keep_alive(bool value);
         virtual void set_client_tcp_no_delay(bool value);
         virtual void set_server_tcp_no_delay(bool value);
+        virtual void set_tap_sample_rate(boost::uint32_t value);
+        virtual void set_tap_filter(std::string const& value);
+        virtual void set_capture_file(std::string const& value);
+        virtual void set_capture_segment_size(size_t value);
+        virtual void set_capture_segment_count(size_t value);
+        virtual void set_shadow_addr(std::string const& value);
+        virtual void set_shadow_port(boost::uint16_t value);
+        virtual void set_shadow_sample_rate(boost::uint32_t value);
+        virtual void set_shadow_buffer_size(size_t value);
+        virtual void set_admin_addr(std::string const& value);
+        virtual void set_admin_port(boost::uint16_t value);
+        virtual void set_client_idle_timeout(boost::int32_t value);
+        virtual void set_query_timeout(boost::int32_t value);
+        virtual void set_connect_retries(boost::int32_t value);
+        virtual void set_connect_backoff(boost::int32_t value);
+        virtual void set_takeover(bool value);
+        virtual void set_takeover_path(std::string const& value);
+        virtual void set_config_file(std::string const& value);
+        virtual void set_drain_timeout(boost::int32_t value);
+        virtual void set_resolve_ttl(boost::int32_t value);
+        virtual void set_server_cpus(std::string const& value);
+        virtual void set_client_cpus(std::string const& value);
+        virtual void set_worker_cpus(std::string const& value);
 
         virtual boost::uint16_t get_proxy_port(void) const;
         virtual boost::uint16_t get_server_port(void) const;
@@ -252,16 +330,55 @@ namespace proxy_ns {
         virtual bool get_server_keep_alive(void) const;
         virtual bool get_client_tcp_no_delay(void) const;
         virtual bool get_server_tcp_no_delay(void) const;
+        virtual boost::uint32_t get_tap_sample_rate(void) const;
+        virtual std::string const& get_tap_filter(void) const;
+        virtual std::string const& get_capture_file(void) const;
+        virtual size_t get_capture_segment_size(void) const;
+        virtual size_t get_capture_segment_count(void) const;
+        virtual std::string const& get_shadow_addr(void) const;
+        virtual boost::uint16_t get_shadow_port(void) const;
+        virtual boost::uint32_t get_shadow_sample_rate(void) const;
+        virtual size_t get_shadow_buffer_size(void) const;
+        virtual std::string const& get_admin_addr(void) const;
+        virtual boost::uint16_t get_admin_port(void) const;
+        virtual boost::int32_t get_client_idle_timeout(void) const;
+        virtual boost::int32_t get_query_timeout(void) const;
+        virtual boost::int32_t get_connect_retries(void) const;
+        virtual boost::int32_t get_connect_backoff(void) const;
+        virtual bool get_takeover(void) const;
+        virtual std::string const& get_takeover_path(void) const;
+        virtual std::string const& get_config_file(void) const;
+        virtual boost::int32_t get_drain_timeout(void) const;
+        virtual boost::int32_t get_resolve_ttl(void) const;
+        virtual std::string const& get_server_cpus(void) const;
+        virtual std::string const& get_client_cpus(void) const;
+        virtual std::string const& get_worker_cpus(void) const;
 
 		virtual ~proxy_impl(void);
 
         static inline void fok_placeholder(int) {}
         static inline void ferr_placeholder(int, int) {}
+
+        ///
+        /// \brief peer_reset - the peer reset the connection (RST)
+        /// \param sd - socket descriptor after POLLHUP/POLLERR
+        /// \return true on ECONNRESET/EPIPE pending on the socket
+        ///
+        static inline bool peer_reset(int sd) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            return ::getsockopt(sd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 &&
+                   (err == ECONNRESET || err == EPIPE);
+        }
 	protected:
 		virtual void server_run(void);
 		virtual void client_run(void);
 		virtual void worker_run(void);
 	private:
+        int thread_start(pthread_t& th, std::string const& cpus,
+                         char const* who,
+                         void* (*routine)(void*), void* arg);
+
         int pipe_create(int* d);
         size_t set_max_pipe_size(int pipe_fd);
         size_t set_max_pipe_size_force(int pipe_fd, size_t new_size);
@@ -315,6 +432,16 @@ namespace proxy_ns {
         void debug_log_info(const data& d, const std::string& who =
                 std::string("?")) const;
 
+        bool tap_sampled(struct sockaddr_storage const* ca);
+
+        void tap_push(tap_ring<data>& ring, int doorbell_fd,
+                      data const& d) const;
+
+        bool load_runtime_config(void);
+        bool resolve_backends(runtime_config& c, bool force);
+        void refresh_backends(void);
+        void adopt_listeners(int const* fds, size_t n);
+
 		static int const SERVER_CLIENT_IN;
 		static int const SERVER_CLIENT_OUT;
 		static int const CLIENT_SERVER_IN;
@@ -344,6 +471,38 @@ namespace proxy_ns {
 
         static bool const DEFAULT_CLIENT_TCP_NO_DELAY;
         static bool const DEFAULT_SERVER_TCP_NO_DELAY;
+
+        static boost::uint32_t const DEFAULT_TAP_SAMPLE_RATE;
+        static std::string const DEFAULT_TAP_FILTER;
+
+        static std::string const DEFAULT_CAPTURE_FILE;
+        static size_t const DEFAULT_CAPTURE_SEGMENT_SIZE;
+        static size_t const DEFAULT_CAPTURE_SEGMENT_COUNT;
+
+        static std::string const DEFAULT_SHADOW_ADDR;
+        static boost::uint16_t const DEFAULT_SHADOW_PORT;
+        static boost::uint32_t const DEFAULT_SHADOW_SAMPLE_RATE;
+        static size_t const DEFAULT_SHADOW_BUFFER_SIZE;
+
+        static std::string const DEFAULT_ADMIN_ADDR;
+        static boost::uint16_t const DEFAULT_ADMIN_PORT;
+
+        static boost::int32_t const DEFAULT_CLIENT_IDLE_TIMEOUT;
+        static boost::int32_t const DEFAULT_QUERY_TIMEOUT;
+
+        static boost::int32_t const DEFAULT_CONNECT_RETRIES;
+        static boost::int32_t const DEFAULT_CONNECT_BACKOFF;
+
+        static bool const DEFAULT_TAKEOVER;
+        static std::string const DEFAULT_TAKEOVER_PATH;
+
+        static std::string const DEFAULT_CONFIG_FILE;
+
+        static boost::int32_t const DEFAULT_DRAIN_TIMEOUT;
+        static boost::int32_t const DEFAULT_RESOLVE_TTL;
+        static std::string const DEFAULT_SERVER_CPUS;
+        static std::string const DEFAULT_CLIENT_CPUS;
+        static std::string const DEFAULT_WORKER_CPUS;
 		
 		result_t s_last_err;
 		result_t c_last_err;
@@ -351,6 +510,13 @@ namespace proxy_ns {
 
         std::atomic<bool> end_proxy;
 
+        // RU: Слушающие сокеты по слушателям (публикуются потоком клиента)
+        //     и режим "доживания" после их передачи новому процессу
+        //     (см. takeover)
+        std::atomic<int> listen_fd[LISTENERS_MAX];
+        std::atomic<size_t> listen_count;
+        std::atomic<bool> draining;
+
         boost::uint16_t proxy_port;
         boost::uint16_t server_port;
 
@@ -368,6 +534,83 @@ namespace proxy_ns {
         bool client_tcp_no_delay;
         bool server_tcp_no_delay;
 
+        // RU: Выборка сессий для воркера:
+        //     0 - ни одной, 1 - все, N - каждая N-ая сессия.
+        //     Если задан фильтр (A.B.C.D/M), то в выборку попадают только
+        //     сессии клиентов из указанной подсети.
+        boost::uint32_t tap_sample_rate;
+        boost::uint32_t tap_session_counter;
+        std::string tap_filter;
+        in_addr_t tap_filter_addr;
+        in_addr_t tap_filter_mask;
+
+        // RU: Копия трафика для воркера. Потоки клиента и сервера никогда
+        //     не ждут воркера: при переполнении запись теряется.
+        tap_ring<data> cw_tap;
+        tap_ring<data> sw_tap;
+
+        // RU: Живые сессии для администраторского интерфейса. Пишет только
+        //     поток клиента, читать можно из любого потока без блокировок.
+        session_table sessions;
+
+        // RU: Запись трафика сессий из выборки на диск (воркером).
+        //     Пустое имя файла - запись выключена.
+        std::string capture_file;
+        size_t capture_segment_size;
+        size_t capture_segment_count;
+
+        // RU: Зеркалирование запросов сессий из выборки на теневой сервер
+        //     (воркером). Пустой адрес - зеркалирование выключено.
+        std::string shadow_addr;
+        boost::uint16_t shadow_port;
+        boost::uint32_t shadow_sample_rate;
+        size_t shadow_buffer_size;
+
+        // RU: HTTP-интерфейс администратора (/metrics, /sessions).
+        //     Порт 0 - интерфейс выключен.
+        std::string admin_addr;
+        boost::uint16_t admin_port;
+
+        // RU: Таймауты (мс, 0 - выключен): простой клиентской сессии и
+        //     ожидание первого байта ответа сервера на запрос.
+        boost::int32_t client_idle_timeout;
+        boost::int32_t query_timeout;
+
+        // RU: Повторные попытки подключения к серверу: число попыток после
+        //     первой и начальная задержка (мс), удваивается с каждой попыткой.
+        boost::int32_t connect_retries;
+        boost::int32_t connect_backoff;
+
+        // RU: Передача слушающего сокета новому процессу (см. takeover)
+        bool takeover;
+        std::string takeover_path;
+
+        // RU: Файл конфигурации, перечитываемый по SIGHUP (см. runtime_config)
+        std::string config_file;
+
+        // RU: Срок плавного завершения (мс): SIGTERM/SIGINT, /drain, takeover.
+        //     0 - сигнал завершает работу сразу, takeover ждёт без срока.
+        boost::int32_t drain_timeout;
+
+        // RU: Время жизни разрешённого имени сервера (мс), 0 - имя
+        //     разрешается только при запуске и по SIGHUP
+        boost::int32_t resolve_ttl;
+
+        // RU: Списки CPU потоков сервера, клиента и обработчика
+        //     ("0-3,8"), "" - без закрепления
+        std::string server_cpus;
+        std::string client_cpus;
+        std::string worker_cpus;
+
+        // RU: Текущий снимок перечитываемых параметров. Поля выше остаются
+        //     значениями командной строки; файл накладывается поверх них.
+        runtime_config_holder runtime_cfg;
+
+        // RU: Разрешённые имена серверов (только главный поток) и момент
+        //     следующего разрешения (timer_wheel::now(), ~0 - не нужно)
+        address_cache resolver;
+        boost::uint64_t resolve_deadline;
+
 		pthread_t s_thread;
 		pthread_t c_thread;
 		pthread_t w_thread;
@@ -418,13 +661,13 @@ namespace proxy_ns {
         /// \param file
         /// \param line
         ///
-        void error_unknown_exception(auto file, auto line) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line)->std::string {
+        void error_unknown_exception(char const* file, int line) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Unknown exception! WTF!? "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line));
+            });
         }
 
         ///
@@ -432,13 +675,13 @@ namespace proxy_ns {
         /// \param file
         /// \param line
         ///
-        void error_inernal_error(auto file, auto line) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line)->std::string {
+        void error_inernal_error(char const* file, int line) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Internal error. WTF!? "
-                   << " FILE:" << _file << ":" << _line << ".";
+                   << " FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line));
+            });
         }
 
         ///
@@ -448,15 +691,14 @@ namespace proxy_ns {
         /// \param err
         /// \param fd
         ///
-        void error_write_failed(auto file, auto line, int err, int fd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _fd) ->std::string {
+        void error_write_failed(char const* file, int line, int err, int fd) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'write' failed ("
-                   << ::strerror(_err) << ") (fd=" << _fd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (fd=" << fd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, fd));
+            });
         }
 
         ///
@@ -466,15 +708,14 @@ namespace proxy_ns {
         /// \param err
         /// \param fd
         ///
-        void error_read_failed(auto file, auto line, int err, int fd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _fd) ->std::string {
+        void error_read_failed(char const* file, int line, int err, int fd) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'read' failed ("
-                   << ::strerror(_err) << ") (fd=" << _fd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (fd=" << fd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, fd));
+            });
         }
 
         ///
@@ -484,15 +725,15 @@ namespace proxy_ns {
         /// \param err
         /// \param fd
         ///
-        void error_setsockopt_failed(auto file, auto line, int err, int sd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _sd) ->std::string {
+        void error_setsockopt_failed(char const* file, int line, int err,
+                                     int sd) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'setsockopt' failed ("
-                   << ::strerror(_err) << ") (sd=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (sd=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, sd));
+            });
         }
 
         ///
@@ -502,15 +743,15 @@ namespace proxy_ns {
         /// \param err
         /// \param fd
         ///
-        void error_getsockopt_failed(auto file, auto line, int err, int sd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _sd) ->std::string {
+        void error_getsockopt_failed(char const* file, int line, int err,
+                                     int sd) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'getsockopt' failed ("
-                   << ::strerror(_err) << ") (sd=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (sd=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, sd));
+            });
         }
 
         ///
@@ -520,15 +761,14 @@ namespace proxy_ns {
         /// \param err
         /// \param fd
         ///
-        void error_socket_failed(auto file, auto line, int err, int sd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _sd) ->std::string {
+        void error_socket_failed(char const* file, int line, int err, int sd) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'socket' failed ("
-                   << ::strerror(_err) << ") (sd=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (sd=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, sd));
+            });
         }
 
         ///
@@ -538,15 +778,14 @@ namespace proxy_ns {
         /// \param err
         /// \param fd
         ///
-        void error_connect_failed(auto file, auto line, int err, int sd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _sd) ->std::string {
+        void error_connect_failed(char const* file, int line, int err, int sd) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'connect' failed ("
-                   << ::strerror(_err) << ") (sd=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (sd=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, sd));
+            });
         }
 
         ///
@@ -556,15 +795,14 @@ namespace proxy_ns {
         /// \param err
         /// \param fd
         ///
-        void error_send_failed(auto file, auto line, int err, int sd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _sd) ->std::string {
+        void error_send_failed(char const* file, int line, int err, int sd) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'send' failed ("
-                   << ::strerror(_err) << ") (sd=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (sd=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, sd));
+            });
         }
 
         ///
@@ -574,15 +812,14 @@ namespace proxy_ns {
         /// \param err
         /// \param fd
         ///
-        void error_recv_failed(auto file, auto line, int err, int sd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _sd) ->std::string {
+        void error_recv_failed(char const* file, int line, int err, int sd) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'recv' failed ("
-                   << ::strerror(_err) << ") (sd=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (sd=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, sd));
+            });
         }
 
         ///
@@ -591,15 +828,14 @@ namespace proxy_ns {
         /// \param line
         /// \param err
         ///
-        void error_poll_failed(auto file, auto line, int err) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err) ->std::string {
+        void error_poll_failed(char const* file, int line, int err) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'poll' failed ("
-                   << ::strerror(_err) << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err));
+            });
         }
 
         ///
@@ -609,15 +845,15 @@ namespace proxy_ns {
         /// \param err
         /// \param sd
         ///
-        void error_getsockname_failed(auto file, auto line, int err, int sd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _sd) ->std::string {
+        void error_getsockname_failed(char const* file, int line, int err,
+                                      int sd) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'getsockname' failed ("
-                   << ::strerror(_err) << ") (sd=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (sd=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, sd));
+            });
         }
 
         ///
@@ -627,16 +863,15 @@ namespace proxy_ns {
         /// \param err
         /// \param sd
         ///
-        void error_ioctl_fionread_failed(auto file, auto line,
+        void error_ioctl_fionread_failed(char const* file, int line,
                                          int err, int sd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _sd) ->std::string {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'ioctl' with FIONREAD failed ("
-                   << ::strerror(_err) << ") (sd=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (sd=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, sd));
+            });
         }
 
         ///
@@ -646,16 +881,15 @@ namespace proxy_ns {
         /// \param err
         /// \param sd
         ///
-        void error_ioctl_or_fcntl_failed(auto file, auto line,
+        void error_ioctl_or_fcntl_failed(char const* file, int line,
                                          int err, int sd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _sd) ->std::string {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'ioctl' or 'fcntl' failed ("
-                   << ::strerror(_err) << ") (sd=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (sd=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, sd));
+            });
         }
 
         ///
@@ -665,16 +899,69 @@ namespace proxy_ns {
         /// \param err
         /// \param sd
         ///
-        void error_bind_failed(auto file, auto line,
+        void error_bind_failed(char const* file, int line,
                                int err, int sd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _sd) ->std::string {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'bind' failed ("
-                   << ::strerror(_err) << ") (sd=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (sd=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
+                return ss.str();
+            });
+        }
+
+        ///
+        /// \brief error_sockopt_failed
+        /// \param file
+        /// \param line
+        /// \param err
+        /// \param sd
+        /// \param name - option name
+        ///
+        void error_sockopt_failed(char const* file, int line,
+                                  int err, int sd, char const* name) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
+                std::stringstream ss;
+                ss << this->_prefix << ": 'setsockopt' " << name
+                   << " failed (" << ::strerror(err) << ") (sd=" << sd
+                   << "). FILE:" << file << ":" << line << ".";
+                return ss.str();
+            });
+        }
+
+        ///
+        /// \brief error_chmod_failed
+        /// \param file
+        /// \param line
+        /// \param err
+        /// \param sd
+        ///
+        void error_chmod_failed(char const* file, int line,
+                                int err, int sd) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
+                std::stringstream ss;
+                ss << this->_prefix << ": 'chmod' failed ("
+                   << ::strerror(err) << ") (sd=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
+                return ss.str();
+            });
+        }
+
+        ///
+        /// \brief info_stale_socket_removed
+        /// \param file
+        /// \param line
+        /// \param addr
+        ///
+        void info_stale_socket_removed(char const* file, int line,
+                                       struct sockaddr_storage const& addr) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
+                std::stringstream ss;
+                ss << this->_prefix << ":  Stale socket file removed ("
+                   << address_to_string(addr) << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, sd));
+            });
         }
 
         ///
@@ -684,16 +971,15 @@ namespace proxy_ns {
         /// \param err
         /// \param sd
         ///
-        void error_listen_failed(auto file, auto line,
+        void error_listen_failed(char const* file, int line,
                                  int err, int sd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _sd) ->std::string {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'listen' failed ("
-                   << ::strerror(_err) << ") (sd=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (sd=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, sd));
+            });
         }
 
         ///
@@ -703,16 +989,15 @@ namespace proxy_ns {
         /// \param err
         /// \param sd
         ///
-        void error_accept_failed(auto file, auto line,
+        void error_accept_failed(char const* file, int line,
                                  int err, int sd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file, auto _line,
-                                            int _err, int _sd) ->std::string {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": 'accept' failed ("
-                   << ::strerror(_err) << ") (sd=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ::strerror(err) << ") (sd=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, sd));
+            });
         }
 
         ///
@@ -721,17 +1006,16 @@ namespace proxy_ns {
         /// \param line
         /// \param val
         ///
-        void debug_keep_alive_onoff(auto file, auto line, bool val, int sd) {
-            this->_l(Ilog::LEVEL_DEBUG, [&](auto _file, auto _line,
-                                            bool _val, int _sd)
-              ->std::string {
+        void debug_keep_alive_onoff(char const* file, int line, bool val,
+                                    int sd) {
+            this->_write<Ilog::LEVEL_DEBUG>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": SO_KEEPALIVE is "
-                   << (_val ? "ON" : "OFF")
-                   << " on socket=" << _sd << ". "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << (val ? "ON" : "OFF")
+                   << " on socket=" << sd << ". "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, val, sd));
+            });
         }
 
         ///
@@ -740,17 +1024,16 @@ namespace proxy_ns {
         /// \param line
         /// \param val
         ///
-        void debug_tcp_no_delay_onoff(auto file, auto line, bool val, int sd) {
-            this->_l(Ilog::LEVEL_DEBUG, [&](auto _file, auto _line,
-                                            bool _val, int _sd)
-              ->std::string {
+        void debug_tcp_no_delay_onoff(char const* file, int line, bool val,
+                                      int sd) {
+            this->_write<Ilog::LEVEL_DEBUG>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": TCP_NODELAY is "
-                   << (_val ? "ON" : "OFF")
-                   << " on socket=" << _sd << ". "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << (val ? "ON" : "OFF")
+                   << " on socket=" << sd << ". "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, val, sd));
+            });
         }
 
         ///
@@ -759,15 +1042,14 @@ namespace proxy_ns {
         /// \param line
         /// \param sd
         ///
-        void debug_connect_take_time(auto file, auto line, int sd) {
-            this->_l(Ilog::LEVEL_DEBUG, [&](auto _file, auto _line, int _sd)
-              ->std::string {
+        void debug_connect_take_time(char const* file, int line, int sd) {
+            this->_write<Ilog::LEVEL_DEBUG>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": The connection takes time... "
-                   << "(socket=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "(socket=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, sd));
+            });
         }
 
         ///
@@ -776,15 +1058,14 @@ namespace proxy_ns {
         /// \param line
         /// \param sd
         ///
-        void info_connect_immediately(auto file, auto line, int sd) {
-            this->_l(Ilog::LEVEL_INFO, [&](auto _file, auto _line, int _sd)
-              ->std::string {
+        void info_connect_immediately(char const* file, int line, int sd) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": The connection was immediately "
-                   << "(socket=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "(socket=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, sd));
+            });
         }
 
         ///
@@ -793,15 +1074,14 @@ namespace proxy_ns {
         /// \param line
         /// \param sd
         ///
-        void info_connect_successful(auto file, auto line, int sd) {
-            this->_l(Ilog::LEVEL_INFO, [&](auto _file, auto _line, int _sd)
-              ->std::string {
+        void info_connect_successful(char const* file, int line, int sd) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Connection was successful "
-                   << "(socket=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "(socket=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, sd));
+            });
         }
 
         ///
@@ -810,29 +1090,23 @@ namespace proxy_ns {
         /// \param line
         /// \param sd
         ///
-        void info_connect_close(auto file, auto line, int sd,
-                                boost::uint32_t count_sent,
-                                boost::uint32_t count_recv,
-                                boost::uint32_t count_buffered,
-                                boost::uint32_t count_lost) {
-            this->_l(Ilog::LEVEL_INFO, [&](auto _file, auto _line, int _sd,
-                     boost::uint32_t _count_sent,
-                     boost::uint32_t _count_recv,
-                     boost::uint32_t _count_buffered,
-                     boost::uint32_t _count_lost)
-              ->std::string {
+        void info_connect_close(char const* file, int line, int sd,
+                                boost::uint64_t count_sent,
+                                boost::uint64_t count_recv,
+                                boost::uint64_t count_buffered,
+                                boost::uint64_t count_lost) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Connection closed "
-                   << "(socket=" << _sd << "). "
+                   << "(socket=" << sd << "). "
                    << "Stat: "
-                   << "Sent=" << _count_sent << "; "
-                   << "Recv=" << _count_recv << "; "
-                   << "Buf=" << _count_buffered << "; "
-                   << "Lost=" << _count_lost << ". "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "Sent=" << count_sent << "; "
+                   << "Recv=" << count_recv << "; "
+                   << "Buf=" << count_buffered << "; "
+                   << "Lost=" << count_lost << ". "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, sd,
-              count_sent, count_recv, count_buffered, count_lost));
+            });
         }
 
         ///
@@ -841,16 +1115,15 @@ namespace proxy_ns {
         /// \param line
         /// \param tod
         ///
-        void debug_unsupported_data_client(auto file, auto line,
+        void debug_unsupported_data_client(char const* file, int line,
                                            type_of_data_t tod) {
-            this->_l(Ilog::LEVEL_INFO, [&](auto _file, auto _line, auto _tod)
-              ->std::string {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Unsupperted data from client. (TOD="
-                   << _tod << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << tod << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, tod));
+            });
         }
 
         ///
@@ -859,16 +1132,15 @@ namespace proxy_ns {
         /// \param line
         /// \param tod
         ///
-        void debug_unsupported_data_server(auto file, auto line,
+        void debug_unsupported_data_server(char const* file, int line,
                                            type_of_data_t tod) {
-            this->_l(Ilog::LEVEL_INFO, [&](auto _file, auto _line, auto _tod)
-              ->std::string {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Unsupperted data from server. (TOD="
-                   << _tod << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << tod << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, tod));
+            });
         }
 
         ///
@@ -878,17 +1150,15 @@ namespace proxy_ns {
         /// \param c_sd
         /// \param s_sd
         ///
-        void debug_signal_client_connect_not_found(auto file, auto line,
+        void debug_signal_client_connect_not_found(char const* file, int line,
                                                    int c_sd, int s_sd) {
-            this->_l(Ilog::LEVEL_DEBUG, [&](auto _file, auto _line,
-                                            auto _c_sd, auto _s_sd)
-              ->std::string {
+            this->_write<Ilog::LEVEL_DEBUG>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Signal from client 'connect not "
-                   << "found' (c_sd=" << _c_sd << "; s_sd=" << _s_sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "found' (c_sd=" << c_sd << "; s_sd=" << s_sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, c_sd, s_sd));
+            });
         }
 
         ///
@@ -898,17 +1168,15 @@ namespace proxy_ns {
         /// \param c_sd
         /// \param s_sd
         ///
-        void debug_signal_client_disconnect(auto file, auto line,
+        void debug_signal_client_disconnect(char const* file, int line,
                                             int c_sd, int s_sd) {
-            this->_l(Ilog::LEVEL_DEBUG, [&](auto _file, auto _line,
-                                            auto _c_sd, auto _s_sd)
-              ->std::string {
+            this->_write<Ilog::LEVEL_DEBUG>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Signal from client 'disconnect'"
-                   << " (c_sd=" << _c_sd << "; s_sd=" << _s_sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << " (c_sd=" << c_sd << "; s_sd=" << s_sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, c_sd, s_sd));
+            });
         }
 
         ///
@@ -918,17 +1186,15 @@ namespace proxy_ns {
         /// \param c_sd
         /// \param s_sd
         ///
-        void debug_signal_server_connect_not_found(auto file, auto line,
+        void debug_signal_server_connect_not_found(char const* file, int line,
                                                    int c_sd, int s_sd) {
-            this->_l(Ilog::LEVEL_DEBUG, [&](auto _file, auto _line,
-                                            auto _c_sd, auto _s_sd)
-              ->std::string {
+            this->_write<Ilog::LEVEL_DEBUG>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Signal from server 'connect not "
-                   << "found' (c_sd=" << _c_sd << "; s_sd=" << _s_sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "found' (c_sd=" << c_sd << "; s_sd=" << s_sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, c_sd, s_sd));
+            });
         }
 
         ///
@@ -938,17 +1204,15 @@ namespace proxy_ns {
         /// \param c_sd
         /// \param s_sd
         ///
-        void debug_signal_server_disconnect(auto file, auto line,
+        void debug_signal_server_disconnect(char const* file, int line,
                                             int c_sd, int s_sd) {
-            this->_l(Ilog::LEVEL_DEBUG, [&](auto _file, auto _line,
-                                            auto _c_sd, auto _s_sd)
-              ->std::string {
+            this->_write<Ilog::LEVEL_DEBUG>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Signal from server 'disconnect'"
-                   << " (c_sd=" << _c_sd << "; s_sd=" << _s_sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << " (c_sd=" << c_sd << "; s_sd=" << s_sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, c_sd, s_sd));
+            });
         }
 
         ///
@@ -958,17 +1222,15 @@ namespace proxy_ns {
         /// \param c_sd
         /// \param s_sd
         ///
-        void debug_signal_server_not_connect(auto file, auto line,
+        void debug_signal_server_not_connect(char const* file, int line,
                                              int c_sd, int s_sd) {
-            this->_l(Ilog::LEVEL_DEBUG, [&](auto _file, auto _line,
-                                            auto _c_sd, auto _s_sd)
-              ->std::string {
+            this->_write<Ilog::LEVEL_DEBUG>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Signal from server 'not connect'"
-                   << " (c_sd=" << _c_sd << "; s_sd=" << _s_sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << " (c_sd=" << c_sd << "; s_sd=" << s_sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, c_sd, s_sd));
+            });
         }
 
         ///
@@ -977,18 +1239,15 @@ namespace proxy_ns {
         /// \param line
         /// \param descriptor
         ///
-        void debug_revent_includes_pollhup(auto file, auto line,
+        void debug_revent_includes_pollhup(char const* file, int line,
                                            int descriptor) {
-            this->_l(Ilog::LEVEL_DEBUG, [&](auto _file,
-                                            auto _line,
-                                            auto _descriptor)
-              ->std::string {
+            this->_write<Ilog::LEVEL_DEBUG>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Revent includes POLLHUP ("
-                   << "descriptor=" << _descriptor << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "descriptor=" << descriptor << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, descriptor));
+            });
         }
 
         ///
@@ -997,18 +1256,15 @@ namespace proxy_ns {
         /// \param line
         /// \param descriptor
         ///
-        void debug_revent_includes_pollerr(auto file, auto line,
+        void debug_revent_includes_pollerr(char const* file, int line,
                                            int descriptor) {
-            this->_l(Ilog::LEVEL_DEBUG, [&](auto _file,
-                                            auto _line,
-                                            auto _descriptor)
-              ->std::string {
+            this->_write<Ilog::LEVEL_DEBUG>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Revent includes POLLERR ("
-                   << "descriptor=" << _descriptor << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "descriptor=" << descriptor << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, descriptor));
+            });
         }
 
         ///
@@ -1017,18 +1273,15 @@ namespace proxy_ns {
         /// \param line
         /// \param descriptor
         ///
-        void debug_revent_includes_pollnval(auto file, auto line,
+        void debug_revent_includes_pollnval(char const* file, int line,
                                            int descriptor) {
-            this->_l(Ilog::LEVEL_DEBUG, [&](auto _file,
-                                            auto _line,
-                                            auto _descriptor)
-              ->std::string {
+            this->_write<Ilog::LEVEL_DEBUG>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Revent includes POLLNVAL ("
-                   << "descriptor=" << _descriptor << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "descriptor=" << descriptor << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, descriptor));
+            });
         }
 
         ///
@@ -1038,20 +1291,18 @@ namespace proxy_ns {
         /// \param err
         /// \param error
         ///
-        void info_server_not_respond(auto file, auto line, int err,
+        void info_server_not_respond(char const* file, int line, int err,
                                      int error, int sd) {
-            this->_l(Ilog::LEVEL_DEBUG, [&](auto _file, auto _line,
-                                     auto _err, auto _error, auto _sd)
-              ->std::string {
-                boost::ignore_unused(_error);
+            this->_write<Ilog::LEVEL_DEBUG>([&]()->std::string {
+                boost::ignore_unused(error);
                 std::stringstream ss;
                 ss << this->_prefix << ": The server does not respond. "
                    << "Connection failed ("
-                   << ((_err < 0) ? ::strerror(_err) : "error != 0") << "). "
-                   << "(socket=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << ((err < 0) ? ::strerror(err) : "error != 0") << "). "
+                   << "(socket=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, err, error, sd));
+            });
         }
 
         ///
@@ -1060,17 +1311,14 @@ namespace proxy_ns {
         /// \param line
         /// \param sd
         ///
-        void debug_listen_socket_readable(auto file, auto line, int sd) {
-            this->_l(Ilog::LEVEL_DEBUG, [&](auto _file,
-                                            auto _line,
-                                            auto _sd)
-              ->std::string {
+        void debug_listen_socket_readable(char const* file, int line, int sd) {
+            this->_write<Ilog::LEVEL_DEBUG>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Listening socket is readable ("
-                   << "socket=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "socket=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, sd));
+            });
         }
 
         ///
@@ -1079,23 +1327,41 @@ namespace proxy_ns {
         /// \param line
         /// \param sd
         /// \param addr
-        /// \param p
-        ///
-        void info_new_incoming_connection(auto file, auto line, int sd,
-                                          char const* addr, boost::uint16_t p) {
-            this->_l(Ilog::LEVEL_INFO, [&](auto _file,
-                                           auto _line,
-                                           auto _sd,
-                                           auto _addr,
-                                           auto _p)
-              ->std::string {
+        ///
+        void info_new_incoming_connection(
+                char const* file, int line, int sd,
+                struct sockaddr_storage const& addr) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ":  New incoming connection("
-                   << "socket=" << _sd << "; "
-                   << _addr << ":" << _p << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "socket=" << sd << "; "
+                   << address_to_string(addr) << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, sd, addr, p));
+            });
+        }
+
+        ///
+        /// \brief info_peer_credentials
+        /// \param file
+        /// \param line
+        /// \param sd
+        /// \param peer
+        /// \param allowed
+        ///
+        void info_peer_credentials(char const* file, int line, int sd,
+                                   struct ucred const& peer, bool allowed) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
+                std::stringstream ss;
+                ss << this->_prefix << ":  Unix socket peer ("
+                   << "socket=" << sd << "; "
+                   << "pid=" << peer.pid << "; "
+                   << "uid=" << peer.uid << "; "
+                   << "gid=" << peer.gid << ")"
+                   << (allowed ? "" : " rejected by peer-uid/peer-gid")
+                   << ". FILE:" << file << ":" << line << ".";
+                return ss.str();
+            });
         }
 
         ///
@@ -1104,17 +1370,15 @@ namespace proxy_ns {
         /// \param line
         /// \param sd
         ///
-        void error_unknown_socket_descriptor(auto file, auto line, int sd) {
-            this->_l(Ilog::LEVEL_ERROR, [&](auto _file,
-                                            auto _line,
-                                            auto _sd)
-              ->std::string {
+        void error_unknown_socket_descriptor(char const* file, int line,
+                                             int sd) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Unknown socket descriptor ("
-                   << "socket=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "socket=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, sd));
+            });
         }
 
         ///
@@ -1123,19 +1387,181 @@ namespace proxy_ns {
         /// \param line
         /// \param sd
         ///
-        void info_connection_closed(auto file, auto line, int sd) {
-            this->_l(Ilog::LEVEL_INFO, [&](auto _file,
-                                           auto _line,
-                                           auto _sd)
-              ->std::string {
+        void info_connection_closed(char const* file, int line, int sd) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
                 std::stringstream ss;
                 ss << this->_prefix << ": Connection closed ("
-                   << "socket=" << _sd << "). "
-                   << "FILE:" << _file << ":" << _line << ".";
+                   << "socket=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
+                return ss.str();
+            });
+        }
+
+        ///
+        /// \brief info_idle_timeout
+        /// \param file
+        /// \param line
+        /// \param sd
+        /// \param ms
+        ///
+        void info_idle_timeout(char const* file, int line, int sd,
+                               boost::int32_t ms) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
+                std::stringstream ss;
+                ss << this->_prefix << ": Session is idle for " << ms
+                   << " ms. Closing (socket=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
+                return ss.str();
+            });
+        }
+
+        ///
+        /// \brief info_query_timeout
+        /// \param file
+        /// \param line
+        /// \param sd
+        /// \param ms
+        ///
+        void info_query_timeout(char const* file, int line, int sd,
+                                boost::int32_t ms) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
+                std::stringstream ss;
+                ss << this->_prefix << ": No response from the server for "
+                   << ms << " ms. Closing (socket=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
+                return ss.str();
+            });
+        }
+
+        ///
+        /// \brief info_connect_timeout
+        /// \param file
+        /// \param line
+        /// \param sd
+        /// \param ms
+        ///
+        void info_connect_timeout(char const* file, int line, int sd,
+                                  boost::int32_t ms) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
+                std::stringstream ss;
+                ss << this->_prefix << ": Connection is not established in "
+                   << ms << " ms (socket=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
+                return ss.str();
+            });
+        }
+
+        ///
+        /// \brief error_server_unresolved
+        /// \param file
+        /// \param line
+        /// \param sd - client socket descriptor
+        /// \param name
+        ///
+        void error_server_unresolved(char const* file, int line, int sd,
+                                     std::string const& name) {
+            this->_write<Ilog::LEVEL_ERROR>([&]()->std::string {
+                std::stringstream ss;
+                ss << this->_prefix << ": Server " << name
+                   << " is not resolved (client socket=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
+                return ss.str();
+            });
+        }
+
+        ///
+        /// \brief info_connect_retry
+        /// \param file
+        /// \param line
+        /// \param sd - client socket descriptor
+        /// \param attempt
+        /// \param ms - delay
+        ///
+        void info_connect_retry(char const* file, int line, int sd,
+                                unsigned int attempt, boost::uint64_t ms) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
+                std::stringstream ss;
+                ss << this->_prefix << ": Connection to the server failed. "
+                   << "Retry #" << attempt << " in " << ms << " ms "
+                   << "(client socket=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
+                return ss.str();
+            });
+        }
+
+        ///
+        /// \brief info_drained
+        /// \param file
+        /// \param line
+        ///
+        void info_drained(char const* file, int line) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
+                std::stringstream ss;
+                ss << this->_prefix << ": All sessions are closed while "
+                   << "draining. Exiting... "
+                   << "FILE:" << file << ":" << line << ".";
+                return ss.str();
+            });
+        }
+
+        ///
+        /// \brief info_peer_reset
+        /// \param file
+        /// \param line
+        /// \param err
+        /// \param sd
+        ///
+        void info_peer_reset(char const* file, int line, int err, int sd) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
+                std::stringstream ss;
+                ss << this->_prefix << ": Connection is broken by the peer "
+                   << "(socket=" << sd << "): " << ::strerror(err)
+                   << ". FILE:" << file << ":" << line << ".";
                 return ss.str();
-            }(file, line, sd));
+            });
+        }
+
+        ///
+        /// \brief info_drain_start
+        /// \param file
+        /// \param line
+        /// \param count - sessions left
+        ///
+        void info_drain_start(char const* file, int line, size_t count) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
+                std::stringstream ss;
+                ss << this->_prefix << ": Draining: not accepting, "
+                   << "waiting for " << count << " sessions. "
+                   << "FILE:" << file << ":" << line << ".";
+                return ss.str();
+            });
+        }
+
+        ///
+        /// \brief info_drain_close
+        /// \param file
+        /// \param line
+        /// \param sd
+        ///
+        void info_drain_close(char const* file, int line, int sd) {
+            this->_write<Ilog::LEVEL_INFO>([&]()->std::string {
+                std::stringstream ss;
+                ss << this->_prefix << ": Draining: session is quiet. "
+                   << "Closing (socket=" << sd << "). "
+                   << "FILE:" << file << ":" << line << ".";
+                return ss.str();
+            });
         }
     private:
+        ///
+        /// \brief _write - format the message only if level L is enabled
+        /// \param f - formatter
+        ///
+        template<Ilog::level_t L, class F>
+        void _write(F const& f) {
+            this->_l.write_lazy<L>(f);
+        }
+
         std::string const _prefix;
         log_ns::log& _l;
     };
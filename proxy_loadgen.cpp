@@ -0,0 +1,1133 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+/* *****************************************************************************
+ * RU: Генератор нагрузки для прокси. Открывает N соединений и выполняет
+ *     запросы в одном из двух режимов:
+ *
+ *     closed - замкнутый цикл: каждое соединение посылает следующий запрос
+ *              сразу после получения ответа на предыдущий (фиксированная
+ *              конкурентность);
+ *     open   - разомкнутый цикл: запросы поступают с фиксированной
+ *              интенсивностью RATE запросов/с независимо от того, успевает
+ *              ли система их обрабатывать. Задержка считается от момента,
+ *              когда запрос должен был быть отправлен по расписанию, а не от
+ *              фактической отправки (коррекция coordinated omission).
+ *
+ *     Запрос - это COM_QUERY (mysql), Query (pgsql) или SIZE байт, на которые
+ *     ожидается столько же байт ответа (raw, эхо-сервер). Соединения можно
+ *     переоткрывать каждые K запросов (--reconnect) для проверки работы с
+ *     большим потоком соединений.
+ *
+ *     Результат (пропускная способность и HDR-гистограммы задержки запросов
+ *     и установления соединения) выводится в формате JSON.
+ *
+ *     Пример:
+ *
+ *     fake_sqld -P pgsql -d 5432 &
+ *     proxy -d 5432 -p 4880 &
+ *     proxy_loadgen -P pgsql -d 4880 -c 64 -t 4 --mode=open --rate=20000
+ * ************************************************************************** */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <deque>
+#include <thread>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef LOADGEN_EVENTS
+    #define LOADGEN_EVENTS 256
+#endif // LOADGEN_EVENTS
+
+#ifndef LOADGEN_READ_SIZE
+    #define LOADGEN_READ_SIZE 65536
+#endif // LOADGEN_READ_SIZE
+
+// RU: Пауза перед повторным соединением после ошибки
+#ifndef LOADGEN_RECONNECT_DELAY_NS
+    #define LOADGEN_RECONNECT_DELAY_NS 100000000ULL
+#endif // LOADGEN_RECONNECT_DELAY_NS
+
+namespace {
+    typedef enum {
+        PROTOCOL_RAW = 0,
+        PROTOCOL_MYSQL,
+        PROTOCOL_PGSQL
+    } protocol_t;
+
+    typedef enum {
+        MODE_CLOSED = 0,
+        MODE_OPEN
+    } run_mode_t;
+
+    struct configuration {
+        std::string addr;
+        boost::uint16_t port;
+        protocol_t protocol;
+        run_mode_t mode;
+        unsigned int connections;
+        unsigned int threads;
+        double duration;        // s
+        double rate;            // requests/s, open loop only
+        boost::uint32_t size;   // raw only
+        std::string query;
+        std::string user;
+        std::string database;
+        boost::uint64_t reconnect;
+        std::string output;
+
+        configuration(void) :
+            addr("127.0.0.1"),
+            port(4880),
+            protocol(PROTOCOL_RAW),
+            mode(MODE_CLOSED),
+            connections(16),
+            threads(1),
+            duration(10.0),
+            rate(1000.0),
+            size(64),
+            query("SELECT 1"),
+            user("root"),
+            database(""),
+            reconnect(0),
+            output("") {
+        }
+    };
+
+    configuration config;
+
+    option longopts[] = {
+        {"help",        no_argument,       0, 'h'},
+        {"addr",        required_argument, 0, 'i'},
+        {"port",        required_argument, 0, 'd'},
+        {"protocol",    required_argument, 0, 'P'},
+        {"mode",        required_argument, 0, 'm'},
+        {"connections", required_argument, 0, 'c'},
+        {"threads",     required_argument, 0, 't'},
+        {"duration",    required_argument, 0, 'D'},
+        {"rate",        required_argument, 0, 'r'},
+        {"size",        required_argument, 0, 's'},
+        {"query",       required_argument, 0, 'q'},
+        {"user",        required_argument, 0, 'u'},
+        {"database",    required_argument, 0, 'b'},
+        {"reconnect",   required_argument, 0, 'n'},
+        {"output",      required_argument, 0, 'o'},
+        {0,             0,                 0, 0x00}
+    };
+
+    void help(char const* name) noexcept {
+        std::cout << "Use " << name << " [OPTIONS]" << std::endl;
+        std::cout << std::endl << "Options:" << std::endl;
+        std::cout << "-h\t--help\t\t\t\t"
+                  << "- show this help and exit" << std::endl;
+        std::cout << "-i\t--addr=[IPADDRESS]\t\t"
+                  << "- proxy ip-address (127.0.0.1)" << std::endl;
+        std::cout << "-d\t--port=[PORT]\t\t\t"
+                  << "- proxy port (4880)" << std::endl;
+        std::cout << "-P\t--protocol=[raw|mysql|pgsql]\t"
+                  << "- request protocol (raw - echo)" << std::endl;
+        std::cout << "-m\t--mode=[closed|open]\t\t"
+                  << "- fixed concurrency or fixed arrival rate (closed)"
+                  << std::endl;
+        std::cout << "-c\t--connections=[N]\t\t"
+                  << "- concurrent connections (16)" << std::endl;
+        std::cout << "-t\t--threads=[N]\t\t\t"
+                  << "- threads (1)" << std::endl;
+        std::cout << "-D\t--duration=[SEC]\t\t"
+                  << "- test duration (10)" << std::endl;
+        std::cout << "-r\t--rate=[RPS]\t\t\t"
+                  << "- requests per second in the open mode (1000)"
+                  << std::endl;
+        std::cout << "-s\t--size=[BYTES]\t\t\t"
+                  << "- raw request size (64)" << std::endl;
+        std::cout << "-q\t--query=[SQL]\t\t\t"
+                  << "- mysql/pgsql query (SELECT 1)" << std::endl;
+        std::cout << "-u\t--user=[NAME]\t\t\t"
+                  << "- mysql/pgsql user, no password (root)" << std::endl;
+        std::cout << "-b\t--database=[NAME]\t\t"
+                  << "- mysql/pgsql database" << std::endl;
+        std::cout << "-n\t--reconnect=[N]\t\t\t"
+                  << "- reopen connection every N requests (0 - never)"
+                  << std::endl;
+        std::cout << "-o\t--output=[FILE]\t\t\t"
+                  << "- write JSON to the file (stdout)" << std::endl;
+    }
+
+    boost::uint64_t now_ns(void) noexcept {
+        struct timespec ts;
+        (void) ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<boost::uint64_t>(ts.tv_sec) * 1000000000ULL +
+               static_cast<boost::uint64_t>(ts.tv_nsec);
+    }
+
+    ///
+    /// \brief The histogram class - HDR histogram of nanoseconds
+    ///
+    /// RU: Логарифмически-линейная гистограмма: 64 линейных подкорзины на
+    ///     каждую степень двойки (относительная погрешность < 1.6%),
+    ///     значения до 2^64 нс без предварительной настройки диапазона.
+    ///
+    class histogram {
+        typedef histogram self;
+    public:
+        static unsigned int const SUB_BITS = 6;
+        static unsigned int const SUB_COUNT = 1U << SUB_BITS;
+        static unsigned int const BUCKETS =
+                2 * SUB_COUNT + (63 - SUB_BITS) * SUB_COUNT;
+
+        histogram(void) :
+            counts(BUCKETS, 0), total(0), sum(0), min(~0ULL), max(0) {
+        }
+
+        void record(boost::uint64_t v) noexcept {
+            this->counts[index(v)]++;
+            this->total++;
+            this->sum += v;
+            this->min = std::min(this->min, v);
+            this->max = std::max(this->max, v);
+        }
+
+        void merge(self const& o) noexcept {
+            for(unsigned int i = 0; i < BUCKETS; i++) {
+                this->counts[i] += o.counts[i];
+            }
+
+            this->total += o.total;
+            this->sum += o.sum;
+            this->min = std::min(this->min, o.min);
+            this->max = std::max(this->max, o.max);
+        }
+
+        ///
+        /// \brief value_at - upper bound of the bucket with the quantile q
+        ///
+        boost::uint64_t value_at(double q) const noexcept {
+            if(!this->total) {
+                return 0;
+            }
+
+            boost::uint64_t const rank = std::max<boost::uint64_t>(
+                        1, static_cast<boost::uint64_t>(q * this->total + 0.5));
+            boost::uint64_t seen = 0;
+
+            for(unsigned int i = 0; i < BUCKETS; i++) {
+                seen += this->counts[i];
+                if(seen >= rank) {
+                    return std::min(highest(i), this->max);
+                }
+            }
+
+            return this->max;
+        }
+
+        void to_json(std::ostream& os) const {
+            os << "{\"count\": " << this->total
+               << ", \"min_us\": " << us(this->total ? this->min : 0)
+               << ", \"mean_us\": "
+               << us(this->total ? this->sum / this->total : 0)
+               << ", \"p50_us\": " << us(this->value_at(0.5))
+               << ", \"p90_us\": " << us(this->value_at(0.9))
+               << ", \"p99_us\": " << us(this->value_at(0.99))
+               << ", \"p999_us\": " << us(this->value_at(0.999))
+               << ", \"p9999_us\": " << us(this->value_at(0.9999))
+               << ", \"max_us\": " << us(this->max)
+               << ", \"buckets\": [";
+
+            // RU: Только непустые корзины: [верхняя граница, количество]
+            bool first = true;
+            for(unsigned int i = 0; i < BUCKETS; i++) {
+                if(this->counts[i]) {
+                    os << (first ? "" : ", ") << "[" << us(highest(i))
+                       << ", " << this->counts[i] << "]";
+                    first = false;
+                }
+            }
+
+            os << "]}";
+        }
+    private:
+        static unsigned int index(boost::uint64_t v) noexcept {
+            if(v < 2 * SUB_COUNT) {
+                return static_cast<unsigned int>(v);
+            }
+
+            unsigned int const shift = 63 - __builtin_clzll(v) - SUB_BITS;
+
+            return 2 * SUB_COUNT + (shift - 1) * SUB_COUNT +
+                   static_cast<unsigned int>((v >> shift) - SUB_COUNT);
+        }
+
+        static boost::uint64_t highest(unsigned int i) noexcept {
+            if(i < 2 * SUB_COUNT) {
+                return i;
+            }
+
+            unsigned int const shift = (i - 2 * SUB_COUNT) / SUB_COUNT + 1;
+            boost::uint64_t const sub = (i - 2 * SUB_COUNT) % SUB_COUNT +
+                                        SUB_COUNT;
+
+            return ((sub + 1) << shift) - 1;
+        }
+
+        static std::string us(boost::uint64_t ns) {
+            std::ostringstream s;
+            s << std::fixed << std::setprecision(3) << (ns / 1000.0);
+            return s.str();
+        }
+
+        std::vector<boost::uint64_t> counts;
+        boost::uint64_t total;
+        boost::uint64_t sum;
+        boost::uint64_t min;
+        boost::uint64_t max;
+    };
+
+    struct result {
+        histogram latency;
+        histogram connect;
+        boost::uint64_t requests;
+        boost::uint64_t errors;
+        boost::uint64_t connects;
+        boost::uint64_t bytes_sent;
+        boost::uint64_t bytes_recv;
+        boost::uint64_t backlog_max;    // open loop only
+
+        result(void) :
+            latency(), connect(), requests(0), errors(0), connects(0),
+            bytes_sent(0), bytes_recv(0), backlog_max(0) {
+        }
+    };
+
+    /* ***** protocol messages ***** */
+
+    void put_le(std::string& s, boost::uint64_t v, size_t n) {
+        for(size_t i = 0; i < n; i++) {
+            s += static_cast<char>((v >> (8 * i)) & 0xff);
+        }
+    }
+
+    void put_be(std::string& s, boost::uint64_t v, size_t n) {
+        for(size_t i = n; i > 0; i--) {
+            s += static_cast<char>((v >> (8 * (i - 1))) & 0xff);
+        }
+    }
+
+    boost::uint32_t get_be32(char const* p) {
+        unsigned char const* u = reinterpret_cast<unsigned char const*>(p);
+        return (static_cast<boost::uint32_t>(u[0]) << 24) |
+               (static_cast<boost::uint32_t>(u[1]) << 16) |
+               (static_cast<boost::uint32_t>(u[2]) << 8) |
+                static_cast<boost::uint32_t>(u[3]);
+    }
+
+    void my_packet(std::string& out, boost::uint8_t seq,
+                   std::string const& payload) {
+        put_le(out, payload.size(), 3);
+        out += static_cast<char>(seq);
+        out += payload;
+    }
+
+    void pg_message(std::string& out, char type, std::string const& body) {
+        if(type) {
+            out += type;
+        }
+        put_be(out, body.size() + 4, 4);
+        out += body;
+    }
+
+    struct messages {
+        std::string request;
+        std::string login;      // mysql: HandshakeResponse41, pgsql: startup
+    };
+
+    messages msg;
+
+    void build_messages(void) {
+        std::string b;
+
+        switch(config.protocol) {
+        case PROTOCOL_RAW:
+            msg.request.assign(config.size, 'x');
+            break;
+        case PROTOCOL_MYSQL:
+            // RU: CLIENT_LONG_PASSWORD | CLIENT_LONG_FLAG |
+            //     CLIENT_PROTOCOL_41 | CLIENT_TRANSACTIONS |
+            //     CLIENT_SECURE_CONNECTION | CLIENT_MULTI_RESULTS |
+            //     CLIENT_PLUGIN_AUTH [| CLIENT_CONNECT_WITH_DB]
+            put_le(b, 0x1 | 0x4 | 0x200 | 0x2000 | 0x8000 | 0x20000 |
+                      0x80000 | (config.database.empty() ? 0 : 0x8), 4);
+            put_le(b, 1 << 24, 4);
+            b += '\x21';
+            b += std::string(23, '\0');
+            b += config.user;
+            b += '\0';
+            b += '\0';                                  // empty auth data
+            if(!config.database.empty()) {
+                b += config.database;
+                b += '\0';
+            }
+            b += std::string("mysql_native_password", 22);
+            my_packet(msg.login, 1, b);
+
+            my_packet(msg.request, 0, "\x03" + config.query);
+            break;
+        case PROTOCOL_PGSQL:
+            put_be(b, 196608, 4);                       // 3.0
+            b += std::string("user", 5) + config.user + '\0';
+            if(!config.database.empty()) {
+                b += std::string("database", 9) + config.database + '\0';
+            }
+            b += '\0';
+            pg_message(msg.login, 0, b);
+
+            pg_message(msg.request, 'Q', config.query + '\0');
+            break;
+        }
+    }
+
+    /* ***** connections ***** */
+
+    typedef enum {
+        STATE_DOWN = 0,
+        STATE_CONNECTING,
+        STATE_GREETING,         // mysql: wait for the server handshake
+        STATE_LOGIN,            // mysql: OK/ERR, pgsql: ReadyForQuery
+        STATE_IDLE,
+        STATE_BUSY
+    } state_t;
+
+    struct connection {
+        int sd;
+        state_t state;
+        std::string out;
+        size_t sent;
+        std::string in;
+        boost::uint64_t expected;       // raw: bytes left in the response
+        unsigned int eofs;              // mysql: EOF packets seen
+        boost::uint64_t start_ns;       // request (or connect) start time
+        boost::uint64_t requests;       // since the last (re)connect
+        boost::uint64_t retry_ns;       // reconnect not before
+        bool want_out;
+    };
+
+    typedef enum {
+        PARSE_MORE = 0,
+        PARSE_DONE,
+        PARSE_ERROR
+    } parse_t;
+
+    ///
+    /// \brief The worker class - one thread of the load generator
+    ///
+    class worker {
+        typedef worker self;
+    public:
+        worker(unsigned int connections, double rate) :
+            ep(-1), conns(connections), rate(rate), res(), idle(),
+            backlog() {
+        }
+
+        void run(boost::uint64_t start_ns, boost::uint64_t stop_ns);
+
+        result const& get_result(void) const noexcept {
+            return this->res;
+        }
+
+        ~worker(void) noexcept;
+    private:
+        void open(connection& c, boost::uint64_t now);
+        void close(connection& c, bool error, boost::uint64_t now);
+        void on_event(connection& c, boost::uint32_t ev,
+                      boost::uint64_t now);
+        bool flush(connection& c);
+        void update_events(connection& c);
+        parse_t parse(connection& c);
+        void send_request(connection& c, boost::uint64_t intended);
+        void ready(connection& c, boost::uint64_t now);
+        void dispatch(boost::uint64_t now);
+
+        int ep;
+        std::vector<connection> conns;
+        double const rate;
+        result res;
+
+        // RU: Индексы свободных соединений
+        std::vector<size_t> idle;
+
+        // RU: Разомкнутый цикл: плановые моменты отправки запросов,
+        //     для которых ещё не нашлось свободного соединения
+        std::deque<boost::uint64_t> backlog;
+    };
+
+    worker::~worker(void) noexcept {
+        for(auto& c : this->conns) {
+            if(c.sd >= 0) {
+                (void) ::close(c.sd);
+            }
+        }
+
+        if(this->ep >= 0) {
+            (void) ::close(this->ep);
+        }
+    }
+
+    void worker::open(connection& c, boost::uint64_t now) {
+        struct sockaddr_in a;
+        int const on = 1;
+
+        std::memset(&a, 0, sizeof(a));
+        a.sin_family = AF_INET;
+        a.sin_port = htons(config.port);
+        (void) ::inet_pton(AF_INET, config.addr.c_str(), &a.sin_addr);
+
+        c.in.clear();
+        c.out.clear();
+        c.sent = 0;
+        c.requests = 0;
+        c.want_out = true;
+        c.start_ns = now;
+
+        c.sd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        0);
+        if(c.sd < 0) {
+            this->close(c, true, now);
+            return;
+        }
+
+        (void) ::setsockopt(c.sd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        if(::connect(c.sd, reinterpret_cast<struct sockaddr*>(&a),
+                     sizeof(a)) < 0 && errno != EINPROGRESS) {
+            this->close(c, true, now);
+            return;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.u64 = static_cast<boost::uint64_t>(&c - &this->conns[0]);
+
+        if(::epoll_ctl(this->ep, EPOLL_CTL_ADD, c.sd, &ev) < 0) {
+            this->close(c, true, now);
+            return;
+        }
+
+        c.state = STATE_CONNECTING;
+    }
+
+    void worker::close(connection& c, bool error, boost::uint64_t now) {
+        if(c.sd >= 0) {
+            (void) ::epoll_ctl(this->ep, EPOLL_CTL_DEL, c.sd, nullptr);
+            (void) ::close(c.sd);
+            c.sd = -1;
+        }
+
+        if(error) {
+            this->res.errors++;
+        }
+
+        if(STATE_IDLE == c.state) {
+            size_t const i = &c - &this->conns[0];
+            this->idle.erase(std::remove(this->idle.begin(),
+                                         this->idle.end(), i),
+                             this->idle.end());
+        }
+
+        c.state = STATE_DOWN;
+        c.retry_ns = error ? now + LOADGEN_RECONNECT_DELAY_NS : now;
+    }
+
+    bool worker::flush(connection& c) {
+        while(c.sent < c.out.size()) {
+            ssize_t const rc = ::send(c.sd, c.out.data() + c.sent,
+                                      c.out.size() - c.sent, MSG_NOSIGNAL);
+            if(rc < 0) {
+                if(EAGAIN == errno || EWOULDBLOCK == errno) {
+                    break;
+                }
+                if(EINTR == errno) {
+                    continue;
+                }
+                return false;
+            }
+
+            c.sent += rc;
+            this->res.bytes_sent += rc;
+        }
+
+        if(c.sent == c.out.size()) {
+            c.out.clear();
+            c.sent = 0;
+        }
+
+        this->update_events(c);
+
+        return true;
+    }
+
+    void worker::update_events(connection& c) {
+        bool const want_out = !c.out.empty() || STATE_CONNECTING == c.state;
+
+        if(want_out != c.want_out) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN |
+                        (want_out ? static_cast<boost::uint32_t>(EPOLLOUT) : 0U);
+            ev.data.u64 = static_cast<boost::uint64_t>(&c - &this->conns[0]);
+
+            (void) ::epoll_ctl(this->ep, EPOLL_CTL_MOD, c.sd, &ev);
+            c.want_out = want_out;
+        }
+    }
+
+    ///
+    /// \brief worker::parse - consume the input of the current exchange
+    /// \return PARSE_DONE when the response (or login step) is complete
+    ///
+    parse_t worker::parse(connection& c) {
+        if(PROTOCOL_RAW == config.protocol) {
+            boost::uint64_t const n = std::min<boost::uint64_t>(c.expected,
+                                                                c.in.size());
+            c.expected -= n;
+            c.in.erase(0, n);
+
+            return c.expected ? PARSE_MORE : PARSE_DONE;
+        }
+
+        size_t pos = 0;
+        parse_t rc = PARSE_MORE;
+
+        if(PROTOCOL_MYSQL == config.protocol) {
+            while(PARSE_MORE == rc && c.in.size() - pos >= 4) {
+                unsigned char const* h = reinterpret_cast<unsigned char const*>(
+                            c.in.data() + pos);
+                size_t const len = h[0] | (h[1] << 8) | (h[2] << 16);
+
+                if(c.in.size() - pos < 4 + len) {
+                    break;
+                }
+
+                unsigned char const first = len ? h[4] : 0;
+                pos += 4 + len;
+
+                if(STATE_GREETING == c.state) {
+                    rc = (0x0a == first) ? PARSE_DONE : PARSE_ERROR;
+                }
+                else if(STATE_LOGIN == c.state) {
+                    rc = (0x00 == first) ? PARSE_DONE : PARSE_ERROR;
+                }
+                else if(0xff == first) {
+                    rc = PARSE_ERROR;
+                }
+                else if(0 == c.eofs && 0x00 == first) {
+                    rc = PARSE_DONE;    // OK - statement without a result
+                }
+                else if(0xfe == first && len < 9) {
+                    // RU: Первый EOF - после описания колонок, второй -
+                    //     после строк
+                    rc = (++c.eofs == 2) ? PARSE_DONE : PARSE_MORE;
+                }
+            }
+        }
+        else {
+            while(PARSE_MORE == rc && c.in.size() - pos >= 5) {
+                char const* p = c.in.data() + pos;
+                size_t const len = get_be32(p + 1);
+
+                if(len < 4) {
+                    return PARSE_ERROR;
+                }
+
+                if(c.in.size() - pos < 1 + len) {
+                    break;
+                }
+
+                pos += 1 + len;
+
+                if('Z' == p[0]) {
+                    rc = PARSE_DONE;
+                }
+                else if('R' == p[0] && len >= 8 && get_be32(p + 5) != 0) {
+                    // RU: Сервер требует пароль
+                    rc = PARSE_ERROR;
+                }
+                else if('E' == p[0] && STATE_LOGIN == c.state) {
+                    rc = PARSE_ERROR;
+                }
+            }
+        }
+
+        c.in.erase(0, pos);
+
+        return rc;
+    }
+
+    void worker::send_request(connection& c, boost::uint64_t intended) {
+        size_t const i = &c - &this->conns[0];
+        this->idle.erase(std::remove(this->idle.begin(), this->idle.end(), i),
+                         this->idle.end());
+
+        c.state = STATE_BUSY;
+        c.start_ns = intended;
+        c.expected = msg.request.size();
+        c.eofs = 0;
+        c.out += msg.request;
+
+        if(!this->flush(c)) {
+            this->close(c, true, now_ns());
+        }
+    }
+
+    ///
+    /// \brief worker::ready - the connection may accept the next request
+    ///
+    void worker::ready(connection& c, boost::uint64_t now) {
+        if(config.reconnect && c.requests >= config.reconnect) {
+            this->close(c, false, now);
+            this->open(c, now);
+            return;
+        }
+
+        c.state = STATE_IDLE;
+        this->idle.push_back(&c - &this->conns[0]);
+    }
+
+    void worker::on_event(connection& c, boost::uint32_t ev,
+                          boost::uint64_t now) {
+        if(STATE_CONNECTING == c.state) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+
+            if((ev & (EPOLLERR | EPOLLHUP)) ||
+               ::getsockopt(c.sd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 ||
+               err) {
+                this->close(c, true, now);
+                return;
+            }
+
+            if(!(ev & EPOLLOUT)) {
+                return;
+            }
+
+            switch(config.protocol) {
+            case PROTOCOL_RAW:
+                this->res.connects++;
+                this->res.connect.record(now - c.start_ns);
+                this->ready(c, now);
+                break;
+            case PROTOCOL_MYSQL:
+                c.state = STATE_GREETING;
+                break;
+            case PROTOCOL_PGSQL:
+                c.state = STATE_LOGIN;
+                c.out += msg.login;
+                break;
+            }
+
+            if(STATE_DOWN != c.state && !this->flush(c)) {
+                this->close(c, true, now);
+            }
+
+            return;
+        }
+
+        if(ev & EPOLLIN) {
+            char buf[LOADGEN_READ_SIZE];
+            bool eof = false;
+
+            for(;;) {
+                ssize_t const rc = ::recv(c.sd, buf, sizeof(buf), 0);
+
+                if(rc > 0) {
+                    c.in.append(buf, rc);
+                    this->res.bytes_recv += rc;
+                    continue;
+                }
+
+                if(0 == rc || (errno != EAGAIN && errno != EWOULDBLOCK &&
+                               errno != EINTR)) {
+                    eof = true;
+                }
+
+                break;
+            }
+
+            parse_t const rc = this->parse(c);
+
+            if(PARSE_ERROR == rc ||
+               (!c.in.empty() && STATE_IDLE == c.state)) {
+                this->close(c, true, now);
+                return;
+            }
+
+            if(PARSE_DONE == rc) {
+                switch(c.state) {
+                case STATE_GREETING:
+                    c.state = STATE_LOGIN;
+                    c.out += msg.login;
+                    break;
+                case STATE_LOGIN:
+                    this->res.connects++;
+                    this->res.connect.record(now - c.start_ns);
+                    this->ready(c, now);
+                    break;
+                case STATE_BUSY:
+                    this->res.requests++;
+                    this->res.latency.record(now - c.start_ns);
+                    c.requests++;
+                    this->ready(c, now);
+                    break;
+                default:
+                    break;
+                }
+
+                if(STATE_DOWN == c.state || STATE_CONNECTING == c.state) {
+                    return;
+                }
+            }
+
+            if(eof) {
+                this->close(c, true, now);
+                return;
+            }
+        }
+        else if(ev & (EPOLLERR | EPOLLHUP)) {
+            this->close(c, true, now);
+            return;
+        }
+
+        if(!this->flush(c)) {
+            this->close(c, true, now);
+        }
+    }
+
+    ///
+    /// \brief worker::dispatch - hand out requests to idle connections
+    ///
+    void worker::dispatch(boost::uint64_t now) {
+        if(MODE_CLOSED == config.mode) {
+            while(!this->idle.empty()) {
+                this->send_request(this->conns[this->idle.back()], now);
+            }
+            return;
+        }
+
+        while(!this->idle.empty() && !this->backlog.empty()) {
+            boost::uint64_t const intended = this->backlog.front();
+            this->backlog.pop_front();
+            this->send_request(this->conns[this->idle.back()], intended);
+        }
+    }
+
+    void worker::run(boost::uint64_t start_ns, boost::uint64_t stop_ns) {
+        struct epoll_event events[LOADGEN_EVENTS];
+        double const interval = (this->rate > 0) ? 1e9 / this->rate : 0;
+        boost::uint64_t issued = 0;
+
+        this->ep = ::epoll_create1(EPOLL_CLOEXEC);
+        if(this->ep < 0) {
+            std::cerr << "epoll_create1: " << ::strerror(errno) << std::endl;
+            return;
+        }
+
+        for(auto& c : this->conns) {
+            c.sd = -1;
+            c.state = STATE_DOWN;
+            this->open(c, now_ns());
+        }
+
+        for(;;) {
+            boost::uint64_t now = now_ns();
+
+            if(now >= stop_ns) {
+                break;
+            }
+
+            // RU: Разомкнутый цикл: запросы появляются по расписанию
+            //     независимо от состояния соединений
+            boost::uint64_t next_ns = stop_ns;
+            if(MODE_OPEN == config.mode && interval > 0) {
+                for(;;) {
+                    boost::uint64_t const t = start_ns + static_cast<
+                            boost::uint64_t>(issued * interval);
+                    if(t > now) {
+                        next_ns = std::min(next_ns, t);
+                        break;
+                    }
+                    this->backlog.push_back(t);
+                    issued++;
+                }
+
+                this->res.backlog_max = std::max<boost::uint64_t>(
+                            this->res.backlog_max, this->backlog.size());
+            }
+
+            for(auto& c : this->conns) {
+                if(STATE_DOWN == c.state) {
+                    if(c.retry_ns <= now) {
+                        this->open(c, now);
+                    }
+                    else {
+                        next_ns = std::min(next_ns, c.retry_ns);
+                    }
+                }
+            }
+
+            this->dispatch(now);
+
+            int const timeout = static_cast<int>(
+                        std::min<boost::uint64_t>(
+                            (next_ns > now) ? (next_ns - now) / 1000000 : 0,
+                            100));
+
+            int const n = ::epoll_wait(this->ep, events, LOADGEN_EVENTS,
+                                       timeout);
+
+            now = now_ns();
+
+            for(int i = 0; i < n; i++) {
+                connection& c = this->conns[events[i].data.u64];
+
+                if(c.sd >= 0) {
+                    this->on_event(c, events[i].events, now);
+                }
+            }
+
+            this->dispatch(now);
+        }
+    }
+
+    void print_json(std::ostream& os, result const& r, double elapsed) {
+        os << std::fixed << std::setprecision(3)
+           << "{\n"
+           << "  \"target\": \"" << config.addr << ":" << config.port
+           << "\",\n"
+           << "  \"protocol\": \""
+           << ((PROTOCOL_RAW == config.protocol) ? "raw" :
+               (PROTOCOL_MYSQL == config.protocol) ? "mysql" : "pgsql")
+           << "\",\n"
+           << "  \"mode\": \""
+           << ((MODE_CLOSED == config.mode) ? "closed" : "open") << "\",\n"
+           << "  \"connections\": " << config.connections << ",\n"
+           << "  \"threads\": " << config.threads << ",\n"
+           << "  \"target_rate\": "
+           << ((MODE_OPEN == config.mode) ? config.rate : 0.0) << ",\n"
+           << "  \"reconnect_every\": " << config.reconnect << ",\n"
+           << "  \"duration_s\": " << elapsed << ",\n"
+           << "  \"requests\": " << r.requests << ",\n"
+           << "  \"errors\": " << r.errors << ",\n"
+           << "  \"connects\": " << r.connects << ",\n"
+           << "  \"bytes_sent\": " << r.bytes_sent << ",\n"
+           << "  \"bytes_received\": " << r.bytes_recv << ",\n"
+           << "  \"throughput_rps\": " << (r.requests / elapsed) << ",\n"
+           << "  \"connects_per_s\": " << (r.connects / elapsed) << ",\n"
+           << "  \"throughput_mbps\": "
+           << ((r.bytes_sent + r.bytes_recv) / elapsed / 1e6) << ",\n"
+           << "  \"backlog_max\": " << r.backlog_max << ",\n"
+           << "  \"latency\": ";
+        r.latency.to_json(os);
+        os << ",\n  \"connect_latency\": ";
+        r.connect.to_json(os);
+        os << "\n}" << std::endl;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    int optc = 0;
+
+    while((optc = getopt_long(argc, argv, ":hi:d:P:m:c:t:D:r:s:q:u:b:n:o:",
+                              longopts, 0)) != -1) {
+        try {
+            switch(optc) {
+            case 'h':
+                help(argv[0]);
+                return EXIT_SUCCESS;
+            case 'i':
+                config.addr = optarg;
+                break;
+            case 'd':
+                config.port = boost::lexical_cast<boost::uint16_t>(optarg);
+                break;
+            case 'P':
+                if(std::string("raw") == optarg) {
+                    config.protocol = PROTOCOL_RAW;
+                }
+                else if(std::string("mysql") == optarg) {
+                    config.protocol = PROTOCOL_MYSQL;
+                }
+                else if(std::string("pgsql") == optarg) {
+                    config.protocol = PROTOCOL_PGSQL;
+                }
+                else {
+                    throw boost::bad_lexical_cast();
+                }
+                break;
+            case 'm':
+                if(std::string("closed") == optarg) {
+                    config.mode = MODE_CLOSED;
+                }
+                else if(std::string("open") == optarg) {
+                    config.mode = MODE_OPEN;
+                }
+                else {
+                    throw boost::bad_lexical_cast();
+                }
+                break;
+            case 'c':
+                config.connections = boost::lexical_cast<unsigned int>(optarg);
+                break;
+            case 't':
+                config.threads = boost::lexical_cast<unsigned int>(optarg);
+                break;
+            case 'D':
+                config.duration = boost::lexical_cast<double>(optarg);
+                break;
+            case 'r':
+                config.rate = boost::lexical_cast<double>(optarg);
+                break;
+            case 's':
+                config.size = boost::lexical_cast<boost::uint32_t>(optarg);
+                break;
+            case 'q':
+                config.query = optarg;
+                break;
+            case 'u':
+                config.user = optarg;
+                break;
+            case 'b':
+                config.database = optarg;
+                break;
+            case 'n':
+                config.reconnect = boost::lexical_cast<boost::uint64_t>(
+                            optarg);
+                break;
+            case 'o':
+                config.output = optarg;
+                break;
+            default:
+                help(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        catch(boost::bad_lexical_cast const&) {
+            std::cerr << argv[0] << ": invalid value '" << optarg << "'"
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct in_addr tmp;
+    if(::inet_pton(AF_INET, config.addr.c_str(), &tmp) != 1) {
+        std::cerr << argv[0] << ": invalid address '" << config.addr << "'"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if(!config.connections || config.duration <= 0 ||
+       (PROTOCOL_RAW == config.protocol && !config.size) ||
+       (MODE_OPEN == config.mode && config.rate <= 0)) {
+        help(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    config.threads = std::max(1U, std::min(config.threads,
+                                           config.connections));
+
+    build_messages();
+
+    // RU: Соединения и интенсивность делятся между потоками поровну
+    std::vector<worker*> workers;
+    for(unsigned int i = 0; i < config.threads; i++) {
+        unsigned int const n = config.connections / config.threads +
+                               (i < config.connections % config.threads);
+        workers.push_back(new worker(n, config.rate * n /
+                                        config.connections));
+    }
+
+    boost::uint64_t const start_ns = now_ns();
+    boost::uint64_t const stop_ns =
+            start_ns + static_cast<boost::uint64_t>(config.duration * 1e9);
+
+    std::vector<std::thread> threads;
+    for(auto w : workers) {
+        threads.emplace_back(&worker::run, w, start_ns, stop_ns);
+    }
+
+    for(auto& t : threads) {
+        t.join();
+    }
+
+    double const elapsed = (now_ns() - start_ns) / 1e9;
+
+    result total;
+    for(auto w : workers) {
+        result const& r = w->get_result();
+
+        total.latency.merge(r.latency);
+        total.connect.merge(r.connect);
+        total.requests += r.requests;
+        total.errors += r.errors;
+        total.connects += r.connects;
+        total.bytes_sent += r.bytes_sent;
+        total.bytes_recv += r.bytes_recv;
+        total.backlog_max += r.backlog_max;
+
+        delete w;
+    }
+
+    if(config.output.empty()) {
+        print_json(std::cout, total, elapsed);
+    }
+    else {
+        std::ofstream f(config.output.c_str());
+        if(!f) {
+            std::cerr << config.output << ": " << ::strerror(errno)
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+        print_json(f, total, elapsed);
+    }
+
+    return (total.requests && !total.errors) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
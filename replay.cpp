@@ -0,0 +1,496 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+/* *****************************************************************************
+ * RU: Воспроизведение трафика, записанного прокси (--capture-file), на
+ *     локальный сервер СУБД (или на сам прокси). Воспроизводятся только
+ *     данные от клиентов; ответы сервера читаются и отбрасываются.
+ *     Сессии открываются и закрываются в те же моменты, что и при записи
+ *     (с учётом коэффициента ускорения).
+ *
+ *     Пример:
+ *
+ *     replay -i 127.0.0.1 -d 3306 --speed=2 /var/tmp/sqlproxy.cap.*
+ * ************************************************************************** */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "capture.hpp"
+
+// RU: Значение TOD_* из proxy_impl.hpp (формат файла не зависит от прокси).
+#define REPLAY_TOD_NEW_CONNECT 1
+#define REPLAY_TOD_DISCONNECT  2
+#define REPLAY_TOD_DATA        3
+
+namespace {
+    using namespace capture_ns;
+
+    struct configuration {
+        std::string server_addr;
+        boost::uint16_t server_port;
+        double speed;
+        boost::int32_t linger;
+        int flag_quiet;
+        std::vector<std::string> files;
+
+        configuration(void) :
+            server_addr("127.0.0.1"),
+            server_port(3306),
+            speed(1.0),
+            linger(1000),
+            flag_quiet(0),
+            files() {
+        }
+    };
+
+    struct session {
+        int sd;
+        std::vector<unsigned char> pending;
+        bool closing;           // RU: Клиент закрыл сессию (TOD_DISCONNECT)
+        bool shut;              // RU: Выполнен shutdown(SHUT_WR)
+        bool dead;              // RU: Сервер закрыл соединение или ошибка
+    };
+
+    struct statistic {
+        boost::uint64_t records;
+        boost::uint64_t sessions;
+        boost::uint64_t connect_failed;
+        boost::uint64_t bytes_sent;
+        boost::uint64_t bytes_recv;
+        boost::uint64_t bytes_expected;
+        boost::uint64_t max_lag_ns;
+    };
+
+    configuration config;
+    statistic stats;
+
+    option longopts[] = {
+        {"help",         no_argument,       0,                  'h'},
+        {"server-addr",  required_argument, 0,                  'i'},
+        {"server-port",  required_argument, 0,                  'd'},
+        {"speed",        required_argument, 0,                  'x'},
+        {"linger",       required_argument, 0,                  'g'},
+        {"quiet",        no_argument,       &config.flag_quiet, 0x01},
+        {0,              0,                 0,                  0x00}
+    };
+
+    void help(char const* name) noexcept {
+        std::cout << "Use " << name << " [OPTIONS] FILE..." << std::endl;
+        std::cout << std::endl << "Options:" << std::endl;
+        std::cout << "-h\t--help\t\t\t\t"
+                  << "- show this help and exit" << std::endl;
+        std::cout << "-i\t--server-addr=[IPADDRESS]\t"
+                  << "- server ip-address (127.0.0.1)" << std::endl;
+        std::cout << "-d\t--server-port=[PORT]\t\t"
+                  << "- server port (3306)" << std::endl;
+        std::cout << "-x\t--speed=[FACTOR]\t\t"
+                  << "- 1 - original speed, 2 - twice as fast, "
+                  << "0 - as fast as possible" << std::endl;
+        std::cout << "-g\t--linger=[MSEC]\t\t\t"
+                  << "- wait for responses after the last record"
+                  << std::endl;
+        std::cout << "\t--quiet\t\t\t\t"
+                  << "- print only the summary" << std::endl;
+    }
+
+    ///
+    /// \brief map_file - map a capture segment and collect its records
+    ///
+    bool map_file(std::string const& name,
+                  std::vector<capture_record_header const*>& out) {
+        int fd = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0) {
+            std::cerr << name << ": " << ::strerror(errno) << std::endl;
+            return false;
+        }
+
+        struct stat st;
+        if(::fstat(fd, &st) < 0 ||
+           static_cast<size_t>(st.st_size) < sizeof(capture_file_header)) {
+            std::cerr << name << ": not a capture file" << std::endl;
+            (void) ::close(fd);
+            return false;
+        }
+
+        size_t const size = st.st_size;
+        void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        (void) ::close(fd);
+
+        if(MAP_FAILED == p) {
+            std::cerr << name << ": " << ::strerror(errno) << std::endl;
+            return false;
+        }
+
+        (void) ::madvise(p, size, MADV_SEQUENTIAL);
+
+        unsigned char const* base = reinterpret_cast<unsigned char const*>(p);
+        capture_file_header const* fh =
+                reinterpret_cast<capture_file_header const*>(base);
+
+        if(std::memcmp(fh->magic, CAPTURE_MAGIC, sizeof(fh->magic)) ||
+           fh->version != CAPTURE_VERSION) {
+            std::cerr << name << ": not a capture file" << std::endl;
+            (void) ::munmap(p, size);
+            return false;
+        }
+
+        // RU: Файл остаётся отображённым до конца работы программы.
+        size_t offset = fh->header_size;
+        while(offset + sizeof(capture_record_header) <= size) {
+            capture_record_header const* h =
+                    reinterpret_cast<capture_record_header const*>(
+                        base + offset);
+
+            if(0 == h->timestamp ||
+               offset + capture_record_size(h->length) > size) {
+                break;
+            }
+
+            out.push_back(h);
+            offset += capture_record_size(h->length);
+        }
+
+        return true;
+    }
+
+    boost::uint64_t now_ns(void) noexcept {
+        return monotonic_ns();
+    }
+
+    int open_session(void) {
+        struct sockaddr_in addr;
+        int one = 1;
+
+        int sd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(sd < 0) {
+            return -1;
+        }
+
+        std::fill_n(reinterpret_cast<char*>(&addr), sizeof(addr), '\0');
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(config.server_port);
+        (void) ::inet_pton(AF_INET, config.server_addr.c_str(),
+                           &addr.sin_addr);
+
+        if(::connect(sd, reinterpret_cast<struct sockaddr*>(&addr),
+                     sizeof(addr)) < 0) {
+            (void) ::close(sd);
+            return -1;
+        }
+
+        (void) ::setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        (void) ::fcntl(sd, F_SETFL, ::fcntl(sd, F_GETFL, 0) | O_NONBLOCK);
+
+        return sd;
+    }
+
+    void close_session(std::map<boost::uint32_t, session>& sessions,
+                       boost::uint32_t id) {
+        auto search = sessions.find(id);
+        if(search != sessions.end()) {
+            if(search->second.sd >= 0) {
+                (void) ::close(search->second.sd);
+            }
+            sessions.erase(search);
+        }
+    }
+
+    void flush_session(session& s) {
+        while(!s.pending.empty()) {
+            ssize_t rc = ::send(s.sd, s.pending.data(), s.pending.size(),
+                                MSG_NOSIGNAL);
+            if(rc < 0) {
+                if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return;
+                }
+                s.pending.clear();
+                s.dead = true;
+                return;
+            }
+
+            stats.bytes_sent += rc;
+            s.pending.erase(s.pending.begin(), s.pending.begin() + rc);
+        }
+    }
+
+    ///
+    /// \brief pump - service all sessions until 'deadline' (monotonic, ns)
+    ///
+    void pump(std::map<boost::uint32_t, session>& sessions,
+              boost::uint64_t deadline) {
+        std::vector<struct pollfd> fds;
+        std::vector<boost::uint32_t> ids;
+        unsigned char buf[65536];
+
+        do {
+            fds.clear();
+            ids.clear();
+
+            for(auto& x : sessions) {
+                struct pollfd pfd;
+                pfd.fd = x.second.sd;
+                pfd.events = POLLIN |
+                        (x.second.pending.empty() ? 0 : POLLOUT);
+                pfd.revents = 0;
+                fds.push_back(pfd);
+                ids.push_back(x.first);
+            }
+
+            boost::uint64_t const now = now_ns();
+            int timeout = (deadline > now) ?
+                static_cast<int>((deadline - now + 999999) / 1000000) : 0;
+
+            int rc = ::poll(fds.data(), fds.size(), timeout);
+            if(rc < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "'poll' failed: " << ::strerror(errno)
+                          << std::endl;
+                ::exit(EXIT_FAILURE);
+            }
+
+            for(size_t i = 0; rc > 0 && i < fds.size(); i++) {
+                if(0 == fds[i].revents) {
+                    continue;
+                }
+
+                session& s = sessions[ids[i]];
+
+                if(fds[i].revents & POLLOUT) {
+                    flush_session(s);
+                }
+
+                if(fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                    ssize_t n = ::recv(s.sd, buf, sizeof(buf), 0);
+                    if(n > 0) {
+                        stats.bytes_recv += n;
+                    }
+                    else if(n == 0 || (errno != EAGAIN &&
+                                       errno != EWOULDBLOCK)) {
+                        s.pending.clear();
+                        s.dead = true;
+                    }
+                }
+            }
+
+            // RU: После закрытия сессии клиентом дочитываем ответы сервера
+            //     до тех пор, пока он сам не закроет соединение.
+            for(auto it = sessions.begin(); it != sessions.end();) {
+                if(it->second.dead) {
+                    (void) ::close(it->second.sd);
+                    it = sessions.erase(it);
+                    continue;
+                }
+
+                if(it->second.closing && !it->second.shut &&
+                   it->second.pending.empty()) {
+                    (void) ::shutdown(it->second.sd, SHUT_WR);
+                    it->second.shut = true;
+                }
+
+                ++it;
+            }
+        }
+        while(now_ns() < deadline);
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    int optc = 0;
+
+    while((optc = getopt_long(argc, argv, ":hi:d:x:g:",
+                              longopts, 0)) != -1) {
+        try {
+            switch(optc) {
+            case 'h':
+                help(argv[0]);
+                return EXIT_SUCCESS;
+            case 'i':
+                config.server_addr = optarg;
+                break;
+            case 'd':
+                config.server_port =
+                        boost::lexical_cast<boost::uint16_t>(optarg);
+                break;
+            case 'x':
+                config.speed = boost::lexical_cast<double>(optarg);
+                break;
+            case 'g':
+                config.linger = boost::lexical_cast<boost::int32_t>(optarg);
+                break;
+            case 0:
+                break;
+            default:
+                help(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        catch(boost::bad_lexical_cast const&) {
+            std::cerr << argv[0] << ": invalid value '" << optarg << "'"
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    for(int i = optind; i < argc; i++) {
+        config.files.push_back(argv[i]);
+    }
+
+    if(config.files.empty() || config.speed < 0) {
+        help(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<capture_record_header const*> records;
+
+    for(auto const& name : config.files) {
+        if(!map_file(name, records)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    // RU: Сегменты могли быть переданы в произвольном порядке.
+    std::stable_sort(records.begin(), records.end(),
+                     [](auto a, auto b) {
+                         return a->timestamp < b->timestamp;
+                     });
+
+    std::fill_n(reinterpret_cast<char*>(&stats), sizeof(stats), '\0');
+
+    if(records.empty()) {
+        std::cout << "Nothing to replay" << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    std::map<boost::uint32_t, session> sessions;
+
+    boost::uint64_t const base_ts = records.front()->timestamp;
+    boost::uint64_t const start = now_ns();
+
+    for(auto h : records) {
+        if(CAPTURE_DIRECTION_SERVER_TO_CLIENT == h->direction) {
+            if(REPLAY_TOD_DATA == h->tod) {
+                stats.bytes_expected += h->length;
+            }
+            continue;
+        }
+
+        boost::uint64_t due = start;
+        if(config.speed > 0) {
+            due += static_cast<boost::uint64_t>(
+                        (h->timestamp - base_ts) / config.speed);
+        }
+
+        pump(sessions, due);
+
+        boost::uint64_t const now = now_ns();
+        if(now > due) {
+            stats.max_lag_ns = std::max(stats.max_lag_ns, now - due);
+        }
+
+        stats.records++;
+
+        auto search = sessions.find(h->session);
+
+        if(REPLAY_TOD_NEW_CONNECT == h->tod ||
+           (REPLAY_TOD_DATA == h->tod && search == sessions.end())) {
+            if(search != sessions.end()) {
+                close_session(sessions, h->session);
+            }
+
+            int sd = open_session();
+            if(sd < 0) {
+                stats.connect_failed++;
+                continue;
+            }
+
+            stats.sessions++;
+            search = sessions.emplace(h->session,
+                                      session{sd, {}, false, false, false}).first;
+        }
+
+        if(REPLAY_TOD_DATA == h->tod && search != sessions.end()) {
+            unsigned char const* payload =
+                    reinterpret_cast<unsigned char const*>(h + 1);
+            search->second.pending.insert(search->second.pending.end(),
+                                          payload, payload + h->length);
+            flush_session(search->second);
+        }
+        else if(REPLAY_TOD_DISCONNECT == h->tod && search != sessions.end()) {
+            search->second.closing = true;
+        }
+
+        if(!config.flag_quiet && 0 == (stats.records % 10000)) {
+            std::cout << "records=" << stats.records
+                      << " sessions=" << sessions.size() << std::endl;
+        }
+    }
+
+    pump(sessions, now_ns() +
+         static_cast<boost::uint64_t>(config.linger) * 1000000ULL);
+
+    while(!sessions.empty()) {
+        close_session(sessions, sessions.begin()->first);
+    }
+
+    double const elapsed = (now_ns() - start) / 1e9;
+
+    std::cout << "Replayed records: " << stats.records << std::endl;
+    std::cout << "Sessions: " << stats.sessions
+              << " (connect failed: " << stats.connect_failed << ")"
+              << std::endl;
+    std::cout << "Bytes sent: " << stats.bytes_sent << std::endl;
+    std::cout << "Bytes received: " << stats.bytes_recv
+              << " (captured: " << stats.bytes_expected << ")" << std::endl;
+    std::cout << "Elapsed: " << elapsed << " s" << std::endl;
+    std::cout << "Max lag behind schedule: "
+              << (stats.max_lag_ns / 1000) << " us" << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
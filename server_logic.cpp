@@ -33,7 +33,6 @@
 #include <iomanip>
 #include <ios>
 #include <new>
-#include <chrono>
 
 #include <ctime>
 #include <cerrno>
@@ -61,6 +60,10 @@
 #include "proxy_result.hpp"
 #include "proxy.hpp"
 //#include "proxy_impl.hpp" // Instead of "proxy_impl.hpp" we use "proxy.hpp".
+#include "metrics.hpp"
+#include "capture.hpp"
+#include "trace.hpp"
+#include "dispatch.hpp"
 
 #include "server_logic.hpp"
 
@@ -92,7 +95,10 @@ namespace proxy_ns {
         c_read_enable(false),
         w_read_enable(false),
         c_write_enable(false),
-        w_write_enable(false) {
+        timers(),
+        now_ms(timer_wheel::now()),
+        backoff_seed(capture_ns::monotonic_ns() | 1),
+        cfg(_pi->runtime_cfg) {
 
         std::fill_n(reinterpret_cast<char*>(this->fds),
                     sizeof(this->fds), '\0');
@@ -133,14 +139,10 @@ namespace proxy_ns {
             this->fds[nfds].fd = this->c_out_fd;
             this->fds[nfds].events = POLLOUT;
             this->nfds++;
-
-            this->fds[nfds].fd = this->w_out_fd;
-            this->fds[nfds].events = POLLOUT;
-            this->nfds++;
         };
 
         auto connects_absence = [&]() {
-            nfds -= 2;
+            nfds -= 1;
         };
 
         //bool have_connects = false;
@@ -149,21 +151,30 @@ namespace proxy_ns {
             this->c_read_enable = false;
             this->w_read_enable = false;
             this->c_write_enable = false;
-            this->w_write_enable = false;
 
             constexpr size_t const data_size = sizeof(data);
 
             static int const min_descriptors_count_ro = 2;
-            static int const min_descriptors_count_rw = 4;
+            static int const min_descriptors_count_rw = 3;
 #ifdef USE_FULL_DEBUG
     #ifdef USE_FULL_DEBUG_POLL_INTERVAL
             l(Ilog::LEVEL_DEBUG, "S: Waiting on poll (server)...");
     #endif // USE_FULL_DEBUG_POLL_INTERVAL
 #endif // USE_FULL_DEBUG
 
-            this->erase_old_wait_connect();
+            metrics_ns::gauge_set(metrics_ns::GAUGE_BACKEND_CONNECTS_PENDING,
+                                  this->connects.size());
+
+            // RU: Ждём не дольше, чем до ближайшего таймера
+            this->timeout = this->timers.size() ?
+                    this->timers.next_timeout(timer_wheel::now(),
+                                              this->pi->server_poll_timeout) :
+                    this->pi->server_poll_timeout;
 
             int rc = ::poll(this->fds, this->nfds, this->timeout);
+
+            this->now_ms = timer_wheel::now();
+            (void) this->cfg.refresh();
             if(rc < 0) {
                 this->l.get()->error_poll_failed(__FILE__, __LINE__, errno);
                 this->pi->s_last_err = RES_CODE_ERROR;
@@ -173,7 +184,9 @@ namespace proxy_ns {
                 if(min_descriptors_count_ro == this->nfds) {
                     connects_present();
                 }
-                else if(min_descriptors_count_rw == this->nfds) {
+                else if(min_descriptors_count_rw == this->nfds &&
+                        this->c_out_queue.empty()) {
+                    // RU: Пока очередь не пуста, канал остаётся в опросе
                     connects_absence();
                 }
 
@@ -187,8 +200,28 @@ namespace proxy_ns {
                         this->l.get()->debug_revent_includes_pollhup(
                                     __FILE__, __LINE__, this->fds[i].fd);
 
-                        if(this->fds[i].fd != this->c_in_fd &&
-                           this->fds[i].fd != this->w_in_fd) {
+                        int const c_sd = this->connecting(this->fds[i].fd);
+
+                        if(c_sd >= 0) {
+                            // RU: Подключение к серверу не удалось
+                            this->l.get()->info_server_not_respond(
+                                __FILE__, __LINE__, 0, 0, this->fds[i].fd);
+                            this->connect_failed(c_sd);
+                        }
+                        else if(this->fds[i].fd != this->c_in_fd &&
+                                this->fds[i].fd != this->w_in_fd &&
+                                (this->fds[i].revents & POLLIN)) {
+                            // RU: Сервер (через unix-сокет) мог ответить и
+                            //     сразу закрыть соединение. Ответ
+                            //     дочитывается ниже, а конец данных закроет
+                            //     сессию обычным путём (recv вернёт 0).
+                        }
+                        else if(this->fds[i].fd != this->c_in_fd &&
+                                this->fds[i].fd != this->w_in_fd) {
+                            if(proxy_impl::peer_reset(this->fds[i].fd)) {
+                                metrics_ns::counter_add(
+                                    metrics_ns::COUNTER_BACKEND_RESETS);
+                            }
                             this->send_disconnect(this->db[this->fds[i].fd],
                                                   this->fds[i].fd);
                             this->calculate_count_lost(this->fds[i].fd);
@@ -209,8 +242,20 @@ namespace proxy_ns {
                         this->l.get()->debug_revent_includes_pollerr(
                                     __FILE__, __LINE__, this->fds[i].fd);
 
-                        if(this->fds[i].fd != this->c_in_fd &&
-                           this->fds[i].fd != this->w_in_fd) {
+                        int const c_sd = this->connecting(this->fds[i].fd);
+
+                        if(c_sd >= 0) {
+                            // RU: Подключение к серверу не удалось
+                            this->l.get()->info_server_not_respond(
+                                __FILE__, __LINE__, 0, 0, this->fds[i].fd);
+                            this->connect_failed(c_sd);
+                        }
+                        else if(this->fds[i].fd != this->c_in_fd &&
+                                this->fds[i].fd != this->w_in_fd) {
+                            if(proxy_impl::peer_reset(this->fds[i].fd)) {
+                                metrics_ns::counter_add(
+                                    metrics_ns::COUNTER_BACKEND_RESETS);
+                            }
                             this->send_disconnect(this->db[this->fds[i].fd],
                                                   this->fds[i].fd);
                             this->calculate_count_lost(this->fds[i].fd);
@@ -253,17 +298,20 @@ namespace proxy_ns {
                         this->from_worker();
                     }
                     else if(this->cur_fd == this->c_out_fd) {
-                        this->c_write_enable =
-                                this->pi->can_write_to_pipe_data(
-                                    this->cur_fd, data_size);
-                    }
-                    else if(this->cur_fd == this->w_out_fd) {
-                        this->w_write_enable =
+                        this->flush_c_out_queue();
+
+                        // RU: Чтение новых данных приостанавливается до
+                        //     разбора очереди. Решение принимается один раз
+                        //     за проход: иначе первые в таблице сессии
+                        //     занимали бы канал, а остальные не читались.
+                        this->c_write_enable = this->c_out_queue.empty() &&
                                 this->pi->can_write_to_pipe_data(
                                     this->cur_fd, data_size);
                     }
                     else {
-                        if(this->c_write_enable && this->w_write_enable) {
+                        // RU: Воркер не влияет на пересылку данных: копия
+                        //     трафика для него никогда не блокирует.
+                        if(this->c_write_enable) {
                             this->from_server();
                         }
                     }
@@ -274,6 +322,15 @@ namespace proxy_ns {
                     this->compress_array();
                 }
             }
+
+            if(this->timers.size()) {
+                this->expire_timers();
+
+                if(this->flag_compress_array) {
+                    this->flag_compress_array = false;
+                    this->compress_array();
+                }
+            }
         }
     }
 
@@ -371,8 +428,8 @@ namespace proxy_ns {
 
         if(this->cur_revents & POLLOUT) {
             // RU: Сокет доступен для записи
-            auto search_wait = this->db_con_wait.find(this->cur_fd);
-            if(search_wait != this->db_con_wait.end()) {
+            int const c_sd = this->connecting(this->cur_fd);
+            if(c_sd >= 0) {
                 // RU: Текущий сокет ожидает подключения
                 socklen_t err_len = 0;
                 int error = 0;
@@ -386,8 +443,9 @@ namespace proxy_ns {
                     this->l.get()->info_server_not_respond(
                                 __FILE__, __LINE__, rc, errno, this->cur_fd);
 
-                    this->send_not_connect(this->db[this->cur_fd], -1);
-                    this->close_connect_force(this->cur_fd);
+                    // RU: Сокет закрывается (возможно, будет повторная
+                    //     попытка подключения)
+                    this->connect_failed(c_sd);
 
                     cont = false;
                 }
@@ -396,14 +454,10 @@ namespace proxy_ns {
                     this->l.get()->info_connect_successful(
                                 __FILE__, __LINE__, this->cur_fd);
 
-                    this->send_new_connect(this->db[this->cur_fd], this->cur_fd);
+                    this->connect_succeeded(c_sd);
 
                     cont = true;
                 }
-
-                // RU: В любом случае, данный дескриптор более не
-                //     находится среди ожидающих окончания соединения
-                db_con_wait.erase(this->cur_fd);
             }
             else {
                 auto search_close = std::find(
@@ -424,18 +478,22 @@ namespace proxy_ns {
                     buf = const_cast<unsigned char*>(this->get_data_storage(
                                                      this->cur_fd, buf_size));
 
-                    int rc = ::send(this->cur_fd, buf + index, buf_size, 0);
+                    int rc = ::send(this->cur_fd, buf + index, buf_size,
+                                    MSG_NOSIGNAL);
                     if(rc < 0) {
-                        if(errno != EWOULDBLOCK) {
-                            this->l.get()->error_send_failed(
-                                        __FILE__, __LINE__,
-                                        errno,
-                                        this->cur_fd);
+                        if(errno != EWOULDBLOCK && errno != EINTR) {
+                            // RU: Сервер пропал - закрывается только эта
+                            //     сессия
+                            this->close_broken(this->cur_fd, errno);
+                            return;
                         }
                     }
                     else {
                         // Отправка данных удалась
                         this->counter_sent[this->cur_fd] += rc;
+                        TRACE_PROBE2(server_send, this->cur_fd, rc);
+                        metrics_ns::counter_add(
+                            metrics_ns::COUNTER_SERVER_BYTES_SENT, rc);
                         if(static_cast<unsigned int>(rc) != buf_size) {
                             // RU: не все данные отправлены
                             buf_size = buf_size - rc;
@@ -458,6 +516,8 @@ namespace proxy_ns {
                             this->delete_data_storage(this->cur_fd);
                         }
                     }
+
+                    this->exchange_sent(this->cur_fd);
                 }
 
                 if(for_close && this->empty_data_storage(this->cur_fd)) {
@@ -490,7 +550,14 @@ namespace proxy_ns {
                 this->read_data_socket(this->cur_fd, buffer, buf_size,
                     [this, &close_conn, &cont](int err) -> void {
                         // rc < 0
-                        if((err != EWOULDBLOCK) && (err != EAGAIN)) {
+                        if(err == ECONNRESET) {
+                            this->l.get()->info_peer_reset(
+                                __FILE__, __LINE__, err, this->cur_fd);
+                            metrics_ns::counter_add(
+                                metrics_ns::COUNTER_BACKEND_RESETS);
+                            close_conn = true;
+                        }
+                        else if((err != EWOULDBLOCK) && (err != EAGAIN)) {
                             this->l.get()->error_recv_failed(
                                 __FILE__, __LINE__, err, this->cur_fd);
                             close_conn = true;
@@ -504,6 +571,7 @@ namespace proxy_ns {
                                               size_t size) -> void {
                         // rc > 0
                         boost::ignore_unused(size);
+                        this->exchange_response(this->cur_fd);
                         if(!for_close) {
                             size_t len = rc;
                             this->send_data(this->db[this->cur_fd],
@@ -535,16 +603,74 @@ namespace proxy_ns {
     /// \param d
     ///
     void server_logic::from_client_new_connect(data const& d) {
+        this->tap[d.c_sd] = d.tap;
+        this->route[d.c_sd] = d.route;
+
+        pending_connect x;
+        x.state = CONNECT_IN_PROGRESS;
+        x.s_sd = -1;
+        x.attempt = 0;
+        x.start_ns = 0;
+        x.timer = 0;
+        this->connects[d.c_sd] = x;
+
+        this->start_connect(d.c_sd);
+    }
+
+    ///
+    /// \brief server_logic::start_connect - an attempt to connect
+    /// \param c_sd - client socket descriptor
+    ///
+    void server_logic::start_connect(int c_sd) {
         int rc_ = RES_CODE_OK;
         int rc = 0;
         int new_server_sd = 0;
-        struct sockaddr_in server_addr;
+        struct sockaddr_storage server_addr;
         int val = 0;
 
-        new_server_sd = ::socket(AF_INET, SOCK_STREAM, 0);
+        pending_connect& x = this->connects[c_sd];
+
+        x.state = CONNECT_IN_PROGRESS;
+        x.s_sd = -1;
+        x.timer = 0;
+
+        if(this->nfds >= POLLING_REQUESTS_SIZE - 1) {
+            // RU: Таблица pollfd заполнена - как нехватка дескрипторов
+            this->l.get()->error_socket_failed(
+                        __FILE__, __LINE__, EMFILE, -1);
+            this->connect_failed(c_sd);
+            return;
+        }
+
+        // RU: Адрес берётся у слушателя сессии из текущего снимка
+        //     конфигурации (SIGHUP, разрешение имён)
+        listener_config const& route = this->route_of(c_sd);
+
+        server_addr = route.server_addr;
+
+        if(AF_UNSPEC == server_addr.ss_family) {
+            // RU: Имя сервера ещё ни разу не удалось разрешить
+            this->l.get()->error_server_unresolved(
+                        __FILE__, __LINE__, c_sd, route.server_ip);
+            this->connect_failed(c_sd);
+            return;
+        }
+
+        new_server_sd = ::socket(server_addr.ss_family, SOCK_STREAM, 0);
         if(new_server_sd < 0) {
+            int const err = errno;
+
             this->l.get()->error_socket_failed(
-                        __FILE__, __LINE__, errno, new_server_sd);
+                        __FILE__, __LINE__, err, new_server_sd);
+
+            if(EMFILE == err || ENFILE == err ||
+               ENOBUFS == err || ENOMEM == err) {
+                // RU: Нехватка ресурсов не фатальна для прокси - сессия
+                //     получит отказ (или повторную попытку)
+                this->connect_failed(c_sd);
+                return;
+            }
+
             this->pi->s_last_err = RES_CODE_ERROR;
             throw Eserver_logic_fatal();
         }
@@ -564,97 +690,105 @@ namespace proxy_ns {
             throw Eserver_logic_fatal();
         }
 
-        // Keep alive
-        rc_ = this->pi->set_keep_alive(new_server_sd,
-            this->pi->server_keep_alive,
-            this->pi->fok_placeholder,
-            [this, &new_server_sd](int rc, int err) {
-                boost::ignore_unused(rc);
-                this->l.get()->error_setsockopt_failed(
-                        __FILE__, __LINE__, err, new_server_sd);
-            });
+        // RU: Параметры TCP к unix-сокету не применимы
+        if(address_is_tcp(server_addr)) {
+            // Keep alive
+            rc_ = this->pi->set_keep_alive(new_server_sd,
+                this->pi->server_keep_alive,
+                this->pi->fok_placeholder,
+                [this, &new_server_sd](int rc, int err) {
+                    boost::ignore_unused(rc);
+                    this->l.get()->error_setsockopt_failed(
+                            __FILE__, __LINE__, err, new_server_sd);
+                });
 
-        if(RES_CODE_OK != rc_) {
-            (void) ::close(new_server_sd);
-            this->pi->s_last_err = RES_CODE_ERROR;
-            throw Eserver_logic_fatal();
-        }
+            if(RES_CODE_OK != rc_) {
+                (void) ::close(new_server_sd);
+                this->pi->s_last_err = RES_CODE_ERROR;
+                throw Eserver_logic_fatal();
+            }
 
-        rc_ = this->pi->get_keep_alive(new_server_sd, val,
-            this->pi->fok_placeholder,
-            [this, &new_server_sd](int rc, int err) {
-                boost::ignore_unused(rc);
-                this->l.get()->error_getsockopt_failed(
-                        __FILE__, __LINE__, err, new_server_sd);
-            });
+            rc_ = this->pi->get_keep_alive(new_server_sd, val,
+                this->pi->fok_placeholder,
+                [this, &new_server_sd](int rc, int err) {
+                    boost::ignore_unused(rc);
+                    this->l.get()->error_getsockopt_failed(
+                            __FILE__, __LINE__, err, new_server_sd);
+                });
 
-        if(RES_CODE_OK != rc_) {
-            (void) ::close(new_server_sd);
-            this->pi->s_last_err = RES_CODE_ERROR;
-            throw Eserver_logic_fatal();
-        }
-        else {
-            this->l.get()->debug_keep_alive_onoff(
-                        __FILE__, __LINE__, val, new_server_sd);
-        }
+            if(RES_CODE_OK != rc_) {
+                (void) ::close(new_server_sd);
+                this->pi->s_last_err = RES_CODE_ERROR;
+                throw Eserver_logic_fatal();
+            }
+            else {
+                this->l.get()->debug_keep_alive_onoff(
+                            __FILE__, __LINE__, val, new_server_sd);
+            }
 
-        // TCP no delay (Nagle's algorithm)
-        rc_ = this->pi->set_tcp_no_delay(new_server_sd,
-            this->pi->server_tcp_no_delay,
-            this->pi->fok_placeholder,
-            [this, &new_server_sd](int rc, int err) {
-                boost::ignore_unused(rc);
-                this->l.get()->error_setsockopt_failed(
-                        __FILE__, __LINE__, err, new_server_sd);
-            });
+            // TCP no delay (Nagle's algorithm)
+            rc_ = this->pi->set_tcp_no_delay(new_server_sd,
+                this->pi->server_tcp_no_delay,
+                this->pi->fok_placeholder,
+                [this, &new_server_sd](int rc, int err) {
+                    boost::ignore_unused(rc);
+                    this->l.get()->error_setsockopt_failed(
+                            __FILE__, __LINE__, err, new_server_sd);
+                });
 
-        if(RES_CODE_OK != rc_) {
-            (void) ::close(new_server_sd);
-            this->pi->s_last_err = RES_CODE_ERROR;
-            throw Eserver_logic_fatal();
-        }
+            if(RES_CODE_OK != rc_) {
+                (void) ::close(new_server_sd);
+                this->pi->s_last_err = RES_CODE_ERROR;
+                throw Eserver_logic_fatal();
+            }
 
-        rc_ = this->pi->get_tcp_no_delay(new_server_sd, val,
-            this->pi->fok_placeholder,
-            [this, &new_server_sd](int rc, int err) {
-                boost::ignore_unused(rc);
-                this->l.get()->error_getsockopt_failed(
-                        __FILE__, __LINE__, err, new_server_sd);
-            });
+            rc_ = this->pi->get_tcp_no_delay(new_server_sd, val,
+                this->pi->fok_placeholder,
+                [this, &new_server_sd](int rc, int err) {
+                    boost::ignore_unused(rc);
+                    this->l.get()->error_getsockopt_failed(
+                            __FILE__, __LINE__, err, new_server_sd);
+                });
 
-        if(RES_CODE_OK != rc_) {
-            (void) ::close(new_server_sd);
-            this->pi->s_last_err = RES_CODE_ERROR;
-            throw Eserver_logic_fatal();
-        }
-        else {
-            this->l.get()->debug_tcp_no_delay_onoff(
-                        __FILE__, __LINE__, val, new_server_sd);
+            if(RES_CODE_OK != rc_) {
+                (void) ::close(new_server_sd);
+                this->pi->s_last_err = RES_CODE_ERROR;
+                throw Eserver_logic_fatal();
+            }
+            else {
+                this->l.get()->debug_tcp_no_delay_onoff(
+                            __FILE__, __LINE__, val, new_server_sd);
+            }
         }
 
-        server_addr.sin_family =
-                AF_INET;
+        // RU: TCP_FASTOPEN_CONNECT и буферы - до connect
+        (void) sockopt_apply(new_server_sd, route.server_opts, SOCKOPT_CONNECT,
+            address_is_tcp(server_addr),
+            [this, &new_server_sd](char const* name, int err) {
+                this->l.get()->error_sockopt_failed(
+                        __FILE__, __LINE__, err, new_server_sd, name);
+            });
 
-        server_addr.sin_port =
-                htons(this->pi->server_port);
+        x.start_ns = capture_ns::monotonic_ns();
 
-        server_addr.sin_addr.s_addr =
-                inet_addr(this->pi->server_ip.c_str());
+        TRACE_PROBE2(backend_connect_start, c_sd, new_server_sd);
 
         rc = ::connect(new_server_sd,
                        reinterpret_cast<struct sockaddr*>(
                            &server_addr),
-                       sizeof(server_addr));
+                       address_length(server_addr));
         if(rc < 0) {
             if(EINPROGRESS == errno) {
                 // RU: Для установки соединения требуется время
                 this->l.get()->debug_connect_take_time(
                             __FILE__, __LINE__, new_server_sd);
 
-                this->db_con_wait[new_server_sd] =
-                        std::chrono::system_clock::now();
+                x.s_sd = new_server_sd;
+                x.timer = this->timers.arm(
+                            this->now_ms + route.connect_timeout,
+                            TIMER_CONNECT, c_sd);
 
-                this->new_connect(new_server_sd, d.c_sd);
+                this->new_connect(new_server_sd, c_sd);
             }
             else {
                 // RU: Соединение не удалось! Это не факт что
@@ -664,9 +798,7 @@ namespace proxy_ns {
 
                 (void) ::close(new_server_sd);
 
-                this->send_not_connect(d.c_sd, -1,
-                                       0, nullptr,
-                                       nullptr, nullptr, &server_addr);
+                this->connect_failed(c_sd);
             }
         }
         else {
@@ -674,11 +806,10 @@ namespace proxy_ns {
             this->l.get()->info_connect_immediately(
                         __FILE__, __LINE__, new_server_sd);
 
-            this->send_new_connect(d.c_sd, new_server_sd,
-                                   0, nullptr,
-                                   nullptr, nullptr, &server_addr);
+            x.s_sd = new_server_sd;
 
-            this->new_connect(new_server_sd, d.c_sd);
+            this->new_connect(new_server_sd, c_sd);
+            this->connect_succeeded(c_sd);
         }
     }
 
@@ -701,6 +832,8 @@ namespace proxy_ns {
                 if(this->fds[server_index].revents & POLLOUT) {
                     // RU: серверный сокет найден в базе сервера и он
                     //     готов принимать данные
+                    this->exchange_request(d.s_sd, d.timestamp);
+
                     if(this->empty_data_storage(d.s_sd)) {
                         // No unsent data are present
                         buf = const_cast<unsigned char*>(&d.buffer[index]);
@@ -715,13 +848,15 @@ namespace proxy_ns {
                                                              d.s_sd, buf_size));
 
                         direct = false;
-                    //}
+                    }
 
-                    int rc = ::send(d.s_sd, buf, buf_size, 0);
+                    int rc = ::send(d.s_sd, buf, buf_size, MSG_NOSIGNAL);
                     if(rc < 0) {
-                        if(errno != EWOULDBLOCK) {
-                            this->l.get()->error_send_failed(
-                                        __FILE__, __LINE__, errno, d.s_sd);
+                        if(errno != EWOULDBLOCK && errno != EINTR) {
+                            // RU: Сервер пропал - закрывается только эта
+                            //     сессия
+                            this->close_broken(d.s_sd, errno);
+                            return;
                         }
                         else {
                             if(direct) {
@@ -741,6 +876,9 @@ namespace proxy_ns {
                     else {
                         // Отправка данных удалась
                         this->counter_sent[d.s_sd] += rc;
+                        TRACE_PROBE2(server_send, d.s_sd, rc);
+                        metrics_ns::counter_add(
+                            metrics_ns::COUNTER_SERVER_BYTES_SENT, rc);
                         if(static_cast<unsigned int>(rc) != buf_size) {
                             // RU: не все данные отправлены
                             buf_size = buf_size - rc;
@@ -770,6 +908,8 @@ namespace proxy_ns {
 
                         direct = false;
                     }
+
+                    this->exchange_sent(d.s_sd);
                 }
             }
             else {
@@ -798,6 +938,32 @@ namespace proxy_ns {
         this->l.get()->debug_signal_client_disconnect(
                     __FILE__, __LINE__, d.c_sd, d.s_sd);
 
+        this->tap.erase(d.c_sd);
+        this->route.erase(d.c_sd);
+
+        auto search = this->connects.find(d.c_sd);
+        if(search != this->connects.end()) {
+            // RU: Клиент ушёл, не дождавшись подключения к серверу
+            int const s_sd = search->second.s_sd;
+
+            this->erase_connect(d.c_sd);
+
+            if(s_sd >= 0) {
+                this->close_connect_force(s_sd);
+            }
+
+            if(s_sd == d.s_sd) {
+                return;
+            }
+        }
+
+        // RU: Сервер мог закрыть сессию одновременно с клиентом - тогда
+        //     дескриптор уже закрыт (или занят новой сессией)
+        auto search_srv = this->db.find(d.s_sd);
+        if(search_srv == this->db.end() || search_srv->second != d.c_sd) {
+            return;
+        }
+
         this->close_connect(d.s_sd);
     }
 
@@ -807,8 +973,9 @@ namespace proxy_ns {
     void server_logic::compress_array(void) {
         for(int i = 0; i < this->nfds;) {
             if(this->fds[i].fd == -1) {
-                for(int j = i; j < this->nfds; j++) {
-                    this->fds[j].fd = this->fds[j + 1].fd;
+                // RU: Сдвигается весь pollfd - events у слотов разные
+                for(int j = i; j < this->nfds - 1; j++) {
+                    this->fds[j] = this->fds[j + 1];
                 }
                 this->nfds--;
             }
@@ -819,62 +986,42 @@ namespace proxy_ns {
     }
 
     ///
-    /// \brief server_logic::erase_old_wait_connect
+    /// \brief server_logic::expire_timers
     ///
-    void server_logic::erase_old_wait_connect(void) {
-        if(this->db_con_wait.empty()) {
-            // RU: Нет сокетов, которые ожидают соединения
-            //     (ожидание завершения ::connect)
-            return;
-        }
-
-        // RU: Поиск просроченных дескрипторов, у которых
-        //     истёк интервал ожидания подключения
-        bool compress = false;
-
-        auto cur_time = std::chrono::system_clock::now();
-        std::map<int, std::chrono::system_clock::time_point>::iterator it =
-                this->db_con_wait.begin();
-
-        for(it = this->db_con_wait.begin(); it != this->db_con_wait.end();) {
-            auto start_time = it->second;
-
-            auto dur = std::chrono::duration_cast<
-                    std::chrono::milliseconds>(
-                        cur_time - start_time).count();
-
-            if(dur > this->pi->connect_timeout) {
-                // RU: Удаляем просроченные дескрипторы и оповещаем
-                //     клиента и воркера
-                int s_sd = it->first;
-                int c_sd = db[s_sd];
-
-                this->send_not_connect(c_sd, -1, 0, nullptr);
-
-                (void) ::close(s_sd);
-
-                this->db.erase(s_sd);
-
-                int count = nfds;
-                for(int i = 0; i < count; i++) {
-                    if(fds[i].fd == s_sd) {
-                        fds[i].fd = -1;
-                        break;
+    void server_logic::expire_timers(void) {
+        timer_wheel::expired e;
+
+        while(this->timers.expire(this->now_ms, e)) {
+            switch(e.kind) {
+            case TIMER_CONNECT:
+                {
+                    auto search = this->connects.find(e.key);
+                    if(search != this->connects.end() &&
+                       search->second.timer == e.id) {
+                        search->second.timer = 0;
+                        this->connect_expired(e.key);
+                        continue;
                     }
                 }
-
-                compress = true;
-
-                it = this->db_con_wait.erase(it);
-            }
-            else {
-                it++;
+                break;
+            case TIMER_QUERY:
+                {
+                    auto search = this->exchanges.find(e.key);
+                    if(search != this->exchanges.end() &&
+                       search->second.timer == e.id) {
+                        search->second.timer = 0;
+                        this->query_expired(e.key);
+                        continue;
+                    }
+                }
+                break;
+            default:
+                break;
             }
-        }
 
-        if(compress) {
-           compress = false;
-           this->compress_array();
+            // RU: Владелец таймера отменяет его при закрытии сокета,
+            //     поэтому сюда попадать не должны
+            this->l.get()->error_inernal_error(__FILE__, __LINE__);
         }
     }
 
@@ -889,10 +1036,22 @@ namespace proxy_ns {
         this->counter_buffered[new_sd] = 0;
         this->counter_lost[new_sd] = 0;
 
+        metrics_ns::gauge_add(metrics_ns::GAUGE_BACKEND_SESSIONS_ACTIVE, 1);
+
         std::deque<boost::shared_ptr<std::vector<unsigned char>>> q;
         this->storage[new_sd] = q;
 
         this->db[new_sd] = client_sd;
+
+        if(2 == this->nfds) {
+            // RU: Сокеты серверов идут после c_out (см. run). Повторная
+            //     попытка подключения стартует по таймеру, когда c_out
+            //     может быть убран из массива.
+            this->fds[this->nfds].fd = this->c_out_fd;
+            this->fds[this->nfds].events = POLLOUT;
+            this->nfds++;
+        }
+
         this->fds[this->nfds].fd = new_sd;
         this->fds[this->nfds].events = POLLIN | POLLOUT;
         this->nfds++;
@@ -904,7 +1063,6 @@ namespace proxy_ns {
             this->db_for_close.push_front(d);
 
             this->db.erase(d);
-            this->db_con_wait.erase(d);
         }
         else {
             this->calculate_count_lost(d);
@@ -922,24 +1080,305 @@ namespace proxy_ns {
         int count = this->nfds;
         for(int i = 0; i < count; i++) {
             if(this->fds[i].fd == d) {
+               // RU: Сессия может закрываться при обработке другого
+               //     дескриптора - события этого poll ей уже не нужны
                this->fds[i].fd = -1;
+               this->fds[i].revents = 0;
                this->flag_compress_array = true;
                break;
             }
         }
 
+        if(TRACE_ENABLED(backend_close)) {
+            TRACE_PROBE3(backend_close, d,
+                         this->counter_sent.count(d) ?
+                            this->counter_sent.at(d) : 0,
+                         this->counter_recv.count(d) ?
+                            this->counter_recv.at(d) : 0);
+        }
+
         (void) ::close(d);
 
+        int const c_sd = this->connecting(d);
+        if(c_sd >= 0) {
+            this->erase_connect(c_sd);
+        }
+
         this->db.erase(d);
-        this->db_con_wait.erase(d);
         this->db_for_close.remove(d);
         this->clear_data_storage(d);
         this->storage.erase(d);
 
-        this->counter_sent.erase(d);
+        if(this->counter_sent.erase(d)) {
+            metrics_ns::gauge_add(metrics_ns::GAUGE_BACKEND_SESSIONS_ACTIVE, -1);
+        }
+
         this->counter_recv.erase(d);
         this->counter_buffered.erase(d);
         this->counter_lost.erase(d);
+
+        auto search = this->exchanges.find(d);
+        if(search != this->exchanges.end()) {
+            this->exchange_finish(search->second);
+            this->exchanges.erase(search);
+        }
+    }
+
+    ///
+    /// \brief server_logic::connecting - is the socket connecting?
+    /// \param s_sd - server socket descriptor
+    /// \return client socket descriptor or -1
+    ///
+    int server_logic::connecting(int s_sd) const {
+        auto search_db = this->db.find(s_sd);
+        if(search_db == this->db.end()) {
+            return -1;
+        }
+
+        auto search = this->connects.find(search_db->second);
+        if(search == this->connects.end() ||
+           search->second.state != CONNECT_IN_PROGRESS ||
+           search->second.s_sd != s_sd) {
+            return -1;
+        }
+
+        return search_db->second;
+    }
+
+    ///
+    /// \brief server_logic::connect_succeeded
+    /// \param c_sd - client socket descriptor
+    ///
+    void server_logic::connect_succeeded(int c_sd) {
+        auto search = this->connects.find(c_sd);
+        if(search == this->connects.end()) {
+            this->l.get()->error_inernal_error(__FILE__, __LINE__);
+            return;
+        }
+
+        pending_connect const x = search->second;
+
+        this->erase_connect(c_sd);
+
+        metrics_ns::counter_add(metrics_ns::COUNTER_BACKEND_CONNECTS);
+        TRACE_PROBE3(backend_connect_done, c_sd, x.s_sd, 1);
+        metrics_ns::histogram_observe(
+            metrics_ns::HISTOGRAM_BACKEND_CONNECT_US,
+            (capture_ns::monotonic_ns() - x.start_ns) / 1000);
+
+        this->send_new_connect(c_sd, x.s_sd);
+    }
+
+    ///
+    /// \brief server_logic::connect_failed
+    /// \param c_sd - client socket descriptor
+    ///
+    /// RU: Сокет (если есть) закрывается. Пока не исчерпаны попытки
+    ///     (connect_retries), следующая откладывается на таймере
+    ///     (экспоненциально, со случайной составляющей), иначе клиент
+    ///     получает отказ.
+    ///
+    void server_logic::connect_failed(int c_sd) {
+        auto search = this->connects.find(c_sd);
+        if(search == this->connects.end()) {
+            this->l.get()->error_inernal_error(__FILE__, __LINE__);
+            return;
+        }
+
+        pending_connect& x = search->second;
+
+        this->timers.cancel(x.timer);
+        x.timer = 0;
+
+        TRACE_PROBE3(backend_connect_done, c_sd, x.s_sd, 0);
+
+        if(x.s_sd >= 0) {
+            int const s_sd = x.s_sd;
+
+            // RU: Сначала отвязываем сокет, чтобы close_connect_force
+            //     не удалил саму попытку
+            x.s_sd = -1;
+            this->close_connect_force(s_sd);
+        }
+
+        listener_config const& route = this->route_of(c_sd);
+
+        if(route.connect_retries > 0 &&
+           x.attempt < static_cast<unsigned>(route.connect_retries)) {
+            boost::uint64_t const delay =
+                    this->backoff_delay(route.connect_backoff, x.attempt);
+
+            x.attempt++;
+            x.state = CONNECT_BACKOFF;
+            x.timer = this->timers.arm(this->now_ms + delay,
+                                       TIMER_CONNECT, c_sd);
+
+            this->l.get()->info_connect_retry(__FILE__, __LINE__, c_sd,
+                                              x.attempt, delay);
+
+            metrics_ns::counter_add(
+                metrics_ns::COUNTER_BACKEND_CONNECT_RETRIES);
+            return;
+        }
+
+        this->connects.erase(search);
+
+        metrics_ns::counter_add(metrics_ns::COUNTER_BACKEND_CONNECT_FAILURES);
+
+        this->send_not_connect(c_sd, -1, 0, nullptr);
+    }
+
+    ///
+    /// \brief server_logic::connect_expired - connect_timeout or backoff
+    /// \param c_sd - client socket descriptor
+    ///
+    void server_logic::connect_expired(int c_sd) {
+        auto search = this->connects.find(c_sd);
+        if(search == this->connects.end()) {
+            this->l.get()->error_inernal_error(__FILE__, __LINE__);
+            return;
+        }
+
+        if(CONNECT_BACKOFF == search->second.state) {
+            // RU: Пауза перед повторной попыткой закончилась
+            this->start_connect(c_sd);
+            return;
+        }
+
+        // RU: Подключение могло завершиться, но не быть разобрано: пока
+        //     очередь к клиенту не пуста, сокеты сервера не читаются
+        int const s_sd = search->second.s_sd;
+        struct pollfd pfd = {s_sd, POLLOUT, 0};
+        int error = 0;
+        socklen_t err_len = sizeof(error);
+
+        if(::poll(&pfd, 1, 0) > 0 &&
+           POLLOUT == (pfd.revents & (POLLOUT | POLLERR | POLLHUP)) &&
+           0 == ::getsockopt(s_sd, SOL_SOCKET, SO_ERROR, &error, &err_len) &&
+           0 == error) {
+            this->l.get()->info_connect_successful(__FILE__, __LINE__, s_sd);
+            this->connect_succeeded(c_sd);
+            return;
+        }
+
+        this->l.get()->info_connect_timeout(__FILE__, __LINE__, s_sd,
+                                            this->route_of(c_sd).
+                                                connect_timeout);
+
+        this->connect_failed(c_sd);
+    }
+
+    ///
+    /// \brief server_logic::erase_connect
+    /// \param c_sd - client socket descriptor
+    ///
+    void server_logic::erase_connect(int c_sd) {
+        auto search = this->connects.find(c_sd);
+        if(search != this->connects.end()) {
+            this->timers.cancel(search->second.timer);
+            this->connects.erase(search);
+        }
+    }
+
+    ///
+    /// \brief server_logic::backoff_delay
+    /// \param backoff - connect_backoff of the session listener (ms)
+    /// \param attempt - number of the failed attempts before (0, 1, ...)
+    /// \return delay (ms)
+    ///
+    /// RU: connect_backoff * 2^attempt, из которых половина случайна -
+    ///     чтобы одновременно отказавшие сессии не повторяли попытки
+    ///     синхронно.
+    ///
+    boost::uint64_t server_logic::backoff_delay(boost::int32_t backoff,
+                                                unsigned attempt) {
+        boost::uint64_t const base =
+            backoff > 0 ? static_cast<boost::uint64_t>(backoff) : 1;
+        boost::uint64_t const d = base << std::min(attempt, 6U);
+
+        // RU: xorshift64 - криптостойкость здесь не нужна
+        this->backoff_seed ^= this->backoff_seed << 13;
+        this->backoff_seed ^= this->backoff_seed >> 7;
+        this->backoff_seed ^= this->backoff_seed << 17;
+
+        return d / 2 + this->backoff_seed % (d / 2 + 1);
+    }
+
+    ///
+    /// \brief server_logic::route_of - listener of a session
+    /// \param c_sd - client socket descriptor
+    /// \return listener [0] if the session is unknown
+    ///
+    listener_config const& server_logic::route_of(int c_sd) const {
+        auto search = this->route.find(c_sd);
+
+        return this->cfg->route(search != this->route.end() ?
+                                search->second : 0);
+    }
+
+    ///
+    /// \brief server_logic::query_expired - query_timeout
+    /// \param d - server socket descriptor
+    ///
+    /// RU: Сервер не ответил на запрос вовремя. Протокол прокси не
+    ///     разбирает, поэтому отменить запрос нельзя - сессия закрывается
+    ///     целиком (клиент увидит разрыв соединения).
+    ///
+    void server_logic::query_expired(int d) {
+        auto search = this->db.find(d);
+
+        this->l.get()->info_query_timeout(
+                    __FILE__, __LINE__, d,
+                    this->route_of(search != this->db.end() ?
+                                   search->second : -1).query_timeout);
+
+        metrics_ns::counter_add(metrics_ns::COUNTER_QUERY_TIMEOUTS);
+
+        if(search != this->db.end()) {
+            this->send_disconnect(search->second, d);
+        }
+
+        this->calculate_count_lost(d);
+        this->l.get()->info_connect_close(
+            __FILE__, __LINE__, d,
+            this->counter_sent[d],
+            this->counter_recv[d],
+            this->counter_buffered[d],
+            this->counter_lost[d]);
+        this->close_connect_force(d);
+    }
+
+    ///
+    /// \brief server_logic::close_broken - send to the server failed
+    /// \param d - server socket descriptor
+    /// \param err - errno of the failed send
+    ///
+    /// RU: Сервер сбросил соединение (EPIPE/ECONNRESET) или сокет сломан
+    ///     иначе - клиенту сообщается о разрыве, закрывается только эта
+    ///     сессия.
+    ///
+    void server_logic::close_broken(int d, int err) {
+        if(err == EPIPE || err == ECONNRESET) {
+            this->l.get()->info_peer_reset(__FILE__, __LINE__, err, d);
+            metrics_ns::counter_add(metrics_ns::COUNTER_BACKEND_RESETS);
+        }
+        else {
+            this->l.get()->error_send_failed(__FILE__, __LINE__, err, d);
+        }
+
+        auto search = this->db.find(d);
+        if(search != this->db.end()) {
+            this->send_disconnect(search->second, d);
+        }
+
+        this->calculate_count_lost(d);
+        this->l.get()->info_connect_close(
+            __FILE__, __LINE__, d,
+            this->counter_sent[d],
+            this->counter_recv[d],
+            this->counter_buffered[d],
+            this->counter_lost[d]);
+        this->close_connect_force(d);
     }
 
     bool server_logic::save_new_data_storage(int d, unsigned char const* buf,
@@ -955,6 +1394,9 @@ namespace proxy_ns {
             search->second.push_back(v);
 
             this->counter_buffered[d] += size;
+            TRACE_PROBE2(server_enqueue, d, size);
+
+            metrics_ns::counter_add(metrics_ns::COUNTER_BYTES_BUFFERED, size);
 
             return true;
         }
@@ -975,6 +1417,9 @@ namespace proxy_ns {
             search->second.push_front(v);
 
             this->counter_buffered[d] += size;
+            TRACE_PROBE2(server_enqueue, d, size);
+
+            metrics_ns::counter_add(metrics_ns::COUNTER_BYTES_BUFFERED, size);
 
             return true;
         }
@@ -999,6 +1444,11 @@ namespace proxy_ns {
     bool server_logic::delete_data_storage(int d) {
         auto search = storage.find(d);
         if(search != storage.end()) {
+            if(TRACE_ENABLED(server_dequeue)) {
+                TRACE_PROBE2(server_dequeue, d,
+                             search->second.empty() ?
+                                0 : search->second.front().get()->size());
+            }
             search->second.pop_front();
             return true;
         }
@@ -1035,17 +1485,7 @@ namespace proxy_ns {
     }
 
     int server_logic::find_pollfd(int d) const {
-        int res_index = -1;
-
-        int count = this->nfds;
-        for(int i = 0; i < count; i++) {
-            if(this->fds[i].fd == d) {
-               res_index = i;
-               break;
-            }
-        }
-
-        return res_index;
+        return proxy_ns::find_pollfd_index(this->fds, this->nfds, d);
     }
 
     void server_logic::calculate_count_lost(int d) {
@@ -1054,13 +1494,110 @@ namespace proxy_ns {
             this->counter_lost[d] = 0;
         }
         else {
-            boost::uint32_t count = 0;
+            boost::uint64_t count = 0;
             std::for_each(search->second.begin(), search->second.end(),
                           [&count](auto const v) {
                 count += v.get()->size();
             });
             this->counter_lost[d] = count;
+
+            metrics_ns::counter_add(metrics_ns::COUNTER_BYTES_LOST, count);
+        }
+    }
+
+    ///
+    /// \brief server_logic::exchange_request - client data for the backend
+    /// \param d - server socket descriptor
+    /// \param read_ns - time the data was read from the client
+    ///
+    void server_logic::exchange_request(int d, boost::uint64_t read_ns) {
+        exchange& x = this->exchanges[d];
+
+        if(x.first_ns) {
+            // RU: Ответ на предыдущий запрос уже пошёл - новый запрос
+            this->exchange_finish(x);
+        }
+
+        if(!x.request_ns) {
+            x.request_ns = read_ns;
+
+            auto search = this->db.find(d);
+            boost::int32_t const query_timeout =
+                    this->route_of(search != this->db.end() ?
+                                   search->second : -1).query_timeout;
+
+            if(query_timeout > 0) {
+                x.timer = this->timers.arm(
+                            this->now_ms + query_timeout,
+                            TIMER_QUERY, d);
+            }
+        }
+    }
+
+    ///
+    /// \brief server_logic::exchange_sent - after a send to the backend
+    /// \param d - server socket descriptor
+    ///
+    void server_logic::exchange_sent(int d) {
+        auto search = this->exchanges.find(d);
+
+        if(search != this->exchanges.end() &&
+           search->second.request_ns && !search->second.first_ns &&
+           this->empty_data_storage(d)) {
+            // RU: Запрос отправлен серверу целиком
+            search->second.sent_ns = capture_ns::monotonic_ns();
+        }
+    }
+
+    ///
+    /// \brief server_logic::exchange_response - data read from the backend
+    /// \param d - server socket descriptor
+    ///
+    void server_logic::exchange_response(int d) {
+        auto search = this->exchanges.find(d);
+
+        if(search != this->exchanges.end() && search->second.timer) {
+            // RU: Сервер отвечает - срок запроса больше не важен
+            this->timers.cancel(search->second.timer);
+            search->second.timer = 0;
+        }
+
+        if(search == this->exchanges.end() || !search->second.sent_ns) {
+            // RU: Данные сервера без запроса (например, приветствие)
+            return;
+        }
+
+        exchange& x = search->second;
+        boost::uint64_t const now = capture_ns::monotonic_ns();
+
+        if(!x.first_ns) {
+            x.first_ns = now;
+
+            metrics_ns::histogram_observe(
+                metrics_ns::HISTOGRAM_PROXY_REQUEST_US,
+                (x.sent_ns - x.request_ns) / 1000);
+            metrics_ns::histogram_observe(
+                metrics_ns::HISTOGRAM_BACKEND_FIRST_BYTE_US,
+                (x.first_ns - x.sent_ns) / 1000);
         }
+
+        x.last_ns = now;
+    }
+
+    ///
+    /// \brief server_logic::exchange_finish - the response is complete
+    /// \param x
+    ///
+    void server_logic::exchange_finish(exchange& x) noexcept {
+        this->timers.cancel(x.timer);
+
+        if(x.first_ns) {
+            metrics_ns::histogram_observe(
+                metrics_ns::HISTOGRAM_BACKEND_RESPONSE_US,
+                (x.last_ns - x.sent_ns) / 1000);
+        }
+
+        x = exchange();
     }
 
     template<class TF_NEG, class TF_ZERO, class TF_POS>
@@ -1080,6 +1617,8 @@ namespace proxy_ns {
         }
         else {
             this->counter_recv[sd] += rc;
+            TRACE_PROBE2(server_read, sd, rc);
+            metrics_ns::counter_add(metrics_ns::COUNTER_SERVER_BYTES_RECV, rc);
             p_f(rc, buf, size);
         }
 
@@ -1110,6 +1649,7 @@ namespace proxy_ns {
     bool server_logic::read_data(int fd, data& d) {
         return this->read_data(fd, d,
             [this, &d](int rc) -> bool {
+                boost::ignore_unused(rc);
                 assert(rc == sizeof(d));
                 return true;
             },
@@ -1150,6 +1690,7 @@ namespace proxy_ns {
                DIRECTION_SERVER_TO_WORKER == direction);
         return this->send_data(fd, direction, d,
             [this, &d](int rc) -> bool {
+                boost::ignore_unused(rc);
                 assert(rc == sizeof(d));
                 return true;
             },
@@ -1160,6 +1701,41 @@ namespace proxy_ns {
             });
     }
 
+    ///
+    /// \brief server_logic::send_to_client
+    /// \param d
+    /// \return
+    ///
+    /// RU: Поток клиента в это время может сам писать нам и ждать, пока
+    ///     мы прочитаем. Поэтому блокирующая запись допустима только при
+    ///     свободном месте в канале, иначе сообщение ставится в очередь
+    ///     (и управляющее, и с данными - порядок сохраняется).
+    ///
+    bool server_logic::send_to_client(data& d) {
+        if(this->c_out_queue.empty() &&
+           this->pi->can_write_to_pipe(this->c_out_fd, sizeof(d))) {
+            return this->send_data(this->c_out_fd,
+                                   DIRECTION_SERVER_TO_CLIENT, d);
+        }
+
+        d.direction = DIRECTION_SERVER_TO_CLIENT;
+        this->c_out_queue.push_back(d);
+
+        return true;
+    }
+
+    ///
+    /// \brief server_logic::flush_c_out_queue
+    ///
+    void server_logic::flush_c_out_queue(void) {
+        while(!this->c_out_queue.empty() &&
+              this->pi->can_write_to_pipe(this->c_out_fd, sizeof(data))) {
+            (void) this->send_data(this->c_out_fd, DIRECTION_SERVER_TO_CLIENT,
+                                   this->c_out_queue.front());
+            this->c_out_queue.pop_front();
+        }
+    }
+
     ///
     /// \brief server_logic::send_data
     /// \param tod
@@ -1175,18 +1751,29 @@ namespace proxy_ns {
     bool server_logic::send_data(type_of_data_t tod, int c, int s,
                                  unsigned int len,
                                  unsigned char const* buf,
-                                 struct sockaddr_in const* ca,
-                                 struct sockaddr_in const* pa,
-                                 struct sockaddr_in const* sa) {
+                                 struct sockaddr_storage const* ca,
+                                 struct sockaddr_storage const* pa,
+                                 struct sockaddr_storage const* sa) {
         bool retc = true;
-        bool retw = true;
 
         data d(DIRECTION_UNKNOWN, tod, c, s, len, buf, ca, pa, sa);
 
-        retc = this->send_data(this->c_out_fd, DIRECTION_SERVER_TO_CLIENT, d);
-        retw = this->send_data(this->w_out_fd, DIRECTION_SERVER_TO_WORKER, d);
+        auto search_tap = this->tap.find(c);
+        d.tap = (search_tap != this->tap.end() && search_tap->second);
+
+        retc = this->send_to_client(d);
+
+        if(d.tap) {
+            d.direction = DIRECTION_SERVER_TO_WORKER;
+            this->pi->tap_push(this->pi->sw_tap, this->w_out_fd, d);
+        }
+
+        if(TOD_DISCONNECT == tod || TOD_NOT_CONNECT == tod) {
+            this->tap.erase(c);
+            this->route.erase(c);
+        }
 
-        return (retc && retw);
+        return retc;
     }
 
     ///
@@ -1203,9 +1790,9 @@ namespace proxy_ns {
     bool server_logic::send_new_connect(int c, int s,
                                         unsigned int len,
                                         unsigned char const* buf,
-                                        struct sockaddr_in const* ca,
-                                        struct sockaddr_in const* pa,
-                                        struct sockaddr_in const* sa) {
+                                        struct sockaddr_storage const* ca,
+                                        struct sockaddr_storage const* pa,
+                                        struct sockaddr_storage const* sa) {
         return this->send_data(TOD_NEW_CONNECT, c, s, len, buf, ca, pa, sa);
     }
 
@@ -1223,18 +1810,18 @@ namespace proxy_ns {
     bool server_logic::send_disconnect(int c, int s,
                                        unsigned int len,
                                        unsigned char const* buf,
-                                       struct sockaddr_in const* ca,
-                                       struct sockaddr_in const* pa,
-                                       struct sockaddr_in const* sa) {
+                                       struct sockaddr_storage const* ca,
+                                       struct sockaddr_storage const* pa,
+                                       struct sockaddr_storage const* sa) {
         return this->send_data(TOD_DISCONNECT, c, s, len, buf, ca, pa, sa);
     }
 
     bool server_logic::send_data(int c, int s,
                                  unsigned int len,
                                  unsigned char const* buf,
-                                 struct sockaddr_in const* ca,
-                                 struct sockaddr_in const* pa,
-                                 struct sockaddr_in const* sa) {
+                                 struct sockaddr_storage const* ca,
+                                 struct sockaddr_storage const* pa,
+                                 struct sockaddr_storage const* sa) {
         return this->send_data(TOD_DATA, c, s, len, buf, ca, pa, sa);
     }
 
@@ -1252,9 +1839,9 @@ namespace proxy_ns {
     bool server_logic::send_not_connect(int c, int s,
                                         unsigned int len,
                                         unsigned char const* buf,
-                                        struct sockaddr_in const* ca,
-                                        struct sockaddr_in const* pa,
-                                        struct sockaddr_in const* sa) {
+                                        struct sockaddr_storage const* ca,
+                                        struct sockaddr_storage const* pa,
+                                        struct sockaddr_storage const* sa) {
         return this->send_data(TOD_NOT_CONNECT, c, s, len, buf, ca, pa, sa);
     }
 
@@ -1272,9 +1859,9 @@ namespace proxy_ns {
     bool server_logic::send_connect_not_found(int c, int s,
                                               unsigned int len,
                                               unsigned char const* buf,
-                                              struct sockaddr_in const* ca,
-                                              struct sockaddr_in const* pa,
-                                              struct sockaddr_in const* sa) {
+                                              struct sockaddr_storage const* ca,
+                                              struct sockaddr_storage const* pa,
+                                              struct sockaddr_storage const* sa) {
         return this->send_data(TOD_CONNECT_NOT_FOUND,
                                c, s, len, buf, ca, pa, sa);
     }
@@ -1293,9 +1880,9 @@ namespace proxy_ns {
     bool server_logic::send_other(int c, int s,
                                   unsigned int len,
                                   unsigned char const* buf,
-                                  struct sockaddr_in const* ca,
-                                  struct sockaddr_in const* pa,
-                                  struct sockaddr_in const* sa) {
+                                  struct sockaddr_storage const* ca,
+                                  struct sockaddr_storage const* pa,
+                                  struct sockaddr_storage const* sa) {
         return this->send_data(TOD_OTHER, c, s, len, buf, ca, pa, sa);
     }
 } // namespace proxy_ns
@@ -42,6 +42,7 @@
 #include "proxy_result.hpp"
 #include "proxy.hpp"
 //#include "proxy_impl.hpp" // Instead of "proxy_impl.hpp" we use "proxy.hpp".
+#include "timer_wheel.hpp"
 
 namespace proxy_ns {
     using namespace log_ns;
@@ -123,10 +124,39 @@ namespace proxy_ns {
         void compress_array(void);
 
         ///
-        /// \brief erase_old_wait_connect
+        /// \brief expire_timers - connect and query deadlines
         ///
-        void erase_old_wait_connect(void);
+        void expire_timers(void);
     private:
+        // RU: Виды таймеров потока сервера. Ключ: TIMER_CONNECT -
+        //     клиентский сокет, TIMER_QUERY - серверный.
+        enum {
+            TIMER_CONNECT = 1,
+            TIMER_QUERY
+        };
+
+        typedef enum {
+            CONNECT_IN_PROGRESS = 0,  // ::connect, waiting for POLLOUT
+            CONNECT_BACKOFF           // no socket, waiting for the retry
+        } connect_state_t;
+
+        ///
+        /// \brief The pending_connect struct - connection to the server
+        ///
+        /// RU: Подключение к серверу для клиентской сессии. Все подключения
+        ///     идут параллельно: ::connect неблокирующий, срок попытки
+        ///     (connect_timeout) и задержка перед повтором - таймеры колеса.
+        ///     После неудачи (ошибка, RST, таймаут) сокет закрывается, и,
+        ///     если попытки не исчерпаны, через задержку открывается новый.
+        ///
+        struct pending_connect {
+            connect_state_t state;
+            int s_sd;                     // -1 in CONNECT_BACKOFF
+            unsigned int attempt;         // 0 - the first one
+            boost::uint64_t start_ns;     // attempt start (CLOCK_MONOTONIC)
+            timer_wheel::timer_id timer;  // connect_timeout or backoff
+        };
+
         server_routine_arg* s_arg;
         proxy_impl* pi;
         boost::scoped_ptr<proxy_ns::common_logic_log> l;
@@ -148,15 +178,17 @@ namespace proxy_ns {
         bool c_read_enable;
         bool w_read_enable;
         bool c_write_enable;
-        bool w_write_enable;
+
+        // RU: Сообщения для потока клиента, которые не поместились в канал.
+        //     Пока очередь не пуста, новые сообщения встают за ней.
+        std::deque<data> c_out_queue;
 
         // key: server socket descriptor
         // value: client socket descriptor
         std::map<int, int> db;
 
-        // key: server socket descriptor
-        // value: time
-        std::map<int, std::chrono::system_clock::time_point> db_con_wait;
+        // key: client socket descriptor
+        std::map<int, pending_connect> connects;
 
         // key: server socket descriptor
         // value deque with data for send
@@ -166,14 +198,60 @@ namespace proxy_ns {
         // Value: server socket descriptor
         std::list<int> db_for_close;
 
-        std::map<int, boost::uint32_t> counter_sent;
-        std::map<int, boost::uint32_t> counter_recv;
-        std::map<int, boost::uint32_t> counter_buffered;
-        std::map<int, boost::uint32_t> counter_lost;
+        // key: client socket descriptor
+        // value: session is copied to the worker
+        std::map<int, bool> tap;
+
+        // key: client socket descriptor
+        // value: listener index (see listener_config)
+        std::map<int, size_t> route;
+
+        std::map<int, boost::uint64_t> counter_sent;
+        std::map<int, boost::uint64_t> counter_recv;
+        std::map<int, boost::uint64_t> counter_buffered;
+        std::map<int, boost::uint64_t> counter_lost;
+
+        ///
+        /// \brief The exchange struct - timestamps of the current query
+        ///
+        /// RU: Запрос - данные клиента до первого байта ответа сервера,
+        ///     ответ - данные сервера до следующего запроса. Время -
+        ///     CLOCK_MONOTONIC (нс), 0 - точка ещё не пройдена.
+        ///
+        struct exchange {
+            boost::uint64_t request_ns;  // client read (first packet)
+            boost::uint64_t sent_ns;     // backend send completion
+            boost::uint64_t first_ns;    // first response byte
+            boost::uint64_t last_ns;     // last response byte
+            timer_wheel::timer_id timer; // query_timeout (until first_ns)
+        };
+
+        // key: server socket descriptor
+        std::map<int, exchange> exchanges;
+
+        // RU: Таймеры потока и время (мс) последнего выхода из poll
+        timer_wheel timers;
+        boost::uint64_t now_ms;
+
+        boost::uint64_t backoff_seed;
+
+        // RU: Снимок перечитываемых параметров (обновляется после poll)
+        runtime_config_view cfg;
 
         void new_connect(int sd, int client_sd);
         void close_connect(int d);
         void close_connect_force(int d);
+        void start_connect(int c_sd);
+        int connecting(int s_sd) const;
+        void connect_succeeded(int c_sd);
+        void connect_failed(int c_sd);
+        void connect_expired(int c_sd);
+        void erase_connect(int c_sd);
+        boost::uint64_t backoff_delay(boost::int32_t backoff,
+                                      unsigned int attempt);
+        listener_config const& route_of(int c_sd) const;
+        void query_expired(int d);
+        void close_broken(int d, int err);
         bool save_new_data_storage(int d, unsigned char const* buf,
                                    unsigned int size);
         bool save_unset_data_storage(int d, unsigned char const* buf,
@@ -185,6 +263,10 @@ namespace proxy_ns {
         bool empty_data_storage(int d);
         int find_pollfd(int d) const;
         void calculate_count_lost(int d);
+        void exchange_request(int d, boost::uint64_t read_ns);
+        void exchange_sent(int d);
+        void exchange_response(int d);
+        void exchange_finish(exchange& x) noexcept;
 
         template<class TF_NEG, class TF_ZERO, class TF_POS>
         int read_data_socket(int sd, unsigned char* buf, size_t size,
@@ -222,6 +304,18 @@ namespace proxy_ns {
         ///
         bool send_data(int fd, direction_t direction, data& d);
 
+        ///
+        /// \brief send_to_client - message to the client thread (never blocks)
+        /// \param d
+        /// \return
+        ///
+        bool send_to_client(data& d);
+
+        ///
+        /// \brief flush_c_out_queue - write queued messages while there is room
+        ///
+        void flush_c_out_queue(void);
+
         ///
         /// \brief send_data
         /// \param tod
@@ -237,9 +331,9 @@ namespace proxy_ns {
         bool send_data(type_of_data_t tod, int c, int s = -1,
                        unsigned int len = 0,
                        unsigned char const* buf = nullptr,
-                       struct sockaddr_in const* ca = nullptr,
-                       struct sockaddr_in const* pa = nullptr,
-                       struct sockaddr_in const* sa = nullptr);
+                       struct sockaddr_storage const* ca = nullptr,
+                       struct sockaddr_storage const* pa = nullptr,
+                       struct sockaddr_storage const* sa = nullptr);
 
         ///
         /// \brief send_new_connect
@@ -255,9 +349,9 @@ namespace proxy_ns {
         bool send_new_connect(int c, int s,
                               unsigned int len = 0,
                               unsigned char const* buf = nullptr,
-                              struct sockaddr_in const* ca = nullptr,
-                              struct sockaddr_in const* pa = nullptr,
-                              struct sockaddr_in const* sa = nullptr);
+                              struct sockaddr_storage const* ca = nullptr,
+                              struct sockaddr_storage const* pa = nullptr,
+                              struct sockaddr_storage const* sa = nullptr);
 
         ///
         /// \brief send_disconnect
@@ -273,9 +367,9 @@ namespace proxy_ns {
         bool send_disconnect(int c, int s,
                              unsigned int len = 0,
                              unsigned char const* buf = nullptr,
-                             struct sockaddr_in const* ca = nullptr,
-                             struct sockaddr_in const* pa = nullptr,
-                             struct sockaddr_in const* sa = nullptr);
+                             struct sockaddr_storage const* ca = nullptr,
+                             struct sockaddr_storage const* pa = nullptr,
+                             struct sockaddr_storage const* sa = nullptr);
 
         ///
         /// \brief send_data
@@ -291,9 +385,9 @@ namespace proxy_ns {
         bool send_data(int c, int s,
                        unsigned int len,
                        unsigned char const* buf,
-                       struct sockaddr_in const* ca = nullptr,
-                       struct sockaddr_in const* pa = nullptr,
-                       struct sockaddr_in const* sa = nullptr);
+                       struct sockaddr_storage const* ca = nullptr,
+                       struct sockaddr_storage const* pa = nullptr,
+                       struct sockaddr_storage const* sa = nullptr);
 
         ///
         /// \brief send_not_connect
@@ -309,9 +403,9 @@ namespace proxy_ns {
         bool send_not_connect(int c, int s = -1,
                               unsigned int len = 0,
                               unsigned char const* buf = nullptr,
-                              struct sockaddr_in const* ca = nullptr,
-                              struct sockaddr_in const* pa = nullptr,
-                              struct sockaddr_in const* sa = nullptr);
+                              struct sockaddr_storage const* ca = nullptr,
+                              struct sockaddr_storage const* pa = nullptr,
+                              struct sockaddr_storage const* sa = nullptr);
 
         ///
         /// \brief send_connect_not_found
@@ -327,9 +421,9 @@ namespace proxy_ns {
         bool send_connect_not_found(int c, int s,
                                     unsigned int len = 0,
                                     unsigned char const* buf = nullptr,
-                                    struct sockaddr_in const* ca = nullptr,
-                                    struct sockaddr_in const* pa = nullptr,
-                                    struct sockaddr_in const* sa = nullptr);
+                                    struct sockaddr_storage const* ca = nullptr,
+                                    struct sockaddr_storage const* pa = nullptr,
+                                    struct sockaddr_storage const* sa = nullptr);
 
         ///
         /// \brief send_other
@@ -345,9 +439,9 @@ namespace proxy_ns {
         bool send_other(int c, int s,
                         unsigned int len,
                         unsigned char const* buf,
-                        struct sockaddr_in const* ca = nullptr,
-                        struct sockaddr_in const* pa = nullptr,
-                        struct sockaddr_in const* sa = nullptr);
+                        struct sockaddr_storage const* ca = nullptr,
+                        struct sockaddr_storage const* pa = nullptr,
+                        struct sockaddr_storage const* sa = nullptr);
 
 
     };
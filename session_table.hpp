@@ -0,0 +1,318 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#pragma once
+
+#ifndef __SESSION_TABLE_HPP__
+#define __SESSION_TABLE_HPP__
+
+#include <atomic>
+#include <new>
+#include <cstddef>
+#include <cstring>
+
+#include <boost/cstdint.hpp>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#ifndef SESSION_TABLE_SIZE
+    #define SESSION_TABLE_SIZE 131072
+#endif // SESSION_TABLE_SIZE
+
+#ifndef SESSION_TABLE_CHUNK
+    #define SESSION_TABLE_CHUNK 1024 // slots, SESSION_TABLE_SIZE is a multiple
+#endif // SESSION_TABLE_CHUNK
+
+namespace proxy_ns {
+    ///
+    /// \brief The session_info struct - consistent copy of a slot
+    ///
+    struct session_info {
+        int c_sd;
+        int s_sd;
+        boost::uint16_t client_family; // AF_INET, AF_INET6, AF_UNIX
+        boost::uint32_t client_addr[4]; // network byte order; IPv4 - [0];
+                                        // AF_UNIX - peer pid, uid, gid
+        boost::uint16_t client_port;   // host byte order
+        bool tap;
+        boost::uint64_t start_ns;      // CLOCK_REALTIME
+        boost::uint64_t bytes_in;      // client -> proxy
+        boost::uint64_t bytes_out;     // proxy -> client
+    };
+
+    ///
+    /// \brief The session_table class
+    ///
+    /// RU: Таблица живых сессий для чтения извне (администраторский
+    ///     интерфейс). Индекс - дескриптор сокета клиента. Пишет только
+    ///     поток клиента; читатели не берут блокировок (seqlock): при
+    ///     одновременной записи чтение слота повторяется. Счётчики байт
+    ///     читаются вне seqlock и могут быть чуть неточными.
+    ///     Сессии с дескриптором >= SESSION_TABLE_SIZE не отслеживаются.
+    ///     Слоты выделяются блоками по SESSION_TABLE_CHUNK при первой
+    ///     сессии с дескриптором из блока: пока дескрипторы малы, таблица
+    ///     занимает несколько десятков КиБ, а не всю SESSION_TABLE_SIZE.
+    ///
+    class session_table {
+        typedef session_table self;
+    public:
+        session_table(void) :
+            high(0) {
+            for(auto& c : this->chunks) {
+                c.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        ~session_table(void) {
+            for(auto& c : this->chunks) {
+                delete[] c.load(std::memory_order_relaxed);
+            }
+        }
+
+        session_table(session_table const&) = delete;
+        session_table& operator=(session_table const&) = delete;
+
+        void open(int c_sd, struct sockaddr_storage const* addr, bool tap,
+                  boost::uint64_t start_ns,
+                  struct ucred const* peer = nullptr) noexcept {
+            slot* s = this->get_or_alloc(c_sd);
+
+            if(!s) {
+                return;
+            }
+
+            boost::uint32_t a[4] = {0, 0, 0, 0};
+            boost::uint16_t port = 0;
+
+            if(addr && AF_INET == addr->ss_family) {
+                auto const* x = reinterpret_cast<struct sockaddr_in const*>(addr);
+
+                a[0] = x->sin_addr.s_addr;
+                port = ntohs(x->sin_port);
+            }
+            else if(addr && AF_INET6 == addr->ss_family) {
+                auto const* x =
+                        reinterpret_cast<struct sockaddr_in6 const*>(addr);
+
+                std::memcpy(a, &x->sin6_addr, sizeof(a));
+                port = ntohs(x->sin6_port);
+            }
+            else if(addr && AF_UNIX == addr->ss_family && peer) {
+                a[0] = static_cast<boost::uint32_t>(peer->pid);
+                a[1] = peer->uid;
+                a[2] = peer->gid;
+            }
+
+            self::begin(*s);
+
+            s->s_sd.store(-1, std::memory_order_relaxed);
+            s->client_family.store(addr ? addr->ss_family : AF_UNSPEC,
+                                   std::memory_order_relaxed);
+            for(size_t i = 0; i < 4; i++) {
+                s->client_addr[i].store(a[i], std::memory_order_relaxed);
+            }
+            s->client_port.store(port, std::memory_order_relaxed);
+            s->tap.store(tap, std::memory_order_relaxed);
+            s->start_ns.store(start_ns, std::memory_order_relaxed);
+            s->bytes_in.store(0, std::memory_order_relaxed);
+            s->bytes_out.store(0, std::memory_order_relaxed);
+            s->active.store(true, std::memory_order_relaxed);
+
+            self::end(*s);
+
+            size_t h = this->high.load(std::memory_order_relaxed);
+            while(static_cast<size_t>(c_sd) >= h &&
+                  !this->high.compare_exchange_weak(
+                      h, static_cast<size_t>(c_sd) + 1,
+                      std::memory_order_relaxed)) {
+            }
+        }
+
+        void set_server(int c_sd, int s_sd) noexcept {
+            slot* s = this->get(c_sd);
+
+            if(s) {
+                self::begin(*s);
+                s->s_sd.store(s_sd, std::memory_order_relaxed);
+                self::end(*s);
+            }
+        }
+
+        void close(int c_sd) noexcept {
+            slot* s = this->get(c_sd);
+
+            if(s) {
+                self::begin(*s);
+                s->active.store(false, std::memory_order_relaxed);
+                self::end(*s);
+            }
+        }
+
+        void add_in(int c_sd, boost::uint64_t n) noexcept {
+            slot* s = this->get(c_sd);
+
+            if(s) {
+                s->bytes_in.store(
+                    s->bytes_in.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+            }
+        }
+
+        void add_out(int c_sd, boost::uint64_t n) noexcept {
+            slot* s = this->get(c_sd);
+
+            if(s) {
+                s->bytes_out.store(
+                    s->bytes_out.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+            }
+        }
+
+        ///
+        /// \brief for_each - call f(session_info const&) for live sessions
+        /// \param f
+        ///
+        template<class F>
+        void for_each(F f) const {
+            size_t const h = this->high.load(std::memory_order_relaxed);
+
+            for(size_t i = 0; i < h; i++) {
+                slot const* const c =
+                        this->chunks[i / SESSION_TABLE_CHUNK].load(
+                            std::memory_order_acquire);
+
+                if(!c) {
+                    // RU: В блоке ещё не было сессий
+                    i += SESSION_TABLE_CHUNK - 1 - (i % SESSION_TABLE_CHUNK);
+                    continue;
+                }
+
+                slot const& s = c[i % SESSION_TABLE_CHUNK];
+                session_info info = session_info();
+                bool active = false;
+                bool ok = false;
+
+                for(int attempt = 0; attempt < 8 && !ok; attempt++) {
+                    boost::uint32_t const seq =
+                            s.seq.load(std::memory_order_acquire);
+
+                    if(seq & 1) {
+                        continue;
+                    }
+
+                    active = s.active.load(std::memory_order_relaxed);
+                    info.c_sd = static_cast<int>(i);
+                    info.s_sd = s.s_sd.load(std::memory_order_relaxed);
+                    info.client_family =
+                            s.client_family.load(std::memory_order_relaxed);
+                    for(size_t k = 0; k < 4; k++) {
+                        info.client_addr[k] =
+                                s.client_addr[k].load(
+                                    std::memory_order_relaxed);
+                    }
+                    info.client_port =
+                            s.client_port.load(std::memory_order_relaxed);
+                    info.tap = s.tap.load(std::memory_order_relaxed);
+                    info.start_ns = s.start_ns.load(std::memory_order_relaxed);
+
+                    std::atomic_thread_fence(std::memory_order_acquire);
+
+                    ok = (seq == s.seq.load(std::memory_order_relaxed));
+                }
+
+                if(ok && active) {
+                    info.bytes_in = s.bytes_in.load(std::memory_order_relaxed);
+                    info.bytes_out =
+                            s.bytes_out.load(std::memory_order_relaxed);
+                    f(info);
+                }
+            }
+        }
+    private:
+        struct alignas(64) slot {
+            std::atomic<boost::uint32_t> seq;
+            std::atomic<bool> active;
+            std::atomic<bool> tap;
+            std::atomic<int> s_sd;
+            std::atomic<boost::uint16_t> client_family;
+            std::atomic<boost::uint16_t> client_port;
+            std::atomic<boost::uint32_t> client_addr[4];
+            std::atomic<boost::uint64_t> start_ns;
+            std::atomic<boost::uint64_t> bytes_in;
+            std::atomic<boost::uint64_t> bytes_out;
+        };
+
+        slot* get(int c_sd) const noexcept {
+            if(c_sd < 0 || c_sd >= SESSION_TABLE_SIZE) {
+                return nullptr;
+            }
+
+            slot* const c = this->chunks[c_sd / SESSION_TABLE_CHUNK].load(
+                        std::memory_order_relaxed);
+
+            return c ? &c[c_sd % SESSION_TABLE_CHUNK] : nullptr;
+        }
+
+        // RU: Вызывается только пишущим потоком, поэтому блок не может
+        //     появиться одновременно из двух мест
+        slot* get_or_alloc(int c_sd) noexcept {
+            if(c_sd < 0 || c_sd >= SESSION_TABLE_SIZE) {
+                return nullptr;
+            }
+
+            std::atomic<slot*>& a = this->chunks[c_sd / SESSION_TABLE_CHUNK];
+            slot* c = a.load(std::memory_order_relaxed);
+
+            if(!c) {
+                c = new(std::nothrow) slot[SESSION_TABLE_CHUNK]();
+
+                if(!c) {
+                    return nullptr;
+                }
+
+                a.store(c, std::memory_order_release);
+            }
+
+            return &c[c_sd % SESSION_TABLE_CHUNK];
+        }
+
+        static void begin(slot& s) noexcept {
+            s.seq.store(s.seq.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        static void end(slot& s) noexcept {
+            s.seq.store(s.seq.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_release);
+        }
+
+        std::atomic<slot*> chunks[SESSION_TABLE_SIZE / SESSION_TABLE_CHUNK];
+        std::atomic<size_t> high;
+    };
+} // namespace proxy_ns
+
+#endif // __SESSION_TABLE_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
@@ -0,0 +1,353 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#include <map>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+
+#include <boost/cstdint.hpp>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "log.hpp"
+#include "shadow.hpp"
+
+namespace proxy_ns {
+    using namespace log_ns;
+
+    ///
+    /// \brief shadow::shadow
+    /// \param ip
+    /// \param port
+    /// \param _sample_rate - every N-th tapped session (0 - none)
+    /// \param _buffer_size - per-session limit of pending bytes
+    ///
+    shadow::shadow(std::string const& ip, boost::uint16_t port,
+                   boost::uint32_t _sample_rate,
+                   size_t _buffer_size) :
+        sample_rate(_sample_rate),
+        buffer_size(_buffer_size),
+        session_counter(0),
+        sessions(),
+        sessions_total(0),
+        bytes_sent(0),
+        bytes_discarded(0),
+        sessions_dropped(0) {
+
+        std::memset(&this->addr, 0, sizeof(this->addr));
+
+        this->addr.sin_family = AF_INET;
+        this->addr.sin_port = htons(port);
+
+        if(::inet_pton(AF_INET, ip.c_str(), &this->addr.sin_addr) != 1) {
+            throw Eproxy_invalid_value(ip);
+        }
+    }
+
+    ///
+    /// \brief shadow::from_client
+    /// \param d
+    ///
+    void shadow::from_client(data const& d) {
+        switch(d.tod) {
+        case TOD_NEW_CONNECT:
+            this->close_session(d.c_sd);
+
+            if(this->sample_rate &&
+               0 == (this->session_counter++ % this->sample_rate)) {
+                this->open_session(d.c_sd);
+            }
+            break;
+        case TOD_DATA: {
+            auto it = this->sessions.find(d.c_sd);
+
+            if(it == this->sessions.end() || it->second.closing) {
+                break;
+            }
+
+            session& s = it->second;
+
+            // RU: Теневой сервер не успевает - сессия закрывается целиком:
+            //     отбросить часть запросов нельзя, это нарушит протокол.
+            if(s.pending.size() + d.buffer_len > this->buffer_size) {
+                log::inst().write_lazy<Ilog::LEVEL_DEBUG>(
+                            [&]()->std::string {
+                    std::stringstream ss;
+                    ss << "W: Shadow session " << d.c_sd
+                       << " dropped: buffer overflow.";
+                    return ss.str();
+                });
+
+                this->sessions_dropped++;
+                this->close_session(d.c_sd);
+                break;
+            }
+
+            s.pending.insert(s.pending.end(),
+                             d.buffer, d.buffer + d.buffer_len);
+
+            if(s.connected && !this->flush(s)) {
+                this->close_session(d.c_sd);
+            }
+            break;
+        }
+        case TOD_DISCONNECT:
+        case TOD_NOT_CONNECT: {
+            auto it = this->sessions.find(d.c_sd);
+
+            if(it != this->sessions.end()) {
+                it->second.closing = true;
+
+                if(it->second.connected && !this->flush(it->second)) {
+                    this->close_session(d.c_sd);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    ///
+    /// \brief shadow::from_server
+    /// \param d
+    ///
+    void shadow::from_server(data const& d) {
+        if(TOD_DISCONNECT == d.tod || TOD_NOT_CONNECT == d.tod) {
+            this->close_session(d.c_sd);
+        }
+    }
+
+    ///
+    /// \brief shadow::reset
+    ///
+    void shadow::reset(void) noexcept {
+        this->sessions_dropped += this->sessions.size();
+
+        while(!this->sessions.empty()) {
+            this->close_session(this->sessions.begin()->first);
+        }
+    }
+
+    ///
+    /// \brief shadow::fill_pollfds
+    /// \param fds
+    ///
+    void shadow::fill_pollfds(std::vector<struct pollfd>& fds) const {
+        for(auto const& i : this->sessions) {
+            struct pollfd p;
+
+            p.fd = i.second.sd;
+            p.events = POLLIN;
+            p.revents = 0;
+
+            if(!i.second.connected || !i.second.pending.empty()) {
+                p.events |= POLLOUT;
+            }
+
+            fds.push_back(p);
+        }
+    }
+
+    ///
+    /// \brief shadow::process
+    /// \param fds
+    /// \param first
+    ///
+    /// RU: Порядок дескрипторов в fds совпадает с порядком сессий в
+    ///     sessions (см. fill_pollfds), но сессии могли быть закрыты при
+    ///     обработке предыдущих событий, поэтому поиск идёт по ключу.
+    ///
+    void shadow::process(std::vector<struct pollfd> const& fds,
+                         size_t first) {
+        std::vector<int> closed;
+
+        for(auto it = this->sessions.begin();
+            it != this->sessions.end() && first < fds.size();
+            ++it, ++first) {
+            session& s = it->second;
+            short const revents = fds[first].revents;
+
+            if(0 == revents || fds[first].fd != s.sd) {
+                continue;
+            }
+
+            if(!s.connected && (revents & (POLLOUT | POLLERR | POLLHUP))) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+
+                if(::getsockopt(s.sd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 ||
+                   err) {
+                    log::inst()(Ilog::LEVEL_ERROR, [&]()->std::string {
+                        std::stringstream ss;
+                        ss << "W: Shadow connect failed: "
+                           << ::strerror(err ? err : errno) << ".";
+                        return ss.str();
+                    }());
+
+                    closed.push_back(it->first);
+                    continue;
+                }
+
+                s.connected = true;
+            }
+
+            if(revents & (POLLIN | POLLHUP | POLLERR)) {
+                unsigned char buf[DATA_BUFFER_SIZE];
+                ssize_t rc = 0;
+
+                // RU: Ответы теневого сервера не нужны никому.
+                while((rc = ::recv(s.sd, buf, sizeof(buf),
+                                   MSG_DONTWAIT)) > 0) {
+                    this->bytes_discarded += rc;
+                }
+
+                if(0 == rc || (rc < 0 && errno != EAGAIN &&
+                               errno != EWOULDBLOCK && errno != EINTR)) {
+                    closed.push_back(it->first);
+                    continue;
+                }
+            }
+
+            if(s.connected && !this->flush(s)) {
+                closed.push_back(it->first);
+            }
+        }
+
+        for(int c_sd : closed) {
+            this->close_session(c_sd);
+        }
+    }
+
+    boost::uint64_t shadow::get_sessions(void) const noexcept {
+        return this->sessions_total;
+    }
+
+    boost::uint64_t shadow::get_bytes_sent(void) const noexcept {
+        return this->bytes_sent;
+    }
+
+    boost::uint64_t shadow::get_bytes_discarded(void) const noexcept {
+        return this->bytes_discarded;
+    }
+
+    boost::uint64_t shadow::get_sessions_dropped(void) const noexcept {
+        return this->sessions_dropped;
+    }
+
+    ///
+    /// \brief shadow::~shadow
+    ///
+    shadow::~shadow(void) noexcept {
+        while(!this->sessions.empty()) {
+            this->close_session(this->sessions.begin()->first);
+        }
+    }
+
+    ///
+    /// \brief shadow::open_session
+    /// \param c_sd
+    ///
+    void shadow::open_session(int c_sd) {
+        int const sd = ::socket(AF_INET,
+                                SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                0);
+        if(sd < 0) {
+            log::inst()(Ilog::LEVEL_ERROR, "W: Shadow 'socket' failed.");
+            return;
+        }
+
+        if(::connect(sd, reinterpret_cast<struct sockaddr*>(&this->addr),
+                     sizeof(this->addr)) < 0 && errno != EINPROGRESS) {
+            log::inst()(Ilog::LEVEL_ERROR, [&]()->std::string {
+                std::stringstream ss;
+                ss << "W: Shadow connect failed: " << ::strerror(errno) << ".";
+                return ss.str();
+            }());
+
+            (void) ::close(sd);
+            return;
+        }
+
+        session& s = this->sessions[c_sd];
+
+        s.sd = sd;
+        s.connected = false;
+        s.closing = false;
+        s.pending.clear();
+
+        this->sessions_total++;
+    }
+
+    ///
+    /// \brief shadow::close_session
+    /// \param c_sd
+    ///
+    void shadow::close_session(int c_sd) noexcept {
+        auto it = this->sessions.find(c_sd);
+
+        if(it != this->sessions.end()) {
+            (void) ::close(it->second.sd);
+            this->sessions.erase(it);
+        }
+    }
+
+    ///
+    /// \brief shadow::flush - send pending data without blocking
+    /// \param s
+    /// \return false if the session must be closed
+    ///
+    bool shadow::flush(session& s) {
+        while(!s.pending.empty()) {
+            ssize_t const rc = ::send(s.sd, s.pending.data(),
+                                      s.pending.size(),
+                                      MSG_DONTWAIT | MSG_NOSIGNAL);
+            if(rc < 0) {
+                if(EAGAIN == errno || EWOULDBLOCK == errno ||
+                   EINTR == errno) {
+                    return true;
+                }
+
+                return false;
+            }
+
+            this->bytes_sent += rc;
+            s.pending.erase(s.pending.begin(), s.pending.begin() + rc);
+        }
+
+        // RU: Всё отправлено, клиент уже отключился - закрываемся.
+        return !s.closing;
+    }
+} // namespace proxy_ns
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
@@ -0,0 +1,135 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#pragma once
+
+#ifndef __SHADOW_HPP__
+#define __SHADOW_HPP__
+
+#include <map>
+#include <vector>
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+#include <netinet/in.h>
+#include <poll.h>
+
+#include "proxy.hpp"
+
+#ifndef SHADOW_SESSION_BUFFER_SIZE
+    #define SHADOW_SESSION_BUFFER_SIZE (1024 * 1024)
+#endif // SHADOW_SESSION_BUFFER_SIZE
+
+namespace proxy_ns {
+    ///
+    /// \brief The shadow class
+    ///
+    /// RU: Зеркалирование трафика клиент->сервер для сессий из выборки на
+    ///     второй (теневой) сервер. Работает в потоке воркера и никак не
+    ///     влияет на основной путь: все сокеты неблокирующие, ответы
+    ///     теневого сервера читаются и отбрасываются, буфер каждой сессии
+    ///     ограничен - при переполнении сессия теневого сервера закрывается.
+    ///
+    class shadow {
+        typedef shadow self;
+    public:
+        shadow(std::string const& ip, boost::uint16_t port,
+               boost::uint32_t sample_rate,
+               size_t buffer_size = SHADOW_SESSION_BUFFER_SIZE);
+
+        shadow(shadow const&) = delete;
+        shadow& operator=(shadow const&) = delete;
+
+        ///
+        /// \brief from_client - data of a tapped session (C->W)
+        /// \param d
+        ///
+        void from_client(data const& d);
+
+        ///
+        /// \brief from_server - data of a tapped session (S->W)
+        /// \param d
+        ///
+        /// RU: Используется только для закрытия теневой сессии, когда
+        ///     основной сервер разорвал соединение.
+        ///
+        void from_server(data const& d);
+
+        ///
+        /// \brief reset - close all shadow sessions
+        ///
+        /// RU: Вызывается, если кольцо C->W потеряло записи: поток запросов
+        ///     каждой сессии мог быть нарушен.
+        ///
+        void reset(void) noexcept;
+
+        ///
+        /// \brief fill_pollfds - append shadow sockets to the poll set
+        /// \param fds
+        ///
+        void fill_pollfds(std::vector<struct pollfd>& fds) const;
+
+        ///
+        /// \brief process - handle revents for the shadow sockets
+        /// \param fds
+        /// \param first - index of the first shadow socket in fds
+        ///
+        void process(std::vector<struct pollfd> const& fds, size_t first);
+
+        boost::uint64_t get_sessions(void) const noexcept;
+        boost::uint64_t get_bytes_sent(void) const noexcept;
+        boost::uint64_t get_bytes_discarded(void) const noexcept;
+        boost::uint64_t get_sessions_dropped(void) const noexcept;
+
+        virtual ~shadow(void) noexcept;
+    private:
+        struct session {
+            int sd;
+            bool connected;
+            bool closing;
+            std::vector<unsigned char> pending;
+        };
+
+        void open_session(int c_sd);
+        void close_session(int c_sd) noexcept;
+        bool flush(session& s);
+
+        struct sockaddr_in addr;
+        boost::uint32_t const sample_rate;
+        size_t const buffer_size;
+        boost::uint32_t session_counter;
+
+        // key: client socket descriptor
+        std::map<int, session> sessions;
+
+        boost::uint64_t sessions_total;
+        boost::uint64_t bytes_sent;
+        boost::uint64_t bytes_discarded;
+        boost::uint64_t sessions_dropped;
+    };
+} // namespace proxy_ns
+
+#endif // __SHADOW_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
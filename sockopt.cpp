@@ -0,0 +1,109 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#include <iterator>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "sockopt.hpp"
+
+namespace proxy_ns {
+    namespace {
+        ///
+        /// \brief The option struct - one row of the table
+        ///
+        struct option {
+            int stages;                             // sockopt_stage_t mask
+            bool tcp_only;
+            bool flag;                              // value is 0 or 1
+            int level;
+            int name;
+            boost::int32_t sockopt_profile::* field;
+            char const* title;
+        };
+
+        option const options[] = {
+            {SOCKOPT_LISTEN, true, false, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+             &sockopt_profile::defer_accept, "TCP_DEFER_ACCEPT"},
+            {SOCKOPT_LISTEN, true, false, IPPROTO_TCP, TCP_FASTOPEN,
+             &sockopt_profile::fastopen, "TCP_FASTOPEN"},
+#ifdef TCP_FASTOPEN_CONNECT
+            {SOCKOPT_CONNECT, true, true, IPPROTO_TCP, TCP_FASTOPEN_CONNECT,
+             &sockopt_profile::fastopen, "TCP_FASTOPEN_CONNECT"},
+#endif // TCP_FASTOPEN_CONNECT
+            // RU: Размер буфера задаётся до connect/listen: от него
+            //     зависит масштаб окна в SYN
+            {SOCKOPT_LISTEN | SOCKOPT_CONNECT, false, false, SOL_SOCKET,
+             SO_RCVBUF, &sockopt_profile::rcvbuf, "SO_RCVBUF"},
+            {SOCKOPT_LISTEN | SOCKOPT_CONNECT, false, false, SOL_SOCKET,
+             SO_SNDBUF, &sockopt_profile::sndbuf, "SO_SNDBUF"},
+#ifdef TCP_NOTSENT_LOWAT
+            {SOCKOPT_ACCEPT | SOCKOPT_CONNECT, true, false, IPPROTO_TCP,
+             TCP_NOTSENT_LOWAT, &sockopt_profile::notsent_lowat,
+             "TCP_NOTSENT_LOWAT"},
+#endif // TCP_NOTSENT_LOWAT
+#ifdef SO_BUSY_POLL
+            {SOCKOPT_ACCEPT | SOCKOPT_CONNECT, true, false, SOL_SOCKET,
+             SO_BUSY_POLL, &sockopt_profile::busy_poll, "SO_BUSY_POLL"},
+#endif // SO_BUSY_POLL
+        };
+    }
+
+    ///
+    /// \brief sockopt_apply
+    /// \param sd
+    /// \param p
+    /// \param stage
+    /// \param tcp
+    /// \param ferr
+    /// \return
+    ///
+    int sockopt_apply(int sd, sockopt_profile const& p, sockopt_stage_t stage,
+                      bool tcp,
+                      std::function<void (char const*, int)> const& ferr) {
+        int failed = 0;
+
+        for(option const& o : options) {
+            boost::int32_t const v = p.*o.field;
+
+            if(!v || !(o.stages & stage) || (o.tcp_only && !tcp)) {
+                continue;
+            }
+
+            int const val = o.flag ? 1 : v;
+
+            if(::setsockopt(sd, o.level, o.name, &val, sizeof(val)) < 0) {
+                ferr(o.title, errno);
+                failed++;
+            }
+        }
+
+        return failed;
+    }
+} // namespace proxy_ns
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
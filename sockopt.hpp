@@ -0,0 +1,80 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#pragma once
+
+#ifndef __SOCKOPT_HPP__
+#define __SOCKOPT_HPP__
+
+#include <functional>
+
+#include <boost/cstdint.hpp>
+
+namespace proxy_ns {
+    ///
+    /// \brief The sockopt_profile struct - socket tuning of one side
+    ///
+    /// RU: Ноль - параметр не трогается (значение ядра), поэтому профиль
+    ///     по умолчанию не добавляет ни одного системного вызова.
+    ///
+    struct sockopt_profile {
+        boost::int32_t defer_accept;    // s, TCP_DEFER_ACCEPT (listener)
+        boost::int32_t fastopen;        // listener - queue length;
+                                        // backend - TCP_FASTOPEN_CONNECT
+        boost::int32_t rcvbuf;          // bytes, SO_RCVBUF
+        boost::int32_t sndbuf;          // bytes, SO_SNDBUF
+        boost::int32_t notsent_lowat;   // bytes, TCP_NOTSENT_LOWAT
+        boost::int32_t busy_poll;       // us, SO_BUSY_POLL
+    };
+
+    ///
+    /// \brief The sockopt_stage_t enum - where a socket is
+    ///
+    typedef enum {
+        SOCKOPT_LISTEN  = 1,    // before bind; accepted sockets inherit
+        SOCKOPT_ACCEPT  = 2,    // just accepted
+        SOCKOPT_CONNECT = 4     // before connect
+    } sockopt_stage_t;
+
+    ///
+    /// \brief sockopt_apply - set the options of a profile for a stage
+    /// \param sd - socket descriptor
+    /// \param p - profile
+    /// \param stage
+    /// \param tcp - false for a unix socket: TCP options are skipped
+    /// \param ferr - called for each failed option (name, errno)
+    /// \return number of failed options
+    ///
+    /// RU: Один проход по таблице параметров: неустановленные (0)
+    ///     пропускаются, ошибка одного параметра не мешает остальным.
+    ///     Параметры - настройка, а не условие работы, поэтому ошибки
+    ///     не фатальны для соединения.
+    ///
+    int sockopt_apply(int sd, sockopt_profile const& p, sockopt_stage_t stage,
+                      bool tcp,
+                      std::function<void (char const*, int)> const& ferr);
+} // namespace proxy_ns
+
+#endif // __SOCKOPT_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
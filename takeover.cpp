@@ -0,0 +1,348 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "log.hpp"
+#include "proxy.hpp"
+//#include "proxy_impl.hpp" // Instead of "proxy_impl.hpp" we use "proxy.hpp".
+#include "takeover.hpp"
+
+namespace proxy_ns {
+    using namespace log_ns;
+
+    namespace {
+        bool make_addr(std::string const& path, struct sockaddr_un& addr) {
+            std::memset(&addr, 0, sizeof(addr));
+
+            if(path.empty() || path.size() >= sizeof(addr.sun_path)) {
+                return false;
+            }
+
+            addr.sun_family = AF_UNIX;
+            std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+            return true;
+        }
+
+        // RU: Слушающий сокет отдаётся только процессу того же
+        //     пользователя или root'у
+        bool peer_allowed(int sd, unsigned int& uid) {
+            struct ucred cred;
+            socklen_t len = sizeof(cred);
+
+            if(::getsockopt(sd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 ||
+               len != sizeof(cred)) {
+                uid = static_cast<unsigned int>(-1);
+                return false;
+            }
+
+            uid = cred.uid;
+
+            return cred.uid == ::geteuid() || 0 == cred.uid;
+        }
+    }
+
+    ///
+    /// \brief takeover::takeover
+    /// \param pi
+    /// \param path
+    ///
+    takeover::takeover(proxy_impl* pi, std::string const& path) :
+        pi(pi),
+        path(path),
+        listen_sd(-1),
+        handed_over(false),
+        stop(false),
+        thread() {
+
+        struct sockaddr_un addr;
+
+        if(!make_addr(path, addr)) {
+            throw Eproxy_invalid_value(path);
+        }
+
+        this->listen_sd = ::socket(AF_UNIX,
+                                   SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                   0);
+        if(this->listen_sd < 0) {
+            throw Eproxy_syscall_failed("'socket'");
+        }
+
+        // RU: Сокет предыдущего процесса (если он был) уже не нужен:
+        //     слушающий сокет получен (см. receive) или его нет.
+        (void) ::unlink(path.c_str());
+
+        // RU: Права выставляются до listen: раньше подключиться нельзя
+        if(::bind(this->listen_sd,
+                  reinterpret_cast<struct sockaddr*>(&addr),
+                  sizeof(addr)) < 0 ||
+           ::chmod(path.c_str(), S_IRUSR | S_IWUSR) < 0 ||
+           ::listen(this->listen_sd, 1) < 0) {
+            std::string const what = "'bind/chmod/listen' (" + path + ": " +
+                                     ::strerror(errno) + ")";
+            (void) ::close(this->listen_sd);
+            this->listen_sd = -1;
+            throw Eproxy_syscall_failed(what);
+        }
+
+        this->thread = std::thread(&self::run, this);
+    }
+
+    ///
+    /// \brief takeover::receive
+    /// \param path
+    /// \param timeout
+    /// \param fds
+    /// \param max
+    /// \return
+    ///
+    size_t takeover::receive(std::string const& path, int timeout,
+                             int* fds, size_t max) {
+        struct sockaddr_un addr;
+        struct timeval tv;
+        struct msghdr msg;
+        struct iovec iov;
+        char byte = 0;
+        size_t n = 0;
+
+        union {
+            struct cmsghdr align;
+            char buf[CMSG_SPACE(sizeof(int) * LISTENERS_MAX)];
+        } control;
+
+        if(!make_addr(path, addr)) {
+            return 0;
+        }
+
+        int const sd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(sd < 0) {
+            return 0;
+        }
+
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+
+        (void) ::setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        if(::connect(sd, reinterpret_cast<struct sockaddr*>(&addr),
+                     sizeof(addr)) < 0) {
+            // RU: Работающей копии нет (или она не поддерживает передачу)
+            (void) ::close(sd);
+            return 0;
+        }
+
+        std::memset(&msg, 0, sizeof(msg));
+        std::memset(&control, 0, sizeof(control));
+
+        iov.iov_base = &byte;
+        iov.iov_len = sizeof(byte);
+
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        if(::recvmsg(sd, &msg, MSG_CMSG_CLOEXEC) == sizeof(byte)) {
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+
+            if(cmsg != nullptr &&
+               SOL_SOCKET == cmsg->cmsg_level &&
+               SCM_RIGHTS == cmsg->cmsg_type &&
+               cmsg->cmsg_len > CMSG_LEN(0)) {
+                size_t const got = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+                for(size_t i = 0; i < got; i++) {
+                    int fd = -1;
+
+                    std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int),
+                                sizeof(fd));
+
+                    if(n < max) {
+                        fds[n++] = fd;
+                    }
+                    else {
+                        (void) ::close(fd);
+                    }
+                }
+            }
+        }
+
+        (void) ::close(sd);
+
+        return n;
+    }
+
+    ///
+    /// \brief takeover::~takeover
+    ///
+    takeover::~takeover(void) noexcept {
+        this->stop = true;
+
+        if(this->thread.joinable()) {
+            this->thread.join();
+        }
+
+        if(this->listen_sd >= 0) {
+            (void) ::close(this->listen_sd);
+        }
+
+        // RU: После передачи путь принадлежит новому процессу
+        if(!this->handed_over) {
+            (void) ::unlink(this->path.c_str());
+        }
+    }
+
+    ///
+    /// \brief takeover::run
+    ///
+    void takeover::run(void) {
+        while(!this->stop && !this->handed_over) {
+            struct pollfd pfd = {this->listen_sd, POLLIN, 0};
+
+            // RU: Короткий таймаут - для проверки флага остановки.
+            int const rc = ::poll(&pfd, 1, 100);
+
+            if(rc < 0) {
+                if(EINTR == errno) {
+                    continue;
+                }
+
+                log::inst()(Ilog::LEVEL_ERROR, "T: 'poll' failed");
+                break;
+            }
+            else if(!rc) {
+                continue;
+            }
+
+            int const sd = ::accept4(this->listen_sd, nullptr, nullptr,
+                                     SOCK_CLOEXEC);
+            if(sd < 0) {
+                continue;
+            }
+
+            unsigned int uid = 0;
+
+            if(!peer_allowed(sd, uid)) {
+                std::stringstream ss;
+
+                ss << "T: Takeover refused: peer uid=" << uid;
+
+                log::inst()(Ilog::LEVEL_ERROR, ss.str());
+
+                (void) ::close(sd);
+                continue;
+            }
+
+            if(this->hand_over(sd)) {
+                this->handed_over = true;
+
+                // RU: Повторно сокет не передаётся
+                (void) ::close(this->listen_sd);
+                this->listen_sd = -1;
+            }
+
+            (void) ::close(sd);
+        }
+    }
+
+    ///
+    /// \brief takeover::hand_over - send the listening sockets
+    /// \param sd - connection from the new process
+    /// \return
+    ///
+    bool takeover::hand_over(int sd) {
+        struct msghdr msg;
+        struct iovec iov;
+        char byte = 'T';
+        int fds[LISTENERS_MAX];
+
+        union {
+            struct cmsghdr align;
+            char buf[CMSG_SPACE(sizeof(int) * LISTENERS_MAX)];
+        } control;
+
+        size_t const n = this->pi->listen_count;
+        bool listening = n > 0;
+
+        for(size_t i = 0; i < n; i++) {
+            fds[i] = this->pi->listen_fd[i];
+            listening = listening && fds[i] >= 0;
+        }
+
+        if(!listening) {
+            // RU: Поток клиента ещё не создал слушающие сокеты
+            log::inst()(Ilog::LEVEL_ERROR,
+                        "T: Takeover refused: not listening yet");
+            return false;
+        }
+
+        std::memset(&msg, 0, sizeof(msg));
+        std::memset(&control, 0, sizeof(control));
+
+        iov.iov_base = &byte;
+        iov.iov_len = sizeof(byte);
+
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n);
+
+        std::memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n);
+
+        if(::sendmsg(sd, &msg, MSG_NOSIGNAL) != sizeof(byte)) {
+            log::inst()(Ilog::LEVEL_ERROR,
+                        std::string("T: 'sendmsg' failed: ") +
+                        ::strerror(errno));
+            return false;
+        }
+
+        // RU: Новый процесс принимает соединения - этот доживает своё
+        this->pi->draining = true;
+
+        log::inst()(Ilog::LEVEL_INFO,
+                    "T: The listening sockets are handed over. Draining...");
+
+        return true;
+    }
+} // namespace proxy_ns
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
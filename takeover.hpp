@@ -0,0 +1,89 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+
+#pragma once
+
+#ifndef __TAKEOVER_HPP__
+#define __TAKEOVER_HPP__
+
+#include <string>
+#include <atomic>
+#include <thread>
+
+#include "proxy.hpp"
+
+#ifndef TAKEOVER_TIMEOUT
+    #define TAKEOVER_TIMEOUT 5000 // ms
+#endif // TAKEOVER_TIMEOUT
+
+namespace proxy_ns {
+    ///
+    /// \brief The takeover class
+    ///
+    /// RU: Обновление бинарника без остановки. Работающий процесс слушает
+    ///     unix-сокет (--takeover-path) в отдельном потоке. Новый процесс,
+    ///     запущенный с --takeover, подключается к нему и получает слушающие
+    ///     сокеты (все слушатели) через SCM_RIGHTS. Очередь listen у
+    ///     процессов общая, поэтому
+    ///     соединения не теряются: старый процесс перестаёт принимать новые
+    ///     и завершается, когда закроется последняя его сессия.
+    ///
+    class takeover {
+        typedef takeover self;
+    public:
+        takeover(proxy_impl* pi, std::string const& path);
+
+        takeover(takeover const&) = delete;
+        takeover& operator=(takeover const&) = delete;
+
+        ///
+        /// \brief receive - get the listening sockets from a running copy
+        /// \param path
+        /// \param timeout - ms
+        /// \param fds - [out] socket descriptors
+        /// \param max - size of fds
+        /// \return number of sockets, 0 - no running copy
+        ///
+        static size_t receive(std::string const& path, int timeout,
+                              int* fds, size_t max);
+
+        virtual ~takeover(void) noexcept;
+    private:
+        void run(void);
+        bool hand_over(int sd);
+
+        proxy_impl* const pi;
+        std::string const path;
+
+        int listen_sd;
+        bool handed_over;
+
+        std::atomic<bool> stop;
+        std::thread thread;
+    };
+} // namespace proxy_ns
+
+#endif // __TAKEOVER_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
@@ -0,0 +1,141 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#pragma once
+
+#ifndef __TAP_RING_HPP__
+#define __TAP_RING_HPP__
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+#include <boost/cstdint.hpp>
+
+#ifndef TAP_RING_SIZE
+    #define TAP_RING_SIZE 1024
+#endif // TAP_RING_SIZE
+
+namespace proxy_ns {
+    ///
+    /// \brief The tap_ring class
+    ///
+    /// RU: Ограниченное кольцо "один писатель - один читатель" (SPSC) без
+    ///     блокировок. Используется для передачи копии трафика от потоков
+    ///     клиента и сервера воркеру. Писатель никогда не ждёт: если кольцо
+    ///     заполнено, новая запись отбрасывается и увеличивается счётчик
+    ///     потерь. Емкость должна быть степенью двойки.
+    ///
+    template<class T, size_t N = TAP_RING_SIZE>
+    class tap_ring {
+        typedef tap_ring self;
+
+        static_assert(N >= 2 && (N & (N - 1)) == 0,
+                      "tap_ring: size must be a power of two");
+    public:
+        ///
+        /// \brief tap_ring
+        ///
+        tap_ring(void) : head(0), tail(0), dropped(0),
+            slots(new T[N]) {
+        }
+
+        tap_ring(tap_ring const&) = delete;
+        tap_ring& operator=(tap_ring const&) = delete;
+
+        ///
+        /// \brief try_push - producer side
+        /// \param v
+        /// \param first - set to true if the ring was empty before the push
+        /// \return false if the ring is full (the record is dropped)
+        ///
+        bool try_push(T const& v, bool& first) noexcept {
+            size_t const t = this->tail.load(std::memory_order_relaxed);
+
+            first = false;
+
+            if(t - this->head.load(std::memory_order_acquire) >= N) {
+                this->dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            this->slots[t & (N - 1)] = v;
+            this->tail.store(t + 1, std::memory_order_seq_cst);
+
+            // RU: Читатель мог успеть забрать всё, кроме только что
+            //     записанного элемента. В этом случае его нужно разбудить.
+            first = ((t + 1) - this->head.load(std::memory_order_seq_cst)) == 1;
+
+            return true;
+        }
+
+        ///
+        /// \brief try_pop - consumer side
+        /// \param v
+        /// \return false if the ring is empty
+        ///
+        bool try_pop(T& v) noexcept {
+            size_t const h = this->head.load(std::memory_order_relaxed);
+
+            if(h == this->tail.load(std::memory_order_seq_cst)) {
+                return false;
+            }
+
+            v = this->slots[h & (N - 1)];
+            this->head.store(h + 1, std::memory_order_seq_cst);
+
+            return true;
+        }
+
+        ///
+        /// \brief size - approximate number of records in the ring
+        /// \return
+        ///
+        size_t size(void) const noexcept {
+            return this->tail.load(std::memory_order_relaxed) -
+                    this->head.load(std::memory_order_relaxed);
+        }
+
+        ///
+        /// \brief get_dropped
+        /// \return
+        ///
+        boost::uint64_t get_dropped(void) const noexcept {
+            return this->dropped.load(std::memory_order_relaxed);
+        }
+
+        static constexpr size_t capacity(void) noexcept {
+            return N;
+        }
+    private:
+        alignas(64) std::atomic<size_t> head;
+        alignas(64) std::atomic<size_t> tail;
+        alignas(64) std::atomic<boost::uint64_t> dropped;
+
+        std::unique_ptr<T[]> slots;
+    };
+} // namespace proxy_ns
+
+#endif // __TAP_RING_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
@@ -0,0 +1,353 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+
+#include <vector>
+#include <limits>
+
+#include <ctime>
+
+#include <boost/cstdint.hpp>
+
+#include "timer_wheel.hpp"
+
+namespace proxy_ns {
+    namespace {
+        inline boost::uint64_t rotr(boost::uint64_t x, unsigned int s) {
+            return s ? ((x >> s) | (x << (64 - s))) : x;
+        }
+    } // namespace
+
+    ///
+    /// \brief timer_wheel::timer_wheel
+    /// \param now_ms
+    ///
+    timer_wheel::timer_wheel(boost::uint64_t now_ms) :
+        nodes(self::HEADS),
+        free_list(0),
+        bitmap(),
+        current(now_ms),
+        count(0) {
+
+        for(boost::uint32_t i = 0; i < self::HEADS; i++) {
+            this->nodes[i].prev = i;
+            this->nodes[i].next = i;
+            this->nodes[i].gen = 0;
+            this->nodes[i].list = i;
+            this->nodes[i].deadline = 0;
+            this->nodes[i].kind = 0;
+            this->nodes[i].key = -1;
+        }
+    }
+
+    ///
+    /// \brief timer_wheel::~timer_wheel
+    ///
+    timer_wheel::~timer_wheel(void) noexcept {
+    }
+
+    ///
+    /// \brief timer_wheel::arm
+    /// \param deadline_ms
+    /// \param kind
+    /// \param key
+    /// \return
+    ///
+    timer_wheel::timer_id timer_wheel::arm(boost::uint64_t deadline_ms,
+                                           int kind, int key) {
+        boost::uint32_t n = this->free_list;
+
+        if(n) {
+            this->free_list = this->nodes[n].next;
+        }
+        else {
+            n = static_cast<boost::uint32_t>(this->nodes.size());
+
+            node x = node();
+            x.gen = 1;
+            this->nodes.push_back(x);
+        }
+
+        node& x = this->nodes[n];
+
+        // RU: Уже наступивший срок сработает на следующем шаге
+        x.deadline = (deadline_ms > this->current) ?
+                    deadline_ms : this->current + 1;
+        x.kind = kind;
+        x.key = key;
+
+        this->insert(n);
+        this->count++;
+
+        return (static_cast<timer_id>(x.gen) << 32) | n;
+    }
+
+    ///
+    /// \brief timer_wheel::cancel
+    /// \param id
+    /// \return
+    ///
+    bool timer_wheel::cancel(timer_id id) noexcept {
+        boost::uint32_t const n = static_cast<boost::uint32_t>(id);
+
+        if(n < self::HEADS || n >= this->nodes.size() ||
+           this->nodes[n].gen != static_cast<boost::uint32_t>(id >> 32) ||
+           this->nodes[n].list >= self::HEADS) {
+            // RU: Таймер уже сработал или отменён
+            return false;
+        }
+
+        this->unlink(n);
+        this->release(n);
+        this->count--;
+
+        return true;
+    }
+
+    ///
+    /// \brief timer_wheel::expire
+    /// \param now_ms
+    /// \param e
+    /// \return
+    ///
+    bool timer_wheel::expire(boost::uint64_t now_ms, expired& e) {
+        for(;;) {
+            if(!this->empty(self::FIRED)) {
+                boost::uint32_t const n = this->nodes[self::FIRED].next;
+                node const& x = this->nodes[n];
+
+                e.id = (static_cast<timer_id>(x.gen) << 32) | n;
+                e.kind = x.kind;
+                e.key = x.key;
+
+                this->unlink(n);
+                this->release(n);
+                this->count--;
+
+                return true;
+            }
+
+            boost::uint64_t const t = this->next_event();
+
+            if(t > now_ms) {
+                if(now_ms > this->current) {
+                    // RU: До now_ms событий нет - шаги можно пропустить
+                    this->current = now_ms;
+                }
+
+                return false;
+            }
+
+            this->current = t;
+
+            for(unsigned int l = self::LEVELS - 1; l > 0; l--) {
+                unsigned int const shift = l * self::LEVEL_BITS;
+
+                if(!(t & ((static_cast<boost::uint64_t>(1) << shift) - 1))) {
+                    this->cascade(l, (t >> shift) & (self::SLOTS - 1));
+                }
+            }
+
+            boost::uint32_t const h = t & (self::SLOTS - 1);
+
+            while(!this->empty(h)) {
+                boost::uint32_t const n = this->nodes[h].next;
+
+                this->unlink(n);
+                this->link(self::FIRED, n);
+            }
+        }
+    }
+
+    ///
+    /// \brief timer_wheel::next_timeout
+    /// \param now_ms
+    /// \param max_ms
+    /// \return
+    ///
+    int timer_wheel::next_timeout(boost::uint64_t now_ms,
+                                  int max_ms) const noexcept {
+        boost::uint64_t const t = this->empty(self::FIRED) ?
+                    this->next_event() : now_ms;
+
+        if(t == std::numeric_limits<boost::uint64_t>::max()) {
+            return max_ms;
+        }
+        else if(t <= now_ms) {
+            return 0;
+        }
+
+        boost::uint64_t const d = t - now_ms;
+
+        if(max_ms >= 0 && d > static_cast<boost::uint64_t>(max_ms)) {
+            return max_ms;
+        }
+        else if(d > static_cast<boost::uint64_t>(
+                    std::numeric_limits<int>::max())) {
+            return std::numeric_limits<int>::max();
+        }
+
+        return static_cast<int>(d);
+    }
+
+    ///
+    /// \brief timer_wheel::size
+    /// \return
+    ///
+    size_t timer_wheel::size(void) const noexcept {
+        return this->count;
+    }
+
+    ///
+    /// \brief timer_wheel::now
+    /// \return
+    ///
+    boost::uint64_t timer_wheel::now(void) noexcept {
+        struct timespec ts;
+
+        (void) ::clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return static_cast<boost::uint64_t>(ts.tv_sec) * 1000 +
+                static_cast<boost::uint64_t>(ts.tv_nsec) / 1000000;
+    }
+
+    /* ***************************************************************** */
+    /* ********************** CLASS: timer_wheel *********************** */
+    /* **************************** PRIVATE **************************** */
+    /* ***************************************************************** */
+
+    void timer_wheel::link(boost::uint32_t head, boost::uint32_t n) noexcept {
+        node& h = this->nodes[head];
+        node& x = this->nodes[n];
+
+        x.prev = h.prev;
+        x.next = head;
+        this->nodes[h.prev].next = n;
+        h.prev = n;
+        x.list = head;
+
+        if(head < self::FIRED) {
+            this->bitmap[head / self::SLOTS] |=
+                    static_cast<boost::uint64_t>(1) << (head % self::SLOTS);
+        }
+    }
+
+    void timer_wheel::unlink(boost::uint32_t n) noexcept {
+        node& x = this->nodes[n];
+        boost::uint32_t const head = x.list;
+
+        this->nodes[x.prev].next = x.next;
+        this->nodes[x.next].prev = x.prev;
+        x.prev = x.next = n;
+
+        if(head < self::FIRED && this->empty(head)) {
+            this->bitmap[head / self::SLOTS] &=
+                    ~(static_cast<boost::uint64_t>(1) << (head % self::SLOTS));
+        }
+    }
+
+    void timer_wheel::insert(boost::uint32_t n) noexcept {
+        boost::uint64_t d = this->nodes[n].deadline;
+
+        if(d <= this->current) {
+            this->link(self::FIRED, n);
+            return;
+        }
+
+        boost::uint64_t const delta = d - this->current;
+        unsigned int level = 0;
+
+        if(delta >= self::SLOTS) {
+            // RU: Уровень l хранит сроки из [64^l, 64^(l+1))
+            level = (63 - __builtin_clzll(delta)) / self::LEVEL_BITS;
+
+            if(level >= self::LEVELS) {
+                // RU: Дальше диапазона колеса - в последний слот, при
+                //     перекладывании срок будет проверен снова
+                level = self::LEVELS - 1;
+                d = this->current + (static_cast<boost::uint64_t>(1) <<
+                                     (self::LEVELS * self::LEVEL_BITS)) - 1;
+            }
+        }
+
+        unsigned int const slot =
+                (d >> (level * self::LEVEL_BITS)) & (self::SLOTS - 1);
+
+        this->link(level * self::SLOTS + slot, n);
+    }
+
+    void timer_wheel::release(boost::uint32_t n) noexcept {
+        node& x = this->nodes[n];
+
+        if(!++x.gen) {
+            x.gen = 1;
+        }
+
+        x.list = self::HEADS;
+        x.next = this->free_list;
+        this->free_list = n;
+    }
+
+    void timer_wheel::cascade(unsigned int level, unsigned int slot) noexcept {
+        boost::uint32_t const h = level * self::SLOTS + slot;
+
+        // RU: Таймеры слота уходят на младшие уровни (или в сработавшие),
+        //     обратно в этот слот ни один не попадает
+        while(!this->empty(h)) {
+            boost::uint32_t const n = this->nodes[h].next;
+
+            this->unlink(n);
+            this->insert(n);
+        }
+    }
+
+    boost::uint64_t timer_wheel::next_event(void) const noexcept {
+        boost::uint64_t t = std::numeric_limits<boost::uint64_t>::max();
+
+        for(unsigned int l = 0; l < self::LEVELS; l++) {
+            if(!this->bitmap[l]) {
+                continue;
+            }
+
+            // RU: Слоты уровня l по порядку, начиная со следующего блока
+            //     длиной 64^l
+            unsigned int const shift = l * self::LEVEL_BITS;
+            boost::uint64_t const b = (this->current >> shift) + 1;
+            boost::uint64_t const r = rotr(this->bitmap[l],
+                                           b & (self::SLOTS - 1));
+            boost::uint64_t const e = (b + __builtin_ctzll(r)) << shift;
+
+            if(e < t) {
+                t = e;
+            }
+        }
+
+        return t;
+    }
+
+    bool timer_wheel::empty(boost::uint32_t head) const noexcept {
+        return this->nodes[head].next == head;
+    }
+} // namespace proxy_ns
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
@@ -0,0 +1,164 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+
+#pragma once
+
+#ifndef __TIMER_WHEEL_HPP__
+#define __TIMER_WHEEL_HPP__
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+namespace proxy_ns {
+    ///
+    /// \brief The timer_wheel class - hierarchical timing wheel
+    ///
+    /// RU: Иерархическое колесо таймеров (Varghese & Lauck): 4 уровня по
+    ///     64 слота, шаг - 1 мс, диапазон - 2^24 мс (~4.6 ч), более
+    ///     дальние сроки перекладываются заново. Взвод и отмена - O(1),
+    ///     срабатывание - O(1) на таймер (плюс перекладывание при переходе
+    ///     на следующий слот старшего уровня). Занятые слоты отмечены в
+    ///     битовых масках, поэтому время до ближайшего события (таймаут
+    ///     poll) находится без обхода слотов.
+    ///
+    ///     Узлы лежат в одном векторе и связаны индексами; идентификатор
+    ///     таймера содержит поколение узла, поэтому отмена уже сработавшего
+    ///     или отменённого таймера безопасна. Не потокобезопасно: у
+    ///     каждого потока своё колесо.
+    ///
+    class timer_wheel {
+        typedef timer_wheel self;
+    public:
+        ///
+        /// \brief timer_id - 0 is never a valid timer
+        ///
+        typedef boost::uint64_t timer_id;
+
+        ///
+        /// \brief The expired struct - a fired timer
+        ///
+        struct expired {
+            timer_id id;
+            int kind;
+            int key;
+        };
+
+        ///
+        /// \brief timer_wheel
+        /// \param now_ms - current time (CLOCK_MONOTONIC, ms)
+        ///
+        explicit timer_wheel(boost::uint64_t now_ms = self::now());
+
+        timer_wheel(timer_wheel const&) = delete;
+        timer_wheel& operator=(timer_wheel const&) = delete;
+
+        ///
+        /// \brief arm - start a timer
+        /// \param deadline_ms - CLOCK_MONOTONIC, ms
+        /// \param kind - user data
+        /// \param key - user data (socket descriptor, etc.)
+        /// \return timer id
+        ///
+        timer_id arm(boost::uint64_t deadline_ms, int kind, int key);
+
+        ///
+        /// \brief cancel - stop a timer (stale or zero id is ignored)
+        /// \param id
+        /// \return true if the timer was active
+        ///
+        bool cancel(timer_id id) noexcept;
+
+        ///
+        /// \brief expire - take the next timer with deadline <= now_ms
+        /// \param now_ms
+        /// \param e - fired timer
+        /// \return false if there are no more expired timers
+        ///
+        /// RU: Вызывается в цикле до false. Обработчик может взводить и
+        ///     отменять любые таймеры между вызовами.
+        ///
+        bool expire(boost::uint64_t now_ms, expired& e);
+
+        ///
+        /// \brief next_timeout - poll timeout
+        /// \param now_ms
+        /// \param max_ms - timeout without timers
+        /// \return ms until the nearest event, not more than max_ms
+        ///
+        /// RU: Событием считается и перекладывание слота старшего уровня,
+        ///     поэтому poll может проснуться раньше срока таймера.
+        ///
+        int next_timeout(boost::uint64_t now_ms, int max_ms) const noexcept;
+
+        ///
+        /// \brief size - number of active timers
+        ///
+        size_t size(void) const noexcept;
+
+        ///
+        /// \brief now - CLOCK_MONOTONIC, ms
+        ///
+        static boost::uint64_t now(void) noexcept;
+
+        virtual ~timer_wheel(void) noexcept;
+    private:
+        static unsigned int const LEVEL_BITS = 6;
+        static unsigned int const SLOTS = 1U << LEVEL_BITS;
+        static unsigned int const LEVELS = 4;
+
+        // RU: Первые HEADS узлов - заголовки кольцевых списков: слоты всех
+        //     уровней и список сработавших таймеров.
+        static boost::uint32_t const FIRED = LEVELS * SLOTS;
+        static boost::uint32_t const HEADS = FIRED + 1;
+
+        struct node {
+            boost::uint32_t prev;
+            boost::uint32_t next;
+            boost::uint32_t gen;
+            boost::uint32_t list;   // head of the list
+            boost::uint64_t deadline;
+            int kind;
+            int key;
+        };
+
+        void link(boost::uint32_t head, boost::uint32_t n) noexcept;
+        void unlink(boost::uint32_t n) noexcept;
+        void insert(boost::uint32_t n) noexcept;
+        void release(boost::uint32_t n) noexcept;
+        void cascade(unsigned int level, unsigned int slot) noexcept;
+        boost::uint64_t next_event(void) const noexcept;
+        bool empty(boost::uint32_t head) const noexcept;
+
+        std::vector<node> nodes;
+        boost::uint32_t free_list;  // 0 - empty
+        boost::uint64_t bitmap[LEVELS];
+        boost::uint64_t current;    // last processed tick
+        size_t count;
+    };
+} // namespace proxy_ns
+
+#endif // __TIMER_WHEEL_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
@@ -0,0 +1,38 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+#include "trace.hpp"
+
+#if defined(USE_USDT)
+    // RU: Семафоры точек трассировки (объявлены в trace.hpp). Секция
+    //     .probes - там их ищут systemtap, perf и bpftrace.
+    #define TRACE_SEMAPHORE_DEFINE(name) \
+        __extension__ unsigned short TRACE_SEMAPHORE(name) \
+            __attribute__((unused)) __attribute__((section(".probes"))) = 0;
+
+    extern "C" {
+        TRACE_PROBES(TRACE_SEMAPHORE_DEFINE)
+    }
+#endif // USE_USDT
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
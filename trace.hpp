@@ -0,0 +1,110 @@
+/* *****************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Vasiliy V. Bodrov aka Bodro, Ryazan, Russia
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+ * OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ************************************************************************** */
+
+
+#pragma once
+
+#ifndef __TRACE_HPP__
+#define __TRACE_HPP__
+
+///
+/// Static (USDT) tracepoints of the forwarding path, provider "sqlproxy".
+///
+/// RU: Точки трассировки в формате systemtap (sys/sdt.h). Каждая точка -
+///     одна инструкция nop и запись в секции .note.stapsdt, поэтому без
+///     подключённого трассировщика (bpftrace, perf, stap) накладных
+///     расходов практически нет. Включаются сборкой с -DUSE_USDT (нужен
+///     только заголовок sys/sdt.h, библиотека не требуется).
+///
+///     Пример:
+///         bpftrace -e 'usdt:./proxy:sqlproxy:client_read
+///                      { @bytes = hist(arg1); }'
+///
+/// Probes:
+///     accept(c_sd, client_addr, client_port)
+///     backend_connect_start(c_sd, s_sd)
+///     backend_connect_done(c_sd, s_sd, ok)
+///     client_read(c_sd, len)            server_read(s_sd, len)
+///     client_send(c_sd, len)            server_send(s_sd, len)
+///     client_enqueue(c_sd, len)         server_enqueue(s_sd, len)
+///     client_dequeue(c_sd, len)         server_dequeue(s_sd, len)
+///     session_close(c_sd, sent, recv)   backend_close(s_sd, sent, recv)
+///
+/// client_addr is in network byte order; client_port in host byte order.
+/// *_enqueue/*_dequeue follow the unsent data queue (storage) of a socket.
+///
+/// TRACE_ENABLED(name) is true while a tracer is attached to the probe
+/// (the same semaphore check as dtrace -h's SQLPROXY_<NAME>_ENABLED()).
+/// Arguments that cost more than a load are computed under it:
+///
+///     if(TRACE_ENABLED(session_close)) {
+///         TRACE_PROBE3(session_close, d, sent(d), recv(d));
+///     }
+///
+
+#define TRACE_PROBES(X) \
+    X(accept) \
+    X(backend_connect_start) \
+    X(backend_connect_done) \
+    X(client_read) \
+    X(server_read) \
+    X(client_send) \
+    X(server_send) \
+    X(client_enqueue) \
+    X(server_enqueue) \
+    X(client_dequeue) \
+    X(server_dequeue) \
+    X(session_close) \
+    X(backend_close)
+
+#if defined(USE_USDT)
+    // RU: Каждой точке нужен семафор (определены в trace.cpp).
+    //     Трассировщик увеличивает его, пока подключён к точке.
+    #define _SDT_HAS_SEMAPHORES 1
+    #include <sys/sdt.h>
+
+    #define TRACE_SEMAPHORE(name) sqlproxy_##name##_semaphore
+
+    #define TRACE_SEMAPHORE_DECLARE(name) \
+        __extension__ extern unsigned short TRACE_SEMAPHORE(name) \
+            __attribute__((unused)) __attribute__((section(".probes")));
+
+    extern "C" {
+        TRACE_PROBES(TRACE_SEMAPHORE_DECLARE)
+    }
+
+    #define TRACE_ENABLED(name) \
+        __builtin_expect(TRACE_SEMAPHORE(name) != 0, 0)
+    #define TRACE_PROBE2(name, a1, a2) \
+        DTRACE_PROBE2(sqlproxy, name, a1, a2)
+    #define TRACE_PROBE3(name, a1, a2, a3) \
+        DTRACE_PROBE3(sqlproxy, name, a1, a2, a3)
+#else
+    #define TRACE_ENABLED(name) false
+    #define TRACE_PROBE2(name, a1, a2) do {} while(0)
+    #define TRACE_PROBE3(name, a1, a2, a3) do {} while(0)
+#endif // USE_USDT
+
+#endif // __TRACE_HPP__
+
+/* *****************************************************************************
+ * End of file
+ * ************************************************************************** */
@@ -32,6 +32,8 @@
  */
 
 #include <map>
+#include <vector>
+#include <chrono>
 #include <algorithm>
 #include <iterator>
 #include <sstream>
@@ -44,6 +46,7 @@
 #include <boost/make_shared.hpp>
 #include <boost/cstdint.hpp>
 #include <boost/core/ignore_unused.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -60,6 +63,9 @@
 #include "proxy_result.hpp"
 #include "proxy.hpp"
 //#include "proxy_impl.hpp" // Instead of "proxy_impl.hpp" we use "proxy.hpp".
+#include "capture.hpp"
+#include "shadow.hpp"
+#include "metrics.hpp"
 
 namespace proxy_ns {
     using namespace log_ns;
@@ -84,29 +90,151 @@ namespace proxy_ns {
         //int c_out_fd = worker_arg->_wc_out_pd;
 
         int rc = 0;
-        struct pollfd fds[2];
+        std::vector<struct pollfd> fds;
         int timeout = 0;
 
-        fds[0].fd = c_in_fd;
-        fds[0].events = POLLIN;
+        // RU: Счётчики потерь, о которых уже сообщили в лог.
+        boost::uint64_t reported_c_dropped = 0;
+        boost::uint64_t reported_s_dropped = 0;
+        boost::uint64_t shadow_c_dropped = 0;
+        std::chrono::steady_clock::time_point next_report =
+                std::chrono::steady_clock::now();
 
-        fds[1].fd = s_in_fd;
-        fds[1].events = POLLIN;
+        boost::scoped_ptr<capture_ns::capture> cap;
 
-        timeout = 1000; // TODO: сделать таймаут управляемым снаружи, а не выставляя значение тут (магические числа).
+        if(!_this->capture_file.empty()) {
+            try {
+                cap.reset(new capture_ns::capture(
+                              _this->capture_file,
+                              _this->capture_segment_size,
+                              _this->capture_segment_count));
+            }
+            catch(capture_ns::IEcapture const& e) {
+                l(Ilog::LEVEL_ERROR, std::string("W: ") + e.what());
+            }
+        }
+
+        boost::scoped_ptr<shadow> shd;
+
+        if(!_this->shadow_addr.empty() && _this->shadow_port) {
+            try {
+                shd.reset(new shadow(_this->shadow_addr,
+                                     _this->shadow_port,
+                                     _this->shadow_sample_rate,
+                                     _this->shadow_buffer_size));
+            }
+            catch(IEproxy const& e) {
+                l(Ilog::LEVEL_ERROR, std::string("W: ") + e.what());
+            }
+        }
+
+        // RU: Разбор очереди: сначала "звонок", затем всё кольцо. Именно в
+        //     таком порядке, иначе можно пропустить запись, добавленную
+        //     между опустошением кольца и чтением звонка.
+        auto drain = [&_this, &cap, &shd, &shadow_c_dropped, &l](
+                int fd, tap_ring<data>& ring,
+                capture_ns::capture_direction_t dir) -> void {
+            char bell[64];
+            data d;
+
+            while(::read(fd, bell, sizeof(bell)) > 0) {
+            }
+
+            while(ring.try_pop(d)) {
+                _this->debug_log_info(d, "W");
+
+                if(cap) {
+                    try {
+                        (void) cap.get()->write(
+                                    d.timestamp,
+                                    static_cast<boost::uint32_t>(d.c_sd),
+                                    dir,
+                                    static_cast<boost::uint8_t>(d.tod),
+                                    d.buffer, d.buffer_len);
+                    }
+                    catch(capture_ns::IEcapture const& e) {
+                        // RU: Ошибка записи (например, нет места на
+                        //     диске) - запись трафика прекращается.
+                        l(Ilog::LEVEL_ERROR, std::string("W: ") + e.what());
+                        cap.reset();
+                    }
+                }
+
+                if(shd) {
+                    if(capture_ns::CAPTURE_DIRECTION_CLIENT_TO_SERVER == dir) {
+                        // RU: Потеря записи C->W нарушает поток запросов -
+                        //     теневые сессии закрываются до того, как
+                        //     получат первую запись после разрыва. Счётчик
+                        //     увеличен раньше, чем эта запись попала в
+                        //     кольцо, поэтому он уже виден здесь.
+                        boost::uint64_t const dropped = ring.get_dropped();
+
+                        if(dropped != shadow_c_dropped) {
+                            shadow_c_dropped = dropped;
+                            shd.get()->reset();
+                        }
+
+                        shd.get()->from_client(d);
+                    }
+                    else {
+                        shd.get()->from_server(d);
+                    }
+                }
+            }
+        };
+
+        auto report_dropped = [&l](char const* name,
+                                   boost::uint64_t dropped,
+                                   boost::uint64_t& reported) -> void {
+            if(dropped != reported) {
+                l(Ilog::LEVEL_ERROR, [&]()->std::string {
+                    std::stringstream ss;
+                    ss << "W: Worker is too slow, tap records dropped ("
+                       << name << "): " << (dropped - reported)
+                       << " (total=" << dropped << ").";
+                    return ss.str();
+                }());
+
+                reported = dropped;
+            }
+        };
+
+        timeout = _this->worker_poll_timeout;
+
+        _this->w_last_err = RES_CODE_OK;
 
         do {
-            rc = ::poll(fds, 2, timeout);
+            // RU: Набор дескрипторов динамический: два "звонка" и сокеты
+            //     теневого сервера (если зеркалирование включено).
+            fds.resize(2);
+
+            fds[0].fd = c_in_fd;
+            fds[0].events = POLLIN;
+            fds[0].revents = 0;
+
+            fds[1].fd = s_in_fd;
+            fds[1].events = POLLIN;
+            fds[1].revents = 0;
+
+            if(shd) {
+                shd.get()->fill_pollfds(fds);
+            }
+
+            rc = ::poll(fds.data(), fds.size(), timeout);
 
             if(rc < 0) {
                 l(Ilog::LEVEL_ERROR, "'poll' failed");
-                _this->c_last_err = RES_CODE_ERROR;
+                _this->w_last_err = RES_CODE_ERROR;
                 break;
             }
-            else if(0 == rc) {
-                continue;
-            }
-            else {
+            else if(rc) {
+                // RU: События теневых сокетов обрабатываются до разбора
+                //     колец: разбор меняет набор сессий, и порядок в fds
+                //     перестаёт ему соответствовать.
+                if(shd) {
+                    shd.get()->process(fds, 2);
+                }
+
                 for(int i = 0; i < 2; i++) {
                     if(0 == fds[i].revents) {
                         continue;
@@ -117,23 +245,31 @@ namespace proxy_ns {
                         _this->w_last_err = RES_CODE_ERROR;
                         break;
                     }
+                    else if(fds[i].fd == c_in_fd) {
+                        drain(c_in_fd, _this->cw_tap,
+                              capture_ns::CAPTURE_DIRECTION_CLIENT_TO_SERVER);
+                    }
                     else {
-                        data d;
+                        drain(s_in_fd, _this->sw_tap,
+                              capture_ns::CAPTURE_DIRECTION_SERVER_TO_CLIENT);
+                    }
+                }
+            }
 
-                        ::memset(&d, 0, sizeof(d));
+            // RU: Не чаще одного сообщения за период опроса.
+            auto now = std::chrono::steady_clock::now();
+            if(now >= next_report) {
+                next_report = now + std::chrono::milliseconds(timeout);
 
-                        rc = ::read(fds[i].fd, &d, sizeof(d));
-                        if(rc < 0) {
-                            // TODO: проверить код ошибки!
-                            continue;
-                        }
-                        else {
-                            assert(rc == sizeof(d));
-                        }
+                report_dropped("C->W", _this->cw_tap.get_dropped(),
+                               reported_c_dropped);
+                report_dropped("S->W", _this->sw_tap.get_dropped(),
+                               reported_s_dropped);
 
-                        _this->debug_log_info(d, "W");
-                    }
-                }
+                metrics_ns::gauge_set(metrics_ns::GAUGE_TAP_QUEUE_CW,
+                                      _this->cw_tap.size());
+                metrics_ns::gauge_set(metrics_ns::GAUGE_TAP_QUEUE_SW,
+                                      _this->sw_tap.size());
             }
         }
         while(!_this->end_proxy);